@@ -149,3 +149,16 @@ void ASIC_read_registers(GlobalState * GLOBAL_STATE)
             break;
     }
 }
+
+bm_job_format ASIC_get_job_format(GlobalState * GLOBAL_STATE)
+{
+    switch (GLOBAL_STATE->DEVICE_CONFIG.family.asic.id) {
+        case BM1397:
+            return BM_JOB_FORMAT_MIDSTATES;
+        case BM1366:
+        case BM1368:
+        case BM1370:
+            return BM_JOB_FORMAT_HEADER;
+    }
+    return BM_JOB_FORMAT_MIDSTATES;
+}
@@ -0,0 +1,52 @@
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum
+{
+    JSON_TOKEN_INVALID,
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_NUMBER,
+    JSON_TOKEN_OBJECT,
+    JSON_TOKEN_ARRAY,
+    JSON_TOKEN_TRUE,
+    JSON_TOKEN_FALSE,
+    JSON_TOKEN_NULL
+} json_token_t;
+
+// Forward-only JSON tokenizer working in place on the input, without building a tree
+// or allocating. Any function returning false means the input could not be handled
+// and the caller should fall back to a full parser.
+typedef struct
+{
+    const char * pos;
+    const char * end;
+    bool first; // no member consumed yet in the current container
+    bool error;
+} json_scanner_t;
+
+void json_scanner_init(json_scanner_t * s, const char * json, size_t len);
+
+json_token_t json_scanner_peek(json_scanner_t * s);
+
+bool json_scanner_enter_object(json_scanner_t * s);
+bool json_scanner_enter_array(json_scanner_t * s);
+
+// Moves to the next member or element of the current container. Returns false and
+// consumes the closing bracket at its end; check s->error to tell errors apart.
+bool json_scanner_next(json_scanner_t * s);
+
+// Reads a member key including the following ':'.
+bool json_scanner_key(json_scanner_t * s, const char ** key, size_t * key_len);
+
+// Strings are returned without quotes and are not NUL-terminated. Strings containing
+// escape sequences are rejected.
+bool json_scanner_string(json_scanner_t * s, const char ** str, size_t * len);
+bool json_scanner_number(json_scanner_t * s, double * value);
+bool json_scanner_skip(json_scanner_t * s);
+
+bool json_scanner_equals(const char * str, size_t len, const char * expected);
+
+#endif // JSON_SCANNER_H
@@ -0,0 +1,36 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear buckets, four per power of two, so percentiles are within 25% of the
+// recorded value over the whole uint32_t microsecond range
+#define LATENCY_HISTOGRAM_BUCKETS 124
+
+typedef struct
+{
+    uint32_t counts[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+} latency_histogram;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t mean_us;
+} latency_summary;
+
+void latency_histogram_reset(latency_histogram * histogram);
+void latency_histogram_record(latency_histogram * histogram, uint32_t value_us);
+
+// Upper bound of the bucket holding the given percentile (0-100), capped at the maximum
+uint32_t latency_histogram_percentile(const latency_histogram * histogram, double percentile);
+
+void latency_histogram_summarize(const latency_histogram * histogram, latency_summary * summary);
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,49 @@
+#ifndef LINE_BUFFER_H
+#define LINE_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Large enough for mining.notify messages with long coinbases and MAX_MERKLE_BRANCHES branches
+#define LINE_BUFFER_SIZE (32 * 1024)
+// Capacity when there is no PSRAM and the buffer takes internal RAM, still a notify with a 4 KB
+// coinbase and MAX_MERKLE_BRANCHES branches
+#define LINE_BUFFER_INTERNAL_SIZE (16 * 1024)
+
+// Fixed-capacity receive buffer that frames newline-terminated messages.
+// Incoming bytes are scanned once for '\n', complete lines are returned in place
+// (NUL-terminated) and unread bytes are only moved when the write space runs out.
+typedef struct
+{
+    char * data;
+    size_t capacity;
+    size_t head; // first unconsumed byte
+    size_t tail; // end of received data
+    size_t scan; // bytes before this offset are known not to contain '\n'
+
+    uint64_t bytes_received;
+    uint32_t lines;
+    uint32_t compactions;
+    size_t max_line_len;
+} line_buffer_t;
+
+// Allocates capacity bytes in PSRAM, without PSRAM at most LINE_BUFFER_INTERNAL_SIZE in internal RAM
+esp_err_t line_buffer_init(line_buffer_t * lb, size_t capacity);
+void line_buffer_free(line_buffer_t * lb);
+void line_buffer_reset(line_buffer_t * lb);
+
+// Returns where the next received bytes should be written and how many fit.
+// Returns NULL if the buffer is full without containing a complete line.
+char * line_buffer_write_ptr(line_buffer_t * lb, size_t * available);
+void line_buffer_commit(line_buffer_t * lb, size_t len);
+
+// Returns the next complete line without its line terminator, or NULL if none is buffered yet.
+// The line stays valid until the next call to line_buffer_write_ptr or line_buffer_reset.
+char * line_buffer_next_line(line_buffer_t * lb, size_t * len);
+
+// True if line_buffer_next_line would return a line without receiving more data
+bool line_buffer_has_line(line_buffer_t * lb);
+
+#endif // LINE_BUFFER_H
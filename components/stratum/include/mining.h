@@ -2,6 +2,25 @@
 #define MINING_H_
 
 #include "stratum_api.h"
+#include "sha256_lanes.h"
+#include "slot_pool.h"
+
+// First block states kept per job for nonce verification, one per rolled version
+#define NONCE_VERIFY_STATES 4
+
+// The queued jobs, the up to 32 job ids the chip may still return nonces for, a batch being built
+// and the job ASIC_task holds
+#define BM_JOB_POOL_SLOTS 64
+// Without PSRAM: a full queue and a batch, the job ids still out come from the heap
+#define BM_JOB_POOL_INTERNAL_SLOTS 16
+#define BM_JOB_ID_SIZE 33
+
+// The bm_job fields a chip family serializes
+typedef enum
+{
+    BM_JOB_FORMAT_MIDSTATES, // BM1397: a midstate per version it rolls and the last word of the merkle root
+    BM_JOB_FORMAT_HEADER,    // BM1366 and newer: header fields as reversed 32 bit words, versions rolled in silicon
+} bm_job_format;
 
 typedef struct
 {
@@ -15,29 +34,105 @@ typedef struct
     uint32_t target; // aka difficulty, aka nbits
     uint32_t starting_nonce;
 
-    uint8_t num_midstates;
+    uint8_t num_midstates; // 0 when the job was built for a chip that takes the header
     uint8_t midstate[32];
     uint8_t midstate1[32];
     uint8_t midstate2[32];
     uint8_t midstate3[32];
     uint32_t pool_diff;
-    char *jobid;
-    char *extranonce2;
+    uint32_t pool_target[8];    // from pool_diff, a hash at or below it is a share
+    uint32_t network_target[8]; // from target, a hash at or below it is a block
+    uint8_t pool_id;
+    char jobid[BM_JOB_ID_SIZE]; // truncated, the submit template has the whole pool job id
+    stratum_submit_template *submit_template; // NULL for stratum v2 jobs
+    int64_t notify_received_us; // set on the first job of a new block, for the notify to UART latency
 } bm_job;
 
+// First block states of one job header, filled by test_nonce_hash as nonces of a version come in.
+// The task checking nonces owns it, a queued job is never written. The header bytes in the first
+// block are the key, a cache handed another job starts over.
+typedef struct
+{
+    uint8_t prev_block_hash[32];
+    uint8_t merkle_root[28];
+    uint32_t versions[NONCE_VERIFY_STATES];
+    uint32_t states[NONCE_VERIFY_STATES][8];
+    uint8_t used;
+    uint8_t next;
+} nonce_verify_cache;
+
+// Binary coinbase of a notify for one extranonce_1, the hash state over coinbase_1 + extranonce_1
+// is computed once so every job only hashes its extranonce_2 + coinbase_2
+typedef struct
+{
+    uint32_t prefix_state[8]; // SHA-256 state after the whole blocks of coinbase_1 + extranonce_1
+    uint64_t prefix_len;      // 0 without SHA256_LANES_VECTOR, the tail is then the whole coinbase
+    uint8_t *tail;            // the rest of coinbase_1 + extranonce_1, room for extranonce_2, coinbase_2
+    size_t tail_len;
+    size_t extranonce_2_offset;
+    size_t extranonce_2_len;
+} coinbase_template;
+
+// An uninitialized job from the preallocated pool, free_bm_job returns it
+bm_job *bm_job_alloc(void);
 void free_bm_job(bm_job *job);
+void bm_job_set_jobid(bm_job *job, const char *jobid);
+void bm_job_pool_get_stats(slot_pool_stats *stats);
 
 char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2,
                             const char *extranonce, const char *extranonce_2);
 
 void calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches, char dest[65]);
 
+bool coinbase_template_init(coinbase_template *tmpl, const char *coinbase_1, const char *coinbase_2,
+                            const char *extranonce, size_t extranonce_2_len);
+
+void coinbase_template_free(coinbase_template *tmpl);
+
+// Double SHA-256 of the coinbase for extranonce_2 (extranonce_2_len bytes)
+void coinbase_template_hash(const coinbase_template *tmpl, const uint8_t *extranonce_2, uint8_t dest[32]);
+
+// coinbase_template_hash of count (at most SHA256_LANES) extranonce_2 at once, one at a time
+// through double_sha256_bin without SHA256_LANES_VECTOR
+void coinbase_template_hash_lanes(const coinbase_template *tmpl, const uint8_t *const extranonce_2[], int count,
+                                  uint8_t dest[][32]);
+
+void calculate_merkle_root_bin(const uint8_t coinbase_hash[32], const uint8_t merkle_branches[][32], const int num_merkle_branches,
+                               uint8_t dest[32]);
+
+// calculate_merkle_root_bin of count (at most SHA256_LANES) coinbase hashes at once, in place, one at
+// a time without SHA256_LANES_VECTOR
+void calculate_merkle_root_lanes(uint8_t hashes[][32], const uint8_t merkle_branches[][32], const int num_merkle_branches,
+                                 int count);
+
 bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask, uint32_t difficulty);
 
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version);
+bm_job construct_bm_job_from_header(const uint32_t version, const uint8_t prev_block_hash[32], const uint8_t merkle_root[32],
+                                    const uint32_t ntime, const uint32_t target, const uint32_t version_mask, const uint32_t difficulty);
+
+// Like construct_bm_job_from_header, only with the fields of format
+bm_job construct_bm_job_for_format(const bm_job_format format, const uint32_t version, const uint8_t prev_block_hash[32],
+                                   const uint8_t merkle_root[32], const uint32_t ntime, const uint32_t target,
+                                   const uint32_t version_mask, const uint32_t difficulty);
+
+// Double SHA-256 of the header with nonce and rolled_version, little endian like the targets.
+// cache may be NULL, the first block is then hashed every time. Without SHA256_LANES_VECTOR the
+// cache is not used and every header goes through double_sha256_bin.
+void test_nonce_hash(const bm_job *job, nonce_verify_cache *cache, const uint32_t nonce, const uint32_t rolled_version,
+                     uint8_t hash[32]);
+
+double hash_difficulty(const uint8_t hash[32]);
+
+double test_nonce_value(const bm_job *job, nonce_verify_cache *cache, const uint32_t nonce, const uint32_t rolled_version);
 
 void extranonce_2_generate(uint64_t extranonce_2, uint32_t length, char dest[static length * 2 + 1]);
 
+void extranonce_2_generate_bin(uint64_t extranonce_2, uint32_t length, uint8_t dest[static length]);
+
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask);
 
+// Whether the next job may reuse the merkle root of the last one at ntime + ntime_offset. The
+// pool's clock has moved on by the age of the notify, the rolled ntime stays within window_s of it.
+bool ntime_roll_allowed(uint32_t ntime_offset, int64_t notify_age_us, uint16_t window_s);
+
 #endif /* MINING_H_ */
\ No newline at end of file
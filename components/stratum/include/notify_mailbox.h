@@ -0,0 +1,50 @@
+#ifndef NOTIFY_MAILBOX_H
+#define NOTIFY_MAILBOX_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "stratum_api.h"
+
+// One pending notify per pool id
+#define NOTIFY_MAILBOX_POOLS 2
+
+typedef struct
+{
+    uint32_t posted;
+    uint32_t coalesced;       // replaced by a newer notify of the same pool before the job builder took them
+    uint32_t clean_coalesced; // of those, the ones that started a new block
+} notify_mailbox_stats;
+
+// Latest-wins hand-off of notifies to the job builder. A newer notify replaces the pending
+// one of its pool; if either started a new block, the pending notify keeps clean_jobs set
+// and the receive time of the first one, so the job builder still treats it as a new block.
+typedef struct
+{
+    mining_notify * pending[NOTIFY_MAILBOX_POOLS];
+    uint32_t sequence[NOTIFY_MAILBOX_POOLS];
+    uint32_t next_sequence;
+    notify_mailbox_stats stats;
+    pthread_mutex_t lock;
+    pthread_cond_t posted;
+} notify_mailbox;
+
+void notify_mailbox_init(notify_mailbox * mailbox);
+
+// Takes ownership of notify, frees the notify it replaces
+void notify_mailbox_post(notify_mailbox * mailbox, mining_notify * notify);
+
+// Blocks until a notify is pending, pools are served in the order their notifies were posted
+mining_notify * notify_mailbox_take(notify_mailbox * mailbox);
+
+// Waits up to timeout_ms for a pending notify, returns false on timeout
+bool notify_mailbox_wait(notify_mailbox * mailbox, int timeout_ms);
+
+bool notify_mailbox_pending(notify_mailbox * mailbox);
+
+// Frees the pending notifies
+void notify_mailbox_clear(notify_mailbox * mailbox);
+
+void notify_mailbox_get_stats(notify_mailbox * mailbox, notify_mailbox_stats * stats);
+
+#endif // NOTIFY_MAILBOX_H
@@ -0,0 +1,42 @@
+#ifndef NOTIFY_POOL_H
+#define NOTIFY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stratum_api.h"
+
+// Enough for a pending and a mined notify per pool, the ones being parsed by the primary and
+// fallback session and a hot standby notify
+#define NOTIFY_POOL_SLOTS 8
+// Without PSRAM: the pending and the mined notify of one pool
+#define NOTIFY_POOL_INTERNAL_SLOTS 2
+// Inline storage for job_id, prev_block_hash, coinbase_1 and coinbase_2 including terminators
+#define NOTIFY_POOL_STRING_SIZE 4096
+
+typedef enum
+{
+    NOTIFY_JOB_ID,
+    NOTIFY_PREV_BLOCK_HASH,
+    NOTIFY_COINBASE_1,
+    NOTIFY_COINBASE_2,
+    NOTIFY_STRING_FIELDS
+} notify_string_field;
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t in_use;
+    uint32_t max_in_use;
+    uint32_t slots; // preallocated, NOTIFY_POOL_INTERNAL_SLOTS without PSRAM
+} notify_pool_stats;
+
+// Takes a preallocated slot and copies the fields into it. Falls back to separate heap
+// allocations when all slots are taken or the strings do not fit the inline storage.
+mining_notify * notify_pool_alloc(const char * const strings[NOTIFY_STRING_FIELDS], const size_t lengths[NOTIFY_STRING_FIELDS],
+                                  const uint8_t * merkle_branches, size_t n_merkle_branches);
+void notify_pool_free(mining_notify * notify);
+
+void notify_pool_get_stats(notify_pool_stats * stats);
+
+#endif // NOTIFY_POOL_H
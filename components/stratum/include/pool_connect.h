@@ -0,0 +1,51 @@
+#ifndef POOL_CONNECT_H
+#define POOL_CONNECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#define POOL_MAX_ADDRS 4
+#define POOL_DNS_CACHE_SIZE 4
+#define POOL_DNS_MAX_HOST_LEN 128
+// lwIP does not pass record TTLs up through getaddrinfo, cached answers expire after this instead
+#define POOL_DNS_TTL_S 300
+// RFC 8305 connection attempt delay before racing the next candidate
+#define POOL_CONNECT_ATTEMPT_DELAY_MS 250
+#define POOL_CONNECT_TIMEOUT_MS 5000
+#define POOL_BACKOFF_BASE_MS 1000
+#define POOL_BACKOFF_MAX_MS 30000
+
+// pool_connect() result when not even a socket could be created
+#define POOL_CONNECT_NO_SOCKET -2
+
+// Connection candidates in the order they are tried, IPv6 and IPv4 interleaved
+typedef struct
+{
+    struct sockaddr_storage addrs[POOL_MAX_ADDRS];
+    socklen_t addrlens[POOL_MAX_ADDRS];
+    int count;
+} pool_addr_list;
+
+void pool_addr_list_from_addrinfo(const struct addrinfo * res, pool_addr_list * list);
+
+bool pool_dns_cache_lookup(const char * host, uint16_t port, int64_t now_us, pool_addr_list * list);
+void pool_dns_cache_store(const char * host, uint16_t port, const pool_addr_list * list, int64_t now_us);
+void pool_dns_cache_invalidate(const char * host);
+
+// Answers from the cache while it is fresh, otherwise calls getaddrinfo and caches the result
+esp_err_t pool_resolve(const char * host, uint16_t port, pool_addr_list * list);
+
+// Happy eyeballs: starts a non-blocking connect per candidate, POOL_CONNECT_ATTEMPT_DELAY_MS apart
+// or as soon as the previous attempts failed. Returns the first connected socket in blocking mode,
+// -1 if every candidate failed or POOL_CONNECT_NO_SOCKET. connected is set to the winning index.
+int pool_connect(const pool_addr_list * list, int timeout_ms, int * connected);
+
+// Exponential backoff with equal jitter, attempt 0 waits between half and the full base delay
+uint32_t pool_backoff_ms(int attempt, uint32_t random);
+
+void pool_format_addr(const struct sockaddr_storage * addr, char * buffer, size_t size);
+
+#endif // POOL_CONNECT_H
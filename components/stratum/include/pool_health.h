@@ -0,0 +1,51 @@
+#ifndef POOL_HEALTH_H
+#define POOL_HEALTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bounds of the silence allowed before a session is declared dead, the upper one is the socket receive timeout
+#define POOL_HEALTH_MIN_SILENCE_S 45
+#define POOL_HEALTH_MAX_SILENCE_S 180
+// Silence allowed in multiples of the usual time between notifies
+#define POOL_HEALTH_NOTIFY_INTERVALS 3
+// Notify intervals needed before the cadence is trusted
+#define POOL_HEALTH_MIN_INTERVALS 3
+// Time a submit may stay unanswered
+#define POOL_HEALTH_SUBMIT_TIMEOUT_S 20
+
+typedef enum
+{
+    POOL_HEALTH_OK,
+    POOL_HEALTH_NOTIFY_OVERDUE,
+    POOL_HEALTH_SUBMIT_UNACKED,
+} pool_health_status;
+
+typedef struct
+{
+    int64_t last_rx_us;
+    int64_t last_notify_us;
+    bool notified;
+    double notify_interval_s; // moving average
+    uint32_t notify_intervals;
+
+    int outstanding_submits;
+    int64_t first_unacked_us; // oldest submit sent since the pool last answered one
+} pool_health;
+
+void pool_health_reset(pool_health * health, int64_t now_us);
+
+// Any line from the pool
+void pool_health_on_rx(pool_health * health, int64_t now_us);
+void pool_health_on_notify(pool_health * health, int64_t now_us);
+void pool_health_on_submit(pool_health * health, int count, int64_t now_us);
+void pool_health_on_submit_response(pool_health * health, int64_t now_us);
+
+// Silence after which the session is declared dead, from the notify cadence seen so far
+double pool_health_silence_timeout_s(const pool_health * health);
+
+pool_health_status pool_health_check(const pool_health * health, int64_t now_us);
+
+const char * pool_health_status_str(pool_health_status status);
+
+#endif // POOL_HEALTH_H
@@ -0,0 +1,21 @@
+#ifndef POOL_SCHEDULER_H
+#define POOL_SCHEDULER_H
+
+#include <stdint.h>
+
+#define POOL_SCHEDULER_MAX_POOLS 4
+
+// Smooth weighted round robin. Every job keeps the ASIC busy for about the same time,
+// so handing out jobs in proportion to the weights splits the hashrate the same way.
+typedef struct
+{
+    int32_t credit[POOL_SCHEDULER_MAX_POOLS];
+    uint32_t jobs[POOL_SCHEDULER_MAX_POOLS];
+} pool_scheduler;
+
+void pool_scheduler_reset(pool_scheduler * scheduler);
+
+// Picks the pool for the next job, pools with a weight of 0 are skipped. Returns -1 if none is left.
+int pool_scheduler_next(pool_scheduler * scheduler, const uint16_t weights[], int count);
+
+#endif // POOL_SCHEDULER_H
@@ -0,0 +1,47 @@
+#ifndef POOL_TLS_H
+#define POOL_TLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Stratum sockets that can be TLS at once: the active session, standby or split session and heartbeat probe
+#define POOL_TLS_MAX_CONNECTIONS 3
+// Session tickets kept for resumption, one per pool
+#define POOL_TLS_SESSION_CACHE_SIZE 2
+#define POOL_TLS_HANDSHAKE_TIMEOUT_S 10
+
+typedef struct
+{
+    uint32_t handshakes;
+    uint32_t resumption_offers;     // handshakes that offered a cached session ticket
+    double last_handshake_ms;
+    uint32_t last_handshake_rx_bytes; // a full handshake includes the certificate chain
+    bool last_resumption_offered;
+    int record_overhead;            // bytes added to every message by the record layer
+} pool_tls_stats;
+
+// Strips a stratum+tcp:// or stratum+ssl:// scheme, tls is set for stratum+ssl:// and stratum+tls://
+const char * pool_url_host(const char * url, bool * tls);
+
+// PEM of the CA pool certificates are checked against, the certificate bundle is used when empty.
+// Has to be set before the first handshake.
+void pool_tls_set_ca_cert(const char * pem);
+
+// Runs the TLS handshake on a connected socket, resuming the last session to host:port if there is one.
+// All further I/O on the socket has to go through pool_send(), pool_recv() and pool_close().
+// On failure the socket is left to the caller to close.
+esp_err_t pool_tls_handshake(int sock, const char * host, uint16_t port);
+
+// send(), recv() and close() for pool sockets, plain sockets pass straight through
+int pool_send(int sock, const void * data, size_t len);
+int pool_recv(int sock, void * data, size_t len);
+void pool_close(int sock);
+
+// Whether decrypted data is waiting that select() on the socket would not show
+bool pool_tls_pending(int sock);
+
+void pool_tls_get_stats(pool_tls_stats * stats);
+
+#endif // POOL_TLS_H
@@ -0,0 +1,28 @@
+#ifndef SHA256_LANES_H
+#define SHA256_LANES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Independent messages hashed side by side, 4 or 8
+#ifndef SHA256_LANES
+#define SHA256_LANES 4
+#endif
+
+// GCC vector types become SIMD registers where the target has them, elsewhere every lane
+// goes through sha256_compress. A kernel for another vector unit plugs in here.
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define SHA256_LANES_VECTOR 1
+#else
+#define SHA256_LANES_VECTOR 0
+#endif
+
+// Compresses blocks[i] into state[i] for every lane
+void sha256_compress_lanes(uint32_t state[SHA256_LANES][8], const uint8_t *const blocks[SHA256_LANES]);
+
+// Double SHA-256 of count (at most SHA256_LANES) messages of len bytes each. Every lane continues
+// from state after a common prefix of prefix_len bytes, a multiple of 64; NULL state for no prefix.
+void double_sha256_lanes(const uint32_t state[8], uint64_t prefix_len, const uint8_t *const data[], size_t len, int count,
+                         uint8_t dest[][32]);
+
+#endif // SHA256_LANES_H
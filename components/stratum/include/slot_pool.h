@@ -0,0 +1,48 @@
+#ifndef SLOT_POOL_H
+#define SLOT_POOL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLOT_POOL_MAX_SLOTS 128
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses; // heap allocations, all slots taken or too large for one
+    uint32_t in_use;
+    uint32_t max_in_use;
+    uint32_t slots; // preallocated, 0 before first use
+} slot_pool_stats;
+
+// Fixed-size preallocated objects, taken and returned from any task without a lock. The
+// storage is allocated on first use in PSRAM. Without PSRAM it takes internal RAM, which the
+// stacks, WiFi and lwIP need, so only internal_slots are preallocated there and the heap covers
+// the peaks.
+typedef struct
+{
+    const char * name;
+    size_t slot_size;
+    uint32_t psram_slots;
+    uint32_t internal_slots;
+    atomic_uint slots; // of the storage, stored before the storage is published
+    _Atomic(uint8_t *) storage;
+    atomic_uint used[SLOT_POOL_MAX_SLOTS / 32];
+    atomic_uint hits;
+    atomic_uint misses;
+    atomic_uint in_use;
+    atomic_uint max_in_use;
+} slot_pool;
+
+#define SLOT_POOL_INITIALIZER(pool_name, size, count, internal_count) \
+    { .name = (pool_name), .slot_size = (size), .psram_slots = (count), .internal_slots = (internal_count) }
+
+// A slot if size fits one and one is free, the heap otherwise
+void * slot_pool_alloc(slot_pool * pool, size_t size);
+void slot_pool_free(slot_pool * pool, void * ptr);
+
+void slot_pool_get_stats(slot_pool * pool, slot_pool_stats * stats);
+
+#endif // SLOT_POOL_H
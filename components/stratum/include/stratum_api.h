@@ -2,9 +2,13 @@
 #define STRATUM_API_H
 
 #include "cJSON.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include "latency_histogram.h"
+#include "line_buffer.h"
+#include "slot_pool.h"
 
 
 #define MAX_MERKLE_BRANCHES 32
@@ -35,6 +39,7 @@ typedef struct
 {
     char *job_id;
     char *prev_block_hash;
+    uint8_t prev_block_hash_bin[HASH_SIZE]; // header byte order, decoded once from the word swapped hex
     char *coinbase_1;
     char *coinbase_2;
     uint8_t *merkle_branches;
@@ -42,6 +47,9 @@ typedef struct
     uint32_t version;
     uint32_t target;
     uint32_t ntime;
+    uint8_t pool_id;
+    bool clean_jobs;
+    int64_t received_us;
 } mining_notify;
 
 typedef struct
@@ -65,21 +73,51 @@ typedef struct
     char * error_str;
 } StratumApiV1Message;
 
+// Requests whose response latency is tracked per method
+typedef enum
+{
+    STRATUM_REQUEST_SUBMIT,
+    STRATUM_REQUEST_AUTHORIZE,
+    STRATUM_REQUEST_SUBSCRIBE,
+    STRATUM_REQUEST_OTHER,
+    STRATUM_REQUEST_METHODS
+} stratum_request_method;
+
 typedef struct {
+    int request_id;
+    stratum_request_method method;
     int64_t timestamp_us;
     bool tracking;
 } RequestTiming;
 
+// The parts of a mining.submit line that are fixed for a job, shared by its shares
+typedef struct stratum_submit_template stratum_submit_template;
+
+// A template for every pooled job and every share waiting to be sent, templates of long user
+// names come from the heap
+#define STRATUM_SUBMIT_TEMPLATE_SLOTS 96
+#define STRATUM_SUBMIT_TEMPLATE_SLOT_SIZE 256
+// Without PSRAM: the templates of BM_JOB_POOL_INTERNAL_SLOTS jobs and a few shares
+#define STRATUM_SUBMIT_TEMPLATE_INTERNAL_SLOTS 24
+
 
 void STRATUM_V1_initialize_buffer();
 
-char *STRATUM_V1_receive_jsonrpc_line(int sockfd);
+const char *STRATUM_V1_receive_jsonrpc_line(int sockfd);
+
+// Same as STRATUM_V1_receive_jsonrpc_line for a connection with its own buffer
+const char *STRATUM_V1_receive_line(int sockfd, line_buffer_t *buffer);
+
+// Exchanges the session buffer with buffer, unread bytes of an adopted connection move with it
+void STRATUM_V1_swap_buffer(line_buffer_t *buffer);
 
 int STRATUM_V1_subscribe(int socket, int send_uid, const char * model);
 
 void STRATUM_V1_parse(StratumApiV1Message *message, const char *stratum_json);
 
-void STRATUM_V1_stamp_tx(int request_id);
+// Records the send time of request_id if it went out on the timed socket, every STRATUM_V1_*
+// sender stamps its own id
+void STRATUM_V1_stamp_tx(int socket, int request_id, stratum_request_method method);
 
 void STRATUM_V1_free_mining_notify(mining_notify *params);
 
@@ -95,6 +133,36 @@ int STRATUM_V1_submit_share(int socket, int send_uid, const char *username, cons
                             const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
                             const uint32_t version_bits);
 
+// Writes a newline-terminated mining.submit line, returns the length like snprintf
+int STRATUM_V1_format_submit(char *buffer, size_t size, int send_uid, const char *username, const char *job_id,
+                             const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
+                             const uint32_t version_bits);
+
+// Renders the submit line of a job once, with a reference for the caller. NULL if out of memory.
+stratum_submit_template *STRATUM_V1_create_submit_template(const char *username, const char *job_id, const uint8_t *extranonce_2,
+                                                           size_t extranonce_2_len);
+
+stratum_submit_template *STRATUM_V1_retain_submit_template(stratum_submit_template *tmpl);
+
+void STRATUM_V1_release_submit_template(stratum_submit_template *tmpl);
+
+void STRATUM_V1_get_submit_template_pool_stats(slot_pool_stats *stats);
+
+// Copies the template and patches ntime, nonce and version bits in as fixed-width hex, returns the length like snprintf
+int STRATUM_V1_format_submit_template(char *buffer, size_t size, const stratum_submit_template *tmpl, int send_uid,
+                                      const uint32_t ntime, const uint32_t nonce, const uint32_t version_bits);
+
+// Returns -1 if request_id is not in flight, otherwise records the latency in its method histogram
 double STRATUM_V1_get_response_time_ms(int request_id);
 
+// Call on every parsed line, the latency is only taken for responses. Returns -1 if
+// message is no response or its request is not in flight.
+double STRATUM_V1_record_response(const StratumApiV1Message *message);
+
+// Forgets in-flight requests, ids start over on a new connection. Only requests sent on
+// socket are timed from here on, -1 times none.
+void STRATUM_V1_reset_request_timings(int socket);
+
+void STRATUM_V1_get_latency_summary(stratum_request_method method, latency_summary * summary);
+
 #endif // STRATUM_API_H
\ No newline at end of file
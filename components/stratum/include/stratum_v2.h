@@ -0,0 +1,96 @@
+#ifndef STRATUM_V2_H
+#define STRATUM_V2_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stratum V2 mining protocol, standard channels only
+// https://github.com/stratum-mining/sv2-spec
+
+#define SV2_FRAME_HEADER_SIZE 6
+#define SV2_MAX_PAYLOAD_SIZE 4096
+#define SV2_CHANNEL_MSG_BIT 0x8000
+
+#define SV2_PROTOCOL_MINING 0
+#define SV2_PROTOCOL_VERSION 2
+
+// SetupConnection flags for the mining protocol
+#define SV2_REQUIRES_STANDARD_JOBS 0x01
+#define SV2_REQUIRES_VERSION_ROLLING 0x04
+
+typedef enum
+{
+    SV2_SETUP_CONNECTION = 0x00,
+    SV2_SETUP_CONNECTION_SUCCESS = 0x01,
+    SV2_SETUP_CONNECTION_ERROR = 0x02,
+    SV2_OPEN_STANDARD_MINING_CHANNEL = 0x10,
+    SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS = 0x11,
+    SV2_OPEN_MINING_CHANNEL_ERROR = 0x12,
+    SV2_NEW_MINING_JOB = 0x15,
+    SV2_SUBMIT_SHARES_STANDARD = 0x1a,
+    SV2_SUBMIT_SHARES_SUCCESS = 0x1c,
+    SV2_SUBMIT_SHARES_ERROR = 0x1d,
+    SV2_SET_NEW_PREV_HASH = 0x20,
+    SV2_SET_TARGET = 0x21,
+    SV2_RECONNECT = 0x25,
+} sv2_msg_type;
+
+typedef struct
+{
+    uint8_t msg_type;
+
+    // SetupConnection.Success
+    uint16_t used_version;
+    uint32_t flags;
+
+    // OpenStandardMiningChannel.Success
+    uint32_t request_id;
+    uint32_t channel_id;
+    uint8_t target[32];
+    uint8_t extranonce_prefix[32];
+    uint8_t extranonce_prefix_len;
+    uint32_t group_channel_id;
+
+    // NewMiningJob and SetNewPrevHash, a job without min_ntime is a future job
+    uint32_t job_id;
+    bool has_min_ntime;
+    uint32_t min_ntime;
+    uint32_t version;
+    uint8_t merkle_root[32];
+    uint8_t prev_hash[32];
+    uint32_t nbits;
+
+    // SubmitShares.Success and SubmitShares.Error
+    uint32_t sequence_number;
+    uint32_t accepted_count;
+    uint64_t shares_sum;
+
+    // *.Error, Reconnect host
+    char error_code[256];
+    uint16_t port;
+} StratumApiV2Message;
+
+size_t STRATUM_V2_encode_setup_connection(uint8_t *buffer, size_t size, uint32_t flags, const char *host, uint16_t port,
+                                          const char *vendor, const char *hardware_version, const char *firmware,
+                                          const char *device_id);
+size_t STRATUM_V2_encode_open_standard_channel(uint8_t *buffer, size_t size, uint32_t request_id, const char *user,
+                                               float nominal_hashrate, const uint8_t max_target[32]);
+size_t STRATUM_V2_encode_submit_shares_standard(uint8_t *buffer, size_t size, uint32_t channel_id, uint32_t sequence_number,
+                                                uint32_t job_id, uint32_t nonce, uint32_t ntime, uint32_t version);
+
+// Encoders for the pool side, used by tests and benchmarks
+size_t STRATUM_V2_encode_new_mining_job(uint8_t *buffer, size_t size, uint32_t channel_id, uint32_t job_id, bool has_min_ntime,
+                                        uint32_t min_ntime, uint32_t version, const uint8_t merkle_root[32]);
+size_t STRATUM_V2_encode_set_new_prev_hash(uint8_t *buffer, size_t size, uint32_t channel_id, uint32_t job_id,
+                                           const uint8_t prev_hash[32], uint32_t min_ntime, uint32_t nbits);
+
+// Parses a complete frame including its header. Returns false for malformed frames.
+bool STRATUM_V2_parse(StratumApiV2Message *message, const uint8_t *frame, size_t len);
+
+// Receives one frame into an internal buffer, valid until the next call. Returns NULL on socket errors.
+const uint8_t *STRATUM_V2_receive_frame(int sockfd, size_t *len);
+
+double STRATUM_V2_target_to_difficulty(const uint8_t target[32]);
+
+#endif // STRATUM_V2_H
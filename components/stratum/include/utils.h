@@ -1,6 +1,7 @@
 #ifndef STRATUM_UTILS_H
 #define STRATUM_UTILS_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -9,8 +10,16 @@ size_t bin2hex(const uint8_t *buf, size_t buflen, char *hex, size_t hexlen);
 void flip80bytes(void *dest_p, const void *src_p);
 void flip32bytes(void *dest_p, const void *src_p);
 
+// Decodes up to bin_len bytes, stops at the end of hex or at the first character that is not a hex
+// digit. Returns the bytes decoded.
 size_t hex2bin(const char *hex, uint8_t *bin, size_t bin_len);
 
+// Exactly hex_len / 2 bytes, false on an odd length or any character that is not a hex digit
+bool hex_decode(const char *hex, size_t hex_len, uint8_t *bin);
+
+// 2 * bin_len lowercase digits, not terminated
+void hex_encode(const uint8_t *bin, size_t bin_len, char *hex);
+
 void print_hex(const uint8_t *b, size_t len,
                const size_t in_line, const char *prefix);
 
@@ -21,6 +30,13 @@ void double_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t dest[
 void single_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t dest[32]);
 void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t dest[32]);
 
+// Plain SHA-256 block function in software, for resuming from a saved state. The mbedtls
+// context state is not portable, the hardware implementation keeps it in another byte order.
+extern const uint32_t sha256_k[64];
+extern const uint32_t sha256_initial_state[8];
+void sha256_compress(uint32_t state[8], const uint8_t block[64]);
+void sha256_state_to_bytes(const uint32_t state[8], uint8_t dest[32]);
+
 void swap_endian_words(const char *hex, uint8_t *output);
 
 void reverse_bytes(uint8_t *data, size_t len);
@@ -33,6 +49,13 @@ uint32_t flip32(uint32_t val);
 
 double networkDifficulty(uint32_t nBits);
 
+// 256-bit targets as 8 little endian words, the byte order of the header hash
+void difficulty_to_target(uint32_t difficulty, uint32_t target[8]);
+void nbits_to_target(uint32_t nBits, uint32_t target[8]);
+
+// hash <= target, compared from the most significant word down
+bool hash_meets_target(const uint8_t hash[32], const uint32_t target[8]);
+
 void suffixString(uint64_t val, char * buf, size_t bufsiz, int sigdigits);
 
 float hashCounterToGhs(uint32_t duration_ms, uint32_t counter);
@@ -0,0 +1,41 @@
+#ifndef VARDIFF_H
+#define VARDIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Time between difficulty decisions, shortened when shares arrive far too fast
+#define VARDIFF_RETARGET_S 120
+// Below this many accepted shares in a window the expected hashrate is trusted over the share rate
+#define VARDIFF_MIN_SHARES 8
+// No new suggestion while the pool difficulty is within this factor of the target
+#define VARDIFF_HYSTERESIS 2.0
+
+typedef struct
+{
+    double target_shares_per_min;
+    uint32_t min_difficulty;
+    uint32_t max_difficulty;
+
+    int64_t window_start_us;
+    uint32_t window_shares;
+    double window_work; // sum of the difficulties of the accepted shares
+
+    uint32_t last_suggested;
+} vardiff_controller;
+
+void vardiff_init(vardiff_controller * vardiff, double target_shares_per_min, uint32_t min_difficulty, uint32_t max_difficulty,
+                  int64_t now_us);
+
+void vardiff_record_share(vardiff_controller * vardiff, uint32_t difficulty);
+
+// Call when mining.set_difficulty changes the pool difficulty
+void vardiff_pool_difficulty_changed(vardiff_controller * vardiff);
+
+// Difficulty that yields the target share rate at the given hashrate, clamped to the limits
+uint32_t vardiff_difficulty_for_hashrate(const vardiff_controller * vardiff, double hashrate_ghs);
+
+// Returns the difficulty to suggest to the pool, or 0 to keep the current one
+uint32_t vardiff_update(vardiff_controller * vardiff, double hashrate_ghs, uint32_t pool_difficulty, int64_t now_us);
+
+#endif // VARDIFF_H
@@ -0,0 +1,40 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "mining.h"
+
+#define QUEUE_SIZE 12
+// Slots in the ring, a cleared queue can be refilled while the consumer still has to free the old jobs
+#define QUEUE_RING_SIZE 32
+
+// Lock-free ring for one producer (the job builder) and one consumer (ASIC_task). Each side
+// only writes its own index, the lock and condition variables are only touched when a side
+// has to wait for the other. Clearing may happen from any task: it moves the discard index
+// up to the tail and the consumer frees the discarded jobs on its next dequeue.
+typedef struct
+{
+    void *buffer[QUEUE_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint discard;
+    _Atomic(bm_job *) front;
+    atomic_bool consumer_waiting;
+    atomic_bool producer_waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} work_queue;
+
+void queue_init(work_queue *queue);
+void queue_enqueue(work_queue *queue, void *new_work);
+void ASIC_jobs_queue_clear(work_queue *queue);
+// Puts a job ahead of everything queued, replacing the previous one put there
+void ASIC_jobs_queue_push_front(work_queue *queue, bm_job *job);
+void *queue_dequeue(work_queue *queue);
+// Jobs waiting to be sent, not counting the cleared ones
+int queue_count(work_queue *queue);
+
+#endif // WORK_QUEUE_H
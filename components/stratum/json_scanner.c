@@ -0,0 +1,219 @@
+#include "json_scanner.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SKIP_DEPTH 16
+
+static void skip_whitespace(json_scanner_t * s)
+{
+    while (s->pos < s->end && (*s->pos == ' ' || *s->pos == '\t' || *s->pos == '\r' || *s->pos == '\n')) {
+        s->pos++;
+    }
+}
+
+static bool fail(json_scanner_t * s)
+{
+    s->error = true;
+    return false;
+}
+
+static bool consume(json_scanner_t * s, char c)
+{
+    skip_whitespace(s);
+    if (s->pos >= s->end || *s->pos != c) {
+        return fail(s);
+    }
+    s->pos++;
+    return true;
+}
+
+static bool consume_literal(json_scanner_t * s, const char * literal, size_t len)
+{
+    if ((size_t) (s->end - s->pos) < len || memcmp(s->pos, literal, len) != 0) {
+        return fail(s);
+    }
+    s->pos += len;
+    return true;
+}
+
+void json_scanner_init(json_scanner_t * s, const char * json, size_t len)
+{
+    s->pos = json;
+    s->end = json + len;
+    s->first = true;
+    s->error = false;
+}
+
+json_token_t json_scanner_peek(json_scanner_t * s)
+{
+    skip_whitespace(s);
+    if (s->pos >= s->end) {
+        return JSON_TOKEN_INVALID;
+    }
+    switch (*s->pos) {
+        case '"':
+            return JSON_TOKEN_STRING;
+        case '{':
+            return JSON_TOKEN_OBJECT;
+        case '[':
+            return JSON_TOKEN_ARRAY;
+        case 't':
+            return JSON_TOKEN_TRUE;
+        case 'f':
+            return JSON_TOKEN_FALSE;
+        case 'n':
+            return JSON_TOKEN_NULL;
+        default:
+            if (*s->pos == '-' || (*s->pos >= '0' && *s->pos <= '9')) {
+                return JSON_TOKEN_NUMBER;
+            }
+            return JSON_TOKEN_INVALID;
+    }
+}
+
+bool json_scanner_enter_object(json_scanner_t * s)
+{
+    s->first = true;
+    return consume(s, '{');
+}
+
+bool json_scanner_enter_array(json_scanner_t * s)
+{
+    s->first = true;
+    return consume(s, '[');
+}
+
+bool json_scanner_next(json_scanner_t * s)
+{
+    skip_whitespace(s);
+    if (s->pos >= s->end) {
+        return fail(s);
+    }
+    if (*s->pos == '}' || *s->pos == ']') {
+        s->pos++;
+        s->first = false;
+        return false;
+    }
+    if (!s->first && !consume(s, ',')) {
+        return false;
+    }
+    s->first = false;
+    return true;
+}
+
+bool json_scanner_string(json_scanner_t * s, const char ** str, size_t * len)
+{
+    if (!consume(s, '"')) {
+        return false;
+    }
+    const char * start = s->pos;
+    while (s->pos < s->end && *s->pos != '"') {
+        if (*s->pos == '\\') {
+            return fail(s);
+        }
+        s->pos++;
+    }
+    if (s->pos >= s->end) {
+        return fail(s);
+    }
+    *str = start;
+    *len = s->pos - start;
+    s->pos++;
+    return true;
+}
+
+bool json_scanner_key(json_scanner_t * s, const char ** key, size_t * key_len)
+{
+    return json_scanner_string(s, key, key_len) && consume(s, ':');
+}
+
+bool json_scanner_number(json_scanner_t * s, double * value)
+{
+    if (json_scanner_peek(s) != JSON_TOKEN_NUMBER) {
+        return fail(s);
+    }
+    // The line is NUL-terminated and a number is always followed by ',', ']', '}' or whitespace
+    char * number_end;
+    *value = strtod(s->pos, &number_end);
+    if (number_end == s->pos || number_end > s->end) {
+        return fail(s);
+    }
+    s->pos = number_end;
+    return true;
+}
+
+bool json_scanner_skip(json_scanner_t * s)
+{
+    const char * str;
+    size_t len;
+    double number;
+    int depth = 0;
+    uint32_t objects = 0; // one bit per open container, set for objects
+
+    do {
+        json_token_t token = json_scanner_peek(s);
+        switch (token) {
+            case JSON_TOKEN_STRING:
+                if (!json_scanner_string(s, &str, &len)) {
+                    return false;
+                }
+                break;
+            case JSON_TOKEN_NUMBER:
+                if (!json_scanner_number(s, &number)) {
+                    return false;
+                }
+                break;
+            case JSON_TOKEN_TRUE:
+                if (!consume_literal(s, "true", 4)) {
+                    return false;
+                }
+                break;
+            case JSON_TOKEN_FALSE:
+                if (!consume_literal(s, "false", 5)) {
+                    return false;
+                }
+                break;
+            case JSON_TOKEN_NULL:
+                if (!consume_literal(s, "null", 4)) {
+                    return false;
+                }
+                break;
+            case JSON_TOKEN_OBJECT:
+            case JSON_TOKEN_ARRAY:
+                if (++depth > MAX_SKIP_DEPTH) {
+                    return fail(s);
+                }
+                objects = (objects << 1) | (token == JSON_TOKEN_OBJECT);
+                s->pos++;
+                s->first = true;
+                break;
+            default:
+                return fail(s);
+        }
+
+        // Close finished containers, or move to the next value of the innermost open one
+        while (depth > 0) {
+            if (json_scanner_next(s)) {
+                if ((objects & 1) && !json_scanner_key(s, &str, &len)) {
+                    return false;
+                }
+                break;
+            }
+            if (s->error) {
+                return false;
+            }
+            depth--;
+            objects >>= 1;
+        }
+    } while (depth > 0);
+
+    s->first = false;
+    return true;
+}
+
+bool json_scanner_equals(const char * str, size_t len, const char * expected)
+{
+    return strlen(expected) == len && memcmp(str, expected, len) == 0;
+}
@@ -0,0 +1,72 @@
+#include "latency_histogram.h"
+
+#include <string.h>
+
+static int bucket_index(uint32_t value)
+{
+    if (value < 4) {
+        return value;
+    }
+    int octave = 31 - __builtin_clz(value);
+    int sub = (value >> (octave - 2)) & 3;
+    return octave * 4 + sub - 4;
+}
+
+static uint32_t bucket_upper_bound(int index)
+{
+    if (index < 4) {
+        return index;
+    }
+    int octave = index / 4 + 1;
+    uint32_t width = 1u << (octave - 2);
+    uint32_t lower = (uint32_t) (4 + index % 4) << (octave - 2);
+    return lower + (width - 1);
+}
+
+void latency_histogram_reset(latency_histogram * histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void latency_histogram_record(latency_histogram * histogram, uint32_t value_us)
+{
+    histogram->counts[bucket_index(value_us)]++;
+    histogram->count++;
+    histogram->sum_us += value_us;
+    if (value_us > histogram->max_us) {
+        histogram->max_us = value_us;
+    }
+}
+
+uint32_t latency_histogram_percentile(const latency_histogram * histogram, double percentile)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    // Rank of the sample we are after, rounded up so p100 is the last sample
+    uint64_t rank = (uint64_t) (percentile / 100.0 * histogram->count + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint32_t bound = bucket_upper_bound(i);
+            return bound < histogram->max_us ? bound : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+void latency_histogram_summarize(const latency_histogram * histogram, latency_summary * summary)
+{
+    summary->count = histogram->count;
+    summary->p50_us = latency_histogram_percentile(histogram, 50);
+    summary->p90_us = latency_histogram_percentile(histogram, 90);
+    summary->p99_us = latency_histogram_percentile(histogram, 99);
+    summary->max_us = histogram->max_us;
+    summary->mean_us = histogram->count ? histogram->sum_us / histogram->count : 0;
+}
@@ -0,0 +1,129 @@
+#include "line_buffer.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "esp_heap_caps.h"
+
+// Compact before receiving if less than this is left at the end of the buffer
+#define LINE_BUFFER_MIN_READ 1460
+
+esp_err_t line_buffer_init(line_buffer_t * lb, size_t capacity)
+{
+    size_t internal_capacity = capacity < LINE_BUFFER_INTERNAL_SIZE ? capacity : LINE_BUFFER_INTERNAL_SIZE;
+    if (lb->data != NULL && (lb->capacity == capacity || lb->capacity == internal_capacity)) {
+        line_buffer_reset(lb);
+        return ESP_OK;
+    }
+
+    line_buffer_free(lb);
+
+    lb->data = heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+    if (lb->data == NULL) {
+        capacity = internal_capacity;
+        lb->data = malloc(capacity);
+    }
+    if (lb->data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    lb->capacity = capacity;
+    line_buffer_reset(lb);
+    return ESP_OK;
+}
+
+void line_buffer_free(line_buffer_t * lb)
+{
+    free(lb->data);
+    memset(lb, 0, sizeof(line_buffer_t));
+}
+
+void line_buffer_reset(line_buffer_t * lb)
+{
+    lb->head = 0;
+    lb->tail = 0;
+    lb->scan = 0;
+}
+
+char * line_buffer_write_ptr(line_buffer_t * lb, size_t * available)
+{
+    if (lb->head == lb->tail) {
+        line_buffer_reset(lb);
+    } else if (lb->head > 0 && lb->capacity - lb->tail < LINE_BUFFER_MIN_READ) {
+        // Move the partial line to the front, this only happens once per buffer fill
+        size_t pending = lb->tail - lb->head;
+        memmove(lb->data, lb->data + lb->head, pending);
+        lb->scan -= lb->head;
+        lb->tail = pending;
+        lb->head = 0;
+        lb->compactions++;
+    }
+
+    *available = lb->capacity - lb->tail;
+    if (*available == 0) {
+        return NULL;
+    }
+    return lb->data + lb->tail;
+}
+
+void line_buffer_commit(line_buffer_t * lb, size_t len)
+{
+    lb->tail += len;
+    lb->bytes_received += len;
+}
+
+char * line_buffer_next_line(line_buffer_t * lb, size_t * len)
+{
+    while (lb->head < lb->tail) {
+        size_t from = lb->scan > lb->head ? lb->scan : lb->head;
+        char * newline = memchr(lb->data + from, '\n', lb->tail - from);
+        if (newline == NULL) {
+            lb->scan = lb->tail;
+            return NULL;
+        }
+
+        char * line = lb->data + lb->head;
+        size_t line_len = newline - line;
+        *newline = '\0';
+        if (line_len > 0 && line[line_len - 1] == '\r') {
+            line[--line_len] = '\0';
+        }
+
+        lb->head = newline - lb->data + 1;
+        lb->scan = lb->head;
+
+        // Skip empty lines (keep-alive newlines)
+        if (line_len == 0) {
+            continue;
+        }
+
+        lb->lines++;
+        if (line_len > lb->max_line_len) {
+            lb->max_line_len = line_len;
+        }
+        if (len != NULL) {
+            *len = line_len;
+        }
+        return line;
+    }
+    return NULL;
+}
+
+bool line_buffer_has_line(line_buffer_t * lb)
+{
+    // Keep-alive newlines do not count, they would leave the caller waiting in recv()
+    while (lb->head < lb->tail && (lb->data[lb->head] == '\n' || lb->data[lb->head] == '\r')) {
+        lb->head++;
+    }
+    if (lb->head == lb->tail) {
+        return false;
+    }
+
+    size_t from = lb->scan > lb->head ? lb->scan : lb->head;
+    if (memchr(lb->data + from, '\n', lb->tail - from) != NULL) {
+        return true;
+    }
+    lb->scan = lb->tail;
+    return false;
+}
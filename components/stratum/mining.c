@@ -3,14 +3,32 @@
 #include <limits.h>
 #include "mining.h"
 #include "utils.h"
-#include "mbedtls/sha256.h"
 #include "esp_log.h"
 
+static slot_pool job_pool = SLOT_POOL_INITIALIZER("bm_job", sizeof(bm_job), BM_JOB_POOL_SLOTS,
+                                                   BM_JOB_POOL_INTERNAL_SLOTS);
+
+bm_job *bm_job_alloc(void)
+{
+    return slot_pool_alloc(&job_pool, sizeof(bm_job));
+}
+
 void free_bm_job(bm_job *job)
 {
-    free(job->jobid);
-    free(job->extranonce2);
-    free(job);
+    STRATUM_V1_release_submit_template(job->submit_template);
+    slot_pool_free(&job_pool, job);
+}
+
+void bm_job_set_jobid(bm_job *job, const char *jobid)
+{
+    size_t len = strnlen(jobid, BM_JOB_ID_SIZE - 1);
+    memcpy(job->jobid, jobid, len);
+    job->jobid[len] = '\0';
+}
+
+void bm_job_pool_get_stats(slot_pool_stats *stats)
+{
+    slot_pool_get_stats(&job_pool, stats);
 }
 
 char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2,
@@ -34,72 +52,238 @@ void calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_br
     uint8_t coinbase_tx_bin[coinbase_tx_bin_len];
     hex2bin(coinbase_tx, coinbase_tx_bin, coinbase_tx_bin_len);
 
+    uint8_t merkle_root[32];
+    double_sha256_bin(coinbase_tx_bin, coinbase_tx_bin_len, merkle_root);
+    calculate_merkle_root_bin(merkle_root, merkle_branches, num_merkle_branches, merkle_root);
+
+    bin2hex(merkle_root, 32, dest, 65);
+}
+
+bool coinbase_template_init(coinbase_template *tmpl, const char *coinbase_1, const char *coinbase_2,
+                            const char *extranonce, size_t extranonce_2_len)
+{
+    size_t coinbase_1_hex_len = strlen(coinbase_1);
+    size_t extranonce_hex_len = strlen(extranonce);
+    size_t coinbase_2_hex_len = strlen(coinbase_2);
+    size_t coinbase_1_len = coinbase_1_hex_len / 2;
+    size_t extranonce_len = extranonce_hex_len / 2;
+    size_t coinbase_2_len = coinbase_2_hex_len / 2;
+
+    uint8_t prefix[coinbase_1_len + extranonce_len];
+    if (!hex_decode(coinbase_1, coinbase_1_hex_len, prefix) || !hex_decode(extranonce, extranonce_hex_len, prefix + coinbase_1_len)) {
+        return false;
+    }
+
+#if SHA256_LANES_VECTOR
+    // Whole blocks go into the state, the bytes past them lead the tail of every hash
+    tmpl->prefix_len = sizeof(prefix) / 64 * 64;
+#else
+    // The software prefix state was only measured faster on vector builds, without them the whole
+    // coinbase goes to double_sha256_bin and the SHA accelerator behind mbedtls
+    tmpl->prefix_len = 0;
+#endif
+    memcpy(tmpl->prefix_state, sha256_initial_state, sizeof(tmpl->prefix_state));
+    for (size_t offset = 0; offset < tmpl->prefix_len; offset += 64) {
+        sha256_compress(tmpl->prefix_state, prefix + offset);
+    }
+
+    tmpl->extranonce_2_offset = sizeof(prefix) - tmpl->prefix_len;
+    tmpl->extranonce_2_len = extranonce_2_len;
+    tmpl->tail_len = tmpl->extranonce_2_offset + extranonce_2_len + coinbase_2_len;
+    tmpl->tail = malloc(tmpl->tail_len);
+    if (tmpl->tail == NULL) {
+        return false;
+    }
+    memcpy(tmpl->tail, prefix + tmpl->prefix_len, tmpl->extranonce_2_offset);
+    memset(tmpl->tail + tmpl->extranonce_2_offset, 0, extranonce_2_len);
+    if (!hex_decode(coinbase_2, coinbase_2_hex_len, tmpl->tail + tmpl->extranonce_2_offset + extranonce_2_len)) {
+        free(tmpl->tail);
+        tmpl->tail = NULL;
+        return false;
+    }
+    return true;
+}
+
+void coinbase_template_free(coinbase_template *tmpl)
+{
+    free(tmpl->tail);
+    tmpl->tail = NULL;
+}
+
+void coinbase_template_hash(const coinbase_template *tmpl, const uint8_t *extranonce_2, uint8_t dest[32])
+{
+#if SHA256_LANES_VECTOR
+    coinbase_template_hash_lanes(tmpl, &extranonce_2, 1, (uint8_t(*)[32])dest);
+#else
+    uint8_t coinbase_tx[tmpl->tail_len];
+    memcpy(coinbase_tx, tmpl->tail, tmpl->tail_len);
+    memcpy(coinbase_tx + tmpl->extranonce_2_offset, extranonce_2, tmpl->extranonce_2_len);
+    double_sha256_bin(coinbase_tx, tmpl->tail_len, dest);
+#endif
+}
+
+void coinbase_template_hash_lanes(const coinbase_template *tmpl, const uint8_t *const extranonce_2[], int count,
+                                  uint8_t dest[][32])
+{
+#if SHA256_LANES_VECTOR
+    uint8_t tails[count][tmpl->tail_len];
+    const uint8_t *data[count];
+    for (int lane = 0; lane < count; lane++) {
+        memcpy(tails[lane], tmpl->tail, tmpl->tail_len);
+        memcpy(tails[lane] + tmpl->extranonce_2_offset, extranonce_2[lane], tmpl->extranonce_2_len);
+        data[lane] = tails[lane];
+    }
+    double_sha256_lanes(tmpl->prefix_state, tmpl->prefix_len, data, tmpl->tail_len, count, dest);
+#else
+    // Without vector lanes every coinbase goes through mbedtls, on the ESP32-S3 that is the SHA accelerator
+    for (int lane = 0; lane < count; lane++) {
+        coinbase_template_hash(tmpl, extranonce_2[lane], dest[lane]);
+    }
+#endif
+}
+
+void calculate_merkle_root_lanes(uint8_t hashes[][32], const uint8_t merkle_branches[][32], const int num_merkle_branches,
+                                 int count)
+{
+#if SHA256_LANES_VECTOR
+    uint8_t both_merkles[count][64];
+    const uint8_t *data[count];
+    for (int lane = 0; lane < count; lane++) {
+        data[lane] = both_merkles[lane];
+    }
+    for (int i = 0; i < num_merkle_branches; i++) {
+        for (int lane = 0; lane < count; lane++) {
+            memcpy(both_merkles[lane], hashes[lane], 32);
+            memcpy(both_merkles[lane] + 32, merkle_branches[i], 32);
+        }
+        double_sha256_lanes(NULL, 0, data, 64, count, hashes);
+    }
+#else
+    for (int lane = 0; lane < count; lane++) {
+        calculate_merkle_root_bin(hashes[lane], merkle_branches, num_merkle_branches, hashes[lane]);
+    }
+#endif
+}
+
+void calculate_merkle_root_bin(const uint8_t coinbase_hash[32], const uint8_t merkle_branches[][32], const int num_merkle_branches,
+                               uint8_t dest[32])
+{
     uint8_t both_merkles[64];
-    double_sha256_bin(coinbase_tx_bin, coinbase_tx_bin_len, both_merkles);
+    memcpy(both_merkles, coinbase_hash, 32);
     for (int i = 0; i < num_merkle_branches; i++) {
         memcpy(both_merkles + 32, merkle_branches[i], 32);
         double_sha256_bin(both_merkles, 64, both_merkles);
     }
-
-    bin2hex(both_merkles, 32, dest, 65);
+    memcpy(dest, both_merkles, 32);
 }
 
 // take a mining_notify struct with ascii hex strings and convert it to a bm_job struct
 bm_job construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask, const uint32_t difficulty)
+{
+    uint8_t merkle_root_bin[32];
+    hex2bin(merkle_root, merkle_root_bin, 32);
+
+    // stratum v1 sends the previous block hash with its 32 bit words swapped
+    uint8_t prev_block_hash[32];
+    swap_endian_words(params->prev_block_hash, prev_block_hash);
+
+    return construct_bm_job_from_header(params->version, prev_block_hash, merkle_root_bin, params->ntime, params->target,
+                                        version_mask, difficulty);
+}
+
+// build a bm_job from block header fields in header byte order, no hex or hashing besides the midstates
+static bm_job init_bm_job(const uint32_t version, const uint8_t prev_block_hash[32], const uint8_t merkle_root[32],
+                          const uint32_t ntime, const uint32_t target, const uint32_t difficulty)
 {
     bm_job new_job;
 
-    new_job.version = params->version;
-    new_job.target = params->target;
-    new_job.ntime = params->ntime;
+    new_job.version = version;
+    new_job.target = target;
+    new_job.ntime = ntime;
     new_job.starting_nonce = 0;
     new_job.pool_diff = difficulty;
+    difficulty_to_target(difficulty, new_job.pool_target);
+    nbits_to_target(target, new_job.network_target);
+    new_job.submit_template = NULL;
+    new_job.notify_received_us = 0;
+    new_job.num_midstates = 0;
 
-    hex2bin(merkle_root, new_job.merkle_root, 32);
-
-    // hex2bin(merkle_root, new_job.merkle_root_be, 32);
-    swap_endian_words(merkle_root, new_job.merkle_root_be);
-    reverse_bytes(new_job.merkle_root_be, 32);
+    memcpy(new_job.merkle_root, merkle_root, 32);
+    memcpy(new_job.prev_block_hash, prev_block_hash, 32);
 
-    swap_endian_words(params->prev_block_hash, new_job.prev_block_hash);
+    return new_job;
+}
 
-    hex2bin(params->prev_block_hash, new_job.prev_block_hash_be, 32);
-    reverse_bytes(new_job.prev_block_hash_be, 32);
+static void add_header_be(bm_job *job)
+{
+    // the BM1366 and newer take both hashes as reversed 32 bit words
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) {
+            job->merkle_root_be[31 - (i * 4 + j)] = job->merkle_root[i * 4 + (3 - j)];
+            job->prev_block_hash_be[31 - (i * 4 + j)] = job->prev_block_hash[i * 4 + (3 - j)];
+        }
+    }
+}
 
+static void add_midstates(bm_job *job, const uint32_t version_mask)
+{
     ////make the midstate hash
     uint8_t midstate_data[64];
 
     // copy 68 bytes header data into midstate (and deal with endianess)
-    memcpy(midstate_data, &new_job.version, 4);             // copy version
-    memcpy(midstate_data + 4, new_job.prev_block_hash, 32); // copy prev_block_hash
-    memcpy(midstate_data + 36, new_job.merkle_root, 28);    // copy merkle_root
+    memcpy(midstate_data, &job->version, 4);             // copy version
+    memcpy(midstate_data + 4, job->prev_block_hash, 32); // copy prev_block_hash
+    memcpy(midstate_data + 36, job->merkle_root, 28);    // copy merkle_root
 
-    midstate_sha256_bin(midstate_data, 64, new_job.midstate); // make the midstate hash
-    reverse_bytes(new_job.midstate, 32);                      // reverse the midstate bytes for the BM job packet
+    midstate_sha256_bin(midstate_data, 64, job->midstate); // make the midstate hash
+    reverse_bytes(job->midstate, 32);                      // reverse the midstate bytes for the BM job packet
 
     if (version_mask != 0)
     {
-        uint32_t rolled_version = increment_bitmask(new_job.version, version_mask);
+        uint32_t rolled_version = increment_bitmask(job->version, version_mask);
         memcpy(midstate_data, &rolled_version, 4);
-        midstate_sha256_bin(midstate_data, 64, new_job.midstate1);
-        reverse_bytes(new_job.midstate1, 32);
+        midstate_sha256_bin(midstate_data, 64, job->midstate1);
+        reverse_bytes(job->midstate1, 32);
 
         rolled_version = increment_bitmask(rolled_version, version_mask);
         memcpy(midstate_data, &rolled_version, 4);
-        midstate_sha256_bin(midstate_data, 64, new_job.midstate2);
-        reverse_bytes(new_job.midstate2, 32);
+        midstate_sha256_bin(midstate_data, 64, job->midstate2);
+        reverse_bytes(job->midstate2, 32);
 
         rolled_version = increment_bitmask(rolled_version, version_mask);
         memcpy(midstate_data, &rolled_version, 4);
-        midstate_sha256_bin(midstate_data, 64, new_job.midstate3);
-        reverse_bytes(new_job.midstate3, 32);
-        new_job.num_midstates = 4;
+        midstate_sha256_bin(midstate_data, 64, job->midstate3);
+        reverse_bytes(job->midstate3, 32);
+        job->num_midstates = 4;
     }
     else
     {
-        new_job.num_midstates = 1;
+        job->num_midstates = 1;
     }
+}
 
+bm_job construct_bm_job_from_header(const uint32_t version, const uint8_t prev_block_hash[32], const uint8_t merkle_root[32],
+                                    const uint32_t ntime, const uint32_t target, const uint32_t version_mask, const uint32_t difficulty)
+{
+    bm_job new_job = init_bm_job(version, prev_block_hash, merkle_root, ntime, target, difficulty);
+    add_header_be(&new_job);
+    add_midstates(&new_job, version_mask);
+    return new_job;
+}
+
+bm_job construct_bm_job_for_format(const bm_job_format format, const uint32_t version, const uint8_t prev_block_hash[32],
+                                   const uint8_t merkle_root[32], const uint32_t ntime, const uint32_t target,
+                                   const uint32_t version_mask, const uint32_t difficulty)
+{
+    bm_job new_job = init_bm_job(version, prev_block_hash, merkle_root, ntime, target, difficulty);
+    switch (format) {
+        case BM_JOB_FORMAT_MIDSTATES:
+            add_midstates(&new_job, version_mask);
+            break;
+        case BM_JOB_FORMAT_HEADER:
+            add_header_be(&new_job);
+            break;
+    }
     return new_job;
 }
 
@@ -107,15 +291,20 @@ void extranonce_2_generate(uint64_t extranonce_2, uint32_t length, char dest[sta
 {
     // Allocate buffer to hold the extranonce_2 value in bytes
     uint8_t extranonce_2_bytes[length];
-    memset(extranonce_2_bytes, 0, length);
+    extranonce_2_generate_bin(extranonce_2, length, extranonce_2_bytes);
     
+    // Convert the bytes to hex string
+    bin2hex(extranonce_2_bytes, length, dest, length * 2 + 1);
+}
+
+void extranonce_2_generate_bin(uint64_t extranonce_2, uint32_t length, uint8_t dest[static length])
+{
+    memset(dest, 0, length);
+
     // Copy the extranonce_2 value into the buffer, handling endianness
     // Copy up to the size of uint64_t or the requested length, whichever is smaller
     size_t copy_len = (length < sizeof(uint64_t)) ? length : sizeof(uint64_t);
-    memcpy(extranonce_2_bytes, &extranonce_2, copy_len);
-    
-    // Convert the bytes to hex string
-    bin2hex(extranonce_2_bytes, length, dest, length * 2 + 1);
+    memcpy(dest, &extranonce_2, copy_len);
 }
 
 ///////cgminer nonce testing
@@ -123,38 +312,102 @@ void extranonce_2_generate(uint64_t extranonce_2, uint32_t length, char dest[sta
  */
 static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
 
-/* testing a nonce and return the diff - 0 means invalid */
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+#if SHA256_LANES_VECTOR
+// State after the first 64 header bytes
+static void first_block_state(const bm_job *job, const uint32_t rolled_version, uint32_t state[8])
 {
-    double d64, s64, ds;
-    unsigned char header[80];
+    uint8_t block[64];
+    memcpy(block, &rolled_version, 4);
+    memcpy(block + 4, job->prev_block_hash, 32);
+    memcpy(block + 36, job->merkle_root, 28);
+    memcpy(state, sha256_initial_state, 32);
+    sha256_compress(state, block);
+}
 
-    // // TODO: use the midstate hash instead of hashing the whole header
-    // uint32_t rolled_version = job->version;
-    // for (int i = 0; i < midstate_index; i++) {
-    //     rolled_version = increment_bitmask(rolled_version, job->version_mask);
-    // }
+// The ASIC rolls the version so the cache keeps a state per rolled version
+static const uint32_t *cached_first_block_state(const bm_job *job, nonce_verify_cache *cache, const uint32_t rolled_version)
+{
+    if (memcmp(cache->prev_block_hash, job->prev_block_hash, 32) != 0 || memcmp(cache->merkle_root, job->merkle_root, 28) != 0) {
+        memcpy(cache->prev_block_hash, job->prev_block_hash, 32);
+        memcpy(cache->merkle_root, job->merkle_root, 28);
+        cache->used = 0;
+        cache->next = 0;
+    }
 
-    // copy data from job to header
+    for (int i = 0; i < cache->used; i++) {
+        if (cache->versions[i] == rolled_version) {
+            return cache->states[i];
+        }
+    }
+
+    int slot = cache->next;
+    cache->next = (slot + 1) % NONCE_VERIFY_STATES;
+    if (cache->used < NONCE_VERIFY_STATES) {
+        cache->used++;
+    }
+    first_block_state(job, rolled_version, cache->states[slot]);
+    cache->versions[slot] = rolled_version;
+    return cache->states[slot];
+}
+#endif
+
+void test_nonce_hash(const bm_job *job, nonce_verify_cache *cache, const uint32_t nonce, const uint32_t rolled_version,
+                     uint8_t hash[32])
+{
+#if !SHA256_LANES_VECTOR
+    // Resuming from a software first block state is only measured faster on vector builds, the
+    // others hash the whole header with double_sha256_bin and the SHA accelerator behind mbedtls
+    (void) cache;
+    uint8_t header[80];
     memcpy(header, &rolled_version, 4);
     memcpy(header + 4, job->prev_block_hash, 32);
     memcpy(header + 36, job->merkle_root, 32);
     memcpy(header + 68, &job->ntime, 4);
     memcpy(header + 72, &job->target, 4);
     memcpy(header + 76, &nonce, 4);
+    double_sha256_bin(header, 80, hash);
+#else
+    uint32_t state[8];
+    if (cache != NULL) {
+        memcpy(state, cached_first_block_state(job, cache, rolled_version), 32);
+    } else {
+        first_block_state(job, rolled_version, state);
+    }
 
-    unsigned char hash_buffer[32];
-    unsigned char hash_result[32];
-
-    // double hash the header
-    mbedtls_sha256(header, 80, hash_buffer, 0);
-    mbedtls_sha256(hash_buffer, 32, hash_result, 0);
+    // second block: the last 16 header bytes and the padding of an 80 byte message
+    uint8_t block[64] = {0};
+    memcpy(block, job->merkle_root + 28, 4);
+    memcpy(block + 4, &job->ntime, 4);
+    memcpy(block + 8, &job->target, 4);
+    memcpy(block + 12, &nonce, 4);
+    block[16] = 0x80;
+    block[62] = (80 * 8) >> 8;
+    block[63] = (80 * 8) & 0xff;
+    sha256_compress(state, block);
+
+    // outer hash of the 32 byte digest
+    memset(block, 0, sizeof(block));
+    sha256_state_to_bytes(state, block);
+    block[32] = 0x80;
+    block[62] = (32 * 8) >> 8;
+    block[63] = (32 * 8) & 0xff;
+    memcpy(state, sha256_initial_state, 32);
+    sha256_compress(state, block);
+    sha256_state_to_bytes(state, hash);
+#endif
+}
 
-    d64 = truediffone;
-    s64 = le256todouble(hash_result);
-    ds = d64 / s64;
+double hash_difficulty(const uint8_t hash[32])
+{
+    return truediffone / le256todouble(hash);
+}
 
-    return ds;
+/* testing a nonce and return the diff - 0 means invalid */
+double test_nonce_value(const bm_job *job, nonce_verify_cache *cache, const uint32_t nonce, const uint32_t rolled_version)
+{
+    uint8_t hash[32];
+    test_nonce_hash(job, cache, nonce, rolled_version, hash);
+    return hash_difficulty(hash);
 }
 
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask)
@@ -176,3 +429,11 @@ uint32_t increment_bitmask(const uint32_t value, const uint32_t mask)
 
     return new_value;
 }
+
+bool ntime_roll_allowed(uint32_t ntime_offset, int64_t notify_age_us, uint16_t window_s)
+{
+    if (window_s == 0) {
+        return false;
+    }
+    return ntime_offset <= window_s + (notify_age_us > 0 ? notify_age_us / 1000000 : 0);
+}
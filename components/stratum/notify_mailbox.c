@@ -0,0 +1,119 @@
+#include "notify_mailbox.h"
+
+#include <string.h>
+#include <time.h>
+
+void notify_mailbox_init(notify_mailbox * mailbox)
+{
+    memset(mailbox->pending, 0, sizeof(mailbox->pending));
+    memset(&mailbox->stats, 0, sizeof(mailbox->stats));
+    mailbox->next_sequence = 0;
+    pthread_mutex_init(&mailbox->lock, NULL);
+    pthread_cond_init(&mailbox->posted, NULL);
+}
+
+static bool has_pending(const notify_mailbox * mailbox)
+{
+    for (int i = 0; i < NOTIFY_MAILBOX_POOLS; i++) {
+        if (mailbox->pending[i] != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void notify_mailbox_post(notify_mailbox * mailbox, mining_notify * notify)
+{
+    int pool_id = notify->pool_id < NOTIFY_MAILBOX_POOLS ? notify->pool_id : 0;
+
+    pthread_mutex_lock(&mailbox->lock);
+    mining_notify * replaced = mailbox->pending[pool_id];
+    if (replaced != NULL) {
+        mailbox->stats.coalesced++;
+        if (replaced->clean_jobs) {
+            mailbox->stats.clean_coalesced++;
+            // The block changed since the job builder last looked, whatever the newer notify says
+            notify->clean_jobs = true;
+            notify->received_us = replaced->received_us;
+        }
+    } else {
+        mailbox->sequence[pool_id] = mailbox->next_sequence++;
+    }
+    mailbox->pending[pool_id] = notify;
+    mailbox->stats.posted++;
+    pthread_cond_signal(&mailbox->posted);
+    pthread_mutex_unlock(&mailbox->lock);
+
+    STRATUM_V1_free_mining_notify(replaced);
+}
+
+mining_notify * notify_mailbox_take(notify_mailbox * mailbox)
+{
+    pthread_mutex_lock(&mailbox->lock);
+    while (!has_pending(mailbox)) {
+        pthread_cond_wait(&mailbox->posted, &mailbox->lock);
+    }
+
+    int oldest = -1;
+    for (int i = 0; i < NOTIFY_MAILBOX_POOLS; i++) {
+        if (mailbox->pending[i] != NULL &&
+            (oldest < 0 || (int32_t) (mailbox->sequence[i] - mailbox->sequence[oldest]) < 0)) {
+            oldest = i;
+        }
+    }
+    mining_notify * notify = mailbox->pending[oldest];
+    mailbox->pending[oldest] = NULL;
+    pthread_mutex_unlock(&mailbox->lock);
+    return notify;
+}
+
+bool notify_mailbox_wait(notify_mailbox * mailbox, int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&mailbox->lock);
+    while (!has_pending(mailbox)) {
+        if (pthread_cond_timedwait(&mailbox->posted, &mailbox->lock, &deadline) != 0) {
+            break;
+        }
+    }
+    bool pending = has_pending(mailbox);
+    pthread_mutex_unlock(&mailbox->lock);
+    return pending;
+}
+
+bool notify_mailbox_pending(notify_mailbox * mailbox)
+{
+    pthread_mutex_lock(&mailbox->lock);
+    bool pending = has_pending(mailbox);
+    pthread_mutex_unlock(&mailbox->lock);
+    return pending;
+}
+
+void notify_mailbox_clear(notify_mailbox * mailbox)
+{
+    mining_notify * cleared[NOTIFY_MAILBOX_POOLS];
+
+    pthread_mutex_lock(&mailbox->lock);
+    memcpy(cleared, mailbox->pending, sizeof(cleared));
+    memset(mailbox->pending, 0, sizeof(mailbox->pending));
+    pthread_mutex_unlock(&mailbox->lock);
+
+    for (int i = 0; i < NOTIFY_MAILBOX_POOLS; i++) {
+        STRATUM_V1_free_mining_notify(cleared[i]);
+    }
+}
+
+void notify_mailbox_get_stats(notify_mailbox * mailbox, notify_mailbox_stats * stats)
+{
+    pthread_mutex_lock(&mailbox->lock);
+    *stats = mailbox->stats;
+    pthread_mutex_unlock(&mailbox->lock);
+}
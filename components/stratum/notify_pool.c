@@ -0,0 +1,107 @@
+#include "notify_pool.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slot_pool.h"
+
+typedef struct
+{
+    mining_notify notify; // must stay first, slots are found from the notify pointer
+    uint8_t merkle_branches[MAX_MERKLE_BRANCHES * HASH_SIZE];
+    char strings[NOTIFY_POOL_STRING_SIZE];
+} notify_slot;
+
+// Taken by every session that parses, the stratum task and the hot standby
+static slot_pool pool = SLOT_POOL_INITIALIZER("notify", sizeof(notify_slot), NOTIFY_POOL_SLOTS, NOTIFY_POOL_INTERNAL_SLOTS);
+static atomic_uint oversize;
+
+static mining_notify * alloc_from_heap(const char * const strings[NOTIFY_STRING_FIELDS], const size_t lengths[NOTIFY_STRING_FIELDS],
+                                       const uint8_t * merkle_branches, size_t n_merkle_branches)
+{
+    mining_notify * notify = malloc(sizeof(mining_notify));
+    notify->job_id = strndup(strings[NOTIFY_JOB_ID], lengths[NOTIFY_JOB_ID]);
+    notify->prev_block_hash = strndup(strings[NOTIFY_PREV_BLOCK_HASH], lengths[NOTIFY_PREV_BLOCK_HASH]);
+    notify->coinbase_1 = strndup(strings[NOTIFY_COINBASE_1], lengths[NOTIFY_COINBASE_1]);
+    notify->coinbase_2 = strndup(strings[NOTIFY_COINBASE_2], lengths[NOTIFY_COINBASE_2]);
+    notify->merkle_branches = malloc(HASH_SIZE * n_merkle_branches);
+    memcpy(notify->merkle_branches, merkle_branches, HASH_SIZE * n_merkle_branches);
+    notify->n_merkle_branches = n_merkle_branches;
+    notify->pool_id = 0;
+    notify->clean_jobs = false;
+    notify->received_us = 0;
+    return notify;
+}
+
+mining_notify * notify_pool_alloc(const char * const strings[NOTIFY_STRING_FIELDS], const size_t lengths[NOTIFY_STRING_FIELDS],
+                                  const uint8_t * merkle_branches, size_t n_merkle_branches)
+{
+    size_t strings_size = 0;
+    for (int i = 0; i < NOTIFY_STRING_FIELDS; i++) {
+        strings_size += lengths[i] + 1;
+    }
+
+    if (strings_size > NOTIFY_POOL_STRING_SIZE || n_merkle_branches > MAX_MERKLE_BRANCHES) {
+        atomic_fetch_add(&oversize, 1);
+        return alloc_from_heap(strings, lengths, merkle_branches, n_merkle_branches);
+    }
+
+    // A slot, or a slot sized block from the heap when all are taken
+    notify_slot * slot = slot_pool_alloc(&pool, sizeof(notify_slot));
+    if (slot == NULL) {
+        return NULL;
+    }
+    char * dest = slot->strings;
+    char ** fields[NOTIFY_STRING_FIELDS] = {
+        &slot->notify.job_id,
+        &slot->notify.prev_block_hash,
+        &slot->notify.coinbase_1,
+        &slot->notify.coinbase_2,
+    };
+    for (int i = 0; i < NOTIFY_STRING_FIELDS; i++) {
+        memcpy(dest, strings[i], lengths[i]);
+        dest[lengths[i]] = '\0';
+        *fields[i] = dest;
+        dest += lengths[i] + 1;
+    }
+
+    memcpy(slot->merkle_branches, merkle_branches, HASH_SIZE * n_merkle_branches);
+    slot->notify.merkle_branches = slot->merkle_branches;
+    slot->notify.n_merkle_branches = n_merkle_branches;
+    slot->notify.pool_id = 0;
+    slot->notify.clean_jobs = false;
+    slot->notify.received_us = 0;
+    return &slot->notify;
+}
+
+void notify_pool_free(mining_notify * notify)
+{
+    if (notify == NULL) {
+        return;
+    }
+
+    notify_slot * slot = (notify_slot *) notify;
+    if (notify->job_id == slot->strings) {
+        slot_pool_free(&pool, slot);
+        return;
+    }
+
+    free(notify->job_id);
+    free(notify->prev_block_hash);
+    free(notify->coinbase_1);
+    free(notify->coinbase_2);
+    free(notify->merkle_branches);
+    free(notify);
+}
+
+void notify_pool_get_stats(notify_pool_stats * stats)
+{
+    slot_pool_stats slot_stats;
+    slot_pool_get_stats(&pool, &slot_stats);
+    stats->hits = slot_stats.hits;
+    stats->misses = slot_stats.misses + atomic_load(&oversize);
+    stats->in_use = slot_stats.in_use;
+    stats->max_in_use = slot_stats.max_in_use;
+    stats->slots = slot_stats.slots;
+}
@@ -0,0 +1,293 @@
+#include "pool_connect.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char * TAG = "pool_connect";
+
+typedef struct
+{
+    char host[POOL_DNS_MAX_HOST_LEN];
+    uint16_t port;
+    pool_addr_list list;
+    int64_t expires_us;
+} dns_cache_entry;
+
+static dns_cache_entry dns_cache[POOL_DNS_CACHE_SIZE];
+static pthread_mutex_t dns_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_candidate(pool_addr_list * list, const struct addrinfo * ai)
+{
+    if (list->count == POOL_MAX_ADDRS || ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+        return;
+    }
+    memcpy(&list->addrs[list->count], ai->ai_addr, ai->ai_addrlen);
+    list->addrlens[list->count] = ai->ai_addrlen;
+    list->count++;
+}
+
+void pool_addr_list_from_addrinfo(const struct addrinfo * res, pool_addr_list * list)
+{
+    const struct addrinfo * v6 = res;
+    const struct addrinfo * v4 = res;
+    list->count = 0;
+
+    // Alternate families starting with IPv6, keeping the resolver order within each family
+    while (list->count < POOL_MAX_ADDRS) {
+        while (v6 != NULL && v6->ai_family != AF_INET6) {
+            v6 = v6->ai_next;
+        }
+        while (v4 != NULL && v4->ai_family != AF_INET) {
+            v4 = v4->ai_next;
+        }
+        if (v6 == NULL && v4 == NULL) {
+            break;
+        }
+        if (v6 != NULL) {
+            add_candidate(list, v6);
+            v6 = v6->ai_next;
+        }
+        if (v4 != NULL) {
+            add_candidate(list, v4);
+            v4 = v4->ai_next;
+        }
+    }
+}
+
+static dns_cache_entry * find_entry(const char * host, uint16_t port)
+{
+    for (int i = 0; i < POOL_DNS_CACHE_SIZE; i++) {
+        if (dns_cache[i].expires_us != 0 && dns_cache[i].port == port && strcmp(dns_cache[i].host, host) == 0) {
+            return &dns_cache[i];
+        }
+    }
+    return NULL;
+}
+
+bool pool_dns_cache_lookup(const char * host, uint16_t port, int64_t now_us, pool_addr_list * list)
+{
+    bool found = false;
+    pthread_mutex_lock(&dns_cache_lock);
+    dns_cache_entry * entry = find_entry(host, port);
+    if (entry != NULL && now_us < entry->expires_us) {
+        *list = entry->list;
+        found = true;
+    }
+    pthread_mutex_unlock(&dns_cache_lock);
+    return found;
+}
+
+void pool_dns_cache_store(const char * host, uint16_t port, const pool_addr_list * list, int64_t now_us)
+{
+    if (strlen(host) >= POOL_DNS_MAX_HOST_LEN || list->count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&dns_cache_lock);
+    dns_cache_entry * entry = find_entry(host, port);
+    if (entry == NULL) {
+        // Reuse a free slot or the one expiring first
+        entry = &dns_cache[0];
+        for (int i = 1; i < POOL_DNS_CACHE_SIZE && entry->expires_us != 0; i++) {
+            if (dns_cache[i].expires_us < entry->expires_us) {
+                entry = &dns_cache[i];
+            }
+        }
+        strcpy(entry->host, host);
+        entry->port = port;
+    }
+    entry->list = *list;
+    entry->expires_us = now_us + (int64_t) POOL_DNS_TTL_S * 1000000;
+    pthread_mutex_unlock(&dns_cache_lock);
+}
+
+void pool_dns_cache_invalidate(const char * host)
+{
+    pthread_mutex_lock(&dns_cache_lock);
+    for (int i = 0; i < POOL_DNS_CACHE_SIZE; i++) {
+        if (strcmp(dns_cache[i].host, host) == 0) {
+            dns_cache[i].expires_us = 0;
+        }
+    }
+    pthread_mutex_unlock(&dns_cache_lock);
+}
+
+esp_err_t pool_resolve(const char * host, uint16_t port, pool_addr_list * list)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (pool_dns_cache_lookup(host, port, now_us, list)) {
+        ESP_LOGD(TAG, "Resolved %s from cache", host);
+        return ESP_OK;
+    }
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP,
+        .ai_flags = AI_NUMERICSERV,
+    };
+    struct addrinfo * res;
+    char port_str[6];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    int gai_err = getaddrinfo(host, port_str, &hints, &res);
+    if (gai_err != 0) {
+        ESP_LOGE(TAG, "getaddrinfo failed for %s: error code %d", host, gai_err);
+        return ESP_FAIL;
+    }
+    pool_addr_list_from_addrinfo(res, list);
+    freeaddrinfo(res);
+
+    if (list->count == 0) {
+        ESP_LOGE(TAG, "No suitable address found for %s", host);
+        return ESP_FAIL;
+    }
+
+    pool_dns_cache_store(host, port, list, now_us);
+    return ESP_OK;
+}
+
+static int start_attempt(const struct sockaddr_storage * addr, socklen_t addrlen, bool * connected)
+{
+    int sock = socket(addr->ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return POOL_CONNECT_NO_SOCKET;
+    }
+
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    *connected = connect(sock, (const struct sockaddr *) addr, addrlen) == 0;
+    if (!*connected && errno != EINPROGRESS) {
+        ESP_LOGD(TAG, "connect failed (errno %d: %s)", errno, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int pool_connect(const pool_addr_list * list, int timeout_ms, int * connected)
+{
+    int socks[POOL_MAX_ADDRS];
+    int started = 0;
+    int running = 0;
+    int winner = -1;
+    bool socket_created = false;
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t deadline_us = now_us + (int64_t) timeout_ms * 1000;
+    int64_t next_attempt_us = now_us;
+
+    while (winner < 0 && now_us < deadline_us) {
+        // Start the next candidate after the attempt delay, or right away if nothing is in flight
+        if (started < list->count && (now_us >= next_attempt_us || running == 0)) {
+            bool immediate = false;
+            int sock = start_attempt(&list->addrs[started], list->addrlens[started], &immediate);
+            socks[started] = sock < 0 ? -1 : sock;
+            socket_created |= sock != POOL_CONNECT_NO_SOCKET;
+            if (sock >= 0) {
+                running++;
+                if (immediate) {
+                    winner = started;
+                }
+            }
+            started++;
+            next_attempt_us = now_us + POOL_CONNECT_ATTEMPT_DELAY_MS * 1000;
+            continue;
+        }
+        if (running == 0) {
+            break;
+        }
+
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        for (int i = 0; i < started; i++) {
+            if (socks[i] >= 0) {
+                FD_SET(socks[i], &write_fds);
+                max_fd = socks[i] > max_fd ? socks[i] : max_fd;
+            }
+        }
+
+        int64_t wait_us = deadline_us - now_us;
+        if (started < list->count && next_attempt_us - now_us < wait_us) {
+            wait_us = next_attempt_us - now_us;
+        }
+        struct timeval timeout = {
+            .tv_sec = wait_us / 1000000,
+            .tv_usec = wait_us % 1000000,
+        };
+
+        if (select(max_fd + 1, NULL, &write_fds, NULL, &timeout) > 0) {
+            for (int i = 0; i < started && winner < 0; i++) {
+                if (socks[i] < 0 || !FD_ISSET(socks[i], &write_fds)) {
+                    continue;
+                }
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt(socks[i], SOL_SOCKET, SO_ERROR, &error, &len);
+                if (error == 0) {
+                    winner = i;
+                } else {
+                    char addr_str[INET6_ADDRSTRLEN + 16];
+                    pool_format_addr(&list->addrs[i], addr_str, sizeof(addr_str));
+                    ESP_LOGI(TAG, "Connect to %s failed (errno %d: %s)", addr_str, error, strerror(error));
+                    close(socks[i]);
+                    socks[i] = -1;
+                    running--;
+                }
+            }
+        }
+        now_us = esp_timer_get_time();
+    }
+
+    for (int i = 0; i < started; i++) {
+        if (i != winner && socks[i] >= 0) {
+            close(socks[i]);
+        }
+    }
+
+    if (winner < 0) {
+        return socket_created || started == 0 ? -1 : POOL_CONNECT_NO_SOCKET;
+    }
+
+    int flags = fcntl(socks[winner], F_GETFL, 0);
+    fcntl(socks[winner], F_SETFL, flags & ~O_NONBLOCK);
+    if (connected != NULL) {
+        *connected = winner;
+    }
+    return socks[winner];
+}
+
+uint32_t pool_backoff_ms(int attempt, uint32_t random)
+{
+    uint32_t delay = POOL_BACKOFF_BASE_MS;
+    for (int i = 0; i < attempt && delay < POOL_BACKOFF_MAX_MS; i++) {
+        delay *= 2;
+    }
+    if (delay > POOL_BACKOFF_MAX_MS) {
+        delay = POOL_BACKOFF_MAX_MS;
+    }
+    return delay / 2 + random % (delay / 2 + 1);
+}
+
+void pool_format_addr(const struct sockaddr_storage * addr, char * buffer, size_t size)
+{
+    if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 * addr6 = (const struct sockaddr_in6 *) addr;
+        inet_ntop(AF_INET6, &addr6->sin6_addr, buffer, size);
+        // Append the zone identifier for link-local addresses
+        if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr) && addr6->sin6_scope_id != 0) {
+            size_t len = strlen(buffer);
+            snprintf(buffer + len, size - len, "%%%lu", (unsigned long) addr6->sin6_scope_id);
+        }
+    } else {
+        inet_ntop(AF_INET, &((const struct sockaddr_in *) addr)->sin_addr, buffer, size);
+    }
+}
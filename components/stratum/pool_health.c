@@ -0,0 +1,93 @@
+#include "pool_health.h"
+
+#define US_PER_S 1000000.0
+// Weight of the newest interval in the moving average
+#define NOTIFY_INTERVAL_ALPHA 0.25
+
+void pool_health_reset(pool_health * health, int64_t now_us)
+{
+    health->last_rx_us = now_us;
+    health->last_notify_us = 0;
+    health->notified = false;
+    health->notify_interval_s = 0;
+    health->notify_intervals = 0;
+    health->outstanding_submits = 0;
+    health->first_unacked_us = 0;
+}
+
+void pool_health_on_rx(pool_health * health, int64_t now_us)
+{
+    health->last_rx_us = now_us;
+}
+
+void pool_health_on_notify(pool_health * health, int64_t now_us)
+{
+    health->last_rx_us = now_us;
+    if (health->notified) {
+        double interval_s = (now_us - health->last_notify_us) / US_PER_S;
+        if (health->notify_intervals == 0) {
+            health->notify_interval_s = interval_s;
+        } else {
+            health->notify_interval_s += NOTIFY_INTERVAL_ALPHA * (interval_s - health->notify_interval_s);
+        }
+        health->notify_intervals++;
+    }
+    health->last_notify_us = now_us;
+    health->notified = true;
+}
+
+void pool_health_on_submit(pool_health * health, int count, int64_t now_us)
+{
+    if (health->outstanding_submits == 0) {
+        health->first_unacked_us = now_us;
+    }
+    health->outstanding_submits += count;
+}
+
+void pool_health_on_submit_response(pool_health * health, int64_t now_us)
+{
+    health->last_rx_us = now_us;
+    if (health->outstanding_submits > 0) {
+        health->outstanding_submits--;
+    }
+    // The pool is answering, time the rest from here
+    health->first_unacked_us = health->outstanding_submits > 0 ? now_us : 0;
+}
+
+double pool_health_silence_timeout_s(const pool_health * health)
+{
+    if (health->notify_intervals < POOL_HEALTH_MIN_INTERVALS) {
+        return POOL_HEALTH_MAX_SILENCE_S;
+    }
+    double timeout_s = POOL_HEALTH_NOTIFY_INTERVALS * health->notify_interval_s;
+    if (timeout_s < POOL_HEALTH_MIN_SILENCE_S) {
+        return POOL_HEALTH_MIN_SILENCE_S;
+    }
+    if (timeout_s > POOL_HEALTH_MAX_SILENCE_S) {
+        return POOL_HEALTH_MAX_SILENCE_S;
+    }
+    return timeout_s;
+}
+
+pool_health_status pool_health_check(const pool_health * health, int64_t now_us)
+{
+    if (health->outstanding_submits > 0 && now_us - health->first_unacked_us > POOL_HEALTH_SUBMIT_TIMEOUT_S * US_PER_S) {
+        return POOL_HEALTH_SUBMIT_UNACKED;
+    }
+    if (now_us - health->last_rx_us > pool_health_silence_timeout_s(health) * US_PER_S) {
+        return POOL_HEALTH_NOTIFY_OVERDUE;
+    }
+    return POOL_HEALTH_OK;
+}
+
+const char * pool_health_status_str(pool_health_status status)
+{
+    switch (status) {
+        case POOL_HEALTH_NOTIFY_OVERDUE:
+            return "no notify within the expected cadence";
+        case POOL_HEALTH_SUBMIT_UNACKED:
+            return "submits not answered";
+        default:
+            return "ok";
+    }
+}
@@ -0,0 +1,36 @@
+#include "pool_scheduler.h"
+
+#include <string.h>
+
+void pool_scheduler_reset(pool_scheduler * scheduler)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+}
+
+int pool_scheduler_next(pool_scheduler * scheduler, const uint16_t weights[], int count)
+{
+    if (count > POOL_SCHEDULER_MAX_POOLS) {
+        count = POOL_SCHEDULER_MAX_POOLS;
+    }
+
+    int32_t total = 0;
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+        // An unavailable pool does not build up credit to burst with later
+        if (weights[i] == 0) {
+            scheduler->credit[i] = 0;
+            continue;
+        }
+        scheduler->credit[i] += weights[i];
+        total += weights[i];
+        if (best < 0 || scheduler->credit[i] > scheduler->credit[best]) {
+            best = i;
+        }
+    }
+
+    if (best >= 0) {
+        scheduler->credit[best] -= total;
+        scheduler->jobs[best]++;
+    }
+    return best;
+}
@@ -0,0 +1,436 @@
+#include "pool_tls.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#include "pool_connect.h"
+
+static const char * TAG = "pool_tls";
+
+typedef struct
+{
+    mbedtls_net_context net;
+    size_t rx_bytes;
+} counting_bio;
+
+typedef struct
+{
+    int sock;
+    uint32_t generation;
+    mbedtls_ssl_context ssl;
+    counting_bio bio;
+    // mbedtls contexts are not safe for a concurrent read and write
+    pthread_mutex_t lock;
+} tls_connection;
+
+typedef struct
+{
+    char host[POOL_DNS_MAX_HOST_LEN];
+    uint16_t port;
+    bool valid;
+    mbedtls_ssl_session session;
+} cached_session;
+
+static tls_connection connections[POOL_TLS_MAX_CONNECTIONS];
+static cached_session session_cache[POOL_TLS_SESSION_CACHE_SIZE];
+static pool_tls_stats stats;
+static uint32_t next_generation = 1;
+static bool connections_ready;
+static pthread_mutex_t tls_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool config_ready;
+static char * ca_pem;
+static mbedtls_ssl_config config;
+static mbedtls_x509_crt ca_chain;
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context ctr_drbg;
+
+const char * pool_url_host(const char * url, bool * tls)
+{
+    static const char * const tls_schemes[] = {"stratum+ssl://", "stratum+tls://"};
+    static const char * const plain_schemes[] = {"stratum+tcp://", "stratum://"};
+
+    *tls = false;
+    for (int i = 0; i < sizeof(tls_schemes) / sizeof(tls_schemes[0]); i++) {
+        size_t len = strlen(tls_schemes[i]);
+        if (strncasecmp(url, tls_schemes[i], len) == 0) {
+            *tls = true;
+            return url + len;
+        }
+    }
+    for (int i = 0; i < sizeof(plain_schemes) / sizeof(plain_schemes[0]); i++) {
+        size_t len = strlen(plain_schemes[i]);
+        if (strncasecmp(url, plain_schemes[i], len) == 0) {
+            return url + len;
+        }
+    }
+    return url;
+}
+
+void pool_tls_set_ca_cert(const char * pem)
+{
+    pthread_mutex_lock(&tls_lock);
+    free(ca_pem);
+    ca_pem = pem != NULL && pem[0] != '\0' ? strdup(pem) : NULL;
+    pthread_mutex_unlock(&tls_lock);
+}
+
+static int bio_send(void * ctx, const unsigned char * buf, size_t len)
+{
+    return mbedtls_net_send(&((counting_bio *) ctx)->net, buf, len);
+}
+
+static int bio_recv(void * ctx, unsigned char * buf, size_t len)
+{
+    counting_bio * bio = ctx;
+    int ret = mbedtls_net_recv(&bio->net, buf, len);
+    if (ret > 0) {
+        bio->rx_bytes += ret;
+    }
+    return ret;
+}
+
+// Called with tls_lock held
+static bool setup_config(void)
+{
+    if (config_ready) {
+        return true;
+    }
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_ssl_config_init(&config);
+    mbedtls_x509_crt_init(&ca_chain);
+    int ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed failed: -0x%04x", -ret);
+        goto fail;
+    }
+    ret = mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_config_defaults failed: -0x%04x", -ret);
+        goto fail;
+    }
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    if (ca_pem != NULL) {
+        ret = mbedtls_x509_crt_parse(&ca_chain, (const unsigned char *) ca_pem, strlen(ca_pem) + 1);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "Invalid pool CA certificate: -0x%04x", -ret);
+            goto fail;
+        }
+        mbedtls_ssl_conf_ca_chain(&config, &ca_chain, NULL);
+    } else {
+        ret = esp_crt_bundle_attach(&config);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to attach the certificate bundle: %s", esp_err_to_name(ret));
+            goto fail;
+        }
+    }
+    config_ready = true;
+    return true;
+
+fail:
+    mbedtls_x509_crt_free(&ca_chain);
+    mbedtls_ssl_config_free(&config);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    return false;
+}
+
+// Called with tls_lock held
+static cached_session * find_session(const char * host, uint16_t port, bool create)
+{
+    cached_session * free_entry = NULL;
+    for (int i = 0; i < POOL_TLS_SESSION_CACHE_SIZE; i++) {
+        if (session_cache[i].valid && session_cache[i].port == port && strcmp(session_cache[i].host, host) == 0) {
+            return &session_cache[i];
+        }
+        if (!session_cache[i].valid && free_entry == NULL) {
+            free_entry = &session_cache[i];
+        }
+    }
+    if (!create || strlen(host) >= POOL_DNS_MAX_HOST_LEN) {
+        return NULL;
+    }
+    if (free_entry == NULL) {
+        // Both pools are cached already, the host changed
+        free_entry = &session_cache[0];
+        mbedtls_ssl_session_free(&free_entry->session);
+    }
+    mbedtls_ssl_session_init(&free_entry->session);
+    strcpy(free_entry->host, host);
+    free_entry->port = port;
+    free_entry->valid = true;
+    return free_entry;
+}
+
+static tls_connection * find_connection(int sock, uint32_t * generation)
+{
+    tls_connection * connection = NULL;
+    pthread_mutex_lock(&tls_lock);
+    for (int i = 0; i < POOL_TLS_MAX_CONNECTIONS; i++) {
+        if (connections[i].generation != 0 && connections[i].sock == sock) {
+            connection = &connections[i];
+            *generation = connection->generation;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&tls_lock);
+    return connection;
+}
+
+// Locks the connection unless it was closed since it was looked up
+static bool lock_connection(tls_connection * connection, uint32_t generation)
+{
+    pthread_mutex_lock(&connection->lock);
+    if (connection->generation != generation) {
+        pthread_mutex_unlock(&connection->lock);
+        return false;
+    }
+    return true;
+}
+
+esp_err_t pool_tls_handshake(int sock, const char * host, uint16_t port)
+{
+    tls_connection * connection = NULL;
+    cached_session * cached = NULL;
+    bool offered = false;
+
+    pthread_mutex_lock(&tls_lock);
+    if (!setup_config()) {
+        pthread_mutex_unlock(&tls_lock);
+        return ESP_FAIL;
+    }
+    if (!connections_ready) {
+        for (int i = 0; i < POOL_TLS_MAX_CONNECTIONS; i++) {
+            pthread_mutex_init(&connections[i].lock, NULL);
+            connections[i].sock = -1;
+        }
+        connections_ready = true;
+    }
+    for (int i = 0; i < POOL_TLS_MAX_CONNECTIONS; i++) {
+        if (connections[i].generation == 0) {
+            connection = &connections[i];
+            break;
+        }
+    }
+    if (connection == NULL) {
+        pthread_mutex_unlock(&tls_lock);
+        ESP_LOGE(TAG, "No free TLS connection for %s", host);
+        return ESP_ERR_NO_MEM;
+    }
+
+    connection->sock = sock;
+    connection->generation = next_generation++;
+    connection->bio.net.fd = sock;
+    connection->bio.rx_bytes = 0;
+    mbedtls_ssl_init(&connection->ssl);
+
+    int ret = mbedtls_ssl_setup(&connection->ssl, &config);
+    if (ret == 0) {
+        ret = mbedtls_ssl_set_hostname(&connection->ssl, host);
+    }
+    cached = find_session(host, port, false);
+    if (ret == 0 && cached != NULL && mbedtls_ssl_set_session(&connection->ssl, &cached->session) == 0) {
+        offered = true;
+    }
+    pthread_mutex_unlock(&tls_lock);
+
+    struct timeval timeout = {.tv_sec = POOL_TLS_HANDSHAKE_TIMEOUT_S};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    mbedtls_ssl_set_bio(&connection->ssl, &connection->bio, bio_send, bio_recv, NULL);
+
+    int64_t start_us = esp_timer_get_time();
+    while (ret == 0 && (ret = mbedtls_ssl_handshake(&connection->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            break;
+        }
+        ret = 0;
+    }
+    double handshake_ms = (esp_timer_get_time() - start_us) / 1000.0;
+
+    if (ret != 0) {
+        uint32_t flags = mbedtls_ssl_get_verify_result(&connection->ssl);
+        ESP_LOGE(TAG, "TLS handshake with %s:%d failed: -0x%04x (verify flags 0x%lx)", host, port, -ret, (unsigned long) flags);
+        pthread_mutex_lock(&tls_lock);
+        mbedtls_ssl_free(&connection->ssl);
+        connection->generation = 0;
+        connection->sock = -1;
+        // The pool may have rotated its ticket keys or certificate, start over next time
+        if (offered) {
+            cached = find_session(host, port, false);
+            if (cached != NULL) {
+                mbedtls_ssl_session_free(&cached->session);
+                cached->valid = false;
+            }
+        }
+        pthread_mutex_unlock(&tls_lock);
+        return ESP_FAIL;
+    }
+
+    pthread_mutex_lock(&tls_lock);
+    cached = find_session(host, port, true);
+    if (cached != NULL) {
+        mbedtls_ssl_session_free(&cached->session);
+        mbedtls_ssl_session_init(&cached->session);
+        if (mbedtls_ssl_get_session(&connection->ssl, &cached->session) != 0) {
+            cached->valid = false;
+        }
+    }
+    stats.handshakes++;
+    stats.resumption_offers += offered;
+    stats.last_handshake_ms = handshake_ms;
+    stats.last_handshake_rx_bytes = connection->bio.rx_bytes;
+    stats.last_resumption_offered = offered;
+    stats.record_overhead = mbedtls_ssl_get_record_expansion(&connection->ssl);
+    pthread_mutex_unlock(&tls_lock);
+
+    ESP_LOGI(TAG, "TLS %s with %s:%d in %.1f ms, %u bytes received, %s session%s", mbedtls_ssl_get_version(&connection->ssl), host,
+             port, handshake_ms, (unsigned) connection->bio.rx_bytes, offered ? "cached" : "new",
+             offered ? " offered" : "");
+    return ESP_OK;
+}
+
+int pool_send(int sock, const void * data, size_t len)
+{
+    uint32_t generation;
+    tls_connection * connection = find_connection(sock, &generation);
+    if (connection == NULL) {
+        return send(sock, data, len, 0);
+    }
+    if (!lock_connection(connection, generation)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    int ret;
+    do {
+        ret = mbedtls_ssl_write(&connection->ssl, data, len);
+    } while (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ);
+    pthread_mutex_unlock(&connection->lock);
+
+    if (ret < 0) {
+        ESP_LOGI(TAG, "mbedtls_ssl_write failed: -0x%04x", -ret);
+        errno = EIO;
+        return -1;
+    }
+    return ret;
+}
+
+// Waits for the socket without holding the connection, so submits can go out meanwhile
+static bool wait_readable(int sock)
+{
+    struct timeval timeout;
+    socklen_t timeout_len = sizeof(timeout);
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, &timeout_len) != 0) {
+        timeout_len = 0;
+    }
+
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(sock, &read_fds);
+    bool no_timeout = timeout_len == 0 || (timeout.tv_sec == 0 && timeout.tv_usec == 0);
+    int ret = select(sock + 1, &read_fds, NULL, NULL, no_timeout ? NULL : &timeout);
+    if (ret == 0) {
+        errno = EAGAIN;
+    }
+    return ret > 0;
+}
+
+int pool_recv(int sock, void * data, size_t len)
+{
+    uint32_t generation;
+    tls_connection * connection = find_connection(sock, &generation);
+    if (connection == NULL) {
+        return recv(sock, data, len, 0);
+    }
+
+    while (1) {
+        if (!lock_connection(connection, generation)) {
+            errno = EBADF;
+            return -1;
+        }
+        bool buffered = mbedtls_ssl_get_bytes_avail(&connection->ssl) > 0 || mbedtls_ssl_check_pending(&connection->ssl);
+        pthread_mutex_unlock(&connection->lock);
+
+        if (!buffered && !wait_readable(sock)) {
+            return -1;
+        }
+
+        if (!lock_connection(connection, generation)) {
+            errno = EBADF;
+            return -1;
+        }
+        int ret = mbedtls_ssl_read(&connection->ssl, data, len);
+        pthread_mutex_unlock(&connection->lock);
+
+        if (ret > 0) {
+            return ret;
+        }
+        if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+            return 0;
+        }
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE
+#ifdef MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET
+            || ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET
+#endif
+        ) {
+            continue;
+        }
+        ESP_LOGI(TAG, "mbedtls_ssl_read failed: -0x%04x", -ret);
+        errno = EIO;
+        return -1;
+    }
+}
+
+void pool_close(int sock)
+{
+    uint32_t generation;
+    tls_connection * connection = sock < 0 ? NULL : find_connection(sock, &generation);
+    if (connection != NULL && lock_connection(connection, generation)) {
+        mbedtls_ssl_free(&connection->ssl);
+        pthread_mutex_lock(&tls_lock);
+        connection->generation = 0;
+        connection->sock = -1;
+        pthread_mutex_unlock(&tls_lock);
+        pthread_mutex_unlock(&connection->lock);
+    }
+    if (sock >= 0) {
+        close(sock);
+    }
+}
+
+bool pool_tls_pending(int sock)
+{
+    uint32_t generation;
+    tls_connection * connection = find_connection(sock, &generation);
+    if (connection == NULL || !lock_connection(connection, generation)) {
+        return false;
+    }
+    bool pending = mbedtls_ssl_get_bytes_avail(&connection->ssl) > 0 || mbedtls_ssl_check_pending(&connection->ssl);
+    pthread_mutex_unlock(&connection->lock);
+    return pending;
+}
+
+void pool_tls_get_stats(pool_tls_stats * out)
+{
+    pthread_mutex_lock(&tls_lock);
+    *out = stats;
+    pthread_mutex_unlock(&tls_lock);
+}
@@ -0,0 +1,143 @@
+#include "sha256_lanes.h"
+
+#include <string.h>
+
+#include "utils.h"
+
+#if SHA256_LANES_VECTOR
+
+typedef uint32_t lane_word __attribute__((vector_size(SHA256_LANES * 4)));
+
+#define ROTR_LANES(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256_compress_lanes(uint32_t state[SHA256_LANES][8], const uint8_t *const blocks[SHA256_LANES])
+{
+    lane_word w[64];
+    for (int i = 0; i < 16; i++) {
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            const uint8_t *p = blocks[lane] + i * 4;
+            w[i][lane] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+    }
+    for (int i = 16; i < 64; i++) {
+        lane_word s0 = ROTR_LANES(w[i - 15], 7) ^ ROTR_LANES(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        lane_word s1 = ROTR_LANES(w[i - 2], 17) ^ ROTR_LANES(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    lane_word v[8];
+    for (int j = 0; j < 8; j++) {
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            v[j][lane] = state[lane][j];
+        }
+    }
+
+    lane_word a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+    for (int i = 0; i < 64; i++) {
+        lane_word t1 = h + (ROTR_LANES(e, 6) ^ ROTR_LANES(e, 11) ^ ROTR_LANES(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        lane_word t2 = (ROTR_LANES(a, 2) ^ ROTR_LANES(a, 13) ^ ROTR_LANES(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    v[0] += a;
+    v[1] += b;
+    v[2] += c;
+    v[3] += d;
+    v[4] += e;
+    v[5] += f;
+    v[6] += g;
+    v[7] += h;
+
+    for (int j = 0; j < 8; j++) {
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            state[lane][j] = v[j][lane];
+        }
+    }
+}
+
+#else
+
+void sha256_compress_lanes(uint32_t state[SHA256_LANES][8], const uint8_t *const blocks[SHA256_LANES])
+{
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        sha256_compress(state[lane], blocks[lane]);
+    }
+}
+
+#endif
+
+// A single message is not worth the lanes it would leave idle
+static void compress(uint32_t state[SHA256_LANES][8], const uint8_t *const blocks[SHA256_LANES], int count)
+{
+    if (count == 1) {
+        sha256_compress(state[0], blocks[0]);
+    } else {
+        sha256_compress_lanes(state, blocks);
+    }
+}
+
+static void put_u64_be(uint8_t *dest, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--) {
+        dest[i] = value;
+        value >>= 8;
+    }
+}
+
+void double_sha256_lanes(const uint32_t state[8], uint64_t prefix_len, const uint8_t *const data[], size_t len, int count,
+                         uint8_t dest[][32])
+{
+    uint32_t lanes[SHA256_LANES][8];
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        memcpy(lanes[lane], state != NULL ? state : sha256_initial_state, sizeof(lanes[lane]));
+    }
+
+    // The whole blocks straight from the messages, the rest and the padding from a copy. Unused lanes repeat lane 0.
+    size_t whole = len / 64 * 64;
+    const uint8_t *blocks[SHA256_LANES];
+    for (size_t offset = 0; offset < whole; offset += 64) {
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            blocks[lane] = data[lane < count ? lane : 0] + offset;
+        }
+        compress(lanes, blocks, count);
+    }
+
+    size_t rest = len - whole;
+    size_t final_len = rest + 9 <= 64 ? 64 : 128;
+    uint8_t final[SHA256_LANES][128];
+    for (int lane = 0; lane < count; lane++) {
+        memcpy(final[lane], data[lane] + whole, rest);
+        final[lane][rest] = 0x80;
+        memset(final[lane] + rest + 1, 0, final_len - rest - 9);
+        put_u64_be(final[lane] + final_len - 8, (prefix_len + len) * 8);
+    }
+    for (size_t offset = 0; offset < final_len; offset += 64) {
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            blocks[lane] = final[lane < count ? lane : 0] + offset;
+        }
+        compress(lanes, blocks, count);
+    }
+
+    // The 32 byte digests again, one padded block each
+    for (int lane = 0; lane < count; lane++) {
+        sha256_state_to_bytes(lanes[lane], final[lane]);
+        final[lane][32] = 0x80;
+        memset(final[lane] + 33, 0, 64 - 33 - 8);
+        put_u64_be(final[lane] + 56, 32 * 8);
+    }
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        memcpy(lanes[lane], sha256_initial_state, sizeof(lanes[lane]));
+        blocks[lane] = final[lane < count ? lane : 0];
+    }
+    compress(lanes, blocks, count);
+
+    for (int lane = 0; lane < count; lane++) {
+        sha256_state_to_bytes(lanes[lane], dest[lane]);
+    }
+}
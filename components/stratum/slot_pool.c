@@ -0,0 +1,115 @@
+#include "slot_pool.h"
+
+#include <stdlib.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char * TAG = "slot_pool";
+
+static uint8_t * get_storage(slot_pool * pool)
+{
+    uint8_t * storage = atomic_load(&pool->storage);
+    if (storage != NULL) {
+        return storage;
+    }
+
+    // Every task racing for the first allocation comes to the same slot count
+    bool psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    uint32_t slots = psram ? pool->psram_slots : pool->internal_slots;
+    if (slots > SLOT_POOL_MAX_SLOTS) {
+        slots = SLOT_POOL_MAX_SLOTS;
+    }
+    if (slots == 0) {
+        return NULL;
+    }
+
+    storage = heap_caps_calloc(slots, pool->slot_size, MALLOC_CAP_SPIRAM);
+    if (storage == NULL) {
+        storage = calloc(slots, pool->slot_size);
+    }
+    if (storage == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %lu %s slots, using the heap", (unsigned long) slots, pool->name);
+        return NULL;
+    }
+    if (!psram) {
+        ESP_LOGW(TAG, "No PSRAM, %lu %s slots take %lu bytes of internal RAM", (unsigned long) slots, pool->name,
+                 (unsigned long) (slots * pool->slot_size));
+    }
+
+    // Two tasks may race for the first allocation, the loser frees its copy
+    atomic_store(&pool->slots, slots);
+    uint8_t * expected = NULL;
+    if (!atomic_compare_exchange_strong(&pool->storage, &expected, storage)) {
+        free(storage);
+        return expected;
+    }
+    return storage;
+}
+
+static int take_slot(slot_pool * pool)
+{
+    uint32_t slots = atomic_load(&pool->slots);
+    for (uint32_t word = 0; word * 32 < slots; word++) {
+        uint32_t word_slots = slots - word * 32;
+        uint32_t all = word_slots >= 32 ? UINT32_MAX : (1U << word_slots) - 1;
+        unsigned int used = atomic_load(&pool->used[word]);
+        while (true) {
+            uint32_t free_mask = ~used & all;
+            if (free_mask == 0) {
+                break;
+            }
+            int bit = __builtin_ctz(free_mask);
+            if (atomic_compare_exchange_weak(&pool->used[word], &used, used | (1U << bit))) {
+                return word * 32 + bit;
+            }
+        }
+    }
+    return -1;
+}
+
+void * slot_pool_alloc(slot_pool * pool, size_t size)
+{
+    uint8_t * storage = NULL;
+    int index = -1;
+    if (size <= pool->slot_size && (storage = get_storage(pool)) != NULL) {
+        index = take_slot(pool);
+    }
+    if (index < 0) {
+        atomic_fetch_add(&pool->misses, 1);
+        return malloc(size);
+    }
+    atomic_fetch_add(&pool->hits, 1);
+
+    unsigned int in_use = atomic_fetch_add(&pool->in_use, 1) + 1;
+    unsigned int max = atomic_load(&pool->max_in_use);
+    while (in_use > max && !atomic_compare_exchange_weak(&pool->max_in_use, &max, in_use)) {
+    }
+    return storage + (size_t) index * pool->slot_size;
+}
+
+void slot_pool_free(slot_pool * pool, void * ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    uint8_t * storage = atomic_load(&pool->storage);
+    uint8_t * slot = ptr;
+    if (storage != NULL && slot >= storage && slot < storage + atomic_load(&pool->slots) * pool->slot_size) {
+        size_t index = (slot - storage) / pool->slot_size;
+        atomic_fetch_sub(&pool->in_use, 1);
+        atomic_fetch_and(&pool->used[index / 32], ~(1U << (index % 32)));
+        return;
+    }
+    free(ptr);
+}
+
+void slot_pool_get_stats(slot_pool * pool, slot_pool_stats * stats)
+{
+    stats->hits = atomic_load(&pool->hits);
+    stats->misses = atomic_load(&pool->misses);
+    stats->in_use = atomic_load(&pool->in_use);
+    stats->max_in_use = atomic_load(&pool->max_in_use);
+    stats->slots = atomic_load(&pool->storage) != NULL ? atomic_load(&pool->slots) : 0;
+}
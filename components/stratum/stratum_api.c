@@ -10,64 +10,103 @@
 #include "esp_ota_ops.h"
 #include "lwip/sockets.h"
 #include "utils.h"
+#include "line_buffer.h"
+#include "json_scanner.h"
+#include "notify_pool.h"
+#include "pool_tls.h"
 #include "esp_timer.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #define BUFFER_SIZE 1024
 #define MAX_EXTRANONCE_2_LEN 32
 static const char * TAG = "stratum_api";
 
-static char * json_rpc_buffer = NULL;
-static size_t json_rpc_buffer_size = 0;
-static int last_parsed_request_id = -1;
+static line_buffer_t json_rpc_buffer;
 
+// Stamped from the share submit task, answered from the stratum task. Only the requests of
+// the stratum task's session are timed, the standby and split sessions count their own ids.
+static pthread_mutex_t request_timings_lock = PTHREAD_MUTEX_INITIALIZER;
 static RequestTiming request_timings[MAX_REQUEST_IDS];
-static bool initialized = false;
+static int timed_socket = -1;
+static latency_histogram request_latency[STRATUM_REQUEST_METHODS];
 
-static void init_request_timings() {
-    if (!initialized) {
-        for (int i = 0; i < MAX_REQUEST_IDS; i++) {
-            request_timings[i].timestamp_us = 0;
-            request_timings[i].tracking = false;
-        }
-        initialized = true;
+void STRATUM_V1_stamp_tx(int socket, int request_id, stratum_request_method method)
+{
+    if (request_id < 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&request_timings_lock);
+    if (socket != timed_socket || socket < 0) {
+        pthread_mutex_unlock(&request_timings_lock);
+        return;
     }
+    RequestTiming *timing = &request_timings[request_id % MAX_REQUEST_IDS];
+    timing->request_id = request_id;
+    timing->method = method;
+    timing->timestamp_us = esp_timer_get_time();
+    timing->tracking = true;
+    pthread_mutex_unlock(&request_timings_lock);
 }
 
-static RequestTiming* get_request_timing(int request_id) {
-    if (request_id < 0) return NULL;
-    int index = request_id % MAX_REQUEST_IDS;
-    return &request_timings[index];
+double STRATUM_V1_get_response_time_ms(int request_id)
+{
+    if (request_id < 1) {
+        return -1.0;
+    }
+
+    int64_t now = esp_timer_get_time();
+    double response_time = -1.0;
+
+    pthread_mutex_lock(&request_timings_lock);
+    RequestTiming *timing = &request_timings[request_id % MAX_REQUEST_IDS];
+    // The slot may have been reused by a newer request that wrapped around
+    if (timing->tracking && timing->request_id == request_id) {
+        int64_t elapsed_us = now - timing->timestamp_us;
+        latency_histogram_record(&request_latency[timing->method], elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed_us);
+        timing->tracking = false;
+        response_time = elapsed_us / 1000.0;
+    }
+    pthread_mutex_unlock(&request_timings_lock);
+
+    return response_time;
 }
 
-void STRATUM_V1_stamp_tx(int request_id)
+double STRATUM_V1_record_response(const StratumApiV1Message *message)
 {
-    init_request_timings();
-    if (request_id >= 1) {
-        RequestTiming *timing = get_request_timing(request_id);
-        if (timing) {
-            timing->timestamp_us = esp_timer_get_time();
-            timing->tracking = true;
-        }
+    switch (message->method) {
+        case STRATUM_RESULT:
+        case STRATUM_RESULT_SETUP:
+        case STRATUM_RESULT_VERSION_MASK:
+        case STRATUM_RESULT_SUBSCRIBE:
+            return STRATUM_V1_get_response_time_ms(message->message_id);
+        default:
+            return -1.0;
     }
 }
 
-double STRATUM_V1_get_response_time_ms(int request_id)
+void STRATUM_V1_reset_request_timings(int socket)
 {
-    init_request_timings();
-    if (request_id < 0) return -1.0;
-    
-    RequestTiming *timing = get_request_timing(request_id);
-    if (!timing || !timing->tracking) {
-        return -1.0;
+    pthread_mutex_lock(&request_timings_lock);
+    timed_socket = socket;
+    for (int i = 0; i < MAX_REQUEST_IDS; i++) {
+        request_timings[i].tracking = false;
     }
-    
-    double response_time = (esp_timer_get_time() - timing->timestamp_us) / 1000.0;
-    timing->tracking = false;
-    return response_time;
+    pthread_mutex_unlock(&request_timings_lock);
+}
+
+void STRATUM_V1_get_latency_summary(stratum_request_method method, latency_summary * summary)
+{
+    pthread_mutex_lock(&request_timings_lock);
+    latency_histogram_summarize(&request_latency[method], summary);
+    pthread_mutex_unlock(&request_timings_lock);
 }
 
 static void debug_stratum_tx(const char *);
@@ -75,88 +114,323 @@ int _parse_stratum_subscribe_result_message(const char * result_json_str, char *
 
 void STRATUM_V1_initialize_buffer()
 {
-    json_rpc_buffer = malloc(BUFFER_SIZE);
-    json_rpc_buffer_size = BUFFER_SIZE;
-    if (json_rpc_buffer == NULL) {
-        printf("Error: Failed to allocate memory for buffer\n");
-        exit(1);
+    if (line_buffer_init(&json_rpc_buffer, LINE_BUFFER_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate memory for buffer");
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        esp_restart();
     }
-    memset(json_rpc_buffer, 0, BUFFER_SIZE);
 }
 
-void cleanup_stratum_buffer()
+const char * STRATUM_V1_receive_jsonrpc_line(int sockfd)
 {
-    free(json_rpc_buffer);
+    if (json_rpc_buffer.data == NULL) {
+        STRATUM_V1_initialize_buffer();
+    }
+
+    return STRATUM_V1_receive_line(sockfd, &json_rpc_buffer);
 }
 
-static void realloc_json_buffer(size_t len)
+const char * STRATUM_V1_receive_line(int sockfd, line_buffer_t * buffer)
 {
-    size_t old, new;
+    char * line;
+    while ((line = line_buffer_next_line(buffer, NULL)) == NULL) {
+        size_t available;
+        char * recv_buffer = line_buffer_write_ptr(buffer, &available);
+        if (recv_buffer == NULL) {
+            ESP_LOGE(TAG, "Error: stratum message exceeds %u bytes", (unsigned) buffer->capacity);
+            line_buffer_reset(buffer);
+            return NULL;
+        }
 
-    old = strlen(json_rpc_buffer);
-    new = old + len + 1;
+        int nbytes = pool_recv(sockfd, recv_buffer, available);
+        if (nbytes <= 0) {
+            if (nbytes == 0) {
+                ESP_LOGI(TAG, "Error: recv (connection closed by pool)");
+            } else {
+                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
+            }
+            line_buffer_reset(buffer);
+            return NULL;
+        }
 
-    if (new < json_rpc_buffer_size) {
-        return;
+        line_buffer_commit(buffer, nbytes);
     }
+    return line;
+}
 
-    new = new + (BUFFER_SIZE - (new % BUFFER_SIZE));
-    void * new_sockbuf = realloc(json_rpc_buffer, new);
+void STRATUM_V1_swap_buffer(line_buffer_t * buffer)
+{
+    line_buffer_t previous = json_rpc_buffer;
+    json_rpc_buffer = *buffer;
+    *buffer = previous;
+}
 
-    if (new_sockbuf == NULL) {
-        fprintf(stderr, "Error: realloc failed in recalloc_sock()\n");
-        ESP_LOGI(TAG, "Restarting System because of ERROR: realloc failed in recalloc_sock");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        esp_restart();
+static int json_valueint(double number)
+{
+    // Same conversion as cJSON's valueint
+    if (number >= INT_MAX) {
+        return INT_MAX;
+    } else if (number <= (double) INT_MIN) {
+        return INT_MIN;
     }
+    return (int) number;
+}
 
-    json_rpc_buffer = new_sockbuf;
-    memset(json_rpc_buffer + old, 0, new - old);
-    json_rpc_buffer_size = new;
+static bool parse_hex_u32(const char * hex, size_t len, uint32_t * value)
+{
+    if (len == 0 || len > 8) {
+        return false;
+    }
+    uint32_t result = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = hex[i];
+        uint32_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        result = (result << 4) | nibble;
+    }
+    *value = result;
+    return true;
 }
 
-char * STRATUM_V1_receive_jsonrpc_line(int sockfd)
+static void scanner_at(json_scanner_t * s, const char * value, const char * json_end)
 {
-    if (json_rpc_buffer == NULL) {
-        STRATUM_V1_initialize_buffer();
+    json_scanner_init(s, value, json_end - value);
+}
+
+static bool scan_notify_params(json_scanner_t * s, StratumApiV1Message * message)
+{
+    // job_id, prev_block_hash, coinbase_1, coinbase_2, merkle_branches, version, nbits, ntime
+    const char * fields[8];
+    size_t field_lens[8];
+    uint8_t merkle_branches[MAX_MERKLE_BRANCHES][HASH_SIZE];
+    size_t n_merkle_branches = 0;
+    bool last_is_true = false;
+    int index = 0;
+
+    if (!json_scanner_enter_array(s)) {
+        return false;
+    }
+    while (json_scanner_next(s)) {
+        last_is_true = false;
+        if (index == 4) {
+            if (!json_scanner_enter_array(s)) {
+                return false;
+            }
+            while (json_scanner_next(s)) {
+                const char * branch;
+                size_t branch_len;
+                if (n_merkle_branches == MAX_MERKLE_BRANCHES || !json_scanner_string(s, &branch, &branch_len) ||
+                    branch_len != HASH_SIZE * 2 || !hex_decode(branch, branch_len, merkle_branches[n_merkle_branches])) {
+                    return false;
+                }
+                n_merkle_branches++;
+            }
+            if (s->error) {
+                return false;
+            }
+        } else if (index < 8) {
+            if (!json_scanner_string(s, &fields[index], &field_lens[index])) {
+                return false;
+            }
+        } else {
+            last_is_true = json_scanner_peek(s) == JSON_TOKEN_TRUE;
+            if (!json_scanner_skip(s)) {
+                return false;
+            }
+        }
+        index++;
+    }
+    if (s->error || index < 8 || field_lens[1] != HASH_SIZE * 2) {
+        return false;
     }
-    char *line, *tok = NULL;
-    char recv_buffer[BUFFER_SIZE];
-    int nbytes;
-    size_t buflen = 0;
 
-    if (!strstr(json_rpc_buffer, "\n")) {
-        do {
-            memset(recv_buffer, 0, BUFFER_SIZE);
-            nbytes = recv(sockfd, recv_buffer, BUFFER_SIZE - 1, 0);
-            if (nbytes == -1) {
-                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
-                if (json_rpc_buffer) {
-                    free(json_rpc_buffer);
-                    json_rpc_buffer=0;
+    uint32_t version, target, ntime;
+    uint8_t prev_block_hash[HASH_SIZE];
+    if (!parse_hex_u32(fields[5], field_lens[5], &version) || !parse_hex_u32(fields[6], field_lens[6], &target) ||
+        !parse_hex_u32(fields[7], field_lens[7], &ntime) || !hex_decode(fields[1], field_lens[1], prev_block_hash)) {
+        return false;
+    }
+
+    mining_notify * new_work = notify_pool_alloc(fields, field_lens, merkle_branches[0], n_merkle_branches);
+    new_work->version = version;
+    new_work->target = target;
+    new_work->ntime = ntime;
+    // stratum v1 sends the previous block hash with its 32 bit words swapped
+    for (int i = 0; i < HASH_SIZE; i += 4) {
+        reverse_bytes(prev_block_hash + i, 4);
+    }
+    memcpy(new_work->prev_block_hash_bin, prev_block_hash, HASH_SIZE);
+
+    message->mining_notification = new_work;
+    message->should_abandon_work = last_is_true;
+    return true;
+}
+
+static bool scan_result(const char * result, const char * error, const char * reject_reason, const char * json_end,
+                        StratumApiV1Message * message, stratum_method * method)
+{
+    json_scanner_t s;
+    const char * str;
+    size_t len;
+
+    if (result == NULL) {
+        message->response_success = false;
+        message->error_str = strdup("unknown");
+        *method = STRATUM_UNKNOWN;
+        return true;
+    }
+
+    *method = message->message_id < 5 ? STRATUM_RESULT_SETUP : STRATUM_RESULT;
+
+    if (error != NULL) {
+        scanner_at(&s, error, json_end);
+        json_token_t token = json_scanner_peek(&s);
+        if (token != JSON_TOKEN_NULL) {
+            // [code, "message", data]
+            char * error_str = NULL;
+            if (token == JSON_TOKEN_ARRAY) {
+                json_scanner_enter_array(&s);
+                if (json_scanner_next(&s) && json_scanner_skip(&s) && json_scanner_next(&s) &&
+                    json_scanner_peek(&s) == JSON_TOKEN_STRING) {
+                    if (!json_scanner_string(&s, &str, &len)) {
+                        return false;
+                    }
+                    error_str = strndup(str, len);
+                } else if (s.error) {
+                    return false;
                 }
-                return 0;
             }
+            message->response_success = false;
+            message->error_str = error_str != NULL ? error_str : strdup("unknown");
+            return true;
+        }
+    }
 
-            realloc_json_buffer(nbytes);
-            strncat(json_rpc_buffer, recv_buffer, nbytes);
-        } while (!strstr(json_rpc_buffer, "\n"));
-    }
-    buflen = strlen(json_rpc_buffer);
-    tok = strtok(json_rpc_buffer, "\n");
-    line = strdup(tok);
-    int len = strlen(line);
-    if (buflen > len + 1)
-        memmove(json_rpc_buffer, json_rpc_buffer + len + 1, buflen - len + 1);
-    else
-        strcpy(json_rpc_buffer, "");
-    return line;
+    scanner_at(&s, result, json_end);
+    json_token_t token = json_scanner_peek(&s);
+    if (token == JSON_TOKEN_TRUE) {
+        message->response_success = true;
+        return true;
+    } else if (token == JSON_TOKEN_FALSE) {
+        char * error_str = NULL;
+        if (reject_reason != NULL) {
+            scanner_at(&s, reject_reason, json_end);
+            if (json_scanner_peek(&s) == JSON_TOKEN_STRING) {
+                if (!json_scanner_string(&s, &str, &len)) {
+                    return false;
+                }
+                error_str = strndup(str, len);
+            }
+        }
+        message->response_success = false;
+        message->error_str = error_str != NULL ? error_str : strdup("unknown");
+        return true;
+    }
+
+    // subscribe and configure results are left to cJSON
+    return false;
 }
 
-void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
+// Single pass over the line for the messages seen on every job and share, without building a cJSON tree.
+// Returns false for anything else, the message is then parsed again by parse_with_cjson.
+static bool parse_with_scanner(StratumApiV1Message * message, const char * stratum_json)
 {
-    ESP_LOGI(TAG, "rx: %s", stratum_json); // debug incoming stratum messages
+    const char * json_end = stratum_json + strlen(stratum_json);
+    json_scanner_t s;
+    json_scanner_init(&s, stratum_json, json_end - stratum_json);
+
+    int64_t parsed_id = -1;
+    const char * method = NULL;
+    size_t method_len = 0;
+    const char * params = NULL;
+    const char * result = NULL;
+    const char * error = NULL;
+    const char * reject_reason = NULL;
+
+    if (!json_scanner_enter_object(&s)) {
+        return false;
+    }
+    while (json_scanner_next(&s)) {
+        const char * key;
+        size_t key_len;
+        if (!json_scanner_key(&s, &key, &key_len)) {
+            return false;
+        }
+        json_token_t token = json_scanner_peek(&s);
+
+        if (json_scanner_equals(key, key_len, "id") && token == JSON_TOKEN_NUMBER) {
+            double id;
+            if (!json_scanner_number(&s, &id)) {
+                return false;
+            }
+            parsed_id = json_valueint(id);
+            continue;
+        } else if (json_scanner_equals(key, key_len, "method") && token == JSON_TOKEN_STRING && method == NULL) {
+            if (!json_scanner_string(&s, &method, &method_len)) {
+                return false;
+            }
+            continue;
+        } else if (json_scanner_equals(key, key_len, "params") && params == NULL) {
+            params = s.pos;
+        } else if (json_scanner_equals(key, key_len, "result") && result == NULL) {
+            result = s.pos;
+        } else if (json_scanner_equals(key, key_len, "error") && error == NULL) {
+            error = s.pos;
+        } else if (json_scanner_equals(key, key_len, "reject-reason") && reject_reason == NULL) {
+            reject_reason = s.pos;
+        }
+
+        if (!json_scanner_skip(&s)) {
+            return false;
+        }
+    }
+    if (s.error) {
+        return false;
+    }
+
+    message->message_id = parsed_id;
+    stratum_method parsed_method;
+
+    if (method != NULL) {
+        if (params == NULL) {
+            return false;
+        }
+        json_scanner_t p;
+        scanner_at(&p, params, json_end);
 
+        if (json_scanner_equals(method, method_len, "mining.notify")) {
+            if (!scan_notify_params(&p, message)) {
+                return false;
+            }
+            parsed_method = MINING_NOTIFY;
+        } else if (json_scanner_equals(method, method_len, "mining.set_difficulty")) {
+            double difficulty;
+            if (!json_scanner_enter_array(&p) || !json_scanner_next(&p) || !json_scanner_number(&p, &difficulty)) {
+                return false;
+            }
+            message->new_difficulty = json_valueint(difficulty);
+            parsed_method = MINING_SET_DIFFICULTY;
+        } else {
+            return false;
+        }
+    } else if (!scan_result(result, error, reject_reason, json_end, message, &parsed_method)) {
+        return false;
+    }
+
+    message->method = parsed_method;
+    return true;
+}
+
+static void parse_with_cjson(StratumApiV1Message * message, const char * stratum_json)
+{
     cJSON * json = cJSON_Parse(stratum_json);
 
     cJSON * id_json = cJSON_GetObjectItem(json, "id");
@@ -164,7 +438,6 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
     if (id_json != NULL && cJSON_IsNumber(id_json)) {
         parsed_id = id_json->valueint;
     }
-    last_parsed_request_id = parsed_id;
     message->message_id = parsed_id;
 
     cJSON * method_json = cJSON_GetObjectItem(json, "method");
@@ -245,10 +518,13 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
                 goto done;
             }
             int extranonce_2_len = extranonce2_len_json->valueint;
-            if (extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
-                ESP_LOGW(TAG, "Extranonce_2_len %d exceeds maximum %d, clamping to maximum", 
-                         extranonce_2_len, MAX_EXTRANONCE_2_LEN);
-                extranonce_2_len = MAX_EXTRANONCE_2_LEN;
+            if (extranonce_2_len < 1 || extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
+                ESP_LOGE(TAG, "Extranonce_2_len %d outside 1 to %d, ignoring the subscribe result", extranonce_2_len,
+                         MAX_EXTRANONCE_2_LEN);
+                message->response_success = false;
+                result = STRATUM_UNKNOWN;
+                message->method = result;
+                goto done;
             }
             message->extranonce_2_len = extranonce_2_len;
 
@@ -279,28 +555,45 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
     if (message->method == MINING_NOTIFY) {
 
-        mining_notify * new_work = malloc(sizeof(mining_notify));
-        // new_work->difficulty = difficulty;
         cJSON * params = cJSON_GetObjectItem(json, "params");
-        new_work->job_id = strdup(cJSON_GetArrayItem(params, 0)->valuestring);
-        new_work->prev_block_hash = strdup(cJSON_GetArrayItem(params, 1)->valuestring);
-        new_work->coinbase_1 = strdup(cJSON_GetArrayItem(params, 2)->valuestring);
-        new_work->coinbase_2 = strdup(cJSON_GetArrayItem(params, 3)->valuestring);
+        const char * strings[NOTIFY_STRING_FIELDS];
+        size_t lengths[NOTIFY_STRING_FIELDS];
+        for (int i = 0; i < NOTIFY_STRING_FIELDS; i++) {
+            strings[i] = cJSON_GetArrayItem(params, i)->valuestring;
+            lengths[i] = strlen(strings[i]);
+        }
 
         cJSON * merkle_branch = cJSON_GetArrayItem(params, 4);
-        new_work->n_merkle_branches = cJSON_GetArraySize(merkle_branch);
-        if (new_work->n_merkle_branches > MAX_MERKLE_BRANCHES) {
+        size_t n_merkle_branches = cJSON_GetArraySize(merkle_branch);
+        if (n_merkle_branches > MAX_MERKLE_BRANCHES) {
             printf("Too many Merkle branches.\n");
             abort();
         }
-        new_work->merkle_branches = malloc(HASH_SIZE * new_work->n_merkle_branches);
-        for (size_t i = 0; i < new_work->n_merkle_branches; i++) {
-            hex2bin(cJSON_GetArrayItem(merkle_branch, i)->valuestring, new_work->merkle_branches + HASH_SIZE * i, HASH_SIZE);
+        uint8_t merkle_branches[MAX_MERKLE_BRANCHES][HASH_SIZE];
+        for (size_t i = 0; i < n_merkle_branches; i++) {
+            const char * branch = cJSON_GetArrayItem(merkle_branch, i)->valuestring;
+            if (strlen(branch) != HASH_SIZE * 2 || !hex_decode(branch, HASH_SIZE * 2, merkle_branches[i])) {
+                ESP_LOGE(TAG, "Invalid merkle branch: %s", branch);
+                result = STRATUM_UNKNOWN;
+                message->method = result;
+                goto done;
+            }
         }
 
+        uint8_t prev_block_hash[HASH_SIZE];
+        if (lengths[1] != HASH_SIZE * 2 || !hex_decode(strings[1], HASH_SIZE * 2, prev_block_hash)) {
+            ESP_LOGE(TAG, "Invalid previous block hash: %s", strings[1]);
+            result = STRATUM_UNKNOWN;
+            message->method = result;
+            goto done;
+        }
+
+        mining_notify * new_work = notify_pool_alloc(strings, lengths, merkle_branches[0], n_merkle_branches);
+
         new_work->version = strtoul(cJSON_GetArrayItem(params, 5)->valuestring, NULL, 16);
         new_work->target = strtoul(cJSON_GetArrayItem(params, 6)->valuestring, NULL, 16);
         new_work->ntime = strtoul(cJSON_GetArrayItem(params, 7)->valuestring, NULL, 16);
+        swap_endian_words(new_work->prev_block_hash, new_work->prev_block_hash_bin);
 
         message->mining_notification = new_work;
 
@@ -319,11 +612,12 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
     } else if (message->method == MINING_SET_EXTRANONCE) {
         cJSON * params = cJSON_GetObjectItem(json, "params");
         char * extranonce_str = cJSON_GetArrayItem(params, 0)->valuestring;
-        uint32_t extranonce_2_len = cJSON_GetArrayItem(params, 1)->valueint;
-        if (extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
-            ESP_LOGW(TAG, "Extranonce_2_len %u exceeds maximum %d, clamping to maximum", 
-                     extranonce_2_len, MAX_EXTRANONCE_2_LEN);
-            extranonce_2_len = MAX_EXTRANONCE_2_LEN;
+        int extranonce_2_len = cJSON_GetArrayItem(params, 1)->valueint;
+        if (extranonce_2_len < 1 || extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
+            ESP_LOGE(TAG, "Extranonce_2_len %d outside 1 to %d, ignoring mining.set_extranonce", extranonce_2_len,
+                     MAX_EXTRANONCE_2_LEN);
+            message->method = STRATUM_UNKNOWN;
+            goto done;
         }
         message->extranonce_str = strdup(extranonce_str);
         message->extranonce_2_len = extranonce_2_len;
@@ -332,14 +626,18 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
     cJSON_Delete(json);
 }
 
+void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
+{
+    ESP_LOGI(TAG, "rx: %s", stratum_json); // debug incoming stratum messages
+
+    if (!parse_with_scanner(message, stratum_json)) {
+        parse_with_cjson(message, stratum_json);
+    }
+}
+
 void STRATUM_V1_free_mining_notify(mining_notify * params)
 {
-    free(params->job_id);
-    free(params->prev_block_hash);
-    free(params->coinbase_1);
-    free(params->coinbase_2);
-    free(params->merkle_branches);
-    free(params);
+    notify_pool_free(params);
 }
 
 int _parse_stratum_subscribe_result_message(const char * result_json_str, char ** extranonce, int * extranonce2_len)
@@ -361,6 +659,11 @@ int _parse_stratum_subscribe_result_message(const char * result_json_str, char *
         return -1;
     }
     *extranonce2_len = extranonce2_len_json->valueint;
+    if (*extranonce2_len < 1 || *extranonce2_len > MAX_EXTRANONCE_2_LEN) {
+        ESP_LOGE(TAG, "Extranonce_2_len %d outside 1 to %d", *extranonce2_len, MAX_EXTRANONCE_2_LEN);
+        cJSON_Delete(root);
+        return -1;
+    }
 
     cJSON * extranonce_json = cJSON_GetArrayItem(result, 1);
     if (extranonce_json == NULL) {
@@ -382,17 +685,19 @@ int STRATUM_V1_subscribe(int socket, int send_uid, const char * model)
     const char *version = app_desc->version;	
     sprintf(subscribe_msg, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"bitaxe/%s/%s\"]}\n", send_uid, model, version);
     debug_stratum_tx(subscribe_msg);
+    STRATUM_V1_stamp_tx(socket, send_uid, STRATUM_REQUEST_SUBSCRIBE);
 
-    return write(socket, subscribe_msg, strlen(subscribe_msg));
+    return pool_send(socket, subscribe_msg, strlen(subscribe_msg));
 }
 
 int STRATUM_V1_suggest_difficulty(int socket, int send_uid, uint32_t difficulty)
 {
     char difficulty_msg[BUFFER_SIZE];
-    sprintf(difficulty_msg, "{\"id\": %d, \"method\": \"mining.suggest_difficulty\", \"params\": [%ld]}\n", send_uid, difficulty);
+    sprintf(difficulty_msg, "{\"id\": %d, \"method\": \"mining.suggest_difficulty\", \"params\": [%" PRIu32 "]}\n", send_uid, difficulty);
     debug_stratum_tx(difficulty_msg);
+    STRATUM_V1_stamp_tx(socket, send_uid, STRATUM_REQUEST_OTHER);
 
-    return write(socket, difficulty_msg, strlen(difficulty_msg));
+    return pool_send(socket, difficulty_msg, strlen(difficulty_msg));
 }
 
 int STRATUM_V1_extranonce_subscribe(int socket, int send_uid)
@@ -400,8 +705,9 @@ int STRATUM_V1_extranonce_subscribe(int socket, int send_uid)
     char extranonce_msg[BUFFER_SIZE];
     sprintf(extranonce_msg, "{\"id\": %d, \"method\": \"mining.extranonce.subscribe\", \"params\": []}\n", send_uid);
     debug_stratum_tx(extranonce_msg);
+    STRATUM_V1_stamp_tx(socket, send_uid, STRATUM_REQUEST_OTHER);
 
-    return write(socket, extranonce_msg, strlen(extranonce_msg));
+    return pool_send(socket, extranonce_msg, strlen(extranonce_msg));
 }
 
 int STRATUM_V1_authorize(int socket, int send_uid, const char * username, const char * pass)
@@ -410,8 +716,134 @@ int STRATUM_V1_authorize(int socket, int send_uid, const char * username, const
     sprintf(authorize_msg, "{\"id\": %d, \"method\": \"mining.authorize\", \"params\": [\"%s\", \"%s\"]}\n", send_uid, username,
             pass);
     debug_stratum_tx(authorize_msg);
+    STRATUM_V1_stamp_tx(socket, send_uid, STRATUM_REQUEST_AUTHORIZE);
+
+    return pool_send(socket, authorize_msg, strlen(authorize_msg));
+}
+
+int STRATUM_V1_format_submit(char * buffer, size_t size, int send_uid, const char * username, const char * job_id,
+                             const char * extranonce_2, const uint32_t ntime,
+                             const uint32_t nonce, const uint32_t version_bits)
+{
+    return snprintf(buffer, size,
+                    "{\"id\": %d, \"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%08lx\", \"%08lx\", \"%08lx\"]}\n",
+                    send_uid, username, job_id, extranonce_2, ntime, nonce, version_bits);
+}
+
+// The id comes last so everything before it has a fixed layout:
+// {"method": "mining.submit", "params": ["<user>", "<job>", "<extranonce2>", "<ntime>", "<nonce>", "<version>"], "id": <id>}
+#define SUBMIT_TEMPLATE_TAIL "\"], \"id\": "
+#define SUBMIT_FIELD_SEPARATOR "\", \""
+#define SUBMIT_HEX_LEN 8
+
+struct stratum_submit_template
+{
+    atomic_uint refs;
+    size_t len;
+    size_t ntime_offset;
+    size_t nonce_offset;
+    size_t version_offset;
+    char line[];
+};
+
+static slot_pool submit_template_pool = SLOT_POOL_INITIALIZER("submit template", STRATUM_SUBMIT_TEMPLATE_SLOT_SIZE,
+                                                              STRATUM_SUBMIT_TEMPLATE_SLOTS, STRATUM_SUBMIT_TEMPLATE_INTERNAL_SLOTS);
+
+static char * put_string(char * dest, const char * src, size_t len)
+{
+    memcpy(dest, src, len);
+    return dest + len;
+}
 
-    return write(socket, authorize_msg, strlen(authorize_msg));
+stratum_submit_template * STRATUM_V1_create_submit_template(const char * username, const char * job_id, const uint8_t * extranonce_2,
+                                                            size_t extranonce_2_len)
+{
+    static const char head[] = "{\"method\": \"mining.submit\", \"params\": [\"";
+    static const char tail[] = "00000000" SUBMIT_FIELD_SEPARATOR "00000000" SUBMIT_FIELD_SEPARATOR "00000000" SUBMIT_TEMPLATE_TAIL;
+    static const char digits[] = "0123456789abcdef";
+    const size_t separator_len = strlen(SUBMIT_FIELD_SEPARATOR);
+    size_t username_len = strlen(username);
+    size_t job_id_len = strlen(job_id);
+
+    // Called for every job, so no snprintf
+    size_t len = strlen(head) + username_len + separator_len + job_id_len + separator_len + extranonce_2_len * 2 + separator_len +
+                 strlen(tail);
+    stratum_submit_template * tmpl = slot_pool_alloc(&submit_template_pool, sizeof(stratum_submit_template) + len + 1);
+    if (tmpl == NULL) {
+        return NULL;
+    }
+    char * dest = put_string(tmpl->line, head, strlen(head));
+    dest = put_string(dest, username, username_len);
+    dest = put_string(dest, SUBMIT_FIELD_SEPARATOR, separator_len);
+    dest = put_string(dest, job_id, job_id_len);
+    dest = put_string(dest, SUBMIT_FIELD_SEPARATOR, separator_len);
+    for (size_t i = 0; i < extranonce_2_len; i++) {
+        *dest++ = digits[extranonce_2[i] >> 4];
+        *dest++ = digits[extranonce_2[i] & 0xf];
+    }
+    dest = put_string(dest, SUBMIT_FIELD_SEPARATOR, separator_len);
+    dest = put_string(dest, tail, strlen(tail));
+    *dest = '\0';
+
+    atomic_init(&tmpl->refs, 1);
+    tmpl->len = len;
+    tmpl->version_offset = len - strlen(SUBMIT_TEMPLATE_TAIL) - SUBMIT_HEX_LEN;
+    tmpl->nonce_offset = tmpl->version_offset - separator_len - SUBMIT_HEX_LEN;
+    tmpl->ntime_offset = tmpl->nonce_offset - separator_len - SUBMIT_HEX_LEN;
+    return tmpl;
+}
+
+stratum_submit_template * STRATUM_V1_retain_submit_template(stratum_submit_template * tmpl)
+{
+    if (tmpl != NULL) {
+        atomic_fetch_add(&tmpl->refs, 1);
+    }
+    return tmpl;
+}
+
+void STRATUM_V1_release_submit_template(stratum_submit_template * tmpl)
+{
+    if (tmpl != NULL && atomic_fetch_sub(&tmpl->refs, 1) == 1) {
+        slot_pool_free(&submit_template_pool, tmpl);
+    }
+}
+
+void STRATUM_V1_get_submit_template_pool_stats(slot_pool_stats * stats)
+{
+    slot_pool_get_stats(&submit_template_pool, stats);
+}
+
+static void put_hex_u32(char * dest, uint32_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = SUBMIT_HEX_LEN - 1; i >= 0; i--) {
+        dest[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+}
+
+int STRATUM_V1_format_submit_template(char * buffer, size_t size, const stratum_submit_template * tmpl, int send_uid,
+                                      const uint32_t ntime, const uint32_t nonce, const uint32_t version_bits)
+{
+    char id[12];
+    int id_len = 0;
+    unsigned int uid = send_uid;
+    do {
+        id[sizeof(id) - 1 - id_len++] = '0' + uid % 10;
+        uid /= 10;
+    } while (uid > 0);
+
+    size_t len = tmpl->len + id_len + 2;
+    if (len >= size) {
+        return len;
+    }
+    memcpy(buffer, tmpl->line, tmpl->len);
+    put_hex_u32(buffer + tmpl->ntime_offset, ntime);
+    put_hex_u32(buffer + tmpl->nonce_offset, nonce);
+    put_hex_u32(buffer + tmpl->version_offset, version_bits);
+    memcpy(buffer + tmpl->len, id + sizeof(id) - id_len, id_len);
+    memcpy(buffer + tmpl->len + id_len, "}\n", 3);
+    return len;
 }
 
 /// @param socket Socket to write to
@@ -427,12 +859,11 @@ int STRATUM_V1_submit_share(int socket, int send_uid, const char * username, con
                             const uint32_t nonce, const uint32_t version_bits)
 {
     char submit_msg[BUFFER_SIZE];
-    sprintf(submit_msg,
-            "{\"id\": %d, \"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%08lx\", \"%08lx\", \"%08lx\"]}\n",
-            send_uid, username, job_id, extranonce_2, ntime, nonce, version_bits);
+    STRATUM_V1_format_submit(submit_msg, sizeof(submit_msg), send_uid, username, job_id, extranonce_2, ntime, nonce, version_bits);
     debug_stratum_tx(submit_msg);
+    STRATUM_V1_stamp_tx(socket, send_uid, STRATUM_REQUEST_SUBMIT);
 
-    return write(socket, submit_msg, strlen(submit_msg));
+    return pool_send(socket, submit_msg, strlen(submit_msg));
 }
 
 int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * version_mask)
@@ -443,13 +874,13 @@ int STRATUM_V1_configure_version_rolling(int socket, int send_uid, uint32_t * ve
             "\"ffffffff\"}]}\n",
             send_uid);
     debug_stratum_tx(configure_msg);
+    STRATUM_V1_stamp_tx(socket, send_uid, STRATUM_REQUEST_OTHER);
 
-    return write(socket, configure_msg, strlen(configure_msg));
+    return pool_send(socket, configure_msg, strlen(configure_msg));
 }
 
 static void debug_stratum_tx(const char * msg)
 {
-    STRATUM_V1_stamp_tx(last_parsed_request_id);
     //remove the trailing newline
     char * newline = strchr(msg, '\n');
     if (newline != NULL) {
@@ -0,0 +1,337 @@
+#include "stratum_v2.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "pool_tls.h"
+#include "utils.h"
+
+static const char * TAG = "stratum_v2";
+
+static uint8_t frame_buffer[SV2_FRAME_HEADER_SIZE + SV2_MAX_PAYLOAD_SIZE];
+
+// truediffone == 0x00000000FFFF0000000000000000000000000000000000000000000000000000
+static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
+
+typedef struct
+{
+    uint8_t * data;
+    size_t size;
+    size_t len;
+    bool overflow;
+} sv2_writer;
+
+typedef struct
+{
+    const uint8_t * data;
+    size_t len;
+    size_t pos;
+    bool error;
+} sv2_reader;
+
+static void put_bytes(sv2_writer * w, const void * data, size_t len)
+{
+    if (w->overflow || w->len + len > w->size) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->data + w->len, data, len);
+    w->len += len;
+}
+
+static void put_uint(sv2_writer * w, uint64_t value, size_t bytes)
+{
+    uint8_t le[8];
+    for (size_t i = 0; i < bytes; i++) {
+        le[i] = value >> (8 * i);
+    }
+    put_bytes(w, le, bytes);
+}
+
+static void put_str0_255(sv2_writer * w, const char * str)
+{
+    size_t len = strlen(str);
+    if (len > 255) {
+        len = 255;
+    }
+    put_uint(w, len, 1);
+    put_bytes(w, str, len);
+}
+
+static void begin_frame(sv2_writer * w, uint8_t * buffer, size_t size, uint16_t extension_type, uint8_t msg_type)
+{
+    w->data = buffer;
+    w->size = size;
+    w->len = 0;
+    w->overflow = false;
+    put_uint(w, extension_type, 2);
+    put_uint(w, msg_type, 1);
+    put_uint(w, 0, 3);
+}
+
+static size_t end_frame(sv2_writer * w)
+{
+    if (w->overflow) {
+        return 0;
+    }
+    size_t payload_len = w->len - SV2_FRAME_HEADER_SIZE;
+    w->data[3] = payload_len;
+    w->data[4] = payload_len >> 8;
+    w->data[5] = payload_len >> 16;
+    return w->len;
+}
+
+static const uint8_t * get_bytes(sv2_reader * r, size_t len)
+{
+    if (r->error || r->pos + len > r->len) {
+        r->error = true;
+        return NULL;
+    }
+    const uint8_t * data = r->data + r->pos;
+    r->pos += len;
+    return data;
+}
+
+static uint64_t get_uint(sv2_reader * r, size_t bytes)
+{
+    const uint8_t * le = get_bytes(r, bytes);
+    uint64_t value = 0;
+    if (le != NULL) {
+        for (size_t i = 0; i < bytes; i++) {
+            value |= (uint64_t) le[i] << (8 * i);
+        }
+    }
+    return value;
+}
+
+static void get_u256(sv2_reader * r, uint8_t dest[32])
+{
+    const uint8_t * data = get_bytes(r, 32);
+    if (data != NULL) {
+        memcpy(dest, data, 32);
+    }
+}
+
+static void get_str0_255(sv2_reader * r, char dest[256])
+{
+    size_t len = get_uint(r, 1);
+    const uint8_t * data = get_bytes(r, len);
+    if (data != NULL) {
+        memcpy(dest, data, len);
+        dest[len] = '\0';
+    } else {
+        dest[0] = '\0';
+    }
+}
+
+size_t STRATUM_V2_encode_setup_connection(uint8_t * buffer, size_t size, uint32_t flags, const char * host, uint16_t port,
+                                          const char * vendor, const char * hardware_version, const char * firmware,
+                                          const char * device_id)
+{
+    sv2_writer w;
+    begin_frame(&w, buffer, size, 0, SV2_SETUP_CONNECTION);
+    put_uint(&w, SV2_PROTOCOL_MINING, 1);
+    put_uint(&w, SV2_PROTOCOL_VERSION, 2); // min_version
+    put_uint(&w, SV2_PROTOCOL_VERSION, 2); // max_version
+    put_uint(&w, flags, 4);
+    put_str0_255(&w, host);
+    put_uint(&w, port, 2);
+    put_str0_255(&w, vendor);
+    put_str0_255(&w, hardware_version);
+    put_str0_255(&w, firmware);
+    put_str0_255(&w, device_id);
+    return end_frame(&w);
+}
+
+size_t STRATUM_V2_encode_open_standard_channel(uint8_t * buffer, size_t size, uint32_t request_id, const char * user,
+                                               float nominal_hashrate, const uint8_t max_target[32])
+{
+    uint32_t hashrate_bits;
+    memcpy(&hashrate_bits, &nominal_hashrate, 4);
+
+    sv2_writer w;
+    begin_frame(&w, buffer, size, 0, SV2_OPEN_STANDARD_MINING_CHANNEL);
+    put_uint(&w, request_id, 4);
+    put_str0_255(&w, user);
+    put_uint(&w, hashrate_bits, 4);
+    put_bytes(&w, max_target, 32);
+    return end_frame(&w);
+}
+
+size_t STRATUM_V2_encode_submit_shares_standard(uint8_t * buffer, size_t size, uint32_t channel_id, uint32_t sequence_number,
+                                                uint32_t job_id, uint32_t nonce, uint32_t ntime, uint32_t version)
+{
+    sv2_writer w;
+    begin_frame(&w, buffer, size, SV2_CHANNEL_MSG_BIT, SV2_SUBMIT_SHARES_STANDARD);
+    put_uint(&w, channel_id, 4);
+    put_uint(&w, sequence_number, 4);
+    put_uint(&w, job_id, 4);
+    put_uint(&w, nonce, 4);
+    put_uint(&w, ntime, 4);
+    put_uint(&w, version, 4);
+    return end_frame(&w);
+}
+
+size_t STRATUM_V2_encode_new_mining_job(uint8_t * buffer, size_t size, uint32_t channel_id, uint32_t job_id, bool has_min_ntime,
+                                        uint32_t min_ntime, uint32_t version, const uint8_t merkle_root[32])
+{
+    sv2_writer w;
+    begin_frame(&w, buffer, size, SV2_CHANNEL_MSG_BIT, SV2_NEW_MINING_JOB);
+    put_uint(&w, channel_id, 4);
+    put_uint(&w, job_id, 4);
+    put_uint(&w, has_min_ntime, 1);
+    if (has_min_ntime) {
+        put_uint(&w, min_ntime, 4);
+    }
+    put_uint(&w, version, 4);
+    put_bytes(&w, merkle_root, 32);
+    return end_frame(&w);
+}
+
+size_t STRATUM_V2_encode_set_new_prev_hash(uint8_t * buffer, size_t size, uint32_t channel_id, uint32_t job_id,
+                                           const uint8_t prev_hash[32], uint32_t min_ntime, uint32_t nbits)
+{
+    sv2_writer w;
+    begin_frame(&w, buffer, size, SV2_CHANNEL_MSG_BIT, SV2_SET_NEW_PREV_HASH);
+    put_uint(&w, channel_id, 4);
+    put_uint(&w, job_id, 4);
+    put_bytes(&w, prev_hash, 32);
+    put_uint(&w, min_ntime, 4);
+    put_uint(&w, nbits, 4);
+    return end_frame(&w);
+}
+
+bool STRATUM_V2_parse(StratumApiV2Message * message, const uint8_t * frame, size_t len)
+{
+    if (len < SV2_FRAME_HEADER_SIZE) {
+        return false;
+    }
+
+    size_t payload_len = frame[3] | (frame[4] << 8) | (frame[5] << 16);
+    if (payload_len != len - SV2_FRAME_HEADER_SIZE) {
+        return false;
+    }
+
+    sv2_reader r = {.data = frame + SV2_FRAME_HEADER_SIZE, .len = payload_len};
+    message->msg_type = frame[2];
+    message->error_code[0] = '\0';
+
+    switch (message->msg_type) {
+        case SV2_SETUP_CONNECTION_SUCCESS:
+            message->used_version = get_uint(&r, 2);
+            message->flags = get_uint(&r, 4);
+            break;
+        case SV2_SETUP_CONNECTION_ERROR:
+            message->flags = get_uint(&r, 4);
+            get_str0_255(&r, message->error_code);
+            break;
+        case SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS: {
+            message->request_id = get_uint(&r, 4);
+            message->channel_id = get_uint(&r, 4);
+            get_u256(&r, message->target);
+            size_t prefix_len = get_uint(&r, 1);
+            if (prefix_len > sizeof(message->extranonce_prefix)) {
+                return false;
+            }
+            const uint8_t * prefix = get_bytes(&r, prefix_len);
+            if (prefix != NULL) {
+                memcpy(message->extranonce_prefix, prefix, prefix_len);
+            }
+            message->extranonce_prefix_len = prefix_len;
+            message->group_channel_id = get_uint(&r, 4);
+            break;
+        }
+        case SV2_OPEN_MINING_CHANNEL_ERROR:
+            message->request_id = get_uint(&r, 4);
+            get_str0_255(&r, message->error_code);
+            break;
+        case SV2_NEW_MINING_JOB:
+            message->channel_id = get_uint(&r, 4);
+            message->job_id = get_uint(&r, 4);
+            message->has_min_ntime = get_uint(&r, 1);
+            message->min_ntime = message->has_min_ntime ? get_uint(&r, 4) : 0;
+            message->version = get_uint(&r, 4);
+            get_u256(&r, message->merkle_root);
+            break;
+        case SV2_SET_NEW_PREV_HASH:
+            message->channel_id = get_uint(&r, 4);
+            message->job_id = get_uint(&r, 4);
+            get_u256(&r, message->prev_hash);
+            message->min_ntime = get_uint(&r, 4);
+            message->nbits = get_uint(&r, 4);
+            break;
+        case SV2_SET_TARGET:
+            message->channel_id = get_uint(&r, 4);
+            get_u256(&r, message->target);
+            break;
+        case SV2_SUBMIT_SHARES_SUCCESS:
+            message->channel_id = get_uint(&r, 4);
+            message->sequence_number = get_uint(&r, 4);
+            message->accepted_count = get_uint(&r, 4);
+            message->shares_sum = get_uint(&r, 8);
+            break;
+        case SV2_SUBMIT_SHARES_ERROR:
+            message->channel_id = get_uint(&r, 4);
+            message->sequence_number = get_uint(&r, 4);
+            get_str0_255(&r, message->error_code);
+            break;
+        case SV2_RECONNECT:
+            get_str0_255(&r, message->error_code);
+            message->port = get_uint(&r, 2);
+            break;
+        default:
+            ESP_LOGI(TAG, "unhandled message type 0x%02x (%u bytes)", message->msg_type, (unsigned) payload_len);
+            break;
+    }
+
+    return !r.error;
+}
+
+static bool recv_all(int sockfd, uint8_t * dest, size_t len)
+{
+    while (len > 0) {
+        int nbytes = pool_recv(sockfd, dest, len);
+        if (nbytes <= 0) {
+            if (nbytes == 0) {
+                ESP_LOGI(TAG, "Error: recv (connection closed by pool)");
+            } else {
+                ESP_LOGI(TAG, "Error: recv (errno %d: %s)", errno, strerror(errno));
+            }
+            return false;
+        }
+        dest += nbytes;
+        len -= nbytes;
+    }
+    return true;
+}
+
+const uint8_t * STRATUM_V2_receive_frame(int sockfd, size_t * len)
+{
+    if (!recv_all(sockfd, frame_buffer, SV2_FRAME_HEADER_SIZE)) {
+        return NULL;
+    }
+
+    size_t payload_len = frame_buffer[3] | (frame_buffer[4] << 8) | (frame_buffer[5] << 16);
+    if (payload_len > SV2_MAX_PAYLOAD_SIZE) {
+        ESP_LOGE(TAG, "Error: frame payload of %u bytes exceeds %d", (unsigned) payload_len, SV2_MAX_PAYLOAD_SIZE);
+        return NULL;
+    }
+
+    if (!recv_all(sockfd, frame_buffer + SV2_FRAME_HEADER_SIZE, payload_len)) {
+        return NULL;
+    }
+
+    *len = SV2_FRAME_HEADER_SIZE + payload_len;
+    return frame_buffer;
+}
+
+double STRATUM_V2_target_to_difficulty(const uint8_t target[32])
+{
+    double target_value = le256todouble(target);
+    if (target_value <= 0) {
+        return 0;
+    }
+    return truediffone / target_value;
+}
@@ -0,0 +1,43 @@
+#include "unity.h"
+#include "latency_histogram.h"
+
+TEST_CASE("Latency histogram percentiles", "[latency_histogram]")
+{
+    latency_histogram histogram;
+    latency_histogram_reset(&histogram);
+
+    TEST_ASSERT_EQUAL(0, latency_histogram_percentile(&histogram, 50));
+
+    // 1..1000 ms in microseconds
+    for (uint32_t i = 1; i <= 1000; i++) {
+        latency_histogram_record(&histogram, i * 1000);
+    }
+
+    latency_summary summary;
+    latency_histogram_summarize(&histogram, &summary);
+    TEST_ASSERT_EQUAL(1000, summary.count);
+    TEST_ASSERT_EQUAL(1000000, summary.max_us);
+    TEST_ASSERT_EQUAL(500500, summary.mean_us);
+
+    // Bucket bounds never undershoot and stay within a quarter octave
+    TEST_ASSERT_GREATER_OR_EQUAL(500000, summary.p50_us);
+    TEST_ASSERT_LESS_OR_EQUAL(625000, summary.p50_us);
+    TEST_ASSERT_GREATER_OR_EQUAL(900000, summary.p90_us);
+    TEST_ASSERT_LESS_OR_EQUAL(1000000, summary.p90_us);
+    TEST_ASSERT_EQUAL(1000000, summary.p99_us);
+    TEST_ASSERT_EQUAL(1000000, latency_histogram_percentile(&histogram, 100));
+}
+
+TEST_CASE("Latency histogram covers the full range", "[latency_histogram]")
+{
+    latency_histogram histogram;
+    latency_histogram_reset(&histogram);
+
+    latency_histogram_record(&histogram, 0);
+    latency_histogram_record(&histogram, 3);
+    latency_histogram_record(&histogram, UINT32_MAX);
+
+    TEST_ASSERT_EQUAL(0, latency_histogram_percentile(&histogram, 10));
+    TEST_ASSERT_EQUAL(3, latency_histogram_percentile(&histogram, 50));
+    TEST_ASSERT_EQUAL(UINT32_MAX, latency_histogram_percentile(&histogram, 99));
+}
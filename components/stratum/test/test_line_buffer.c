@@ -0,0 +1,163 @@
+#include "unity.h"
+#include "line_buffer.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include <string.h>
+
+static void feed(line_buffer_t * lb, const char * data, size_t len)
+{
+    size_t available;
+    char * dest = line_buffer_write_ptr(lb, &available);
+    TEST_ASSERT_NOT_NULL(dest);
+    TEST_ASSERT_GREATER_OR_EQUAL(len, available);
+    memcpy(dest, data, len);
+    line_buffer_commit(lb, len);
+}
+
+TEST_CASE("Line buffer frames lines split across chunks", "[line_buffer]")
+{
+    line_buffer_t lb = {};
+    TEST_ASSERT_EQUAL(ESP_OK, line_buffer_init(&lb, 4096));
+
+    feed(&lb, "{\"id\":1,", 8);
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+
+    feed(&lb, "\"result\":true}\n{\"id\":2}\r\n\n{\"id\"", 31);
+
+    size_t len;
+    char * line = line_buffer_next_line(&lb, &len);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":1,\"result\":true}", line);
+    TEST_ASSERT_EQUAL(22, len);
+
+    line = line_buffer_next_line(&lb, &len);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":2}", line);
+    TEST_ASSERT_EQUAL(8, len);
+
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+
+    feed(&lb, ":3}\n", 4);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":3}", line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_EQUAL(3, lb.lines);
+
+    line_buffer_free(&lb);
+}
+
+TEST_CASE("Line buffer keeps partial line when compacting", "[line_buffer]")
+{
+    line_buffer_t lb = {};
+    TEST_ASSERT_EQUAL(ESP_OK, line_buffer_init(&lb, 4096));
+
+    // A complete line followed by 500 bytes of the next one, leaving less than a segment of space
+    char chunk[3000];
+    memset(chunk, 'a', sizeof(chunk));
+    chunk[2499] = '\n';
+    feed(&lb, chunk, sizeof(chunk));
+    TEST_ASSERT_NOT_NULL(line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+
+    size_t available;
+    line_buffer_write_ptr(&lb, &available);
+    TEST_ASSERT_EQUAL(1, lb.compactions);
+    TEST_ASSERT_EQUAL(500, lb.tail);
+    TEST_ASSERT_EQUAL(4096 - 500, available);
+
+    feed(&lb, "bc\n", 3);
+    size_t len;
+    char * line = line_buffer_next_line(&lb, &len);
+    TEST_ASSERT_NOT_NULL(line);
+    TEST_ASSERT_EQUAL(502, len);
+    TEST_ASSERT_EQUAL('a', line[0]);
+    TEST_ASSERT_EQUAL_STRING("bc", line + 500);
+
+    line_buffer_free(&lb);
+}
+
+TEST_CASE("Line buffer rejects lines larger than its capacity", "[line_buffer]")
+{
+    line_buffer_t lb = {};
+    TEST_ASSERT_EQUAL(ESP_OK, line_buffer_init(&lb, 2048));
+
+    char chunk[1024];
+    memset(chunk, 'a', sizeof(chunk));
+    feed(&lb, chunk, sizeof(chunk));
+    feed(&lb, chunk, sizeof(chunk));
+    TEST_ASSERT_NULL(line_buffer_next_line(&lb, NULL));
+
+    size_t available;
+    TEST_ASSERT_NULL(line_buffer_write_ptr(&lb, &available));
+    TEST_ASSERT_EQUAL(0, available);
+
+    line_buffer_free(&lb);
+}
+
+TEST_CASE("Line buffer reports buffered lines without consuming them", "[line_buffer]")
+{
+    line_buffer_t lb = {};
+    TEST_ASSERT_EQUAL(ESP_OK, line_buffer_init(&lb, 4096));
+
+    TEST_ASSERT_FALSE(line_buffer_has_line(&lb));
+
+    // Keep-alive newlines alone are not a line
+    feed(&lb, "\r\n\n{\"id\":1", 10);
+    TEST_ASSERT_FALSE(line_buffer_has_line(&lb));
+
+    feed(&lb, "}\n{\"id\":2}\n", 11);
+    TEST_ASSERT_TRUE(line_buffer_has_line(&lb));
+    TEST_ASSERT_EQUAL_STRING("{\"id\":1}", line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_TRUE(line_buffer_has_line(&lb));
+    TEST_ASSERT_EQUAL_STRING("{\"id\":2}", line_buffer_next_line(&lb, NULL));
+    TEST_ASSERT_FALSE(line_buffer_has_line(&lb));
+
+    line_buffer_free(&lb);
+}
+
+// Captured from a pool session: set_difficulty, a clean notify with 12 merkle branches and a share result
+static const char * captured_traffic =
+    "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[1638]}\n"
+    "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+    "[\"1b4c3d9041\","
+    "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+    "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+    "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+    "\"20000004\",\"1705c739\",\"64495522\",true]}\n"
+    "{\"id\":5,\"error\":null,\"result\":true}\n";
+
+TEST_CASE("Line buffer replay throughput", "[line_buffer][benchmark]")
+{
+    const int iterations = 2000;
+    const size_t segment = 1460; // TCP MSS
+    size_t traffic_len = strlen(captured_traffic);
+
+    line_buffer_t lb = {};
+    TEST_ASSERT_EQUAL(ESP_OK, line_buffer_init(&lb, LINE_BUFFER_SIZE));
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    int64_t start = esp_timer_get_time();
+
+    uint32_t lines = 0;
+    for (int i = 0; i < iterations; i++) {
+        for (size_t offset = 0; offset < traffic_len; offset += segment) {
+            size_t len = traffic_len - offset < segment ? traffic_len - offset : segment;
+            feed(&lb, captured_traffic + offset, len);
+            while (line_buffer_next_line(&lb, NULL) != NULL) {
+                lines++;
+            }
+        }
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+
+    TEST_ASSERT_EQUAL(iterations * 3, lines);
+    TEST_ASSERT_EQUAL(free_before, free_after);
+
+    double bytes_per_s = (double) lb.bytes_received * 1000000.0 / (elapsed_us > 0 ? elapsed_us : 1);
+    printf("line buffer: %lu lines, %llu bytes in %lld us (%.0f bytes/s), %.2f heap bytes/line, %lu compactions\n",
+           (unsigned long) lines, (unsigned long long) lb.bytes_received, (long long) elapsed_us, bytes_per_s,
+           (double) ((int64_t) free_before - (int64_t) free_after) / lines, (unsigned long) lb.compactions);
+
+    line_buffer_free(&lb);
+}
@@ -1,8 +1,11 @@
 #include "unity.h"
 #include "mining.h"
 #include "utils.h"
+#include "esp_timer.h"
 
 #include <limits.h>
+#include <stdio.h>
+#include <string.h>
 
 TEST_CASE("Check coinbase tx construction", "[mining]")
 {
@@ -150,7 +153,7 @@ TEST_CASE("Test nonce diff checking", "[mining test_nonce][not-on-qemu]")
     bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000);
 
     uint32_t nonce = 0x276E8947;
-    double diff = test_nonce_value(&job, nonce, 0);
+    double diff = test_nonce_value(&job, NULL, nonce, 0);
     TEST_ASSERT_EQUAL_INT(18, (int)diff);
 }
 
@@ -187,6 +190,496 @@ TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
     bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 1000);
 
     uint32_t nonce = 0x0a029ed1;
-    double diff = test_nonce_value(&job, nonce, 0);
+    double diff = test_nonce_value(&job, NULL, nonce, 0);
     TEST_ASSERT_EQUAL_INT(683, (int)diff);
 }
+
+static const char *template_branches[] = {
+    "ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81",
+    "980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21",
+    "a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52",
+    "7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2",
+};
+
+TEST_CASE("Coinbase template matches the hex coinbase", "[mining]")
+{
+    // The second coinbase_1 is longer than a sha256 block, so the cached state has whole blocks and a partial one
+    const char *coinbases[][3] = {
+        {"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008",
+         "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000", "e9695791"},
+        {"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000",
+         "41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000", "2a010000"},
+    };
+    const uint32_t extranonce_2_lens[] = {4, 8};
+    const uint64_t extranonce_2_values[] = {0, 1, 0x99999999, 0x0123456789abcdefULL};
+
+    uint8_t merkles[4][32];
+    for (int i = 0; i < 4; i++) {
+        hex2bin(template_branches[i], merkles[i], 32);
+    }
+
+    for (int c = 0; c < 2; c++) {
+        for (int l = 0; l < 2; l++) {
+            uint32_t len = extranonce_2_lens[l];
+            coinbase_template tmpl;
+            TEST_ASSERT_TRUE(coinbase_template_init(&tmpl, coinbases[c][0], coinbases[c][1], coinbases[c][2], len));
+
+            for (int v = 0; v < 4; v++) {
+                char extranonce_2[len * 2 + 1];
+                uint8_t extranonce_2_bin[len];
+                extranonce_2_generate(extranonce_2_values[v], len, extranonce_2);
+                extranonce_2_generate_bin(extranonce_2_values[v], len, extranonce_2_bin);
+
+                char *coinbase_tx = construct_coinbase_tx(coinbases[c][0], coinbases[c][1], coinbases[c][2], extranonce_2);
+                char expected[65];
+                calculate_merkle_root_hash(coinbase_tx, merkles, 4, expected);
+                free(coinbase_tx);
+
+                uint8_t merkle_root[32];
+                char merkle_root_hex[65];
+                coinbase_template_hash(&tmpl, extranonce_2_bin, merkle_root);
+                calculate_merkle_root_bin(merkle_root, merkles, 4, merkle_root);
+                bin2hex(merkle_root, 32, merkle_root_hex, sizeof(merkle_root_hex));
+                TEST_ASSERT_EQUAL_STRING(expected, merkle_root_hex);
+            }
+            coinbase_template_free(&tmpl);
+        }
+    }
+}
+
+TEST_CASE("Coinbase template job throughput", "[mining][benchmark]")
+{
+    mining_notify notify = {
+        .prev_block_hash = "ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000",
+        .coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000",
+        .coinbase_2 = "41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000",
+        .version = 0x20000004,
+        .target = 0x1705c739,
+        .ntime = 0x64495522,
+    };
+    const char *extranonce = "2a010000";
+    const uint32_t extranonce_2_len = 8;
+    const int iterations = 500;
+    uint8_t merkles[4][32];
+    for (int i = 0; i < 4; i++) {
+        hex2bin(template_branches[i], merkles[i], 32);
+    }
+    uint32_t checksum = 0;
+
+    // Job build as create_jobs_task did it: hex coinbase per job, decoded and hashed from byte 0
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        char extranonce_2[extranonce_2_len * 2 + 1];
+        extranonce_2_generate(i, extranonce_2_len, extranonce_2);
+        char *coinbase_tx = construct_coinbase_tx(notify.coinbase_1, notify.coinbase_2, extranonce, extranonce_2);
+        char merkle_root[65];
+        calculate_merkle_root_hash(coinbase_tx, merkles, 4, merkle_root);
+        free(coinbase_tx);
+        bm_job job = construct_bm_job(&notify, merkle_root, STRATUM_DEFAULT_VERSION_MASK, 1000);
+        checksum += job.midstate[0];
+    }
+    int64_t hex_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    coinbase_template tmpl;
+    TEST_ASSERT_TRUE(coinbase_template_init(&tmpl, notify.coinbase_1, notify.coinbase_2, extranonce, extranonce_2_len));
+    uint8_t prev_block_hash[32];
+    swap_endian_words(notify.prev_block_hash, prev_block_hash);
+    for (int i = 0; i < iterations; i++) {
+        uint8_t extranonce_2[extranonce_2_len];
+        extranonce_2_generate_bin(i, extranonce_2_len, extranonce_2);
+        uint8_t merkle_root[32];
+        coinbase_template_hash(&tmpl, extranonce_2, merkle_root);
+        calculate_merkle_root_bin(merkle_root, merkles, 4, merkle_root);
+        bm_job job = construct_bm_job_from_header(notify.version, prev_block_hash, merkle_root, notify.ntime, notify.target,
+                                                  STRATUM_DEFAULT_VERSION_MASK, 1000);
+        checksum -= job.midstate[0];
+    }
+    coinbase_template_free(&tmpl);
+    int64_t template_us = esp_timer_get_time() - start;
+
+    printf("job build: hex coinbase %.0f jobs/s, coinbase template %.0f jobs/s\n", iterations * 1e6 / hex_us,
+           iterations * 1e6 / template_us);
+    TEST_ASSERT_EQUAL_UINT32(0, checksum);
+#if SHA256_LANES_VECTOR
+    // Without the prefix state only the hex round trip is saved, the printed numbers are the measurement
+    TEST_ASSERT_LESS_THAN(hex_us, template_us);
+#endif
+}
+
+// The word swap as the job builder did it per job before the notify carried the binary hash
+static void swap_endian_words_sscanf(const char *hex_words, uint8_t output[32])
+{
+    for (size_t i = 0; i < 32; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            unsigned int byte_val;
+            sscanf(hex_words + (i + j) * 2, "%2x", &byte_val);
+            output[i + (3 - j)] = byte_val;
+        }
+    }
+}
+
+TEST_CASE("Job construction without hex round trips", "[mining][benchmark]")
+{
+    const char *prev_block_hash = "ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000";
+    const char *user = "bc1qexampleaddressexampleaddressexample.bitaxe";
+    const char *job_id = "1b4c3d9041";
+    const uint32_t extranonce_2_len = 8;
+    const int iterations = 2000;
+    uint8_t merkle_root[32];
+    hex2bin(template_branches[0], merkle_root, 32);
+    uint32_t checksum = 0;
+    size_t line_bytes = 0;
+
+    // Everything around the hashing: extranonce_2, merkle root and prev hash through hex, submit line by snprintf.
+    // Only one midstate so the hashing does not hide the rest.
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        char extranonce_2[extranonce_2_len * 2 + 1];
+        extranonce_2_generate(i, extranonce_2_len, extranonce_2);
+        char merkle_root_hex[65];
+        bin2hex(merkle_root, 32, merkle_root_hex, sizeof(merkle_root_hex));
+        uint8_t merkle_root_bin[32];
+        hex2bin(merkle_root_hex, merkle_root_bin, 32);
+        uint8_t prev_block_hash_bin[32];
+        swap_endian_words_sscanf(prev_block_hash, prev_block_hash_bin);
+        bm_job job = construct_bm_job_from_header(0x20000004, prev_block_hash_bin, merkle_root_bin, 0x64495522, 0x1705c739, 0, 1000);
+        char line[256];
+        int len = snprintf(line, sizeof(line), "{\"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"00000000\", "
+                           "\"00000000\", \"00000000\"], \"id\": ", user, job_id, extranonce_2);
+        checksum += job.midstate[0];
+        line_bytes += len;
+    }
+    int64_t hex_us = esp_timer_get_time() - start;
+
+    uint8_t prev_block_hash_bin[32];
+    swap_endian_words(prev_block_hash, prev_block_hash_bin);
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        uint8_t extranonce_2[extranonce_2_len];
+        extranonce_2_generate_bin(i, extranonce_2_len, extranonce_2);
+        bm_job job = construct_bm_job_from_header(0x20000004, prev_block_hash_bin, merkle_root, 0x64495522, 0x1705c739, 0, 1000);
+        stratum_submit_template *tmpl = STRATUM_V1_create_submit_template(user, job_id, extranonce_2, extranonce_2_len);
+        char line[256];
+        int len = STRATUM_V1_format_submit_template(line, sizeof(line), tmpl, 1, 0, 0, 0);
+        checksum -= job.midstate[0];
+        line_bytes += len;
+        STRATUM_V1_release_submit_template(tmpl);
+    }
+    int64_t binary_us = esp_timer_get_time() - start;
+
+    printf("job construction: hex %.2f us/job, binary %.2f us/job (%u)\n", (double) hex_us / iterations,
+           (double) binary_us / iterations, (unsigned) line_bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, checksum);
+}
+
+// Nonce check as it was done before the first block state was kept: two sha256 over the whole header
+static double full_header_nonce_value(const bm_job *job, uint32_t nonce, uint32_t rolled_version)
+{
+    uint8_t header[80];
+    memcpy(header, &rolled_version, 4);
+    memcpy(header + 4, job->prev_block_hash, 32);
+    memcpy(header + 36, job->merkle_root, 32);
+    memcpy(header + 68, &job->ntime, 4);
+    memcpy(header + 72, &job->target, 4);
+    memcpy(header + 76, &nonce, 4);
+
+    uint8_t hash[32];
+    double_sha256_bin(header, 80, hash);
+    return 26959535291011309493156476344723991336010898738574164086137773096960.0 / le256todouble(hash);
+}
+
+static bm_job nonce_check_job(void)
+{
+    mining_notify notify_message;
+    notify_message.prev_block_hash = "d02b10fc0d4711eae1a805af50a8a83312a2215e00017f2b0000000000000000";
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x646ff1a9;
+    return construct_bm_job(&notify_message, "6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9", 0, 1000);
+}
+
+TEST_CASE("Nonce check from the first block state", "[mining test_nonce]")
+{
+    bm_job job = nonce_check_job();
+    const bm_job queued = job;
+    nonce_verify_cache cache = {0};
+    TEST_ASSERT_EQUAL_INT(18, (int) test_nonce_value(&job, &cache, 0x276E8947, 0x20000004));
+
+    // More versions than the cache keeps states for, and back to the first ones after they were replaced
+    uint32_t version = 0x20000004;
+    for (int i = 0; i < 3 * NONCE_VERIFY_STATES; i++) {
+        for (uint32_t nonce = 0; nonce < 4; nonce++) {
+            uint32_t n = nonce * 0x9e3779b9 + i;
+            TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(&job, n, version), test_nonce_value(&job, &cache, n, version));
+            TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(&job, n, version), test_nonce_value(&job, NULL, n, version));
+        }
+        version = i == NONCE_VERIFY_STATES * 2 ? 0x20000004 : increment_bitmask(version, STRATUM_DEFAULT_VERSION_MASK);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(NONCE_VERIFY_STATES, cache.used);
+    // The job may be freed by ASIC_task while its nonces are checked, so checking never writes it
+    TEST_ASSERT_EQUAL_MEMORY(&queued, &job, sizeof(bm_job));
+
+    // The same cache handed the next job behind a job id starts over
+    bm_job next_job = job;
+    next_job.merkle_root[0] ^= 1;
+    TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(&next_job, 7, 0x20000004), test_nonce_value(&next_job, &cache, 7, 0x20000004));
+#if SHA256_LANES_VECTOR
+    TEST_ASSERT_EQUAL(1, cache.used);
+#endif
+    TEST_ASSERT_EQUAL_DOUBLE(full_header_nonce_value(&job, 7, 0x20000004), test_nonce_value(&job, &cache, 7, 0x20000004));
+}
+
+TEST_CASE("Nonce check throughput", "[mining][benchmark]")
+{
+    bm_job job = nonce_check_job();
+    const int iterations = 5000;
+    double full_sum = 0;
+    double cached_sum = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        full_sum += full_header_nonce_value(&job, i, i % 4 == 0 ? 0x20000004 : 0x20002004);
+    }
+    int64_t full_us = esp_timer_get_time() - start;
+
+    // Nonces of two versions, as from a chip that gets the rolled midstates with the job
+    nonce_verify_cache cache = {0};
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        cached_sum += test_nonce_value(&job, &cache, i, i % 4 == 0 ? 0x20000004 : 0x20002004);
+    }
+    int64_t cached_us = esp_timer_get_time() - start;
+
+    // A new version for every nonce, as from a chip that rolls the version itself
+    uint32_t version = 0x20000004;
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        version = increment_bitmask(version, STRATUM_DEFAULT_VERSION_MASK);
+        test_nonce_value(&job, &cache, i, version);
+    }
+    int64_t rolled_us = esp_timer_get_time() - start;
+
+    printf("nonce check: full header %.0f/s, cached first block %.0f/s, new version each %.0f/s\n",
+           iterations * 1e6 / full_us, iterations * 1e6 / cached_us, iterations * 1e6 / rolled_us);
+    TEST_ASSERT_EQUAL_DOUBLE(full_sum, cached_sum);
+}
+
+TEST_CASE("Share and block checks against the job targets", "[mining test_nonce]")
+{
+    mining_notify notify_message;
+    notify_message.prev_block_hash = "d02b10fc0d4711eae1a805af50a8a83312a2215e00017f2b0000000000000000";
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705ae3a;
+    notify_message.ntime = 0x646ff1a9;
+    const char *merkle_root = "6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9";
+
+    // The nonce is worth 18.04
+    uint8_t hash[32];
+    bm_job job = construct_bm_job(&notify_message, merkle_root, 0, 18);
+    test_nonce_hash(&job, NULL, 0x276E8947, 0x20000004, hash);
+    TEST_ASSERT_TRUE(hash_meets_target(hash, job.pool_target));
+    TEST_ASSERT_FALSE(hash_meets_target(hash, job.network_target));
+    TEST_ASSERT_EQUAL_INT(18, (int) hash_difficulty(hash));
+
+    job = construct_bm_job(&notify_message, merkle_root, 0, 19);
+    test_nonce_hash(&job, NULL, 0x276E8947, 0x20000004, hash);
+    TEST_ASSERT_FALSE(hash_meets_target(hash, job.pool_target));
+
+    // A block if the network were at difficulty 1, nBits is part of the header so only the target changes
+    nbits_to_target(0x1d00ffff, job.network_target);
+    TEST_ASSERT_TRUE(hash_meets_target(hash, job.network_target));
+}
+
+TEST_CASE("Nonce classification throughput", "[mining][benchmark]")
+{
+    bm_job job = nonce_check_job();
+    const int iterations = 20000;
+    uint8_t hashes[64][32];
+    for (int i = 0; i < 64; i++) {
+        test_nonce_hash(&job, NULL, i * 0x9e3779b9, 0x20000004, hashes[i]);
+    }
+    int float_hits = 0;
+    int integer_hits = 0;
+
+    // As asic_result_task and SYSTEM_notify_found_nonce did it for every nonce
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        double diff = hash_difficulty(hashes[i % 64]);
+        float_hits += (diff >= job.pool_diff) + (diff > networkDifficulty(job.target));
+    }
+    int64_t float_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        integer_hits += hash_meets_target(hashes[i % 64], job.pool_target) + hash_meets_target(hashes[i % 64], job.network_target);
+    }
+    int64_t integer_us = esp_timer_get_time() - start;
+
+    printf("nonce classification: double %.3f us, integer %.3f us\n", (double) float_us / iterations,
+           (double) integer_us / iterations);
+    TEST_ASSERT_EQUAL_INT(float_hits, integer_hits);
+}
+
+TEST_CASE("Ntime rolling stays within the window of the pool's clock", "[mining]")
+{
+    TEST_ASSERT_FALSE(ntime_roll_allowed(1, 0, 0));
+    TEST_ASSERT_FALSE(ntime_roll_allowed(1, 3600 * 1000000LL, 0));
+
+    TEST_ASSERT_TRUE(ntime_roll_allowed(1, 0, 60));
+    TEST_ASSERT_TRUE(ntime_roll_allowed(60, 0, 60));
+    TEST_ASSERT_FALSE(ntime_roll_allowed(61, 0, 60));
+    // The pool's clock moved on by 10 s since the notify
+    TEST_ASSERT_TRUE(ntime_roll_allowed(70, 10 * 1000000LL, 60));
+    TEST_ASSERT_FALSE(ntime_roll_allowed(71, 10999999LL, 60));
+    // A receive time from the future does not widen the window
+    TEST_ASSERT_FALSE(ntime_roll_allowed(61, -5 * 1000000LL, 60));
+}
+
+// SHA-256 compressions of a coinbase hashed from its cached prefix state, the outer hash included
+static int coinbase_compressions(size_t prefix_len, size_t tail_len)
+{
+    size_t total_blocks = (prefix_len + tail_len + 9 + 63) / 64;
+    return total_blocks - prefix_len / 64 + 1;
+}
+
+TEST_CASE("Ntime rolling SHA work per TH on a BM1370", "[mining][benchmark]")
+{
+    // BM1370 profile: ~1.2 TH/s, a job every 500 ms, the pool sends a notify every 30 s
+    const double hashrate_ths = 1.2;
+    const int job_interval_ms = 500;
+    const int notify_interval_s = 30;
+    const size_t coinbase_1_len = 91, extranonce_len = 4, extranonce_2_len = 8, coinbase_2_len = 163;
+    const int n_merkle_branches = 12;
+
+    // Every job hashes its 4 midstates, only a new extranonce_2 hashes the coinbase and the merkle branches
+    int header_work = 4;
+    int extranonce_2_work = coinbase_compressions(coinbase_1_len + extranonce_len, extranonce_2_len + coinbase_2_len) +
+                            3 * n_merkle_branches + header_work;
+
+    const uint16_t windows[] = {0, 10, 60, 600};
+    uint64_t compressions[4] = {0};
+    for (int w = 0; w < 4; w++) {
+        int extranonce_2_jobs = 0;
+        uint32_t ntime_offset = 0;
+        bool have_base = false;
+        for (int64_t t_ms = 0; t_ms < notify_interval_s * 1000; t_ms += job_interval_ms) {
+            if (have_base && ntime_roll_allowed(ntime_offset + 1, t_ms * 1000, windows[w])) {
+                ntime_offset++;
+                compressions[w] += header_work;
+            } else {
+                extranonce_2_jobs++;
+                ntime_offset = 0;
+                have_base = true;
+                compressions[w] += extranonce_2_work;
+            }
+        }
+        printf("ntime roll %3u s: %d of %d jobs on a new extranonce_2, %.1f SHA-256 compressions/TH\n", windows[w],
+               extranonce_2_jobs, notify_interval_s * 1000 / job_interval_ms,
+               compressions[w] / (hashrate_ths * notify_interval_s));
+    }
+    TEST_ASSERT_EQUAL(notify_interval_s * 1000 / job_interval_ms * extranonce_2_work, compressions[0]);
+    TEST_ASSERT_LESS_THAN(compressions[0] / 4, compressions[2]);
+
+    // The same two kinds of job built for real
+    uint8_t merkles[4][32];
+    for (int i = 0; i < 4; i++) {
+        hex2bin(template_branches[i], merkles[i], 32);
+    }
+    const char *coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000";
+    const char *coinbase_2 = "41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000";
+    coinbase_template tmpl;
+    TEST_ASSERT_TRUE(coinbase_template_init(&tmpl, coinbase_1, coinbase_2, "2a010000", extranonce_2_len));
+    uint8_t prev_block_hash[32] = {0};
+    const int iterations = 500;
+    uint8_t merkle_root[32];
+    uint32_t checksum = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        uint8_t extranonce_2[extranonce_2_len];
+        extranonce_2_generate_bin(i, extranonce_2_len, extranonce_2);
+        coinbase_template_hash(&tmpl, extranonce_2, merkle_root);
+        calculate_merkle_root_bin(merkle_root, merkles, 4, merkle_root);
+        bm_job job = construct_bm_job_from_header(0x20000004, prev_block_hash, merkle_root, 0x64495522, 0x1705c739,
+                                                  STRATUM_DEFAULT_VERSION_MASK, 1000);
+        checksum += job.midstate[0];
+    }
+    int64_t extranonce_2_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        bm_job job = construct_bm_job_from_header(0x20000004, prev_block_hash, merkle_root, 0x64495522 + i, 0x1705c739,
+                                                  STRATUM_DEFAULT_VERSION_MASK, 1000);
+        checksum += job.midstate[0];
+    }
+    int64_t rolled_us = esp_timer_get_time() - start;
+    coinbase_template_free(&tmpl);
+
+    printf("job build: new extranonce_2 %.1f us/job, rolled ntime %.1f us/job (checksum %08lx)\n",
+           (double) extranonce_2_us / iterations, (double) rolled_us / iterations, (unsigned long) checksum);
+}
+
+TEST_CASE("Job formats carry the fields of their chip family", "[mining]")
+{
+    uint8_t prev_block_hash[32], merkle_root[32];
+    swap_endian_words("ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000", prev_block_hash);
+    hex2bin("6d0359c451434605c52a5a9ce074340be47c2c63840731f9edf1db3f26b1cdd9", merkle_root, 32);
+
+    bm_job full = construct_bm_job_from_header(0x20000004, prev_block_hash, merkle_root, 0x64495522, 0x1705c739,
+                                               STRATUM_DEFAULT_VERSION_MASK, 1000);
+
+    bm_job midstates = construct_bm_job_for_format(BM_JOB_FORMAT_MIDSTATES, 0x20000004, prev_block_hash, merkle_root, 0x64495522,
+                                                   0x1705c739, STRATUM_DEFAULT_VERSION_MASK, 1000);
+    TEST_ASSERT_EQUAL_UINT8(4, midstates.num_midstates);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(full.midstate, midstates.midstate, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(full.midstate1, midstates.midstate1, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(full.midstate2, midstates.midstate2, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(full.midstate3, midstates.midstate3, 32);
+
+    bm_job header = construct_bm_job_for_format(BM_JOB_FORMAT_HEADER, 0x20000004, prev_block_hash, merkle_root, 0x64495522,
+                                                0x1705c739, STRATUM_DEFAULT_VERSION_MASK, 1000);
+    TEST_ASSERT_EQUAL_UINT8(0, header.num_midstates);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(full.merkle_root_be, header.merkle_root_be, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(full.prev_block_hash_be, header.prev_block_hash_be, 32);
+
+    // Both formats verify nonces from the little endian header
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(merkle_root, header.merkle_root, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(prev_block_hash, midstates.prev_block_hash, 32);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(full.pool_target, header.pool_target, 8);
+}
+
+TEST_CASE("Job construction per ASIC family", "[mining][benchmark]")
+{
+    const struct
+    {
+        const char *family;
+        bm_job_format format;
+        uint32_t version_mask;
+    } families[] = {
+        {"all fields", BM_JOB_FORMAT_MIDSTATES, STRATUM_DEFAULT_VERSION_MASK},
+        {"BM1397", BM_JOB_FORMAT_MIDSTATES, 0},
+        {"BM1397 rolling", BM_JOB_FORMAT_MIDSTATES, STRATUM_DEFAULT_VERSION_MASK},
+        {"BM1366/BM1368/BM1370", BM_JOB_FORMAT_HEADER, STRATUM_DEFAULT_VERSION_MASK},
+    };
+    const int iterations = 2000;
+    uint8_t prev_block_hash[32] = {0}, merkle_root[32] = {0};
+    int64_t us[4];
+
+    for (int f = 0; f < 4; f++) {
+        uint32_t compressions = 0;
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            merkle_root[0] = i;
+            // A midstate is one SHA-256 compression over the first 64 bytes of the header
+            bm_job job = f == 0 ? construct_bm_job_from_header(0x20000004, prev_block_hash, merkle_root, 0x64495522, 0x1705c739,
+                                                               families[f].version_mask, 1000)
+                                : construct_bm_job_for_format(families[f].format, 0x20000004, prev_block_hash, merkle_root,
+                                                              0x64495522, 0x1705c739, families[f].version_mask, 1000);
+            compressions += job.num_midstates;
+        }
+        us[f] = esp_timer_get_time() - start;
+        printf("job build %-20s %u SHA-256 compressions/job, %.2f us/job\n", families[f].family, compressions / iterations,
+               (double) us[f] / iterations);
+    }
+}
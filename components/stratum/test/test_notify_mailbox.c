@@ -0,0 +1,79 @@
+#include "unity.h"
+#include "notify_mailbox.h"
+#include "notify_pool.h"
+
+#include <string.h>
+
+static mining_notify * make_notify(const char * job_id, uint8_t pool_id, bool clean_jobs, int64_t received_us)
+{
+    static const uint8_t branch[HASH_SIZE] = {0};
+    const char * strings[NOTIFY_STRING_FIELDS] = {job_id, "00", "01", "02"};
+    size_t lengths[NOTIFY_STRING_FIELDS];
+    for (int i = 0; i < NOTIFY_STRING_FIELDS; i++) {
+        lengths[i] = strlen(strings[i]);
+    }
+    mining_notify * notify = notify_pool_alloc(strings, lengths, branch, 1);
+    notify->pool_id = pool_id;
+    notify->clean_jobs = clean_jobs;
+    notify->received_us = received_us;
+    return notify;
+}
+
+TEST_CASE("Notify mailbox keeps the newest notify per pool", "[notify_mailbox]")
+{
+    notify_mailbox mailbox;
+    notify_mailbox_init(&mailbox);
+    notify_pool_stats pool_before, pool_after;
+    notify_pool_get_stats(&pool_before);
+
+    TEST_ASSERT_FALSE(notify_mailbox_pending(&mailbox));
+    TEST_ASSERT_FALSE(notify_mailbox_wait(&mailbox, 10));
+
+    notify_mailbox_post(&mailbox, make_notify("a", 0, false, 100));
+    notify_mailbox_post(&mailbox, make_notify("b", 1, false, 150));
+    notify_mailbox_post(&mailbox, make_notify("c", 0, false, 200));
+    notify_mailbox_post(&mailbox, make_notify("d", 0, false, 300));
+    TEST_ASSERT_TRUE(notify_mailbox_wait(&mailbox, 10));
+
+    // Pool 0 posted first, its newest notify is the only one left
+    mining_notify * notify = notify_mailbox_take(&mailbox);
+    TEST_ASSERT_EQUAL_STRING("d", notify->job_id);
+    STRATUM_V1_free_mining_notify(notify);
+    notify = notify_mailbox_take(&mailbox);
+    TEST_ASSERT_EQUAL_STRING("b", notify->job_id);
+    STRATUM_V1_free_mining_notify(notify);
+    TEST_ASSERT_FALSE(notify_mailbox_pending(&mailbox));
+
+    notify_mailbox_stats stats;
+    notify_mailbox_get_stats(&mailbox, &stats);
+    TEST_ASSERT_EQUAL(4, stats.posted);
+    TEST_ASSERT_EQUAL(2, stats.coalesced);
+    TEST_ASSERT_EQUAL(0, stats.clean_coalesced);
+
+    notify_pool_get_stats(&pool_after);
+    TEST_ASSERT_EQUAL(pool_before.in_use, pool_after.in_use);
+}
+
+TEST_CASE("Notify mailbox keeps a new block across coalescing", "[notify_mailbox]")
+{
+    notify_mailbox mailbox;
+    notify_mailbox_init(&mailbox);
+
+    notify_mailbox_post(&mailbox, make_notify("a", 0, true, 100));
+    notify_mailbox_post(&mailbox, make_notify("b", 0, false, 200));
+
+    mining_notify * notify = notify_mailbox_take(&mailbox);
+    TEST_ASSERT_EQUAL_STRING("b", notify->job_id);
+    TEST_ASSERT_TRUE(notify->clean_jobs);
+    // New block latency counts from the first notify of the block
+    TEST_ASSERT_EQUAL(100, notify->received_us);
+    STRATUM_V1_free_mining_notify(notify);
+
+    notify_mailbox_stats stats;
+    notify_mailbox_get_stats(&mailbox, &stats);
+    TEST_ASSERT_EQUAL(1, stats.clean_coalesced);
+
+    notify_mailbox_post(&mailbox, make_notify("c", 1, false, 300));
+    notify_mailbox_clear(&mailbox);
+    TEST_ASSERT_FALSE(notify_mailbox_pending(&mailbox));
+}
@@ -0,0 +1,103 @@
+#include "unity.h"
+#include "notify_pool.h"
+
+#include <pthread.h>
+#include <string.h>
+
+static const uint8_t branches[2][HASH_SIZE] = { { 0xae }, { 0x03 } };
+
+static mining_notify * alloc_notify(const char * coinbase_2)
+{
+    const char * strings[NOTIFY_STRING_FIELDS] = {
+        "1b4c3d9041",
+        "ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000",
+        "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff",
+        coinbase_2,
+    };
+    size_t lengths[NOTIFY_STRING_FIELDS];
+    for (int i = 0; i < NOTIFY_STRING_FIELDS; i++) {
+        lengths[i] = strlen(strings[i]);
+    }
+    return notify_pool_alloc(strings, lengths, branches[0], 2);
+}
+
+TEST_CASE("Notify pool reuses slots in steady state", "[notify_pool]")
+{
+    notify_pool_stats before, after;
+    notify_pool_get_stats(&before);
+
+    for (int i = 0; i < 100; i++) {
+        mining_notify * notify = alloc_notify("41903d4c1b2f736c7573682f");
+        TEST_ASSERT_EQUAL_STRING("1b4c3d9041", notify->job_id);
+        TEST_ASSERT_EQUAL_STRING("41903d4c1b2f736c7573682f", notify->coinbase_2);
+        TEST_ASSERT_EQUAL(2, notify->n_merkle_branches);
+        TEST_ASSERT_EQUAL_HEX8(0x03, notify->merkle_branches[HASH_SIZE]);
+        notify_pool_free(notify);
+    }
+
+    notify_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(100, after.hits - before.hits);
+    TEST_ASSERT_EQUAL(0, after.misses - before.misses);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
+
+TEST_CASE("Notify pool falls back to the heap", "[notify_pool]")
+{
+    notify_pool_stats before, after;
+    notify_pool_get_stats(&before);
+
+    // Coinbase larger than the inline storage
+    static char long_coinbase[NOTIFY_POOL_STRING_SIZE + 1];
+    memset(long_coinbase, 'a', sizeof(long_coinbase) - 1);
+    mining_notify * notify = alloc_notify(long_coinbase);
+    TEST_ASSERT_EQUAL_STRING(long_coinbase, notify->coinbase_2);
+    notify_pool_free(notify);
+
+    // More notifies alive than there are slots
+    notify_pool_get_stats(&after);
+    const uint32_t slots = after.slots;
+    mining_notify * notifies[NOTIFY_POOL_SLOTS + 2];
+    for (uint32_t i = 0; i < slots + 2; i++) {
+        notifies[i] = alloc_notify("00");
+    }
+    for (uint32_t i = 0; i < slots + 2; i++) {
+        TEST_ASSERT_EQUAL_STRING("00", notifies[i]->coinbase_2);
+        notify_pool_free(notifies[i]);
+    }
+
+    notify_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(3 + before.in_use, after.misses - before.misses);
+    TEST_ASSERT_EQUAL(slots, after.max_in_use);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
+
+static void * parse_notifies(void * arg)
+{
+    const char * coinbase_2 = arg;
+    for (int i = 0; i < 20000; i++) {
+        mining_notify * notify = alloc_notify(coinbase_2);
+        if (strcmp(notify->coinbase_2, coinbase_2) != 0) {
+            return notify;
+        }
+        notify_pool_free(notify);
+    }
+    return NULL;
+}
+
+TEST_CASE("Notify pool is shared by the stratum and standby sessions", "[notify_pool]")
+{
+    notify_pool_stats before, after;
+    notify_pool_get_stats(&before);
+
+    pthread_t standby;
+    TEST_ASSERT_EQUAL(0, pthread_create(&standby, NULL, parse_notifies, "41903d4c1b2f"));
+    void * primary_result = parse_notifies("0300000000");
+    void * standby_result;
+    pthread_join(standby, &standby_result);
+    TEST_ASSERT_NULL(primary_result);
+    TEST_ASSERT_NULL(standby_result);
+
+    notify_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(40000, after.hits - before.hits);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
@@ -0,0 +1,108 @@
+#include "unity.h"
+#include "pool_connect.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void make_addrinfo(struct addrinfo * ai, struct sockaddr_storage * storage, int family, uint8_t last_byte)
+{
+    memset(ai, 0, sizeof(*ai));
+    memset(storage, 0, sizeof(*storage));
+    ai->ai_family = family;
+    ai->ai_addr = (struct sockaddr *) storage;
+    if (family == AF_INET6) {
+        struct sockaddr_in6 * addr6 = (struct sockaddr_in6 *) storage;
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_addr.s6_addr[15] = last_byte;
+        ai->ai_addrlen = sizeof(struct sockaddr_in6);
+    } else {
+        struct sockaddr_in * addr4 = (struct sockaddr_in *) storage;
+        addr4->sin_family = AF_INET;
+        addr4->sin_addr.s_addr = htonl(0x0a000000 | last_byte);
+        ai->ai_addrlen = sizeof(struct sockaddr_in);
+    }
+}
+
+static uint8_t last_byte(const pool_addr_list * list, int i)
+{
+    if (list->addrs[i].ss_family == AF_INET6) {
+        return ((const struct sockaddr_in6 *) &list->addrs[i])->sin6_addr.s6_addr[15];
+    }
+    return ntohl(((const struct sockaddr_in *) &list->addrs[i])->sin_addr.s_addr) & 0xff;
+}
+
+TEST_CASE("Pool candidates interleave IPv6 and IPv4", "[pool_connect]")
+{
+    // Resolver order: 4.1, 4.2, 6.3, 6.4, 4.5
+    const int families[] = {AF_INET, AF_INET, AF_INET6, AF_INET6, AF_INET};
+    struct addrinfo ai[5];
+    struct sockaddr_storage storage[5];
+    for (int i = 0; i < 5; i++) {
+        make_addrinfo(&ai[i], &storage[i], families[i], i + 1);
+        ai[i].ai_next = i < 4 ? &ai[i + 1] : NULL;
+    }
+
+    pool_addr_list list;
+    pool_addr_list_from_addrinfo(ai, &list);
+    TEST_ASSERT_EQUAL(POOL_MAX_ADDRS, list.count);
+    const uint8_t expected[] = {3, 1, 4, 2};
+    for (int i = 0; i < list.count; i++) {
+        TEST_ASSERT_EQUAL(i % 2 == 0 ? AF_INET6 : AF_INET, list.addrs[i].ss_family);
+        TEST_ASSERT_EQUAL(expected[i], last_byte(&list, i));
+    }
+
+    // IPv4 only
+    ai[1].ai_next = NULL;
+    pool_addr_list_from_addrinfo(ai, &list);
+    TEST_ASSERT_EQUAL(2, list.count);
+    TEST_ASSERT_EQUAL(1, last_byte(&list, 0));
+    TEST_ASSERT_EQUAL(2, last_byte(&list, 1));
+}
+
+TEST_CASE("Pool DNS cache expires entries", "[pool_connect]")
+{
+    struct addrinfo ai;
+    struct sockaddr_storage storage;
+    make_addrinfo(&ai, &storage, AF_INET, 7);
+    ai.ai_next = NULL;
+
+    pool_addr_list list, cached;
+    pool_addr_list_from_addrinfo(&ai, &list);
+
+    const int64_t ttl_us = (int64_t) POOL_DNS_TTL_S * 1000000;
+    pool_dns_cache_store("pool.example.com", 3333, &list, 1000);
+    TEST_ASSERT_TRUE(pool_dns_cache_lookup("pool.example.com", 3333, 1000 + ttl_us - 1, &cached));
+    TEST_ASSERT_EQUAL(1, cached.count);
+    TEST_ASSERT_EQUAL(7, last_byte(&cached, 0));
+    TEST_ASSERT_FALSE(pool_dns_cache_lookup("pool.example.com", 3333, 1000 + ttl_us, &cached));
+    TEST_ASSERT_FALSE(pool_dns_cache_lookup("pool.example.com", 4444, 1000, &cached));
+
+    pool_dns_cache_store("pool.example.com", 3333, &list, 2000);
+    pool_dns_cache_invalidate("pool.example.com");
+    TEST_ASSERT_FALSE(pool_dns_cache_lookup("pool.example.com", 3333, 2000, &cached));
+
+    // A full cache replaces the entry that expires first
+    char host[32];
+    for (int i = 0; i <= POOL_DNS_CACHE_SIZE; i++) {
+        snprintf(host, sizeof(host), "pool%d.example.com", i);
+        pool_dns_cache_store(host, 3333, &list, 10000 + i);
+    }
+    TEST_ASSERT_FALSE(pool_dns_cache_lookup("pool0.example.com", 3333, 20000, &cached));
+    snprintf(host, sizeof(host), "pool%d.example.com", POOL_DNS_CACHE_SIZE);
+    TEST_ASSERT_TRUE(pool_dns_cache_lookup(host, 3333, 20000, &cached));
+}
+
+TEST_CASE("Pool reconnect backoff grows with jitter", "[pool_connect]")
+{
+    TEST_ASSERT_EQUAL(POOL_BACKOFF_BASE_MS / 2, pool_backoff_ms(0, 0));
+    TEST_ASSERT_EQUAL(POOL_BACKOFF_BASE_MS, pool_backoff_ms(0, POOL_BACKOFF_BASE_MS / 2));
+    TEST_ASSERT_EQUAL(POOL_BACKOFF_BASE_MS, pool_backoff_ms(1, 0));
+    TEST_ASSERT_EQUAL(POOL_BACKOFF_MAX_MS / 2, pool_backoff_ms(10, 0));
+    TEST_ASSERT_EQUAL(POOL_BACKOFF_MAX_MS, pool_backoff_ms(1000, POOL_BACKOFF_MAX_MS / 2));
+
+    for (uint32_t random = 0; random < 100000; random += 997) {
+        uint32_t delay = pool_backoff_ms(3, random);
+        TEST_ASSERT_GREATER_OR_EQUAL(4 * POOL_BACKOFF_BASE_MS, delay);
+        TEST_ASSERT_LESS_OR_EQUAL(8 * POOL_BACKOFF_BASE_MS, delay);
+    }
+}
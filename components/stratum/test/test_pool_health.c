@@ -0,0 +1,66 @@
+#include "unity.h"
+#include "pool_health.h"
+
+#define S_TO_US(s) ((int64_t) ((s) * 1000000.0))
+
+TEST_CASE("Pool health learns the notify cadence", "[pool_health]")
+{
+    pool_health health;
+    pool_health_reset(&health, 0);
+
+    // Nothing learned yet, the socket receive timeout applies
+    TEST_ASSERT_EQUAL_DOUBLE(POOL_HEALTH_MAX_SILENCE_S, pool_health_silence_timeout_s(&health));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_OK, pool_health_check(&health, S_TO_US(POOL_HEALTH_MAX_SILENCE_S)));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_NOTIFY_OVERDUE, pool_health_check(&health, S_TO_US(POOL_HEALTH_MAX_SILENCE_S + 1)));
+
+    // Notify every 30 s
+    for (int i = 0; i <= POOL_HEALTH_MIN_INTERVALS; i++) {
+        pool_health_on_notify(&health, S_TO_US(30 * i));
+    }
+    int64_t last = S_TO_US(30 * POOL_HEALTH_MIN_INTERVALS);
+    TEST_ASSERT_DOUBLE_WITHIN(0.01, 90, pool_health_silence_timeout_s(&health));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_OK, pool_health_check(&health, last + S_TO_US(89)));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_NOTIFY_OVERDUE, pool_health_check(&health, last + S_TO_US(91)));
+
+    // Submit responses are a sign of life too
+    pool_health_on_rx(&health, last + S_TO_US(80));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_OK, pool_health_check(&health, last + S_TO_US(91)));
+
+    // Pools sending work every few seconds are still given the minimum
+    pool_health_reset(&health, 0);
+    for (int i = 0; i <= POOL_HEALTH_MIN_INTERVALS; i++) {
+        pool_health_on_notify(&health, S_TO_US(5 * i));
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(POOL_HEALTH_MIN_SILENCE_S, pool_health_silence_timeout_s(&health));
+
+    // Block-only pools never fall below the old fixed timeout
+    pool_health_reset(&health, 0);
+    for (int i = 0; i <= POOL_HEALTH_MIN_INTERVALS; i++) {
+        pool_health_on_notify(&health, S_TO_US(600 * i));
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(POOL_HEALTH_MAX_SILENCE_S, pool_health_silence_timeout_s(&health));
+}
+
+TEST_CASE("Pool health flags unanswered submits", "[pool_health]")
+{
+    pool_health health;
+    pool_health_reset(&health, 0);
+
+    pool_health_on_submit(&health, 2, S_TO_US(1));
+    pool_health_on_submit(&health, 1, S_TO_US(5));
+    TEST_ASSERT_EQUAL(3, health.outstanding_submits);
+    TEST_ASSERT_EQUAL(POOL_HEALTH_OK, pool_health_check(&health, S_TO_US(1 + POOL_HEALTH_SUBMIT_TIMEOUT_S)));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_SUBMIT_UNACKED, pool_health_check(&health, S_TO_US(2 + POOL_HEALTH_SUBMIT_TIMEOUT_S)));
+
+    // An answer restarts the clock for the rest
+    pool_health_on_submit_response(&health, S_TO_US(10));
+    TEST_ASSERT_EQUAL(POOL_HEALTH_OK, pool_health_check(&health, S_TO_US(10 + POOL_HEALTH_SUBMIT_TIMEOUT_S)));
+    pool_health_on_submit_response(&health, S_TO_US(11));
+    pool_health_on_submit_response(&health, S_TO_US(12));
+    TEST_ASSERT_EQUAL(0, health.outstanding_submits);
+    TEST_ASSERT_EQUAL(POOL_HEALTH_OK, pool_health_check(&health, S_TO_US(60)));
+
+    // More answers than submits, such as the setup responses, are ignored
+    pool_health_on_submit_response(&health, S_TO_US(61));
+    TEST_ASSERT_EQUAL(0, health.outstanding_submits);
+}
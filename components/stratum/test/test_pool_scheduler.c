@@ -0,0 +1,49 @@
+#include "unity.h"
+#include "pool_scheduler.h"
+
+TEST_CASE("Pool scheduler splits jobs by weight", "[pool_scheduler]")
+{
+    pool_scheduler scheduler;
+    pool_scheduler_reset(&scheduler);
+
+    const uint16_t weights[] = {80, 20};
+    int longest_run = 0;
+    int run = 0;
+    int last = -1;
+    for (int i = 0; i < 1000; i++) {
+        int pool = pool_scheduler_next(&scheduler, weights, 2);
+        TEST_ASSERT_TRUE(pool == 0 || pool == 1);
+        run = pool == last ? run + 1 : 1;
+        last = pool;
+        if (pool == 0 && run > longest_run) {
+            longest_run = run;
+        }
+    }
+    TEST_ASSERT_EQUAL(800, scheduler.jobs[0]);
+    TEST_ASSERT_EQUAL(200, scheduler.jobs[1]);
+    // Interleaved rather than 800 jobs in a row
+    TEST_ASSERT_EQUAL(4, longest_run);
+}
+
+TEST_CASE("Pool scheduler skips pools without work", "[pool_scheduler]")
+{
+    pool_scheduler scheduler;
+    pool_scheduler_reset(&scheduler);
+
+    uint16_t weights[] = {50, 50, 0};
+    for (int i = 0; i < 10; i++) {
+        pool_scheduler_next(&scheduler, weights, 3);
+    }
+    TEST_ASSERT_EQUAL(5, scheduler.jobs[0]);
+    TEST_ASSERT_EQUAL(5, scheduler.jobs[1]);
+    TEST_ASSERT_EQUAL(0, scheduler.jobs[2]);
+
+    // The remaining pool takes all of the jobs
+    weights[1] = 0;
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL(0, pool_scheduler_next(&scheduler, weights, 3));
+    }
+
+    weights[0] = 0;
+    TEST_ASSERT_EQUAL(-1, pool_scheduler_next(&scheduler, weights, 3));
+}
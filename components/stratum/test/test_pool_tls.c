@@ -0,0 +1,30 @@
+#include "unity.h"
+#include "pool_tls.h"
+
+TEST_CASE("Pool URL schemes select TLS", "[pool_tls]")
+{
+    bool tls = true;
+    TEST_ASSERT_EQUAL_STRING("pool.example.com", pool_url_host("pool.example.com", &tls));
+    TEST_ASSERT_FALSE(tls);
+    TEST_ASSERT_EQUAL_STRING("pool.example.com", pool_url_host("stratum+tcp://pool.example.com", &tls));
+    TEST_ASSERT_FALSE(tls);
+    TEST_ASSERT_EQUAL_STRING("pool.example.com", pool_url_host("stratum://pool.example.com", &tls));
+    TEST_ASSERT_FALSE(tls);
+
+    TEST_ASSERT_EQUAL_STRING("pool.example.com", pool_url_host("stratum+ssl://pool.example.com", &tls));
+    TEST_ASSERT_TRUE(tls);
+    tls = false;
+    TEST_ASSERT_EQUAL_STRING("pool.example.com", pool_url_host("Stratum+TLS://pool.example.com", &tls));
+    TEST_ASSERT_TRUE(tls);
+}
+
+TEST_CASE("Plain pool sockets bypass TLS", "[pool_tls]")
+{
+    pool_tls_stats stats;
+    pool_tls_get_stats(&stats);
+    TEST_ASSERT_FALSE(pool_tls_pending(-1));
+    TEST_ASSERT_EQUAL(-1, pool_send(-1, "x", 1));
+    pool_tls_stats after;
+    pool_tls_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(stats.handshakes, after.handshakes);
+}
@@ -0,0 +1,153 @@
+#include "unity.h"
+#include "sha256_lanes.h"
+#include "mining.h"
+#include "utils.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static void fill(uint8_t *data, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+TEST_CASE("Lanes match double_sha256_bin", "[sha256_lanes]")
+{
+    static uint8_t messages[SHA256_LANES][300];
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        fill(messages[lane], sizeof(messages[lane]), lane + 1);
+    }
+    const uint8_t *data[SHA256_LANES];
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        data[lane] = messages[lane];
+    }
+
+    // Every padding case: rest of 0 to 63 bytes, one or two final blocks
+    for (size_t len = 0; len <= sizeof(messages[0]); len++) {
+        for (int count = 1; count <= SHA256_LANES; count++) {
+            uint8_t lanes[SHA256_LANES][32];
+            double_sha256_lanes(NULL, 0, data, len, count, lanes);
+            for (int lane = 0; lane < count; lane++) {
+                uint8_t expected[32];
+                double_sha256_bin(messages[lane], len, expected);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, lanes[lane], 32);
+            }
+        }
+    }
+}
+
+TEST_CASE("Lanes continue from a prefix state", "[sha256_lanes]")
+{
+    uint8_t message[SHA256_LANES][128 + 77];
+    fill(message[0], sizeof(message[0]), 7);
+    for (int lane = 1; lane < SHA256_LANES; lane++) {
+        memcpy(message[lane], message[0], 128);
+        fill(message[lane] + 128, 77, lane + 100);
+    }
+
+    uint32_t state[8];
+    memcpy(state, sha256_initial_state, sizeof(state));
+    sha256_compress(state, message[0]);
+    sha256_compress(state, message[0] + 64);
+
+    const uint8_t *data[SHA256_LANES];
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        data[lane] = message[lane] + 128;
+    }
+    uint8_t lanes[SHA256_LANES][32];
+    double_sha256_lanes(state, 128, data, 77, SHA256_LANES, lanes);
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        uint8_t expected[32];
+        double_sha256_bin(message[lane], sizeof(message[lane]), expected);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, lanes[lane], 32);
+    }
+}
+
+static const char *lanes_coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000";
+static const char *lanes_coinbase_2 = "41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000";
+
+TEST_CASE("Coinbase and merkle lanes match one job at a time", "[sha256_lanes]")
+{
+    uint8_t merkles[12][32];
+    for (int i = 0; i < 12; i++) {
+        fill(merkles[i], 32, i);
+    }
+    const uint32_t extranonce_2_len = 8;
+    coinbase_template tmpl;
+    TEST_ASSERT_TRUE(coinbase_template_init(&tmpl, lanes_coinbase_1, lanes_coinbase_2, "2a010000", extranonce_2_len));
+
+    uint8_t extranonce_2[SHA256_LANES][extranonce_2_len];
+    const uint8_t *extranonce_2_lanes[SHA256_LANES];
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        extranonce_2_generate_bin(1000 + lane, extranonce_2_len, extranonce_2[lane]);
+        extranonce_2_lanes[lane] = extranonce_2[lane];
+    }
+    uint8_t roots[SHA256_LANES][32];
+    coinbase_template_hash_lanes(&tmpl, extranonce_2_lanes, SHA256_LANES, roots);
+    calculate_merkle_root_lanes(roots, merkles, 12, SHA256_LANES);
+
+    for (int lane = 0; lane < SHA256_LANES; lane++) {
+        char extranonce_2_hex[extranonce_2_len * 2 + 1];
+        extranonce_2_generate(1000 + lane, extranonce_2_len, extranonce_2_hex);
+        char *coinbase_tx = construct_coinbase_tx(lanes_coinbase_1, lanes_coinbase_2, "2a010000", extranonce_2_hex);
+        char merkle_root_hex[65];
+        calculate_merkle_root_hash(coinbase_tx, merkles, 12, merkle_root_hex);
+        free(coinbase_tx);
+        uint8_t expected[32];
+        hex2bin(merkle_root_hex, expected, 32);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, roots[lane], 32);
+    }
+    coinbase_template_free(&tmpl);
+}
+
+TEST_CASE("Merkle roots per second in lanes", "[sha256_lanes][benchmark]")
+{
+    uint8_t merkles[12][32];
+    for (int i = 0; i < 12; i++) {
+        fill(merkles[i], 32, i);
+    }
+    const uint32_t extranonce_2_len = 8;
+    coinbase_template tmpl;
+    TEST_ASSERT_TRUE(coinbase_template_init(&tmpl, lanes_coinbase_1, lanes_coinbase_2, "2a010000", extranonce_2_len));
+    const int iterations = 400;
+    uint32_t checksum = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        uint8_t extranonce_2[extranonce_2_len];
+        extranonce_2_generate_bin(i, extranonce_2_len, extranonce_2);
+        uint8_t root[32];
+        coinbase_template_hash(&tmpl, extranonce_2, root);
+        calculate_merkle_root_bin(root, merkles, 12, root);
+        checksum += root[0];
+    }
+    int64_t single_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i += SHA256_LANES) {
+        uint8_t extranonce_2[SHA256_LANES][extranonce_2_len];
+        const uint8_t *extranonce_2_lanes[SHA256_LANES];
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            extranonce_2_generate_bin(i + lane, extranonce_2_len, extranonce_2[lane]);
+            extranonce_2_lanes[lane] = extranonce_2[lane];
+        }
+        uint8_t roots[SHA256_LANES][32];
+        coinbase_template_hash_lanes(&tmpl, extranonce_2_lanes, SHA256_LANES, roots);
+        calculate_merkle_root_lanes(roots, merkles, 12, SHA256_LANES);
+        for (int lane = 0; lane < SHA256_LANES; lane++) {
+            checksum -= roots[lane][0];
+        }
+    }
+    int64_t lanes_us = esp_timer_get_time() - start;
+    coinbase_template_free(&tmpl);
+
+    printf("merkle roots, 12 branches: one at a time %.1f us/root, %d lanes %s %.1f us/root\n", (double) single_us / iterations,
+           SHA256_LANES, SHA256_LANES_VECTOR ? "vector" : "scalar", (double) lanes_us / iterations);
+    TEST_ASSERT_EQUAL_UINT32(0, checksum);
+#if SHA256_LANES_VECTOR
+    TEST_ASSERT_LESS_THAN(single_us, lanes_us);
+#endif
+}
@@ -0,0 +1,109 @@
+#include "unity.h"
+#include "slot_pool.h"
+#include "mining.h"
+
+#include <string.h>
+
+TEST_CASE("Slot pool reuses slots and falls back to the heap", "[slot_pool]")
+{
+    static slot_pool pool = SLOT_POOL_INITIALIZER("test", 48, 40, 40);
+    slot_pool_stats stats;
+
+    for (int i = 0; i < 100; i++) {
+        void * ptr = slot_pool_alloc(&pool, 48);
+        memset(ptr, i, 48);
+        slot_pool_free(&pool, ptr);
+    }
+    slot_pool_get_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(100, stats.hits);
+    TEST_ASSERT_EQUAL(0, stats.misses);
+    TEST_ASSERT_EQUAL(0, stats.in_use);
+
+    // Too large for a slot
+    void * large = slot_pool_alloc(&pool, 49);
+    memset(large, 0, 49);
+    slot_pool_free(&pool, large);
+
+    // More alive than there are slots, across the 32 bit words of the bitmap
+    uint8_t * ptrs[42];
+    for (int i = 0; i < 42; i++) {
+        ptrs[i] = slot_pool_alloc(&pool, 48);
+        memset(ptrs[i], i, 48);
+    }
+    uint8_t expected[48];
+    for (int i = 0; i < 42; i++) {
+        memset(expected, i, sizeof(expected));
+        TEST_ASSERT_EQUAL_MEMORY(expected, ptrs[i], sizeof(expected));
+        for (int j = 0; j < i; j++) {
+            TEST_ASSERT_NOT_EQUAL(ptrs[j], ptrs[i]);
+        }
+    }
+    for (int i = 0; i < 42; i++) {
+        slot_pool_free(&pool, ptrs[i]);
+    }
+
+    slot_pool_get_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(140, stats.hits);
+    TEST_ASSERT_EQUAL(3, stats.misses);
+    TEST_ASSERT_EQUAL(40, stats.max_in_use);
+    TEST_ASSERT_EQUAL(0, stats.in_use);
+    TEST_ASSERT_EQUAL(40, stats.slots);
+}
+
+TEST_CASE("Jobs need no heap in steady state", "[slot_pool]")
+{
+    // Queue depth plus the job ids a BM1397 keeps active, as create_jobs_task and the drivers use them
+    const int window = 12 + 32;
+    bm_job * alive[window];
+    memset(alive, 0, sizeof(alive));
+    uint8_t prev_block_hash[32] = {0}, merkle_root[32] = {0}, extranonce_2[8] = {0};
+
+    slot_pool_stats jobs_before, jobs_after, templates_before, templates_after;
+    bm_job_pool_get_stats(&jobs_before);
+    STRATUM_V1_get_submit_template_pool_stats(&templates_before);
+
+    for (int i = 0; i < 1000; i++) {
+        bm_job next_job = construct_bm_job_for_format(BM_JOB_FORMAT_HEADER, 0x20000004, prev_block_hash, merkle_root, 0x64495522 + i,
+                                                      0x1705c739, 0x1fffe000, 1000);
+        bm_job * job = bm_job_alloc();
+        memcpy(job, &next_job, sizeof(bm_job));
+        bm_job_set_jobid(job, "1b4c3d9041");
+        extranonce_2[0] = i;
+        job->submit_template = STRATUM_V1_create_submit_template("bc1qexampleexampleexampleexampleexample.worker", "1b4c3d9041",
+                                                                 extranonce_2, sizeof(extranonce_2));
+
+        // send_work frees the job that had the same id before
+        if (alive[i % window] != NULL) {
+            free_bm_job(alive[i % window]);
+        }
+        alive[i % window] = job;
+    }
+    for (int i = 0; i < window; i++) {
+        TEST_ASSERT_EQUAL_STRING("1b4c3d9041", alive[i]->jobid);
+        free_bm_job(alive[i]);
+    }
+
+    bm_job_pool_get_stats(&jobs_after);
+    STRATUM_V1_get_submit_template_pool_stats(&templates_after);
+    // Without PSRAM the pools keep fewer slots and the heap covers the rest of the window
+    if (jobs_after.slots == BM_JOB_POOL_SLOTS) {
+        TEST_ASSERT_EQUAL(1000, jobs_after.hits - jobs_before.hits);
+        TEST_ASSERT_EQUAL(0, jobs_after.misses - jobs_before.misses);
+        TEST_ASSERT_EQUAL(0, templates_after.misses - templates_before.misses);
+    } else {
+        TEST_ASSERT_EQUAL(BM_JOB_POOL_INTERNAL_SLOTS, jobs_after.slots);
+        TEST_ASSERT_EQUAL(STRATUM_SUBMIT_TEMPLATE_INTERNAL_SLOTS, templates_after.slots);
+    }
+    TEST_ASSERT_EQUAL(jobs_before.in_use, jobs_after.in_use);
+    TEST_ASSERT_EQUAL(templates_before.in_use, templates_after.in_use);
+}
+
+TEST_CASE("Job ids are truncated to the inline buffer", "[slot_pool]")
+{
+    bm_job * job = bm_job_alloc();
+    job->submit_template = NULL;
+    bm_job_set_jobid(job, "0123456789abcdef0123456789abcdef0123456789");
+    TEST_ASSERT_EQUAL(BM_JOB_ID_SIZE - 1, strlen(job->jobid));
+    TEST_ASSERT_EQUAL_STRING_LEN("0123456789abcdef0123456789abcdef", job->jobid, BM_JOB_ID_SIZE - 1);
+    free_bm_job(job);
+}
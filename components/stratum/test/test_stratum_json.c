@@ -1,5 +1,11 @@
 #include "unity.h"
 #include "stratum_api.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 TEST_CASE("Parse stratum method", "[stratum]")
 {
@@ -86,6 +92,10 @@ TEST_CASE("Parse stratum notify params", "[mining.notify]")
     TEST_ASSERT_EQUAL_UINT32(0x20000004, stratum_api_v1_message.mining_notification->version);
     TEST_ASSERT_EQUAL_UINT32(0x1705c739, stratum_api_v1_message.mining_notification->target);
     TEST_ASSERT_EQUAL_UINT32(0x64495522, stratum_api_v1_message.mining_notification->ntime);
+    // The job builder takes the previous block hash decoded and word swapped
+    const uint8_t prev_block_hash_bin[8] = {0x48, 0x9a, 0x4b, 0xef, 0x66, 0x64, 0x98, 0xc7};
+    TEST_ASSERT_EQUAL_MEMORY(prev_block_hash_bin, stratum_api_v1_message.mining_notification->prev_block_hash_bin, 8);
+    TEST_ASSERT_EQUAL_UINT8(0x00, stratum_api_v1_message.mining_notification->prev_block_hash_bin[31]);
 }
 
 // 'private' function
@@ -105,6 +115,27 @@ TEST_CASE("Parse stratum notify params", "[mining.notify]")
 //     TEST_ASSERT_EQUAL_INT(extranonce2_len, 4);
 // }
 
+TEST_CASE("Reject stratum subscribe result with out of range extranonce2 size", "[mining.subscribe]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    const char *json_string = "{\"id\":2,\"error\":null,\"result\":"
+                              "[[[\"mining.notify\",\"731ec5e0649606ff\"]],\"e9695791\",4]}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT_SUBSCRIBE, stratum_api_v1_message.method);
+    TEST_ASSERT_EQUAL_INT(4, stratum_api_v1_message.extranonce_2_len);
+
+    const char *json_string_empty = "{\"id\":2,\"error\":null,\"result\":"
+                                    "[[[\"mining.notify\",\"731ec5e0649606ff\"]],\"e9695791\",0]}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string_empty);
+    TEST_ASSERT_NOT_EQUAL(STRATUM_RESULT_SUBSCRIBE, stratum_api_v1_message.method);
+    TEST_ASSERT_FALSE(stratum_api_v1_message.response_success);
+
+    const char *json_string_oversized = "{\"id\":2,\"error\":null,\"result\":"
+                                        "[[[\"mining.notify\",\"731ec5e0649606ff\"]],\"e9695791\",33]}";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string_oversized);
+    TEST_ASSERT_NOT_EQUAL(STRATUM_RESULT_SUBSCRIBE, stratum_api_v1_message.method);
+}
+
 TEST_CASE("Parse stratum mining.set_version_mask params", "[stratum]")
 {
     StratumApiV1Message stratum_api_v1_message = {};
@@ -181,3 +212,252 @@ TEST_CASE("Parse stratum result alternative error", "[stratum]")
     TEST_ASSERT_FALSE(stratum_api_v1_message.response_success);
     TEST_ASSERT_EQUAL_STRING("Above target 2", stratum_api_v1_message.error_str);
 }
+
+TEST_CASE("Parse stratum notify with reordered keys and whitespace", "[mining.notify]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    const char *json_string = "{ \"params\" : [ \"6a\", "
+                              "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\", \"01\", \"02\", "
+                              "[ \"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\" , "
+                              "\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\" ], "
+                              "\"20000004\", \"1705C739\", \"64495522\", true ], \"extra\": {\"a\": [1, {}, null]}, "
+                              "\"method\" : \"mining.notify\", \"id\" : null }";
+    STRATUM_V1_parse(&stratum_api_v1_message, json_string);
+    TEST_ASSERT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
+    TEST_ASSERT_EQUAL(-1, stratum_api_v1_message.message_id);
+    TEST_ASSERT_EQUAL_INT(1, stratum_api_v1_message.should_abandon_work);
+
+    mining_notify * notify = stratum_api_v1_message.mining_notification;
+    TEST_ASSERT_EQUAL_STRING("6a", notify->job_id);
+    TEST_ASSERT_EQUAL_STRING("02", notify->coinbase_2);
+    TEST_ASSERT_EQUAL(2, notify->n_merkle_branches);
+    TEST_ASSERT_EQUAL_HEX8(0xae, notify->merkle_branches[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x81, notify->merkle_branches[31]);
+    TEST_ASSERT_EQUAL_HEX8(0x03, notify->merkle_branches[32]);
+    TEST_ASSERT_EQUAL_HEX8(0x76, notify->merkle_branches[63]);
+    TEST_ASSERT_EQUAL_UINT32(0x1705c739, notify->target);
+    STRATUM_V1_free_mining_notify(notify);
+}
+
+TEST_CASE("Parse stratum notify with invalid hex", "[mining.notify]")
+{
+    const char *branch = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"6a\","
+                         "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\",\"01\",\"02\","
+                         "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa8g\"],"
+                         "\"20000004\",\"1705c739\",\"64495522\",false]}";
+    const char *prev_hash = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"6a\","
+                            "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea00000000000000 0\",\"01\",\"02\","
+                            "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\"],"
+                            "\"20000004\",\"1705c739\",\"64495522\",false]}";
+    const char *messages[] = {branch, prev_hash};
+
+    for (int i = 0; i < 2; i++) {
+        StratumApiV1Message stratum_api_v1_message = {};
+        STRATUM_V1_parse(&stratum_api_v1_message, messages[i]);
+        TEST_ASSERT_NOT_EQUAL(MINING_NOTIFY, stratum_api_v1_message.method);
+        TEST_ASSERT_NULL(stratum_api_v1_message.mining_notification);
+    }
+}
+
+TEST_CASE("Parse stratum set_difficulty with fractional difficulty", "[mining.set_difficulty]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    STRATUM_V1_parse(&stratum_api_v1_message, "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[2048.75]}");
+    TEST_ASSERT_EQUAL(MINING_SET_DIFFICULTY, stratum_api_v1_message.method);
+    TEST_ASSERT_EQUAL(2048, stratum_api_v1_message.new_difficulty);
+}
+
+TEST_CASE("Parse stratum result rejected without reason", "[stratum]")
+{
+    StratumApiV1Message stratum_api_v1_message = {};
+    STRATUM_V1_parse(&stratum_api_v1_message, "{\"id\":12,\"result\":false,\"error\":null}");
+    TEST_ASSERT_EQUAL(12, stratum_api_v1_message.message_id);
+    TEST_ASSERT_EQUAL(STRATUM_RESULT, stratum_api_v1_message.method);
+    TEST_ASSERT_FALSE(stratum_api_v1_message.response_success);
+    TEST_ASSERT_EQUAL_STRING("unknown", stratum_api_v1_message.error_str);
+    free(stratum_api_v1_message.error_str);
+
+    StratumApiV1Message error_message = {};
+    STRATUM_V1_parse(&error_message, "{\"id\":13,\"result\":null,\"error\":[23]}");
+    TEST_ASSERT_EQUAL(STRATUM_RESULT, error_message.method);
+    TEST_ASSERT_FALSE(error_message.response_success);
+    TEST_ASSERT_EQUAL_STRING("unknown", error_message.error_str);
+    free(error_message.error_str);
+}
+
+TEST_CASE("Stratum parser latency", "[stratum][benchmark]")
+{
+    const char *json_string = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+                              "[\"1b4c3d9041\","
+                              "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+                              "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+                              "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+                              "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+                              "\"20000004\",\"1705c739\",\"64495522\",true]}";
+    const int iterations = 500;
+
+    esp_log_level_set("stratum_api", ESP_LOG_WARN);
+
+    // Tree build alone, the old path did this plus the same copies as the scanner
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t tree_peak = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        cJSON * json = cJSON_Parse(json_string);
+        size_t used = free_before - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+        if (used > tree_peak) {
+            tree_peak = used;
+        }
+        cJSON_Delete(json);
+    }
+    int64_t tree_us = esp_timer_get_time() - start;
+
+    size_t scan_peak = 0;
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        StratumApiV1Message message = {};
+        STRATUM_V1_parse(&message, json_string);
+        size_t used = free_before - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+        if (used > scan_peak) {
+            scan_peak = used;
+        }
+        STRATUM_V1_free_mining_notify(message.mining_notification);
+    }
+    int64_t scan_us = esp_timer_get_time() - start;
+
+    esp_log_level_set("stratum_api", ESP_LOG_INFO);
+
+    printf("mining.notify: cJSON tree %.1f us/msg, %u bytes peak; scanner %.1f us/msg, %u bytes peak\n",
+           (double) tree_us / iterations, (unsigned) tree_peak, (double) scan_us / iterations, (unsigned) scan_peak);
+    TEST_ASSERT_LESS_THAN(tree_peak, scan_peak);
+}
+
+TEST_CASE("Stratum response times are matched to the request id", "[stratum]")
+{
+    latency_summary before, after;
+    STRATUM_V1_get_latency_summary(STRATUM_REQUEST_SUBMIT, &before);
+
+    STRATUM_V1_reset_request_timings(54);
+    STRATUM_V1_stamp_tx(54, 5, STRATUM_REQUEST_AUTHORIZE);
+    STRATUM_V1_stamp_tx(54, 6, STRATUM_REQUEST_SUBMIT);
+    // The standby session counts the same ids on its own socket
+    STRATUM_V1_stamp_tx(55, 5, STRATUM_REQUEST_SUBMIT);
+    STRATUM_V1_stamp_tx(55, 7, STRATUM_REQUEST_SUBMIT);
+
+    // Never sent, and an id sharing the slot of a request in flight
+    TEST_ASSERT_EQUAL(-1, STRATUM_V1_get_response_time_ms(7));
+    TEST_ASSERT_EQUAL(-1, STRATUM_V1_get_response_time_ms(6 + MAX_REQUEST_IDS));
+
+    TEST_ASSERT_TRUE(STRATUM_V1_get_response_time_ms(6) >= 0);
+    TEST_ASSERT_EQUAL(-1, STRATUM_V1_get_response_time_ms(6));
+
+    STRATUM_V1_get_latency_summary(STRATUM_REQUEST_SUBMIT, &after);
+    TEST_ASSERT_EQUAL(before.count + 1, after.count);
+
+    // A reconnect starts the ids over
+    STRATUM_V1_reset_request_timings(56);
+    TEST_ASSERT_EQUAL(-1, STRATUM_V1_get_response_time_ms(5));
+
+    // No timed session between connections
+    STRATUM_V1_reset_request_timings(-1);
+    STRATUM_V1_stamp_tx(-1, 8, STRATUM_REQUEST_SUBMIT);
+    TEST_ASSERT_EQUAL(-1, STRATUM_V1_get_response_time_ms(8));
+}
+
+static void wait_us(int64_t us)
+{
+    int64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < us) {
+    }
+}
+
+TEST_CASE("Stratum response times end at the response line", "[stratum]")
+{
+    latency_summary before, after;
+    STRATUM_V1_get_latency_summary(STRATUM_REQUEST_SUBMIT, &before);
+    STRATUM_V1_reset_request_timings(54);
+
+    // Lines as stratum_task receives them: each is parsed, then timed
+    const char * lines[] = {
+        "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[1638]}",
+        "{\"id\":6,\"error\":null,\"result\":true}",
+        "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[2048]}",
+    };
+    const int64_t delays_us[] = {0, 2000, 50000};
+
+    STRATUM_V1_stamp_tx(54, 6, STRATUM_REQUEST_SUBMIT);
+    double response_time_ms[3];
+    for (int i = 0; i < 3; i++) {
+        wait_us(delays_us[i]);
+        StratumApiV1Message message = {};
+        STRATUM_V1_parse(&message, lines[i]);
+        response_time_ms[i] = STRATUM_V1_record_response(&message);
+    }
+
+    TEST_ASSERT_EQUAL(-1, response_time_ms[0]);
+    TEST_ASSERT_TRUE(response_time_ms[1] >= 2.0 && response_time_ms[1] < 50.0);
+    TEST_ASSERT_EQUAL(-1, response_time_ms[2]);
+
+    STRATUM_V1_get_latency_summary(STRATUM_REQUEST_SUBMIT, &after);
+    TEST_ASSERT_EQUAL(before.count + 1, after.count);
+}
+
+TEST_CASE("Submit template patches nonce, ntime and version", "[stratum]")
+{
+    const uint8_t extranonce_2[] = {0x00, 0x00, 0x00, 0x2a};
+    stratum_submit_template * tmpl = STRATUM_V1_create_submit_template("bc1qexampleaddress.worker", "1b4c3d9041", extranonce_2,
+                                                                       sizeof(extranonce_2));
+    TEST_ASSERT_NOT_NULL(tmpl);
+
+    char line[512];
+    int len = STRATUM_V1_format_submit_template(line, sizeof(line), tmpl, 1234, 0x64495522, 0x0000beef, 0x1fffe000);
+    TEST_ASSERT_EQUAL(strlen(line), len);
+    TEST_ASSERT_EQUAL('\n', line[len - 1]);
+
+    char expected[512];
+    STRATUM_V1_format_submit(expected, sizeof(expected), 1234, "bc1qexampleaddress.worker", "1b4c3d9041", "0000002a", 0x64495522,
+                             0x0000beef, 0x1fffe000);
+    // Same params as the sprintf line, only the id moved to the end
+    const char * got_params = strstr(line, "\"params\"");
+    const char * expected_params = strstr(expected, "\"params\"");
+    size_t params_len = strchr(expected_params, ']') - expected_params + 1;
+    TEST_ASSERT_EQUAL_STRING_LEN(expected_params, got_params, params_len);
+    TEST_ASSERT_EQUAL_STRING("], \"id\": 1234}\n", got_params + params_len - 1);
+
+    // Every share starts from the template, nothing of the previous one is left
+    len = STRATUM_V1_format_submit_template(line, sizeof(line), tmpl, 7, 0, 0xffffffff, 0);
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"00000000\", \"ffffffff\", \"00000000\"], \"id\": 7}\n"));
+
+    TEST_ASSERT_GREATER_OR_EQUAL(16, STRATUM_V1_format_submit_template(line, 16, tmpl, 7, 0, 0, 0));
+    STRATUM_V1_release_submit_template(tmpl);
+}
+
+TEST_CASE("Submit line encoding throughput", "[stratum][benchmark]")
+{
+    const char * user = "bc1qexampleaddressexampleaddressexample.bitaxe";
+    const char * job_id = "1b4c3d9041";
+    const char * extranonce_2 = "000000000000002a";
+    const int iterations = 5000;
+    char line[512];
+    uint32_t checksum = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        int len = STRATUM_V1_format_submit(line, sizeof(line), i, user, job_id, extranonce_2, 0x64495522, i * 2654435761u, i << 13);
+        checksum += line[len - 3];
+    }
+    int64_t sprintf_us = esp_timer_get_time() - start;
+
+    const uint8_t extranonce_2_bin[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2a};
+    stratum_submit_template * tmpl = STRATUM_V1_create_submit_template(user, job_id, extranonce_2_bin, sizeof(extranonce_2_bin));
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        int len = STRATUM_V1_format_submit_template(line, sizeof(line), tmpl, i, 0x64495522, i * 2654435761u, i << 13);
+        checksum += line[len - 3];
+    }
+    int64_t template_us = esp_timer_get_time() - start;
+    STRATUM_V1_release_submit_template(tmpl);
+
+    printf("mining.submit: snprintf %.2f us/line, template %.2f us/line (%lu)\n", (double) sprintf_us / iterations,
+           (double) template_us / iterations, (unsigned long) checksum);
+}
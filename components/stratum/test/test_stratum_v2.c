@@ -0,0 +1,161 @@
+#include "unity.h"
+#include "stratum_v2.h"
+#include "stratum_api.h"
+#include "mining.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char * prev_block_hash = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+static const char * merkle_root = "cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846";
+
+TEST_CASE("Stratum V2 frames a mining job and prevhash", "[stratum_v2]")
+{
+    uint8_t root[32], prev[32];
+    hex2bin(merkle_root, root, 32);
+    swap_endian_words(prev_block_hash, prev);
+
+    uint8_t frame[128];
+    size_t len = STRATUM_V2_encode_new_mining_job(frame, sizeof(frame), 7, 42, false, 0, 0x20000004, root);
+    TEST_ASSERT_EQUAL(SV2_FRAME_HEADER_SIZE + 4 + 4 + 1 + 4 + 32, len);
+    TEST_ASSERT_EQUAL_HEX8(0x80, frame[1]);
+    TEST_ASSERT_EQUAL_HEX8(SV2_NEW_MINING_JOB, frame[2]);
+    TEST_ASSERT_EQUAL(len - SV2_FRAME_HEADER_SIZE, frame[3]);
+
+    StratumApiV2Message message = {};
+    TEST_ASSERT_TRUE(STRATUM_V2_parse(&message, frame, len));
+    TEST_ASSERT_EQUAL(SV2_NEW_MINING_JOB, message.msg_type);
+    TEST_ASSERT_EQUAL(7, message.channel_id);
+    TEST_ASSERT_EQUAL(42, message.job_id);
+    TEST_ASSERT_FALSE(message.has_min_ntime);
+    TEST_ASSERT_EQUAL_HEX32(0x20000004, message.version);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(root, message.merkle_root, 32);
+
+    len = STRATUM_V2_encode_set_new_prev_hash(frame, sizeof(frame), 7, 42, prev, 0x64658bd8, 0x1705dd01);
+    TEST_ASSERT_TRUE(STRATUM_V2_parse(&message, frame, len));
+    TEST_ASSERT_EQUAL(SV2_SET_NEW_PREV_HASH, message.msg_type);
+    TEST_ASSERT_EQUAL(42, message.job_id);
+    TEST_ASSERT_EQUAL_HEX32(0x64658bd8, message.min_ntime);
+    TEST_ASSERT_EQUAL_HEX32(0x1705dd01, message.nbits);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(prev, message.prev_hash, 32);
+
+    // Truncated payloads are rejected
+    frame[3]--;
+    TEST_ASSERT_FALSE(STRATUM_V2_parse(&message, frame, len - 1));
+}
+
+TEST_CASE("Stratum V2 encodes a standard share", "[stratum_v2]")
+{
+    uint8_t frame[64];
+    size_t len = STRATUM_V2_encode_submit_shares_standard(frame, sizeof(frame), 1, 2, 3, 0xdeadbeef, 0x64658bd8, 0x20002004);
+
+    const uint8_t expected[] = {
+        0x00, 0x80, 0x1a, 0x18, 0x00, 0x00,
+        0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+        0xef, 0xbe, 0xad, 0xde, 0xd8, 0x8b, 0x65, 0x64, 0x04, 0x20, 0x00, 0x20,
+    };
+    TEST_ASSERT_EQUAL(sizeof(expected), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, frame, len);
+
+    TEST_ASSERT_EQUAL(0, STRATUM_V2_encode_submit_shares_standard(frame, 16, 1, 2, 3, 0xdeadbeef, 0x64658bd8, 0x20002004));
+}
+
+TEST_CASE("Stratum V2 parses an opened standard channel", "[stratum_v2]")
+{
+    uint8_t frame[SV2_FRAME_HEADER_SIZE + 4 + 4 + 32 + 1 + 4 + 4] = {0x00, 0x00, SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS, 49};
+    uint8_t * payload = frame + SV2_FRAME_HEADER_SIZE;
+    payload[0] = 1;  // request_id
+    payload[4] = 9;  // channel_id
+    // difficulty 1 target, 0x00000000ffff0000... little endian
+    payload[8 + 26] = 0xff;
+    payload[8 + 27] = 0xff;
+    payload[40] = 4; // extranonce_prefix length
+    memcpy(payload + 41, "\x01\x02\x03\x04", 4);
+    payload[45] = 5; // group_channel_id
+
+    StratumApiV2Message message = {};
+    TEST_ASSERT_TRUE(STRATUM_V2_parse(&message, frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL(SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS, message.msg_type);
+    TEST_ASSERT_EQUAL(1, message.request_id);
+    TEST_ASSERT_EQUAL(9, message.channel_id);
+    TEST_ASSERT_EQUAL(4, message.extranonce_prefix_len);
+    TEST_ASSERT_EQUAL_HEX8(0x04, message.extranonce_prefix[3]);
+    TEST_ASSERT_EQUAL(5, message.group_channel_id);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 1.0, STRATUM_V2_target_to_difficulty(message.target));
+}
+
+TEST_CASE("Stratum V2 header job matches the V1 job", "[stratum_v2]")
+{
+    mining_notify notify_message;
+    notify_message.prev_block_hash = (char *) prev_block_hash;
+    notify_message.version = 0x20000004;
+    notify_message.target = 0x1705dd01;
+    notify_message.ntime = 0x64658bd8;
+    bm_job v1_job = construct_bm_job(&notify_message, merkle_root, STRATUM_DEFAULT_VERSION_MASK, 1000);
+
+    uint8_t root[32], prev[32];
+    hex2bin(merkle_root, root, 32);
+    swap_endian_words(prev_block_hash, prev);
+    bm_job v2_job = construct_bm_job_from_header(0x20000004, prev, root, 0x64658bd8, 0x1705dd01, STRATUM_DEFAULT_VERSION_MASK, 1000);
+
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(v1_job.prev_block_hash_be, v2_job.prev_block_hash_be, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(v1_job.merkle_root_be, v2_job.merkle_root_be, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(v1_job.midstate, v2_job.midstate, 32);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(v1_job.midstate3, v2_job.midstate3, 32);
+}
+
+TEST_CASE("Stratum V2 job size and build latency", "[stratum_v2][benchmark]")
+{
+    const char * notify = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+                          "[\"1b4c3d9041\","
+                          "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+                          "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+                          "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+                          "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+                          "\"20000004\",\"1705c739\",\"64495522\",true]}\n";
+    const int iterations = 200;
+
+    uint8_t root[32], prev[32];
+    hex2bin(merkle_root, root, 32);
+    swap_endian_words(prev_block_hash, prev);
+    uint8_t job_frame[128];
+    size_t job_len = STRATUM_V2_encode_new_mining_job(job_frame, sizeof(job_frame), 1, 1, true, 0x64495522, 0x20000004, root);
+
+    esp_log_level_set("stratum_api", ESP_LOG_WARN);
+
+    // V1: parse the notify, then coinbase, merkle root and job for one extranonce2
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        StratumApiV1Message message = {};
+        STRATUM_V1_parse(&message, notify);
+        mining_notify * params = message.mining_notification;
+        char * coinbase_tx = construct_coinbase_tx(params->coinbase_1, params->coinbase_2, "e9695791", "00000000");
+        char merkle_root_hex[65];
+        calculate_merkle_root_hash(coinbase_tx, (uint8_t(*)[32]) params->merkle_branches, params->n_merkle_branches, merkle_root_hex);
+        bm_job job = construct_bm_job(params, merkle_root_hex, STRATUM_DEFAULT_VERSION_MASK, 1000);
+        TEST_ASSERT_EQUAL_HEX32(0x20000004, job.version);
+        free(coinbase_tx);
+        STRATUM_V1_free_mining_notify(params);
+    }
+    int64_t v1_us = esp_timer_get_time() - start;
+
+    esp_log_level_set("stratum_api", ESP_LOG_INFO);
+
+    // V2: parse the frame and copy the header
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        StratumApiV2Message message;
+        STRATUM_V2_parse(&message, job_frame, job_len);
+        bm_job job = construct_bm_job_from_header(message.version, prev, message.merkle_root, message.min_ntime, 0x1705c739,
+                                                  STRATUM_DEFAULT_VERSION_MASK, 1000);
+        TEST_ASSERT_EQUAL_HEX32(0x20000004, job.version);
+    }
+    int64_t v2_us = esp_timer_get_time() - start;
+
+    printf("bytes per job: V1 mining.notify %u, V2 NewMiningJob %u\n", (unsigned) strlen(notify), (unsigned) job_len);
+    printf("notify to job: V1 %.1f us, V2 %.1f us\n", (double) v1_us / iterations, (double) v2_us / iterations);
+    TEST_ASSERT_LESS_THAN(strlen(notify), job_len);
+}
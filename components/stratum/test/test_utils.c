@@ -1,5 +1,7 @@
 #include "unity.h"
 #include "utils.h"
+#include "esp_timer.h"
+#include <stdio.h>
 #include <string.h>
 
 TEST_CASE("Test double sha", "[utils]")
@@ -29,3 +31,168 @@ TEST_CASE("Test bin2hex", "[utils]")
     bin2hex(bin, 5, hex_string, 11);
     TEST_ASSERT_EQUAL_STRING("48454c4c4f", hex_string);
 }
+
+TEST_CASE("Targets from difficulty and nBits", "[utils]")
+{
+    uint32_t target[8];
+
+    difficulty_to_target(1, target);
+    const uint32_t diff1[8] = {0, 0, 0, 0, 0, 0, 0xffff0000, 0};
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(diff1, target, 8);
+
+    // 0xffff << 208 / 1000, worked out with Python integers
+    difficulty_to_target(1000, target);
+    const uint32_t diff1000[8] = {0xc28f5c28, 0x8f5c28f5, 0x5c28f5c2, 0x28f5c28f, 0xf5c28f5c, 0xc28f5c28, 0x004188f5, 0};
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(diff1000, target, 8);
+
+    // difficulty 1 in nBits
+    nbits_to_target(0x1d00ffff, target);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(diff1, target, 8);
+
+    nbits_to_target(0x1705ae3a, target);
+    const uint32_t block[8] = {0, 0, 0, 0, 0, 0x0005ae3a, 0, 0};
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(block, target, 8);
+}
+
+TEST_CASE("Hash against a target", "[utils]")
+{
+    uint32_t target[8];
+    difficulty_to_target(1000, target);
+
+    // The target itself still meets it, one more does not
+    uint8_t hash[32];
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) {
+            hash[i * 4 + j] = target[i] >> (8 * j);
+        }
+    }
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+    hash[0]++;
+    TEST_ASSERT_FALSE(hash_meets_target(hash, target));
+    hash[0] -= 2;
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+
+    // Decided by the top word
+    memset(hash, 0, sizeof(hash));
+    hash[28] = 1;
+    TEST_ASSERT_FALSE(hash_meets_target(hash, target));
+}
+
+// The byte at a time codec hex2bin and bin2hex used to be
+static const uint8_t table_hex_values[256] = {
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4, ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15
+};
+
+static void table_hex2bin(const char *hex, uint8_t *bin, size_t bin_len)
+{
+    for (size_t i = 0; i < bin_len; i++) {
+        bin[i] = table_hex_values[(unsigned char)hex[2 * i]] << 4 | table_hex_values[(unsigned char)hex[2 * i + 1]];
+    }
+}
+
+static void table_bin2hex(const uint8_t *bin, size_t bin_len, char *hex)
+{
+    for (size_t i = 0; i < bin_len; i++) {
+        hex[2 * i] = "0123456789abcdef"[bin[i] >> 4];
+        hex[2 * i + 1] = "0123456789abcdef"[bin[i] & 0x0f];
+    }
+    hex[2 * bin_len] = '\0';
+}
+
+TEST_CASE("Hex codec matches the byte at a time codec", "[utils]")
+{
+    static uint8_t bin[300], decoded[300], expected[300];
+    static char hex[601], expected_hex[601];
+    uint32_t seed = 1;
+    for (size_t i = 0; i < sizeof(bin); i++) {
+        seed = seed * 1103515245 + 12345;
+        bin[i] = seed >> 16;
+    }
+
+    // Every length, so every split between vector blocks and the byte loop
+    for (size_t len = 0; len <= sizeof(bin); len++) {
+        TEST_ASSERT_EQUAL(len * 2, bin2hex(bin, len, hex, sizeof(hex)));
+        table_bin2hex(bin, len, expected_hex);
+        TEST_ASSERT_EQUAL_STRING(expected_hex, hex);
+
+        // Mixed case decodes the same
+        for (size_t i = 0; i < len * 2; i += 3) {
+            if (hex[i] >= 'a') {
+                hex[i] -= 'a' - 'A';
+            }
+        }
+        table_hex2bin(hex, expected, len);
+        TEST_ASSERT_TRUE(hex_decode(hex, len * 2, decoded));
+        if (len > 0) {
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, decoded, len);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(bin, decoded, len);
+        }
+        TEST_ASSERT_EQUAL(len, hex2bin(hex, decoded, len));
+    }
+    TEST_ASSERT_EQUAL(0, bin2hex(bin, 4, hex, 8));
+}
+
+TEST_CASE("Hex decoding reports invalid characters", "[utils]")
+{
+    const char *valid = "ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000";
+    const char invalid[] = {'g', 'G', 'z', ' ', '/', ':', '@', '`', '\n', (char)0x80, (char)0xb0, (char)0xe1, (char)0xff};
+    char hex[65];
+    uint8_t bin[32];
+
+    for (size_t i = 0; i < 64; i++) {
+        for (size_t j = 0; j < sizeof(invalid); j++) {
+            strcpy(hex, valid);
+            hex[i] = invalid[j];
+            TEST_ASSERT_FALSE(hex_decode(hex, 64, bin));
+            // hex2bin keeps the bytes before the bad one
+            TEST_ASSERT_EQUAL(i / 2, hex2bin(hex, bin, 32));
+        }
+    }
+
+    TEST_ASSERT_FALSE(hex_decode("abc", 3, bin));
+    TEST_ASSERT_EQUAL(2, hex2bin("abc", bin, 2));
+    TEST_ASSERT_EQUAL(2, hex2bin("abc", bin, 4));
+    TEST_ASSERT_EQUAL_HEX8(0xc0, bin[1]);
+    TEST_ASSERT_EQUAL(1, hex2bin("ab", bin, 4));
+}
+
+TEST_CASE("Hex codec throughput", "[utils][benchmark]")
+{
+    // coinbase_1, merkle branch, a typical and a large coinbase_2
+    const size_t lengths[] = {32, 91, 163, 400};
+    static uint8_t bin[400], decoded[400];
+    static char hex[801];
+    for (size_t i = 0; i < sizeof(bin); i++) {
+        bin[i] = i * 37;
+    }
+    const int iterations = 2000;
+
+    for (int l = 0; l < 4; l++) {
+        size_t len = lengths[l];
+        uint32_t checksum = 0;
+
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            bin[0] = i;
+            table_bin2hex(bin, len, hex);
+            table_hex2bin(hex, decoded, len);
+            checksum += decoded[0];
+        }
+        int64_t table_us = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        for (int i = 0; i < iterations; i++) {
+            bin[0] = i;
+            bin2hex(bin, len, hex, sizeof(hex));
+            TEST_ASSERT_TRUE(hex_decode(hex, len * 2, decoded));
+            checksum -= decoded[0];
+        }
+        int64_t codec_us = esp_timer_get_time() - start;
+
+        printf("hex round trip of %3u bytes: byte table %.0f MB/s, codec %.0f MB/s\n", (unsigned) len,
+               (double) len * iterations / table_us, (double) len * iterations / codec_us);
+        TEST_ASSERT_EQUAL_UINT32(0, checksum);
+    }
+}
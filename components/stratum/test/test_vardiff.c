@@ -0,0 +1,118 @@
+#include "unity.h"
+#include "vardiff.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define S_TO_US(s) ((int64_t) (s) * 1000000)
+
+TEST_CASE("Vardiff suggests the difficulty for the target share rate", "[vardiff]")
+{
+    vardiff_controller vardiff;
+    vardiff_init(&vardiff, 6, 256, 1 << 20, 0);
+
+    // 1 TH/s at 6 shares per minute needs 1e12 * 10 / 2^32 = 2328
+    TEST_ASSERT_EQUAL_UINT32(2328, vardiff_difficulty_for_hashrate(&vardiff, 1000));
+    TEST_ASSERT_EQUAL_UINT32(256, vardiff_difficulty_for_hashrate(&vardiff, 1));
+    TEST_ASSERT_EQUAL_UINT32(1 << 20, vardiff_difficulty_for_hashrate(&vardiff, 1e7));
+
+    // Nothing before the window is over
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&vardiff, 1000, 512, S_TO_US(60)));
+    // Few shares, the expected hashrate decides
+    TEST_ASSERT_EQUAL_UINT32(2328, vardiff_update(&vardiff, 1000, 512, S_TO_US(VARDIFF_RETARGET_S)));
+    // Pool still on the old difficulty, the same suggestion is not sent again
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&vardiff, 1000, 512, S_TO_US(2 * VARDIFF_RETARGET_S)));
+    // Within the deadband of the pool difficulty
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&vardiff, 1500, 2328, S_TO_US(3 * VARDIFF_RETARGET_S)));
+
+    // Enough shares, the measured rate wins over a wrong expected hashrate
+    for (int i = 0; i < 48; i++) {
+        vardiff_record_share(&vardiff, 2328);
+    }
+    uint32_t difficulty = vardiff_update(&vardiff, 1000, 2328, S_TO_US(4 * VARDIFF_RETARGET_S));
+    TEST_ASSERT_UINT32_WITHIN(2, 4 * 2328, difficulty);
+
+    // Ignored by the pool, not sent again
+    for (int i = 0; i < 48; i++) {
+        vardiff_record_share(&vardiff, 2328);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&vardiff, 1000, 2328, S_TO_US(5 * VARDIFF_RETARGET_S)));
+    // The pool took the suggestion and later went back on its own, the same target is suggested again
+    vardiff_pool_difficulty_changed(&vardiff);
+    for (int i = 0; i < 48; i++) {
+        vardiff_record_share(&vardiff, 2328);
+    }
+    TEST_ASSERT_EQUAL_UINT32(difficulty, vardiff_update(&vardiff, 1000, 2328, S_TO_US(6 * VARDIFF_RETARGET_S)));
+
+    // Disabled
+    vardiff_init(&vardiff, 0, 256, 1 << 20, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&vardiff, 1000, 512, S_TO_US(VARDIFF_RETARGET_S)));
+}
+
+static uint32_t rng_state = 0x2545f491;
+
+static double uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state + 1.0) / 4294967297.0;
+}
+
+// Submits in one hour of a board with a noisy hashrate, the pool applies suggestions on the next job
+static int simulate_hour(double hashrate_ghs, uint32_t static_difficulty, vardiff_controller * vardiff)
+{
+    const int job_interval_s = 30;
+    uint32_t pool_difficulty = static_difficulty;
+    uint32_t pending_difficulty = 0;
+    int submits = 0;
+
+    rng_state = 0x2545f491;
+    double next_share_s = 0;
+    for (int second = 0; second < 3600; second++) {
+        double shares_per_s = hashrate_ghs * 1e9 / (pool_difficulty * 4294967296.0);
+        if (next_share_s == 0) {
+            next_share_s = second - log(uniform()) / shares_per_s;
+        }
+        while (next_share_s < second + 1) {
+            submits++;
+            if (vardiff != NULL) {
+                vardiff_record_share(vardiff, pool_difficulty);
+            }
+            next_share_s -= log(uniform()) / shares_per_s;
+        }
+
+        if (second % job_interval_s == 0 && pending_difficulty != 0) {
+            pool_difficulty = pending_difficulty;
+            pending_difficulty = 0;
+            next_share_s = 0;
+        }
+        if (vardiff != NULL) {
+            // Reported hashrate wobbles by +-10%
+            double reported_ghs = hashrate_ghs * (0.9 + 0.2 * uniform());
+            uint32_t suggested = vardiff_update(vardiff, reported_ghs, pool_difficulty, S_TO_US(second + 1));
+            if (suggested != 0) {
+                pending_difficulty = suggested;
+            }
+        }
+    }
+    return submits;
+}
+
+TEST_CASE("Vardiff reduces the submits of a Hex class board", "[vardiff]")
+{
+    // Six BM1366 at about 700 GH/s each, static suggestion of 1000
+    const double hashrate_ghs = 4200;
+
+    int static_submits = simulate_hour(hashrate_ghs, 1000, NULL);
+
+    vardiff_controller vardiff;
+    vardiff_init(&vardiff, 6, 1000, UINT32_MAX, 0);
+    int vardiff_submits = simulate_hour(hashrate_ghs, 1000, &vardiff);
+
+    printf("submits per hour at 4.2 TH/s: static difficulty 1000 %d, vardiff 6/min %d (final suggestion %lu)\n", static_submits,
+           vardiff_submits, (unsigned long) vardiff.last_suggested);
+    TEST_ASSERT_INT_WITHIN(300, 3520, static_submits);
+    TEST_ASSERT_INT_WITHIN(120, 6 * 60, vardiff_submits);
+    TEST_ASSERT_GREATER_THAN(5 * vardiff_submits, static_submits);
+}
@@ -0,0 +1,231 @@
+#include "unity.h"
+#include "work_queue.h"
+#include "esp_timer.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STRESS_ITEMS 200000
+
+static bm_job * make_job(uint32_t ntime)
+{
+    bm_job * job = bm_job_alloc();
+    memset(job, 0, sizeof(bm_job));
+    job->ntime = ntime;
+    return job;
+}
+
+static void * produce_items(void * arg)
+{
+    work_queue * queue = arg;
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        queue_enqueue(queue, (void *) i);
+    }
+    return NULL;
+}
+
+TEST_CASE("Work queue keeps order between producer and consumer", "[work_queue]")
+{
+    static work_queue queue;
+    queue_init(&queue);
+
+    pthread_t producer;
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, produce_items, &queue));
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        uintptr_t item = (uintptr_t) queue_dequeue(&queue);
+        if (item != i) {
+            TEST_ASSERT_EQUAL(i, item);
+        }
+    }
+    pthread_join(producer, NULL);
+    TEST_ASSERT_EQUAL(0, queue_count(&queue));
+}
+
+TEST_CASE("Work queue clears and puts new blocks in front", "[work_queue]")
+{
+    static work_queue queue;
+    queue_init(&queue);
+    slot_pool_stats before, after;
+    bm_job_pool_get_stats(&before);
+
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        queue_enqueue(&queue, make_job(i));
+    }
+    TEST_ASSERT_EQUAL(QUEUE_SIZE, queue_count(&queue));
+
+    // A cleared queue takes a full batch again before the consumer freed the old jobs
+    ASIC_jobs_queue_clear(&queue);
+    TEST_ASSERT_EQUAL(0, queue_count(&queue));
+    for (int i = 0; i < QUEUE_SIZE - 1; i++) {
+        queue_enqueue(&queue, make_job(100 + i));
+    }
+    ASIC_jobs_queue_push_front(&queue, make_job(99));
+    TEST_ASSERT_EQUAL(QUEUE_SIZE, queue_count(&queue));
+
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        bm_job * job = queue_dequeue(&queue);
+        TEST_ASSERT_EQUAL(99 + i, job->ntime);
+        free_bm_job(job);
+    }
+    TEST_ASSERT_EQUAL(0, queue_count(&queue));
+
+    queue_enqueue(&queue, make_job(200));
+    ASIC_jobs_queue_push_front(&queue, make_job(201));
+    ASIC_jobs_queue_clear(&queue);
+    queue_enqueue(&queue, make_job(202));
+    bm_job * job = queue_dequeue(&queue);
+    TEST_ASSERT_EQUAL(202, job->ntime);
+    free_bm_job(job);
+
+    bm_job_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
+
+static void * produce_blocks(void * arg)
+{
+    work_queue * queue = arg;
+    for (uint32_t ntime = 1; ntime < STRESS_ITEMS / 10; ntime++) {
+        // A new block every 50 jobs, as create_jobs_task does it
+        if (ntime % 50 == 0) {
+            ASIC_jobs_queue_clear(queue);
+            ASIC_jobs_queue_push_front(queue, make_job(ntime));
+        } else {
+            queue_enqueue(queue, make_job(ntime));
+        }
+    }
+    queue_enqueue(queue, make_job(UINT32_MAX));
+    return NULL;
+}
+
+TEST_CASE("Work queue clears while the consumer runs", "[work_queue]")
+{
+    static work_queue queue;
+    queue_init(&queue);
+    slot_pool_stats before, after;
+    bm_job_pool_get_stats(&before);
+
+    pthread_t producer;
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, produce_blocks, &queue));
+    uint32_t last = 0;
+    int received = 0;
+    while (last != UINT32_MAX) {
+        bm_job * job = queue_dequeue(&queue);
+        // Cleared jobs never come after the new block that cleared them
+        if (job->ntime <= last) {
+            TEST_ASSERT_GREATER_THAN(last, job->ntime);
+        }
+        last = job->ntime;
+        received++;
+        free_bm_job(job);
+    }
+    pthread_join(producer, NULL);
+
+    bm_job_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+    printf("job queue, clear while consuming: %d of %d jobs received\n", received, STRESS_ITEMS / 10);
+}
+
+// The queue as it was before the ring, every call took the lock and signalled
+typedef struct
+{
+    void * buffer[QUEUE_SIZE];
+    int head;
+    int tail;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} locked_queue;
+
+static void locked_enqueue(locked_queue * queue, void * new_work)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == QUEUE_SIZE) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->buffer[queue->tail] = new_work;
+    queue->tail = (queue->tail + 1) % QUEUE_SIZE;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void * locked_dequeue(locked_queue * queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    void * next_work = queue->buffer[queue->head];
+    queue->head = (queue->head + 1) % QUEUE_SIZE;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return next_work;
+}
+
+static void * produce_locked(void * arg)
+{
+    locked_queue * queue = arg;
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        locked_enqueue(queue, (void *) i);
+    }
+    return NULL;
+}
+
+TEST_CASE("Work queue throughput against a locked queue", "[work_queue][benchmark]")
+{
+    static locked_queue locked;
+    memset(&locked, 0, sizeof(locked));
+    pthread_mutex_init(&locked.lock, NULL);
+    pthread_cond_init(&locked.not_empty, NULL);
+    pthread_cond_init(&locked.not_full, NULL);
+
+    pthread_t producer;
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, produce_locked, &locked));
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        TEST_ASSERT_TRUE(locked_dequeue(&locked) == (void *) i);
+    }
+    pthread_join(producer, NULL);
+    int64_t locked_us = esp_timer_get_time() - start;
+
+    static work_queue queue;
+    queue_init(&queue);
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, produce_items, &queue));
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        TEST_ASSERT_TRUE(queue_dequeue(&queue) == (void *) i);
+    }
+    pthread_join(producer, NULL);
+    int64_t ring_us = esp_timer_get_time() - start;
+
+    // As it runs on the device: the job builder refills while ASIC_task waits out the job interval
+    start = esp_timer_get_time();
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i += QUEUE_SIZE) {
+        for (int j = 0; j < QUEUE_SIZE; j++) {
+            locked_enqueue(&locked, (void *) (i + j));
+        }
+        for (int j = 0; j < QUEUE_SIZE; j++) {
+            TEST_ASSERT_TRUE(locked_dequeue(&locked) == (void *) (i + j));
+        }
+    }
+    int64_t locked_refill_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i += QUEUE_SIZE) {
+        for (int j = 0; j < QUEUE_SIZE; j++) {
+            queue_enqueue(&queue, (void *) (i + j));
+        }
+        for (int j = 0; j < QUEUE_SIZE; j++) {
+            TEST_ASSERT_TRUE(queue_dequeue(&queue) == (void *) (i + j));
+        }
+    }
+    int64_t ring_refill_us = esp_timer_get_time() - start;
+
+    printf("job queue, two tasks: locked %.0f ops/s, ring %.0f ops/s\n", STRESS_ITEMS * 1e6 / locked_us,
+           STRESS_ITEMS * 1e6 / ring_us);
+    printf("job queue, batch refill: locked %.0f ops/s, ring %.0f ops/s\n", STRESS_ITEMS * 1e6 / locked_refill_us,
+           STRESS_ITEMS * 1e6 / ring_refill_us);
+}
@@ -3,20 +3,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "mbedtls/sha256.h"
 
 #define HASH_CNT_LSB 0x100000000uLL // 2^32 hashes for difficulty 1
 
-static const char hex_table[] = "0123456789abcdef";
-
-static const uint8_t hex_val_table[256] = {
-    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
-    ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
-    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
-    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15
-};
-
 #ifndef bswap_16
 #define bswap_16(a) ((((uint16_t)(a) << 8) & 0xff00) | (((uint16_t)(a) >> 8) & 0xff))
 #endif
@@ -71,36 +65,170 @@ void flip32bytes(void *dest_p, const void *src_p)
         dest[i] = swab32(src[i]);
 }
 
+// Hex in 16 characters per SSE2 register, 8 per 64 bit word (SWAR) elsewhere. A character that is
+// not a hex digit stops decoding instead of turning into a zero nibble.
+#if defined(__SSE2__)
+
+static bool decode_block(const char *hex, uint8_t *bin)
+{
+    __m128i chars = _mm_loadu_si128((const __m128i *)hex);
+    __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digits, letters)) != 0xffff) {
+        return false;
+    }
+
+    __m128i nibbles = _mm_add_epi8(_mm_and_si128(chars, _mm_set1_epi8(0x0f)), _mm_and_si128(letters, _mm_set1_epi8(9)));
+    __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4), _mm_srli_epi16(nibbles, 8));
+    _mm_storel_epi64((__m128i *)bin, _mm_packus_epi16(pairs, pairs));
+    return true;
+}
+
+static void encode_block(const uint8_t *bin, char *hex)
+{
+    __m128i bytes = _mm_loadl_epi64((const __m128i *)bin);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0f));
+    __m128i low = _mm_and_si128(bytes, _mm_set1_epi8(0x0f));
+    __m128i nibbles = _mm_unpacklo_epi8(high, low);
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    _mm_storeu_si128((__m128i *)hex, _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters));
+}
+
+#define HEX_BLOCK_CHARS 16
+
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+#define ONES 0x0101010101010101ULL
+
+static bool decode_block(const char *hex, uint8_t *bin)
+{
+    uint64_t chars;
+    memcpy(&chars, hex, 8);
+    if (chars & (ONES * 0x80)) {
+        return false;
+    }
+
+    // The high bit of each byte holds a comparison, below 0x80 no byte carries into the next
+    uint64_t digits = (chars + ONES * (0x80 - '0')) & (ONES * (0x80 + '9') - chars) & (ONES * 0x80);
+    uint64_t lower = chars | (ONES * 0x20);
+    uint64_t letters = (lower + ONES * (0x80 - 'a')) & (ONES * (0x80 + 'f') - lower) & (ONES * 0x80);
+    if ((digits | letters) != ONES * 0x80) {
+        return false;
+    }
+
+    uint64_t nibbles = (chars & (ONES * 0x0f)) + (letters >> 7) * 9;
+    uint64_t pairs = ((nibbles & 0x00ff00ff00ff00ffULL) << 4) | ((nibbles >> 8) & 0x00ff00ff00ff00ffULL);
+    pairs = (pairs | (pairs >> 8)) & 0x0000ffff0000ffffULL;
+    uint32_t bytes = pairs | (pairs >> 16);
+    memcpy(bin, &bytes, 4);
+    return true;
+}
+
+static void encode_block(const uint8_t *bin, char *hex)
+{
+    uint32_t bytes;
+    memcpy(&bytes, bin, 4);
+    uint64_t spread = bytes;
+    spread = (spread | (spread << 16)) & 0x0000ffff0000ffffULL;
+    spread = (spread | (spread << 8)) & 0x00ff00ff00ff00ffULL;
+
+    uint64_t nibbles = ((spread >> 4) & 0x000f000f000f000fULL) | ((spread & 0x000f000f000f000fULL) << 8);
+    uint64_t letters = ((nibbles + ONES * (0x80 - 10)) & (ONES * 0x80)) >> 7;
+    uint64_t chars = nibbles + ONES * '0' + letters * ('a' - '0' - 10);
+    memcpy(hex, &chars, 8);
+}
+
+#define HEX_BLOCK_CHARS 8
+
+#else
+
+#define HEX_BLOCK_CHARS 0
+
+#endif
+
+static const char hex_table[] = "0123456789abcdef";
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Decodes up to pairs bytes, returns how many came before the first invalid digit
+static size_t decode(const char *hex, size_t pairs, uint8_t *bin)
+{
+    size_t i = 0;
+#if HEX_BLOCK_CHARS
+    for (; i + HEX_BLOCK_CHARS / 2 <= pairs; i += HEX_BLOCK_CHARS / 2) {
+        if (!decode_block(hex + i * 2, bin + i)) {
+            break;
+        }
+    }
+#endif
+    for (; i < pairs; i++) {
+        int high = hex_value(hex[i * 2]);
+        int low = hex_value(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            break;
+        }
+        bin[i] = high << 4 | low;
+    }
+    return i;
+}
+
+bool hex_decode(const char *hex, size_t hex_len, uint8_t *bin)
+{
+    return hex_len % 2 == 0 && decode(hex, hex_len / 2, bin) == hex_len / 2;
+}
+
+void hex_encode(const uint8_t *bin, size_t bin_len, char *hex)
+{
+    size_t i = 0;
+#if HEX_BLOCK_CHARS
+    for (; i + HEX_BLOCK_CHARS / 2 <= bin_len; i += HEX_BLOCK_CHARS / 2) {
+        encode_block(bin + i, hex + i * 2);
+    }
+#endif
+    for (; i < bin_len; i++) {
+        hex[2 * i] = hex_table[bin[i] >> 4];
+        hex[2 * i + 1] = hex_table[bin[i] & 0x0F];
+    }
+}
+
 size_t bin2hex(const uint8_t *buf, size_t buflen, char *hex, size_t hexlen)
 {
-    if (hexlen < buflen * 2) {
+    if (hexlen < buflen * 2 + 1) {
         return 0;
     }
 
-    for (size_t i = 0; i < buflen; i++) {
-        hex[2 * i] = hex_table[buf[i] >> 4];
-        hex[2 * i + 1] = hex_table[buf[i] & 0x0F];
-    }
+    hex_encode(buf, buflen, hex);
     hex[2 * buflen] = '\0';
     return 2 * buflen;
 }
 
 size_t hex2bin(const char *hex, uint8_t *bin, size_t bin_len)
 {
-    size_t len = 0;
-
-    while (len < bin_len && hex[0]) {
-        if (!hex[1]) {
-            bin[len++] = hex_val_table[(unsigned char)hex[0]] << 4;
-            break;
+    size_t hex_len = strnlen(hex, bin_len * 2);
+    size_t len = decode(hex, hex_len / 2, bin);
+
+    // A trailing single digit is the high nibble of the last byte
+    if (len == hex_len / 2 && hex_len % 2 == 1) {
+        int high = hex_value(hex[hex_len - 1]);
+        if (high >= 0) {
+            bin[len++] = high << 4;
         }
-        bin[len++] = (hex_val_table[(unsigned char)hex[0]] << 4) | hex_val_table[(unsigned char)hex[1]];
-        hex += 2;
     }
-
     return len;
 }
 
+
 void print_hex(const uint8_t *b, size_t len,
                const size_t in_line, const char *prefix)
 {
@@ -183,6 +311,69 @@ void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t des
      flip32bytes(dest, midstate.state);
 }
 
+const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t sha256_initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256_compress(uint32_t state[8], const uint8_t block[64])
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void sha256_state_to_bytes(const uint32_t state[8], uint8_t dest[32])
+{
+    for (int i = 0; i < 8; i++) {
+        dest[i * 4] = state[i] >> 24;
+        dest[i * 4 + 1] = state[i] >> 16;
+        dest[i * 4 + 2] = state[i] >> 8;
+        dest[i * 4 + 3] = state[i];
+    }
+}
+
 void swap_endian_words(const char *hex_words, uint8_t *output)
 {
     size_t hex_length = strlen(hex_words);
@@ -193,15 +384,16 @@ void swap_endian_words(const char *hex_words, uint8_t *output)
     }
 
     size_t binary_length = hex_length / 2;
+    hex2bin(hex_words, output, binary_length);
 
     for (size_t i = 0; i < binary_length; i += 4)
     {
-        for (int j = 0; j < 4; j++)
-        {
-            unsigned int byte_val;
-            sscanf(hex_words + (i + j) * 2, "%2x", &byte_val);
-            output[i + (3 - j)] = byte_val;
-        }
+        uint8_t byte = output[i];
+        output[i] = output[i + 3];
+        output[i + 3] = byte;
+        byte = output[i + 1];
+        output[i + 1] = output[i + 2];
+        output[i + 2] = byte;
     }
 }
 
@@ -275,6 +467,53 @@ double networkDifficulty(uint32_t nBits)
     return difficulty;
 }
 
+void difficulty_to_target(uint32_t difficulty, uint32_t target[8])
+{
+    // difficulty 1 is 0xffff << 208
+    uint32_t diff1[8] = {0, 0, 0, 0, 0, 0, 0xffff0000, 0};
+    uint64_t remainder = 0;
+
+    if (difficulty == 0) {
+        difficulty = 1;
+    }
+    for (int i = 7; i >= 0; i--) {
+        uint64_t dividend = (remainder << 32) | diff1[i];
+        target[i] = dividend / difficulty;
+        remainder = dividend % difficulty;
+    }
+}
+
+void nbits_to_target(uint32_t nBits, uint32_t target[8])
+{
+    uint32_t mantissa = nBits & 0x007fffff;
+    int exponent = (nBits >> 24) & 0xff;
+    uint8_t bytes[32] = {0};
+
+    for (int i = 0; i < 3; i++) {
+        int position = exponent - 3 + i;
+        if (position >= 0 && position < 32) {
+            bytes[position] = mantissa >> (8 * i);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        target[i] = (uint32_t)bytes[i * 4] | (uint32_t)bytes[i * 4 + 1] << 8 | (uint32_t)bytes[i * 4 + 2] << 16 |
+                    (uint32_t)bytes[i * 4 + 3] << 24;
+    }
+}
+
+bool hash_meets_target(const uint8_t hash[32], const uint32_t target[8])
+{
+    // Almost every hash already differs in the top word
+    for (int i = 7; i >= 0; i--) {
+        const uint8_t *word = hash + i * 4;
+        uint32_t value = (uint32_t)word[0] | (uint32_t)word[1] << 8 | (uint32_t)word[2] << 16 | (uint32_t)word[3] << 24;
+        if (value != target[i]) {
+            return value < target[i];
+        }
+    }
+    return true;
+}
+
 /* Convert a uint64_t value into a truncated string for displaying with its
  * associated suitable for Mega, Giga etc. Buf array needs to be long enough */
 void suffixString(uint64_t val, char * buf, size_t bufsiz, int sigdigits)
@@ -0,0 +1,82 @@
+#include "vardiff.h"
+
+#include <math.h>
+
+// Hashes per difficulty 1 share
+#define HASHES_PER_DIFF_1 4294967296.0
+
+void vardiff_init(vardiff_controller * vardiff, double target_shares_per_min, uint32_t min_difficulty, uint32_t max_difficulty,
+                  int64_t now_us)
+{
+    vardiff->target_shares_per_min = target_shares_per_min;
+    vardiff->min_difficulty = min_difficulty < 1 ? 1 : min_difficulty;
+    vardiff->max_difficulty = max_difficulty < vardiff->min_difficulty ? vardiff->min_difficulty : max_difficulty;
+    vardiff->window_start_us = now_us;
+    vardiff->window_shares = 0;
+    vardiff->window_work = 0;
+    vardiff->last_suggested = 0;
+}
+
+void vardiff_record_share(vardiff_controller * vardiff, uint32_t difficulty)
+{
+    vardiff->window_shares++;
+    vardiff->window_work += difficulty;
+}
+
+void vardiff_pool_difficulty_changed(vardiff_controller * vardiff)
+{
+    // The pool acted on its own or on the suggestion, any target may be suggested again
+    vardiff->last_suggested = 0;
+}
+
+uint32_t vardiff_difficulty_for_hashrate(const vardiff_controller * vardiff, double hashrate_ghs)
+{
+    double difficulty = hashrate_ghs * 1e9 * 60.0 / (vardiff->target_shares_per_min * HASHES_PER_DIFF_1);
+    if (!(difficulty > vardiff->min_difficulty)) {
+        return vardiff->min_difficulty;
+    }
+    if (difficulty > vardiff->max_difficulty) {
+        return vardiff->max_difficulty;
+    }
+    return (uint32_t) difficulty;
+}
+
+uint32_t vardiff_update(vardiff_controller * vardiff, double hashrate_ghs, uint32_t pool_difficulty, int64_t now_us)
+{
+    if (vardiff->target_shares_per_min <= 0) {
+        return 0;
+    }
+
+    double elapsed_s = (now_us - vardiff->window_start_us) / 1e6;
+    double expected_shares = vardiff->target_shares_per_min * VARDIFF_RETARGET_S / 60.0;
+    // Flooding, react before the window is over
+    bool flooding = vardiff->window_shares >= VARDIFF_MIN_SHARES && vardiff->window_shares > 4 * expected_shares;
+    if (elapsed_s < VARDIFF_RETARGET_S && !flooding) {
+        return 0;
+    }
+
+    // The accepted shares are what the pool sees, the ASIC hashrate fills in while there are too few of them
+    double measured_ghs = vardiff->window_work * HASHES_PER_DIFF_1 / elapsed_s / 1e9;
+    double estimate_ghs = vardiff->window_shares >= VARDIFF_MIN_SHARES || hashrate_ghs <= 0 ? measured_ghs : hashrate_ghs;
+
+    vardiff->window_start_us = now_us;
+    vardiff->window_shares = 0;
+    vardiff->window_work = 0;
+
+    if (estimate_ghs <= 0) {
+        return 0;
+    }
+
+    uint32_t target = vardiff_difficulty_for_hashrate(vardiff, estimate_ghs);
+    double ratio = pool_difficulty > 0 ? (double) target / pool_difficulty : INFINITY;
+    if (ratio < VARDIFF_HYSTERESIS && ratio > 1.0 / VARDIFF_HYSTERESIS) {
+        return 0;
+    }
+    // The pool ignored the last suggestion, asking again does not help
+    if (target == vardiff->last_suggested) {
+        return 0;
+    }
+
+    vardiff->last_suggested = target;
+    return target;
+}
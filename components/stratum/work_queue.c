@@ -0,0 +1,160 @@
+#include "work_queue.h"
+
+// Retries before a side blocks, the other side is usually a few instructions from done
+#define QUEUE_SPIN_COUNT 64
+
+void queue_init(work_queue *queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->discard, 0);
+    atomic_init(&queue->front, NULL);
+    atomic_init(&queue->consumer_waiting, false);
+    atomic_init(&queue->producer_waiting, false);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+// The waiting side sets its flag before checking the indexes one last time, the other side
+// publishes its index before reading the flag, so one of the two always sees the other
+static void wake(work_queue *queue, atomic_bool *waiting, pthread_cond_t *cond)
+{
+    if (atomic_load(waiting))
+    {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+// Jobs from the first one not cleared up to the tail
+static uint32_t queued(work_queue *queue)
+{
+    uint32_t head = atomic_load(&queue->head);
+    uint32_t discard = atomic_load(&queue->discard);
+    uint32_t tail = atomic_load(&queue->tail);
+    uint32_t first = (int32_t)(discard - head) > 0 ? discard : head;
+    return tail - first;
+}
+
+static bool try_enqueue(work_queue *queue, void *new_work)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load(&queue->head) >= QUEUE_RING_SIZE || queued(queue) >= QUEUE_SIZE)
+    {
+        return false;
+    }
+
+    queue->buffer[tail % QUEUE_RING_SIZE] = new_work;
+    atomic_store(&queue->tail, tail + 1);
+    return true;
+}
+
+static void *try_dequeue(work_queue *queue)
+{
+    bm_job *front = atomic_load(&queue->front);
+    if (front != NULL && (front = atomic_exchange(&queue->front, NULL)) != NULL)
+    {
+        return front;
+    }
+
+    // The discard index is a tail seen earlier, read it first so it never passes the tail
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t discard = atomic_load(&queue->discard);
+    uint32_t tail = atomic_load(&queue->tail);
+    while ((int32_t)(discard - head) > 0)
+    {
+        free_bm_job(queue->buffer[head % QUEUE_RING_SIZE]);
+        head++;
+    }
+
+    void *next_work = NULL;
+    if (head != tail)
+    {
+        next_work = queue->buffer[head % QUEUE_RING_SIZE];
+        head++;
+    }
+    atomic_store(&queue->head, head);
+    return next_work;
+}
+
+void queue_enqueue(work_queue *queue, void *new_work)
+{
+    bool queued_work = try_enqueue(queue, new_work);
+    for (int i = 0; !queued_work && i < QUEUE_SPIN_COUNT; i++)
+    {
+        queued_work = try_enqueue(queue, new_work);
+    }
+    if (!queued_work)
+    {
+        pthread_mutex_lock(&queue->lock);
+        atomic_store(&queue->producer_waiting, true);
+        while (!try_enqueue(queue, new_work))
+        {
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+        }
+        atomic_store(&queue->producer_waiting, false);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    wake(queue, &queue->consumer_waiting, &queue->not_empty);
+}
+
+void *queue_dequeue(work_queue *queue)
+{
+    void *next_work = try_dequeue(queue);
+    for (int i = 0; next_work == NULL && i < QUEUE_SPIN_COUNT; i++)
+    {
+        next_work = try_dequeue(queue);
+    }
+    if (next_work == NULL)
+    {
+        pthread_mutex_lock(&queue->lock);
+        atomic_store(&queue->consumer_waiting, true);
+        while ((next_work = try_dequeue(queue)) == NULL)
+        {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        atomic_store(&queue->consumer_waiting, false);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    wake(queue, &queue->producer_waiting, &queue->not_full);
+    return next_work;
+}
+
+void ASIC_jobs_queue_clear(work_queue *queue)
+{
+    // Any task may clear, the discard index only moves forward
+    uint32_t tail = atomic_load(&queue->tail);
+    uint32_t discard = atomic_load(&queue->discard);
+    while ((int32_t)(tail - discard) > 0 && !atomic_compare_exchange_weak(&queue->discard, &discard, tail))
+    {
+    }
+    bm_job *front = atomic_exchange(&queue->front, NULL);
+    if (front != NULL)
+    {
+        free_bm_job(front);
+    }
+
+    wake(queue, &queue->producer_waiting, &queue->not_full);
+}
+
+void ASIC_jobs_queue_push_front(work_queue *queue, bm_job *job)
+{
+    // Only new block jobs go here, right after the queue was cleared, so a job still waiting
+    // in front is already stale
+    bm_job *stale = atomic_exchange(&queue->front, job);
+    if (stale != NULL)
+    {
+        free_bm_job(stale);
+    }
+
+    wake(queue, &queue->consumer_waiting, &queue->not_empty);
+}
+
+int queue_count(work_queue *queue)
+{
+    return queued(queue) + (atomic_load(&queue->front) != NULL);
+}
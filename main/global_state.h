@@ -1,6 +1,7 @@
 #ifndef GLOBAL_STATE_H_
 #define GLOBAL_STATE_H_
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include "asic_task.h"
@@ -10,6 +11,7 @@
 #include "serial.h"
 #include "stratum_api.h"
 #include "work_queue.h"
+#include "notify_mailbox.h"
 #include "device_config.h"
 #include "display.h"
 
@@ -17,6 +19,11 @@
 #define FALLBACK_STRATUM_USER CONFIG_FALLBACK_STRATUM_USER
 
 #define HISTORY_LENGTH 100
+
+// Pool ids, jobs and shares carry the id of the pool they belong to
+#define POOL_ID_PRIMARY 0
+#define POOL_ID_FALLBACK 1
+#define MAX_POOLS 2
 #define DIFF_STRING_SIZE 10
 
 typedef enum {
@@ -37,12 +44,15 @@ typedef struct
     uint64_t shares_accepted;
     uint64_t shares_rejected;
     uint64_t work_received;
+    uint64_t pool_shares_accepted[MAX_POOLS];
+    uint64_t pool_shares_rejected[MAX_POOLS];
     RejectedReasonStat rejected_reason_stats[10];
     int rejected_reason_stats_count;
     int screen_page;
     uint64_t best_nonce_diff;
     char best_diff_string[DIFF_STRING_SIZE];
     uint64_t best_session_nonce_diff;
+    uint32_t best_session_hash[8]; // lowest hash of the session, as a target
     char best_session_diff_string[DIFF_STRING_SIZE];
     bool block_found;
     char ssid[32];
@@ -60,13 +70,25 @@ typedef struct
     char * fallback_pool_user;
     char * pool_pass;
     char * fallback_pool_pass;
-    uint16_t pool_difficulty;
-    uint16_t fallback_pool_difficulty;
+    uint32_t pool_difficulty;
+    uint32_t fallback_pool_difficulty;
     bool pool_extranonce_subscribe;
     bool fallback_pool_extranonce_subscribe;
+    uint16_t pool_protocol;
+    uint16_t fallback_pool_protocol;
+    uint16_t pool_weight;
+    uint16_t fallback_pool_weight;
+    uint16_t pool_shares_per_minute;
+    uint16_t ntime_roll_s;
     double response_time;
     bool use_fallback_stratum;
     bool is_using_fallback;
+    bool hot_standby;
+    uint32_t failover_count;
+    double last_failover_idle_ms;
+    double time_to_first_notify_ms;
+    uint32_t dead_session_count;
+    double stale_work_s;
     int pool_addr_family;
     bool overheat_mode;
     uint16_t power_fault;
@@ -78,6 +100,17 @@ typedef struct
     char * asic_status;
 } SystemModule;
 
+// Session to the fallback pool while split mining, the primary session lives in GlobalState
+typedef struct
+{
+    int sock; // -1 while there is no subscribed session
+    atomic_int send_uid; // share_submit_task takes ids from it while the session is published
+    char * extranonce_str;
+    int extranonce_2_len;
+    uint32_t difficulty;
+    uint32_t version_mask;
+} PoolSession;
+
 typedef struct
 {
     network_mode_t network_mode;
@@ -104,7 +137,7 @@ typedef struct
 
 typedef struct
 {
-    work_queue stratum_queue;
+    notify_mailbox stratum_mailbox;
     work_queue ASIC_jobs_queue;
 
     SystemModule SYSTEM_MODULE;
@@ -130,9 +163,18 @@ typedef struct
 
     int sock;
 
+    PoolSession split_session;
+    // The standby task swaps and frees the split session's extranonce_str under this lock,
+    // readers copy it while holding it
+    pthread_mutex_t split_session_lock;
+
     // A message ID that must be unique per request that expects a response.
     // For requests not expecting a response (called notifications), this is null.
-    int send_uid;
+    // stratum_task and share_submit_task both take ids, only with atomic_fetch_add.
+    atomic_int send_uid;
+
+    // Set when the pool changes, cleared by ASIC_task once the first job of the new pool is sent
+    int64_t failover_started_us;
 
     bool ASIC_initalized;
     bool psram_is_available;
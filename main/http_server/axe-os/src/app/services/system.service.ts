@@ -57,6 +57,7 @@ export class SystemService {
         sharesAccepted: 1,
         sharesRejected: 0,
         sharesRejectedReasons: [],
+        poolShares: [{ accepted: 1, rejected: 0 }, { accepted: 0, rejected: 0 }],
         uptimeSeconds: 38,
         smallCoreCount: 672,
         ASICModel: "BM1366",
@@ -65,14 +66,26 @@ export class SystemService {
         stratumUser: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1",
         stratumSuggestedDifficulty: 1000,
         stratumExtranonceSubscribe: 0,
+        stratumProtocol: 1,
         fallbackStratumURL: "test.public-pool.io",
         fallbackStratumPort: 21497,
         fallbackStratumUser: "bc1q99n3pu025yyu0jlywpmwzalyhm36tg5u37w20d.bitaxe-U1",
         fallbackStratumSuggestedDifficulty: 1000,
         fallbackStratumExtranonceSubscribe: 0,
+        fallbackStratumProtocol: 1,
         poolDifficulty: 1000,
         responseTime: 10,
         isUsingFallbackStratum: false,
+        stratumHotStandby: 0,
+        stratumWeight: 100,
+        fallbackStratumWeight: 0,
+        stratumSharesPerMinute: 0,
+        stratumNtimeRoll: 0,
+        failoverCount: 0,
+        lastFailoverIdleMs: 0,
+        timeToFirstNotifyMs: 0,
+        deadSessionCount: 0,
+        staleWorkSecondsPerDay: 0,
         poolAddrFamily: 2,
         frequency: 485,
         version: "v2.9.0",
@@ -3,12 +3,34 @@ interface ISharesRejectedStat {
     count: number;
 }
 
+interface IPoolShares {
+    accepted: number;
+    rejected: number;
+}
+
 interface IHashrateMonitorAsic {
     total: number;
     domains?: number[];
     errorCount: number;
 }
 
+interface IStratumLatency {
+    count: number;
+    p50: number;
+    p90: number;
+    p99: number;
+    max: number;
+}
+
+interface IStratumTls {
+    handshakes: number;
+    resumptionOffers: number;
+    lastHandshakeMs: number;
+    lastHandshakeBytes: number;
+    lastResumptionOffered: boolean;
+    recordOverhead: number;
+}
+
 interface IHashrateMonitor {
     asics: IHashrateMonitorAsic[];
 }
@@ -52,6 +74,7 @@ export interface ISystemInfo {
     sharesAccepted: number,
     sharesRejected: number,
     sharesRejectedReasons: ISharesRejectedStat[];
+    poolShares?: IPoolShares[];
     uptimeSeconds: number,
     smallCoreCount: number,
     ASICModel: string,
@@ -60,14 +83,33 @@ export interface ISystemInfo {
     stratumUser: string,
     stratumSuggestedDifficulty: number,
     stratumExtranonceSubscribe: number,
+    stratumProtocol: number,
     fallbackStratumURL: string,
     fallbackStratumPort: number,
     fallbackStratumUser: string,
     fallbackStratumSuggestedDifficulty: number,
     fallbackStratumExtranonceSubscribe: number,
+    fallbackStratumProtocol: number,
     poolDifficulty: number,
     responseTime: number,
+    stratumLatency?: {
+        submit: IStratumLatency,
+        authorize: IStratumLatency,
+        subscribe: IStratumLatency,
+    },
+    newBlockLatency?: IStratumLatency,
+    stratumTls?: IStratumTls,
     isUsingFallbackStratum: boolean,
+    stratumHotStandby?: number,
+    stratumWeight?: number,
+    fallbackStratumWeight?: number,
+    stratumSharesPerMinute?: number,
+    stratumNtimeRoll?: number,
+    failoverCount?: number,
+    lastFailoverIdleMs?: number,
+    timeToFirstNotifyMs?: number,
+    deadSessionCount?: number,
+    staleWorkSecondsPerDay?: number,
     poolAddrFamily: number,
     frequency: number,
     version: string,
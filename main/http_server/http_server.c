@@ -45,6 +45,8 @@
 #include "http_server.h"
 #include "system.h"
 #include "websocket.h"
+#include "notify_pool.h"
+#include "pool_tls.h"
 
 static const char * TAG = "http_server";
 static const char * CORS_TAG = "CORS";
@@ -552,6 +554,7 @@ bool check_settings_and_update(const cJSON * const root)
                 }
                 break;
             }
+            case TYPE_U32:
             case TYPE_U64: {
                 if (!cJSON_IsNumber(item)) {
                     ESP_LOGW(TAG, "Invalid type for '%s', expected number", setting->rest_name);                            
@@ -610,6 +613,9 @@ bool check_settings_and_update(const cJSON * const root)
                 case TYPE_U16:
                     nvs_config_set_u16(key, (uint16_t)item->valueint);
                     break;
+                case TYPE_U32:
+                    nvs_config_set_u32(key, (uint32_t)item->valuedouble);
+                    break;
                 case TYPE_I32:
                     nvs_config_set_i32(key, item->valueint);
                     break;
@@ -869,6 +875,23 @@ static esp_err_t POST_ethernet_mode(httpd_req_t * req)
 }
 
 /* Simple handler for getting system handler */
+static void add_summary(cJSON * parent, const char * name, const latency_summary * summary)
+{
+    cJSON * latency = cJSON_AddObjectToObject(parent, name);
+    cJSON_AddNumberToObject(latency, "count", summary->count);
+    cJSON_AddNumberToObject(latency, "p50", summary->p50_us / 1000.0);
+    cJSON_AddNumberToObject(latency, "p90", summary->p90_us / 1000.0);
+    cJSON_AddNumberToObject(latency, "p99", summary->p99_us / 1000.0);
+    cJSON_AddNumberToObject(latency, "max", summary->max_us / 1000.0);
+}
+
+static void add_latency_summary(cJSON * parent, const char * name, stratum_request_method method)
+{
+    latency_summary summary;
+    STRATUM_V1_get_latency_summary(method, &summary);
+    add_summary(parent, name, &summary);
+}
+
 static esp_err_t GET_system_info(httpd_req_t * req)
 {
     if (is_network_allowed(req) != ESP_OK) {
@@ -970,21 +993,83 @@ static esp_err_t GET_system_info(httpd_req_t * req)
         cJSON_AddItemToArray(error_array, error_obj);
     }
 
+    cJSON *pool_shares = cJSON_AddArrayToObject(root, "poolShares");
+    for (int i = 0; i < MAX_POOLS; i++) {
+        cJSON *pool_obj = cJSON_CreateObject();
+        cJSON_AddNumberToObject(pool_obj, "accepted", GLOBAL_STATE->SYSTEM_MODULE.pool_shares_accepted[i]);
+        cJSON_AddNumberToObject(pool_obj, "rejected", GLOBAL_STATE->SYSTEM_MODULE.pool_shares_rejected[i]);
+        cJSON_AddItemToArray(pool_shares, pool_obj);
+    }
+
     cJSON_AddNumberToObject(root, "uptimeSeconds", (esp_timer_get_time() - GLOBAL_STATE->SYSTEM_MODULE.start_time) / 1000000);
     cJSON_AddNumberToObject(root, "smallCoreCount", GLOBAL_STATE->DEVICE_CONFIG.family.asic.small_core_count);
     cJSON_AddStringToObject(root, "ASICModel", GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
     cJSON_AddStringToObject(root, "stratumURL", stratumURL);
     cJSON_AddNumberToObject(root, "stratumPort", nvs_config_get_u16(NVS_CONFIG_STRATUM_PORT));
     cJSON_AddStringToObject(root, "stratumUser", stratumUser);
-    cJSON_AddNumberToObject(root, "stratumSuggestedDifficulty", nvs_config_get_u16(NVS_CONFIG_STRATUM_DIFFICULTY));
+    cJSON_AddNumberToObject(root, "stratumSuggestedDifficulty", nvs_config_get_u32(NVS_CONFIG_STRATUM_DIFFICULTY));
     cJSON_AddNumberToObject(root, "stratumExtranonceSubscribe", nvs_config_get_bool(NVS_CONFIG_STRATUM_EXTRANONCE_SUBSCRIBE));
+    cJSON_AddNumberToObject(root, "stratumProtocol", nvs_config_get_u16(NVS_CONFIG_STRATUM_PROTOCOL));
     cJSON_AddStringToObject(root, "fallbackStratumURL", fallbackStratumURL);
     cJSON_AddNumberToObject(root, "fallbackStratumPort", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_PORT));
     cJSON_AddStringToObject(root, "fallbackStratumUser", fallbackStratumUser);
-    cJSON_AddNumberToObject(root, "fallbackStratumSuggestedDifficulty", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY));
+    cJSON_AddNumberToObject(root, "fallbackStratumSuggestedDifficulty", nvs_config_get_u32(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY));
     cJSON_AddNumberToObject(root, "fallbackStratumExtranonceSubscribe", nvs_config_get_bool(NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE));
+    cJSON_AddNumberToObject(root, "fallbackStratumProtocol", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_PROTOCOL));
+    cJSON_AddNumberToObject(root, "stratumHotStandby", nvs_config_get_bool(NVS_CONFIG_STRATUM_HOT_STANDBY));
+    cJSON_AddNumberToObject(root, "stratumWeight", nvs_config_get_u16(NVS_CONFIG_STRATUM_WEIGHT));
+    cJSON_AddNumberToObject(root, "fallbackStratumWeight", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_WEIGHT));
+    cJSON_AddNumberToObject(root, "stratumSharesPerMinute", nvs_config_get_u16(NVS_CONFIG_STRATUM_SHARES_PER_MINUTE));
+    cJSON_AddNumberToObject(root, "stratumNtimeRoll", nvs_config_get_u16(NVS_CONFIG_STRATUM_NTIME_ROLL));
+    cJSON_AddNumberToObject(root, "failoverCount", GLOBAL_STATE->SYSTEM_MODULE.failover_count);
+    cJSON_AddNumberToObject(root, "lastFailoverIdleMs", GLOBAL_STATE->SYSTEM_MODULE.last_failover_idle_ms);
+    cJSON_AddNumberToObject(root, "timeToFirstNotifyMs", GLOBAL_STATE->SYSTEM_MODULE.time_to_first_notify_ms);
+    cJSON_AddNumberToObject(root, "deadSessionCount", GLOBAL_STATE->SYSTEM_MODULE.dead_session_count);
+    double uptime_days = (esp_timer_get_time() - GLOBAL_STATE->SYSTEM_MODULE.start_time) / 1e6 / 86400.0;
+    cJSON_AddNumberToObject(root, "staleWorkSecondsPerDay", uptime_days > 0 ? GLOBAL_STATE->SYSTEM_MODULE.stale_work_s / uptime_days : 0);
     cJSON_AddNumberToObject(root, "responseTime", GLOBAL_STATE->SYSTEM_MODULE.response_time);
 
+    cJSON * stratum_latency = cJSON_AddObjectToObject(root, "stratumLatency");
+    add_latency_summary(stratum_latency, "submit", STRATUM_REQUEST_SUBMIT);
+    add_latency_summary(stratum_latency, "authorize", STRATUM_REQUEST_AUTHORIZE);
+    add_latency_summary(stratum_latency, "subscribe", STRATUM_REQUEST_SUBSCRIBE);
+
+    latency_summary new_block_latency;
+    ASIC_task_get_new_block_latency(&new_block_latency);
+    add_summary(root, "newBlockLatency", &new_block_latency);
+
+    notify_pool_stats notify_stats;
+    notify_pool_get_stats(&notify_stats);
+    cJSON_AddNumberToObject(root, "notifyPoolHits", notify_stats.hits);
+    cJSON_AddNumberToObject(root, "notifyPoolMisses", notify_stats.misses);
+
+    slot_pool_stats job_pool_stats;
+    bm_job_pool_get_stats(&job_pool_stats);
+    cJSON_AddNumberToObject(root, "jobPoolHits", job_pool_stats.hits);
+    cJSON_AddNumberToObject(root, "jobPoolMisses", job_pool_stats.misses);
+
+    slot_pool_stats submit_template_stats;
+    STRATUM_V1_get_submit_template_pool_stats(&submit_template_stats);
+    cJSON_AddNumberToObject(root, "submitTemplatePoolHits", submit_template_stats.hits);
+    cJSON_AddNumberToObject(root, "submitTemplatePoolMisses", submit_template_stats.misses);
+
+    notify_mailbox_stats mailbox_stats;
+    notify_mailbox_get_stats(&GLOBAL_STATE->stratum_mailbox, &mailbox_stats);
+    cJSON_AddNumberToObject(root, "notifyCoalesced", mailbox_stats.coalesced);
+    cJSON_AddNumberToObject(root, "notifyCleanCoalesced", mailbox_stats.clean_coalesced);
+
+    pool_tls_stats tls_stats;
+    pool_tls_get_stats(&tls_stats);
+    if (tls_stats.handshakes > 0) {
+        cJSON * stratum_tls = cJSON_AddObjectToObject(root, "stratumTls");
+        cJSON_AddNumberToObject(stratum_tls, "handshakes", tls_stats.handshakes);
+        cJSON_AddNumberToObject(stratum_tls, "resumptionOffers", tls_stats.resumption_offers);
+        cJSON_AddNumberToObject(stratum_tls, "lastHandshakeMs", tls_stats.last_handshake_ms);
+        cJSON_AddNumberToObject(stratum_tls, "lastHandshakeBytes", tls_stats.last_handshake_rx_bytes);
+        cJSON_AddBoolToObject(stratum_tls, "lastResumptionOffered", tls_stats.last_resumption_offered);
+        cJSON_AddNumberToObject(stratum_tls, "recordOverhead", tls_stats.record_overhead);
+    }
+
     cJSON_AddStringToObject(root, "version", esp_app_get_description()->version);
     cJSON_AddStringToObject(root, "axeOSVersion", axeOSVersion);
 
@@ -1,10 +1,12 @@
 #include "esp_event.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_psram.h"
 
 #include "asic_result_task.h"
 #include "asic_task.h"
 #include "create_jobs_task.h"
+#include "share_submit_task.h"
 #include "hashrate_monitor_task.h"
 #include "statistics_task.h"
 #include "system.h"
@@ -32,6 +34,9 @@ void app_main(void)
 
     if (!esp_psram_is_initialized()) {
         ESP_LOGE(TAG, "No PSRAM available on ESP32 device!");
+        // The job, notify and submit template pools and the two stratum line buffers then shrink to
+        // *_INTERNAL_SLOTS and LINE_BUFFER_INTERNAL_SIZE, about 55 KB of internal RAM instead of 155 KB
+        ESP_LOGW(TAG, "Internal RAM free before the stratum buffers: %u bytes", (unsigned) heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
         GLOBAL_STATE.psram_is_available = false;
     } else {
         GLOBAL_STATE.psram_is_available = true;
@@ -135,8 +140,9 @@ void app_main(void)
         vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 
-    queue_init(&GLOBAL_STATE.stratum_queue);
+    notify_mailbox_init(&GLOBAL_STATE.stratum_mailbox);
     queue_init(&GLOBAL_STATE.ASIC_jobs_queue);
+    share_submit_init();
 
     if (asic_initialize(&GLOBAL_STATE, ASIC_INIT_COLD_BOOT, 0) == 0) {
         return;
@@ -154,6 +160,9 @@ void app_main(void)
     if (xTaskCreate(ASIC_result_task, "asic result", 8192, (void *) &GLOBAL_STATE, 15, NULL) != pdPASS) {
         ESP_LOGE(TAG, "Error creating asic result task");
     }
+    if (xTaskCreate(share_submit_task, "share submit", 4096, (void *) &GLOBAL_STATE, 10, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Error creating share submit task");
+    }
     if (xTaskCreateWithCaps(hashrate_monitor_task, "hashrate monitor", 8192, (void *) &GLOBAL_STATE, 5, NULL, MALLOC_CAP_SPIRAM) != pdPASS) {
         ESP_LOGE(TAG, "Error creating hashrate monitor task");
     }
@@ -30,6 +30,8 @@
 
 #define FALLBACK_KEY_ASICFREQUENCY "asicfrequency" // Since v2.10.0 (https://github.com/bitaxeorg/ESP-Miner/pull/1051)
 #define FALLBACK_KEY_FANSPEED "fanspeed"           // Since v2.11.0 (https://github.com/bitaxeorg/ESP-Miner/pull/1331)
+#define FALLBACK_KEY_STRATUMDIFF "stratumdiff"     // Since 32 bit suggested difficulty
+#define FALLBACK_KEY_FBSTRATUMDIFF "fbstratumdiff" // Since 32 bit suggested difficulty
 
 typedef struct {
     NvsConfigKey key;
@@ -51,15 +53,23 @@ static Settings settings[NVS_CONFIG_COUNT] = {
     [NVS_CONFIG_STRATUM_PORT]                          = {.nvs_key_name = "stratumport",     .type = TYPE_U16,   .default_value = {.u16 = CONFIG_STRATUM_PORT},                         .rest_name = "stratumPort",                        .min = 0,  .max = UINT16_MAX},
     [NVS_CONFIG_STRATUM_USER]                          = {.nvs_key_name = "stratumuser",     .type = TYPE_STR,   .default_value = {.str = (char *)CONFIG_STRATUM_USER},                 .rest_name = "stratumUser",                        .min = 0,  .max = NVS_STR_LIMIT},
     [NVS_CONFIG_STRATUM_PASS]                          = {.nvs_key_name = "stratumpass",     .type = TYPE_STR,   .default_value = {.str = (char *)CONFIG_STRATUM_PW},                   .rest_name = "stratumPassword",                    .min = 0,  .max = NVS_STR_LIMIT},
-    [NVS_CONFIG_STRATUM_DIFFICULTY]                    = {.nvs_key_name = "stratumdiff",     .type = TYPE_U16,   .default_value = {.u16 = CONFIG_STRATUM_DIFFICULTY},                   .rest_name = "stratumSuggestedDifficulty",         .min = 0,  .max = UINT16_MAX},
+    [NVS_CONFIG_STRATUM_DIFFICULTY]                    = {.nvs_key_name = "stratumdiff32",   .type = TYPE_U32,   .default_value = {.u32 = CONFIG_STRATUM_DIFFICULTY},                   .rest_name = "stratumSuggestedDifficulty",         .min = 0,  .max = INT32_MAX},
     [NVS_CONFIG_STRATUM_EXTRANONCE_SUBSCRIBE]          = {.nvs_key_name = "stratumxnsub",    .type = TYPE_BOOL,  .default_value = {.b   = (bool)STRATUM_EXTRANONCE_SUBSCRIBE},          .rest_name = "stratumExtranonceSubscribe",         .min = 0,  .max = 1},
+    [NVS_CONFIG_STRATUM_PROTOCOL]                      = {.nvs_key_name = "stratumproto",    .type = TYPE_U16,   .default_value = {.u16 = 1},                                           .rest_name = "stratumProtocol",                    .min = 1,  .max = 2},
     [NVS_CONFIG_FALLBACK_STRATUM_URL]                  = {.nvs_key_name = "fbstratumurl",    .type = TYPE_STR,   .default_value = {.str = (char *)CONFIG_FALLBACK_STRATUM_URL},         .rest_name = "fallbackStratumURL",                 .min = 0,  .max = NVS_STR_LIMIT},
     [NVS_CONFIG_FALLBACK_STRATUM_PORT]                 = {.nvs_key_name = "fbstratumport",   .type = TYPE_U16,   .default_value = {.u16 = CONFIG_FALLBACK_STRATUM_PORT},                .rest_name = "fallbackStratumPort",                .min = 0,  .max = UINT16_MAX},
     [NVS_CONFIG_FALLBACK_STRATUM_USER]                 = {.nvs_key_name = "fbstratumuser",   .type = TYPE_STR,   .default_value = {.str = (char *)CONFIG_FALLBACK_STRATUM_USER},        .rest_name = "fallbackStratumUser",                .min = 0,  .max = NVS_STR_LIMIT},
     [NVS_CONFIG_FALLBACK_STRATUM_PASS]                 = {.nvs_key_name = "fbstratumpass",   .type = TYPE_STR,   .default_value = {.str = (char *)CONFIG_FALLBACK_STRATUM_PW},          .rest_name = "fallbackStratumPassword",            .min = 0,  .max = NVS_STR_LIMIT},
-    [NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY]           = {.nvs_key_name = "fbstratumdiff",   .type = TYPE_U16,   .default_value = {.u16 = CONFIG_FALLBACK_STRATUM_DIFFICULTY},          .rest_name = "fallbackStratumSuggestedDifficulty", .min = 0,  .max = UINT16_MAX},
+    [NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY]           = {.nvs_key_name = "fbstratumdiff32", .type = TYPE_U32,   .default_value = {.u32 = CONFIG_FALLBACK_STRATUM_DIFFICULTY},          .rest_name = "fallbackStratumSuggestedDifficulty", .min = 0,  .max = INT32_MAX},
     [NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE] = {.nvs_key_name = "stratumfbxnsub",  .type = TYPE_BOOL,  .default_value = {.b   = (bool)FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE}, .rest_name = "fallbackStratumExtranonceSubscribe", .min = 0,  .max = 1},
+    [NVS_CONFIG_FALLBACK_STRATUM_PROTOCOL]             = {.nvs_key_name = "fbstratumproto",  .type = TYPE_U16,   .default_value = {.u16 = 1},                                           .rest_name = "fallbackStratumProtocol",            .min = 1,  .max = 2},
     [NVS_CONFIG_USE_FALLBACK_STRATUM]                  = {.nvs_key_name = "usefbstartum",    .type = TYPE_BOOL,                                                                         .rest_name = "useFallbackStratum",                 .min = 0,  .max = 1},
+    [NVS_CONFIG_STRATUM_HOT_STANDBY]                   = {.nvs_key_name = "stratumhotstby",  .type = TYPE_BOOL,                                                                         .rest_name = "stratumHotStandby",                  .min = 0,  .max = 1},
+    [NVS_CONFIG_STRATUM_WEIGHT]                        = {.nvs_key_name = "stratumweight",   .type = TYPE_U16,   .default_value = {.u16 = 100},                                         .rest_name = "stratumWeight",                      .min = 0,  .max = 100},
+    [NVS_CONFIG_FALLBACK_STRATUM_WEIGHT]               = {.nvs_key_name = "fbstratumweight", .type = TYPE_U16,   .default_value = {.u16 = 0},                                           .rest_name = "fallbackStratumWeight",              .min = 0,  .max = 100},
+    [NVS_CONFIG_STRATUM_SHARES_PER_MINUTE]             = {.nvs_key_name = "stratumsharemin", .type = TYPE_U16,   .default_value = {.u16 = 0},                                           .rest_name = "stratumSharesPerMinute",             .min = 0,  .max = 600},
+    [NVS_CONFIG_STRATUM_NTIME_ROLL]                    = {.nvs_key_name = "stratumntroll",   .type = TYPE_U16,   .default_value = {.u16 = 0},                                           .rest_name = "stratumNtimeRoll",                   .min = 0,  .max = 600},
+    [NVS_CONFIG_STRATUM_CA_CERT]                       = {.nvs_key_name = "stratumcacert",   .type = TYPE_STR,   .default_value = {.str = ""},                                          .rest_name = "stratumCaCert",                      .min = 0,  .max = NVS_STR_LIMIT},
 
     [NVS_CONFIG_ASIC_FREQUENCY]                        = {.nvs_key_name = "asicfrequency_f", .type = TYPE_FLOAT, .default_value = {.f   = CONFIG_ASIC_FREQUENCY},                       .rest_name = "frequency",                          .min = 1,  .max = UINT16_MAX},
     [NVS_CONFIG_ASIC_VOLTAGE]                          = {.nvs_key_name = "asicvoltage",     .type = TYPE_U16,   .default_value = {.u16 = CONFIG_ASIC_VOLTAGE},                         .rest_name = "coreVoltage",                        .min = 1,  .max = UINT16_MAX},
@@ -146,6 +156,17 @@ static void nvs_config_init_fallback(NvsConfigKey key, Settings * setting)
             }
         }
     }
+    if (key == NVS_CONFIG_STRATUM_DIFFICULTY || key == NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY) {
+        const char * fallback_key = key == NVS_CONFIG_STRATUM_DIFFICULTY ? FALLBACK_KEY_STRATUMDIFF : FALLBACK_KEY_FBSTRATUMDIFF;
+        if (nvs_find_key(handle, setting->nvs_key_name, NULL) == ESP_ERR_NVS_NOT_FOUND) {
+            uint16_t val;
+            ret = nvs_get_u16(handle, fallback_key, &val);
+            if (ret == ESP_OK) {
+                ESP_LOGI(TAG, "Migrating NVS config %s to %s (%d)", fallback_key, setting->nvs_key_name, val);
+                nvs_set_u32(handle, setting->nvs_key_name, val);
+            }
+        }
+    }
 }
 
 static void nvs_config_apply_fallback(NvsConfigKey key, Settings * setting)
@@ -156,6 +177,10 @@ static void nvs_config_apply_fallback(NvsConfigKey key, Settings * setting)
     if (key == NVS_CONFIG_MANUAL_FAN_SPEED) {
         nvs_set_u16(handle, FALLBACK_KEY_FANSPEED, setting->value.u16);
     }
+    if (key == NVS_CONFIG_STRATUM_DIFFICULTY || key == NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY) {
+        const char * fallback_key = key == NVS_CONFIG_STRATUM_DIFFICULTY ? FALLBACK_KEY_STRATUMDIFF : FALLBACK_KEY_FBSTRATUMDIFF;
+        nvs_set_u16(handle, fallback_key, setting->value.u32 > UINT16_MAX ? UINT16_MAX : setting->value.u32);
+    }
 }
 
 static void nvs_task(void *pvParameters)
@@ -177,6 +202,10 @@ static void nvs_task(void *pvParameters)
                         setting->value.u16 = update.value.u16;
                         ret = nvs_set_u16(handle, setting->nvs_key_name, setting->value.u16);
                         break;
+                    case TYPE_U32:
+                        setting->value.u32 = update.value.u32;
+                        ret = nvs_set_u32(handle, setting->nvs_key_name, setting->value.u32);
+                        break;
                     case TYPE_I32:
                         setting->value.i32 = update.value.i32;
                         ret = nvs_set_i32(handle, setting->nvs_key_name, setting->value.i32);
@@ -255,6 +284,12 @@ esp_err_t nvs_config_init(void)
                 setting->value.u16 = (ret == ESP_OK) ? val : setting->default_value.u16;
                 break;
             }
+            case TYPE_U32: {
+                uint32_t val;
+                ret = nvs_get_u32(handle, setting->nvs_key_name, &val);
+                setting->value.u32 = (ret == ESP_OK) ? val : setting->default_value.u32;
+                break;
+            }
             case TYPE_I32: {
                 int32_t val;
                 ret = nvs_get_i32(handle, setting->nvs_key_name, &val);
@@ -330,6 +365,22 @@ void nvs_config_set_u16(NvsConfigKey key, uint16_t value)
     xQueueSend(nvs_save_queue, &update, portMAX_DELAY);
 }
 
+uint32_t nvs_config_get_u32(NvsConfigKey key)
+{
+    Settings *setting = nvs_config_get_settings(key);
+    if (!setting || setting->type != TYPE_U32) {
+        ESP_LOGE(TAG, "Wrong type for %s (u32)", setting->nvs_key_name);
+        return 0;
+    }
+    return setting->value.u32;
+}
+
+void nvs_config_set_u32(NvsConfigKey key, uint32_t value)
+{
+    ConfigUpdate update = { .key = key, .type = TYPE_U32, .value.u32 = value };
+    xQueueSend(nvs_save_queue, &update, portMAX_DELAY);
+}
+
 int32_t nvs_config_get_i32(NvsConfigKey key)
 {
     Settings *setting = nvs_config_get_settings(key);
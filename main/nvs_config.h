@@ -16,13 +16,21 @@ typedef enum {
     NVS_CONFIG_STRATUM_PASS,
     NVS_CONFIG_STRATUM_DIFFICULTY,
     NVS_CONFIG_STRATUM_EXTRANONCE_SUBSCRIBE,
+    NVS_CONFIG_STRATUM_PROTOCOL,
     NVS_CONFIG_FALLBACK_STRATUM_URL,
     NVS_CONFIG_FALLBACK_STRATUM_PORT,
     NVS_CONFIG_FALLBACK_STRATUM_USER,
     NVS_CONFIG_FALLBACK_STRATUM_PASS,
     NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY,
     NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE,
+    NVS_CONFIG_FALLBACK_STRATUM_PROTOCOL,
     NVS_CONFIG_USE_FALLBACK_STRATUM,
+    NVS_CONFIG_STRATUM_HOT_STANDBY,
+    NVS_CONFIG_STRATUM_WEIGHT,
+    NVS_CONFIG_FALLBACK_STRATUM_WEIGHT,
+    NVS_CONFIG_STRATUM_SHARES_PER_MINUTE,
+    NVS_CONFIG_STRATUM_NTIME_ROLL,
+    NVS_CONFIG_STRATUM_CA_CERT,
     
     NVS_CONFIG_ASIC_FREQUENCY,
     NVS_CONFIG_ASIC_VOLTAGE,
@@ -81,6 +89,7 @@ typedef enum {
 typedef enum {
     TYPE_STR,
     TYPE_U16,
+    TYPE_U32,
     TYPE_I32,
     TYPE_U64,
     TYPE_FLOAT,
@@ -90,6 +99,7 @@ typedef enum {
 typedef union {
     char *str;
     uint16_t u16;
+    uint32_t u32;
     int32_t i32;
     uint64_t u64;
     float f;
@@ -112,6 +122,8 @@ char * nvs_config_get_string(NvsConfigKey key);
 void nvs_config_set_string(NvsConfigKey key, const char * value);
 uint16_t nvs_config_get_u16(NvsConfigKey key);
 void nvs_config_set_u16(NvsConfigKey key, uint16_t value);
+uint32_t nvs_config_get_u32(NvsConfigKey key);
+void nvs_config_set_u32(NvsConfigKey key, uint32_t value);
 int32_t nvs_config_get_i32(NvsConfigKey key);
 void nvs_config_set_i32(NvsConfigKey key, int32_t value);
 uint64_t nvs_config_get_u64(NvsConfigKey key);
@@ -408,7 +408,7 @@ bool self_test(void * pvParameters)
         task_result * asic_result = ASIC_process_work(GLOBAL_STATE);
         if (asic_result != NULL) {
             // check the nonce difficulty
-            double nonce_diff = test_nonce_value(&job, asic_result->nonce, asic_result->rolled_version);
+            double nonce_diff = test_nonce_value(&job, NULL, asic_result->nonce, asic_result->rolled_version);
             counter += DIFFICULTY;
             duration_ms = (esp_timer_get_time() / 1000) - start_ms;
             hashrate = hashCounterToGhs(duration_ms, counter);
@@ -45,6 +45,7 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     module->shares_rejected = 0;
     module->best_nonce_diff = nvs_config_get_u64(NVS_CONFIG_BEST_DIFF);
     module->best_session_nonce_diff = 0;
+    memset(module->best_session_hash, 0xff, sizeof(module->best_session_hash));
     module->start_time = esp_timer_get_time();
     module->lastClockSync = 0;
     module->block_found = false;
@@ -71,19 +72,36 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     module->fallback_pool_pass = nvs_config_get_string(NVS_CONFIG_FALLBACK_STRATUM_PASS);
 
     // set the pool difficulty
-    module->pool_difficulty = nvs_config_get_u16(NVS_CONFIG_STRATUM_DIFFICULTY);
-    module->fallback_pool_difficulty = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY);
+    module->pool_difficulty = nvs_config_get_u32(NVS_CONFIG_STRATUM_DIFFICULTY);
+    module->fallback_pool_difficulty = nvs_config_get_u32(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY);
 
     // set the pool extranonce subscribe
     module->pool_extranonce_subscribe = nvs_config_get_bool(NVS_CONFIG_STRATUM_EXTRANONCE_SUBSCRIBE);
     module->fallback_pool_extranonce_subscribe = nvs_config_get_bool(NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE);
 
+    // set the pool protocol, 1 = stratum v1, 2 = stratum v2
+    module->pool_protocol = nvs_config_get_u16(NVS_CONFIG_STRATUM_PROTOCOL);
+    module->fallback_pool_protocol = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_PROTOCOL);
+
     // use fallback stratum
     module->use_fallback_stratum = nvs_config_get_bool(NVS_CONFIG_USE_FALLBACK_STRATUM);
 
     // set based on config
     module->is_using_fallback = module->use_fallback_stratum;
 
+    // keep the other pool subscribed for failover
+    module->hot_standby = nvs_config_get_bool(NVS_CONFIG_STRATUM_HOT_STANDBY);
+
+    // mine both pools at once when both have a weight
+    module->pool_weight = nvs_config_get_u16(NVS_CONFIG_STRATUM_WEIGHT);
+    module->fallback_pool_weight = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_WEIGHT);
+    GLOBAL_STATE->split_session.sock = -1;
+    pthread_mutex_init(&GLOBAL_STATE->split_session_lock, NULL);
+
+    // re-suggest the difficulty to reach this share rate, 0 = off
+    module->pool_shares_per_minute = nvs_config_get_u16(NVS_CONFIG_STRATUM_SHARES_PER_MINUTE);
+    module->ntime_roll_s = nvs_config_get_u16(NVS_CONFIG_STRATUM_NTIME_ROLL);
+
     // Initialize pool address family
     module->pool_addr_family = 0;
 
@@ -123,11 +141,12 @@ esp_err_t SYSTEM_init_peripherals(GlobalState * GLOBAL_STATE) {
     return ESP_OK;
 }
 
-void SYSTEM_notify_accepted_share(GlobalState * GLOBAL_STATE)
+void SYSTEM_notify_accepted_share(GlobalState * GLOBAL_STATE, int pool_id)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
     module->shares_accepted++;
+    module->pool_shares_accepted[pool_id]++;
 }
 
 static int compare_rejected_reason_stats(const void *a, const void *b) {
@@ -136,11 +155,12 @@ static int compare_rejected_reason_stats(const void *a, const void *b) {
     return (eb->count > ea->count) - (ea->count > eb->count);
 }
 
-void SYSTEM_notify_rejected_share(GlobalState * GLOBAL_STATE, char * error_msg)
+void SYSTEM_notify_rejected_share(GlobalState * GLOBAL_STATE, int pool_id, char * error_msg)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
     module->shares_rejected++;
+    module->pool_shares_rejected[pool_id]++;
 
     for (int i = 0; i < module->rejected_reason_stats_count; i++) {
         if (strncmp(module->rejected_reason_stats[i].message, error_msg, sizeof(module->rejected_reason_stats[i].message) - 1) == 0) {
@@ -180,21 +200,30 @@ void SYSTEM_notify_new_ntime(GlobalState * GLOBAL_STATE, uint32_t ntime)
     settimeofday(&tv, NULL);
 }
 
-void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double diff, uint8_t job_id)
+void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, const uint8_t hash[32], const bm_job * job)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
+    if (hash_meets_target(hash, job->network_target)) {
+        module->block_found = true;
+        ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f > %f", hash_difficulty(hash), networkDifficulty(job->target));
+    }
+
+    // Only a hash below the best of the session can raise a best difficulty
+    if (!hash_meets_target(hash, module->best_session_hash)) {
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        module->best_session_hash[i] = (uint32_t) hash[i * 4] | (uint32_t) hash[i * 4 + 1] << 8 | (uint32_t) hash[i * 4 + 2] << 16 |
+                                       (uint32_t) hash[i * 4 + 3] << 24;
+    }
+
+    double diff = hash_difficulty(hash);
     if ((uint64_t) diff > module->best_session_nonce_diff) {
         module->best_session_nonce_diff = (uint64_t) diff;
         suffixString((uint64_t) diff, module->best_session_diff_string, DIFF_STRING_SIZE, 0);
     }
 
-    double network_diff = networkDifficulty(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->target);
-    if (diff > network_diff) {
-        module->block_found = true;
-        ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f > %f", diff, network_diff);
-    }
-
     if ((uint64_t) diff <= module->best_nonce_diff) {
         return;
     }
@@ -205,7 +234,7 @@ void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double diff, uint8_t
     // make the best_nonce_diff into a string
     suffixString((uint64_t) diff, module->best_diff_string, DIFF_STRING_SIZE, 0);
 
-    ESP_LOGI(TAG, "Network diff: %f", network_diff);
+    ESP_LOGI(TAG, "Network diff: %f", networkDifficulty(job->target));
 }
 
 static esp_err_t ensure_overheat_mode_config() {
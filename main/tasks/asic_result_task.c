@@ -7,12 +7,33 @@
 #include "esp_log.h"
 #include "nvs_config.h"
 #include "utils.h"
-#include "stratum_task.h"
+#include "share_submit_task.h"
 #include "hashrate_monitor_task.h"
 #include "asic.h"
 
 static const char *TAG = "asic_result";
 
+// First block states for the jobs nonces last came in for. ASIC_task may free a job at any time,
+// so they are kept here by job id and not in the job.
+#define VERIFY_CACHES 4
+static nonce_verify_cache verify_caches[VERIFY_CACHES];
+static int verify_cache_job_ids[VERIFY_CACHES] = {-1, -1, -1, -1};
+static int verify_cache_next;
+
+static nonce_verify_cache *verify_cache(uint8_t job_id)
+{
+    for (int i = 0; i < VERIFY_CACHES; i++) {
+        if (verify_cache_job_ids[i] == job_id) {
+            return &verify_caches[i];
+        }
+    }
+    // test_nonce_hash starts the cache over when the job behind the id changed
+    int slot = verify_cache_next;
+    verify_cache_next = (slot + 1) % VERIFY_CACHES;
+    verify_cache_job_ids[slot] = job_id;
+    return &verify_caches[slot];
+}
+
 void ASIC_result_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
@@ -40,38 +61,37 @@ void ASIC_result_task(void *pvParameters)
 
         uint8_t job_id = asic_result->job_id;
 
+        // The driver frees the job behind an id when it sends the next one with that id, so the job is
+        // only looked at and its submit template only retained under valid_jobs_lock
+        pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
         if (GLOBAL_STATE->valid_jobs[job_id] == 0)
         {
+            pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
             ESP_LOGW(TAG, "Invalid job nonce found, 0x%02X", job_id);
             continue;
         }
 
-        bm_job *active_job = GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id];
-        // check the nonce difficulty
-        double nonce_diff = test_nonce_value(active_job, asic_result->nonce, asic_result->rolled_version);
-
-        //log the ASIC response
-        ESP_LOGI(TAG, "ID: %s, ASIC nr: %d, ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %ld.", active_job->jobid, asic_result->asic_nr, asic_result->rolled_version, asic_result->nonce, nonce_diff, active_job->pool_diff);
-
-        if (nonce_diff >= active_job->pool_diff)
+        bm_job active_job = *GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id];
+        // check the nonce against the job's pool target, the difficulty is only worked out for shares
+        uint8_t hash[32];
+        test_nonce_hash(&active_job, verify_cache(job_id), asic_result->nonce, asic_result->rolled_version, hash);
+        bool is_share = hash_meets_target(hash, active_job.pool_target);
+        if (is_share)
         {
-            char * user = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-            int ret = STRATUM_V1_submit_share(
-                GLOBAL_STATE->sock,
-                GLOBAL_STATE->send_uid++,
-                user,
-                active_job->jobid,
-                active_job->extranonce2,
-                active_job->ntime,
-                asic_result->nonce,
-                asic_result->rolled_version ^ active_job->version);
+            share_submit_enqueue(&active_job, asic_result->nonce, asic_result->rolled_version);
+        }
+        pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
 
-            if (ret < 0) {
-                ESP_LOGI(TAG, "Unable to write share to socket. Closing connection. Ret: %d (errno %d: %s)", ret, errno, strerror(errno));
-                stratum_close_connection(GLOBAL_STATE);
-            }
+        if (is_share)
+        {
+            //log the ASIC response
+            ESP_LOGI(TAG, "ID: %s, ASIC nr: %d, ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %ld.", active_job.jobid, asic_result->asic_nr, asic_result->rolled_version, asic_result->nonce, hash_difficulty(hash), active_job.pool_diff);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "ID: %s, ASIC nr: %d, ver: %08" PRIX32 " Nonce %08" PRIX32 " below diff %ld.", active_job.jobid, asic_result->asic_nr, asic_result->rolled_version, asic_result->nonce, active_job.pool_diff);
         }
 
-        SYSTEM_notify_found_nonce(GLOBAL_STATE, nonce_diff, job_id);
+        SYSTEM_notify_found_nonce(GLOBAL_STATE, hash, &active_job);
     }
 }
@@ -4,6 +4,8 @@
 #include <string.h>
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <pthread.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -12,6 +14,17 @@
 
 static const char *TAG = "asic_task";
 
+// Notify receipt to the first job of the new block written to the UART
+static latency_histogram new_block_latency;
+static pthread_mutex_t new_block_latency_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void ASIC_task_get_new_block_latency(latency_summary *summary)
+{
+    pthread_mutex_lock(&new_block_latency_lock);
+    latency_histogram_summarize(&new_block_latency, summary);
+    pthread_mutex_unlock(&new_block_latency_lock);
+}
+
 // static bm_job ** active_jobs; is required to keep track of the active jobs since the
 
 void ASIC_task(void *pvParameters)
@@ -43,10 +56,28 @@ void ASIC_task(void *pvParameters)
         }
         
         bm_job *next_bm_job = (bm_job *)queue_dequeue(&GLOBAL_STATE->ASIC_jobs_queue);
+        // The job may be replaced and freed once it is sent
+        int64_t notify_received_us = next_bm_job->notify_received_us;
     
         //(*GLOBAL_STATE->ASIC_functions.send_work_fn)(GLOBAL_STATE, next_bm_job); // send the job to the ASIC
         ASIC_send_work(GLOBAL_STATE, next_bm_job);
 
+        if (notify_received_us != 0) {
+            int64_t latency_us = esp_timer_get_time() - notify_received_us;
+            pthread_mutex_lock(&new_block_latency_lock);
+            latency_histogram_record(&new_block_latency, latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us);
+            pthread_mutex_unlock(&new_block_latency_lock);
+            ESP_LOGI(TAG, "New block job sent %.2f ms after the notify", latency_us / 1000.0);
+        }
+
+        if (GLOBAL_STATE->failover_started_us != 0) {
+            double idle_ms = (esp_timer_get_time() - GLOBAL_STATE->failover_started_us) / 1000.0;
+            GLOBAL_STATE->failover_started_us = 0;
+            GLOBAL_STATE->SYSTEM_MODULE.failover_count++;
+            GLOBAL_STATE->SYSTEM_MODULE.last_failover_idle_ms = idle_ms;
+            ESP_LOGI(TAG, "First job after pool switch sent, ASIC idle for %.1f ms", idle_ms);
+        }
+
         // Time to execute the above code is ~0.3ms
         // Delay for ASIC(s) to finish the job
         //vTaskDelay((asic_job_frequency_ms - 0.3) / portTICK_PERIOD_MS);
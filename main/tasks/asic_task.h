@@ -4,6 +4,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "mining.h"
+#include "latency_histogram.h"
 typedef struct
 {
     // ASIC may not return the nonce in the same order as the jobs were sent
@@ -16,4 +17,7 @@ typedef struct
 
 void ASIC_task(void *pvParameters);
 
+// Time from receiving a new block notify to writing its first job to the chips
+void ASIC_task_get_new_block_latency(latency_summary *summary);
+
 #endif /* ASIC_TASK_H_ */
@@ -1,6 +1,8 @@
 #include <sys/time.h>
 #include <limits.h>
 
+#include "esp_timer.h"
+
 #include "work_queue.h"
 #include "global_state.h"
 #include "esp_log.h"
@@ -9,22 +11,132 @@
 #include "string.h"
 
 #include "asic.h"
+#include "pool_scheduler.h"
+#include "stratum_task.h"
 
 static const char *TAG = "create_jobs_task";
 
 #define QUEUE_LOW_WATER_MARK 10 // Adjust based on your requirements
 
 static bool should_generate_more_work(GlobalState *GLOBAL_STATE);
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint64_t extranonce_2, uint32_t difficulty);
+static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, const PoolSession *session, uint64_t extranonce_2,
+                          int count, uint32_t version_mask, bool new_block);
+static bool roll_work(GlobalState *GLOBAL_STATE, mining_notify *notification, const PoolSession *session, uint32_t version_mask);
+static void queue_job(GlobalState *GLOBAL_STATE, mining_notify *notification, const PoolSession *session, const uint8_t merkle_root[32],
+                      uint32_t ntime, stratum_submit_template *submit_template, uint32_t version_mask, bool new_block);
+
+// Latest notify of each pool, the pools are mined side by side while split mining
+static mining_notify *pool_work[MAX_POOLS];
+static uint64_t pool_extranonce_2[MAX_POOLS];
+static pool_scheduler scheduler;
+
+// Coinbase of pool_work with the hash over coinbase_1 + extranonce_1 done, built on the first job of a notify
+static coinbase_template pool_coinbase[MAX_POOLS];
+static char *pool_coinbase_extranonce[MAX_POOLS]; // extranonce_1 of pool_coinbase, NULL while not built
+static int pool_coinbase_extranonce_2_len[MAX_POOLS];
+
+// Last extranonce_2 job of each pool, the next jobs roll its ntime while the pool's clock allows
+typedef struct
+{
+    stratum_submit_template *submit_template; // NULL while there is nothing to roll
+    uint8_t merkle_root[32];
+    uint32_t ntime_offset;
+} ntime_roll_base;
+
+static ntime_roll_base pool_roll[MAX_POOLS];
+
+static void clear_pool_roll(int pool_id)
+{
+    STRATUM_V1_release_submit_template(pool_roll[pool_id].submit_template);
+    pool_roll[pool_id].submit_template = NULL;
+}
+
+static void clear_pool_coinbase(int pool_id)
+{
+    clear_pool_roll(pool_id);
+    if (pool_coinbase_extranonce[pool_id] != NULL) {
+        coinbase_template_free(&pool_coinbase[pool_id]);
+        free(pool_coinbase_extranonce[pool_id]);
+        pool_coinbase_extranonce[pool_id] = NULL;
+    }
+}
+
+static void set_pool_work(int pool_id, mining_notify *notification)
+{
+    clear_pool_coinbase(pool_id);
+    STRATUM_V1_free_mining_notify(pool_work[pool_id]);
+    pool_work[pool_id] = notification;
+    pool_extranonce_2[pool_id] = 0;
+}
+
+// The standby task swaps and frees the split session's extranonce, jobs are built from a copy
+static PoolSession split_session = {.sock = -1};
+static char *split_extranonce;
+
+static const PoolSession *copy_split_session(GlobalState *GLOBAL_STATE)
+{
+    const PoolSession *shared = &GLOBAL_STATE->split_session;
+    pthread_mutex_lock(&GLOBAL_STATE->split_session_lock);
+    split_session = *shared;
+    if (shared->extranonce_str == NULL || split_extranonce == NULL || strcmp(split_extranonce, shared->extranonce_str) != 0) {
+        free(split_extranonce);
+        split_extranonce = shared->extranonce_str != NULL ? strdup(shared->extranonce_str) : NULL;
+    }
+    pthread_mutex_unlock(&GLOBAL_STATE->split_session_lock);
+
+    split_session.extranonce_str = split_extranonce;
+    return &split_session;
+}
+
+// mining.set_extranonce keeps the notify, so the coinbase is rebuilt when the session's extranonce changes
+static const coinbase_template *get_pool_coinbase(const mining_notify *notification, const PoolSession *session)
+{
+    int pool_id = notification->pool_id;
+    if (pool_coinbase_extranonce[pool_id] != NULL &&
+        (pool_coinbase_extranonce_2_len[pool_id] != session->extranonce_2_len ||
+         strcmp(pool_coinbase_extranonce[pool_id], session->extranonce_str) != 0)) {
+        clear_pool_coinbase(pool_id);
+    }
+
+    if (pool_coinbase_extranonce[pool_id] == NULL) {
+        char *extranonce = strdup(session->extranonce_str);
+        if (extranonce == NULL) {
+            return NULL;
+        }
+        if (!coinbase_template_init(&pool_coinbase[pool_id], notification->coinbase_1, notification->coinbase_2,
+                                    session->extranonce_str, session->extranonce_2_len)) {
+            free(extranonce);
+            return NULL;
+        }
+        pool_coinbase_extranonce[pool_id] = extranonce;
+        pool_coinbase_extranonce_2_len[pool_id] = session->extranonce_2_len;
+    }
+    return &pool_coinbase[pool_id];
+}
+
+static void abandon_work(GlobalState *GLOBAL_STATE, int active_pool_id)
+{
+    GLOBAL_STATE->abandon_work = 0;
+    // Only stratum_task abandons work, the work of a live split session stays valid
+    for (int pool_id = 0; pool_id < MAX_POOLS; pool_id++) {
+        if (pool_id == active_pool_id || GLOBAL_STATE->split_session.sock < 0) {
+            set_pool_work(pool_id, NULL);
+        }
+    }
+    ASIC_jobs_queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
+    xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
+}
 
 void create_jobs_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
 
     uint32_t difficulty = GLOBAL_STATE->pool_difficulty;
+    uint32_t asic_version_mask = 0;
+    pool_scheduler_reset(&scheduler);
     while (1)
     {
-        mining_notify *mining_notification = (mining_notify *)queue_dequeue(&GLOBAL_STATE->stratum_queue);
+        mining_notify *mining_notification = notify_mailbox_take(&GLOBAL_STATE->stratum_mailbox);
         if (mining_notification == NULL) {
             ESP_LOGE(TAG, "Failed to dequeue mining notification");
             vTaskDelay(100 / portTICK_PERIOD_MS); // Wait a bit before trying again
@@ -33,6 +145,17 @@ void create_jobs_task(void *pvParameters)
 
         ESP_LOGI(TAG, "New Work Dequeued %s", mining_notification->job_id);
 
+        int active_pool_id = stratum_active_pool_id(GLOBAL_STATE);
+        // cleanQueue runs before the notify is queued, so whatever it abandoned is older than this notify
+        if (GLOBAL_STATE->abandon_work == 1) {
+            abandon_work(GLOBAL_STATE, active_pool_id);
+        }
+        if (mining_notification->clean_jobs && mining_notification->pool_id != active_pool_id) {
+            // The queued jobs of the other pool are rebuilt from its notify right away
+            ASIC_jobs_queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
+        }
+        set_pool_work(mining_notification->pool_id, mining_notification);
+
         if (GLOBAL_STATE->new_set_mining_difficulty_msg)
         {
             ESP_LOGI(TAG, "New pool difficulty %lu", GLOBAL_STATE->pool_difficulty);
@@ -40,77 +163,195 @@ void create_jobs_task(void *pvParameters)
             GLOBAL_STATE->new_set_mining_difficulty_msg = false;
         }
 
-        if (GLOBAL_STATE->new_stratum_version_rolling_msg && GLOBAL_STATE->ASIC_initalized) {
-            ESP_LOGI(TAG, "Set chip version rolls %i", (int)(GLOBAL_STATE->version_mask >> 13));
-            ASIC_set_version_mask(GLOBAL_STATE, GLOBAL_STATE->version_mask);
+        // The chip rolls one mask for all pools, so only roll the bits every pool allows
+        uint32_t version_mask = GLOBAL_STATE->version_mask;
+        int other_pool_id = active_pool_id == POOL_ID_PRIMARY ? POOL_ID_FALLBACK : POOL_ID_PRIMARY;
+        if (pool_work[other_pool_id] != NULL && GLOBAL_STATE->split_session.sock >= 0) {
+            version_mask &= GLOBAL_STATE->split_session.version_mask;
+        }
+        if ((GLOBAL_STATE->new_stratum_version_rolling_msg || version_mask != asic_version_mask) && GLOBAL_STATE->ASIC_initalized) {
+            ESP_LOGI(TAG, "Set chip version rolls %i", (int)(version_mask >> 13));
+            ASIC_set_version_mask(GLOBAL_STATE, version_mask);
+            asic_version_mask = version_mask;
             GLOBAL_STATE->new_stratum_version_rolling_msg = false;
         }
 
-        uint64_t extranonce_2 = 0;
-        while (GLOBAL_STATE->stratum_queue.count < 1 && GLOBAL_STATE->abandon_work == 0)
+        PoolSession active_session = {
+            .sock = GLOBAL_STATE->sock,
+            .extranonce_str = GLOBAL_STATE->extranonce_str,
+            .extranonce_2_len = GLOBAL_STATE->extranonce_2_len,
+            .difficulty = difficulty,
+        };
+
+        // New block: the first job goes to the chip right away instead of behind the queue and the job interval
+        if (mining_notification->clean_jobs) {
+            int pool_id = mining_notification->pool_id;
+            const PoolSession *session = pool_id == active_pool_id ? &active_session : copy_split_session(GLOBAL_STATE);
+            if (session->sock >= 0) {
+                generate_work(GLOBAL_STATE, mining_notification, session, pool_extranonce_2[pool_id]++, 1, version_mask, true);
+            }
+        }
+
+        while (!notify_mailbox_pending(&GLOBAL_STATE->stratum_mailbox) && GLOBAL_STATE->abandon_work == 0)
         {
             if (should_generate_more_work(GLOBAL_STATE))
             {
-                generate_work(GLOBAL_STATE, mining_notification, extranonce_2, difficulty);
+                active_session.sock = GLOBAL_STATE->sock;
+                active_session.extranonce_str = GLOBAL_STATE->extranonce_str;
+                active_session.extranonce_2_len = GLOBAL_STATE->extranonce_2_len;
+                const PoolSession *split = copy_split_session(GLOBAL_STATE);
+                const PoolSession *sessions[MAX_POOLS];
+                uint16_t weights[MAX_POOLS] = {0};
+                int weighted_pools = 0;
+                for (int pool_id = 0; pool_id < MAX_POOLS; pool_id++) {
+                    sessions[pool_id] = pool_id == active_pool_id ? &active_session : split;
+                    if (pool_work[pool_id] != NULL && sessions[pool_id]->sock >= 0) {
+                        // Outside of split mining only the active pool has work
+                        weights[pool_id] = pool_id == POOL_ID_FALLBACK ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_weight
+                                                                       : GLOBAL_STATE->SYSTEM_MODULE.pool_weight;
+                        if (weights[pool_id] == 0) {
+                            weights[pool_id] = 1;
+                        }
+                        weighted_pools++;
+                    }
+                }
+
+                int pool_id = pool_scheduler_next(&scheduler, weights, MAX_POOLS);
+                if (pool_id < 0) {
+                    vTaskDelay(100 / portTICK_PERIOD_MS);
+                    continue;
+                }
+
+                if (roll_work(GLOBAL_STATE, pool_work[pool_id], sessions[pool_id], version_mask)) {
+                    continue;
+                }
+
+                // Refill the queue a batch of extranonce_2 at a time, unless the jobs alternate between pools or
+                // the next ones roll ntime
+                int count = 1;
+                if (weighted_pools == 1 && GLOBAL_STATE->SYSTEM_MODULE.ntime_roll_s == 0) {
+                    count = QUEUE_LOW_WATER_MARK - queue_count(&GLOBAL_STATE->ASIC_jobs_queue);
+                    count = count < 1 ? 1 : count > SHA256_LANES ? SHA256_LANES : count;
+                }
+
+                generate_work(GLOBAL_STATE, pool_work[pool_id], sessions[pool_id], pool_extranonce_2[pool_id], count, version_mask, false);
 
                 // Increase extranonce_2 for the next job.
-                extranonce_2++;
+                pool_extranonce_2[pool_id] += count;
             }
             else
             {
-                // If no more work needed, wait a bit before checking again.
-                vTaskDelay(100 / portTICK_PERIOD_MS);
+                // If no more work needed, wait a bit before checking again, a new notify ends the wait
+                notify_mailbox_wait(&GLOBAL_STATE->stratum_mailbox, 100);
             }
         }
 
         if (GLOBAL_STATE->abandon_work == 1)
         {
-            GLOBAL_STATE->abandon_work = 0;
-            ASIC_jobs_queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
-            xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
+            abandon_work(GLOBAL_STATE, active_pool_id);
         }
-
-        STRATUM_V1_free_mining_notify(mining_notification);
     }
 }
 
 static bool should_generate_more_work(GlobalState *GLOBAL_STATE)
 {
-    return GLOBAL_STATE->ASIC_jobs_queue.count < QUEUE_LOW_WATER_MARK;
+    return queue_count(&GLOBAL_STATE->ASIC_jobs_queue) < QUEUE_LOW_WATER_MARK;
 }
 
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint64_t extranonce_2, uint32_t difficulty)
+static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, const PoolSession *session, uint64_t extranonce_2,
+                          int count, uint32_t version_mask, bool new_block)
 {
-    char extranonce_2_str[GLOBAL_STATE->extranonce_2_len * 2 + 1];
-    extranonce_2_generate(extranonce_2, GLOBAL_STATE->extranonce_2_len, extranonce_2_str);
-
-    //print generated extranonce_2
-    //ESP_LOGI(TAG, "Generated extranonce_2: %s", extranonce_2_str);
+    // A split session that just ended
+    if (session->extranonce_str == NULL) {
+        return;
+    }
 
-    char *coinbase_tx = construct_coinbase_tx(notification->coinbase_1, notification->coinbase_2, GLOBAL_STATE->extranonce_str, extranonce_2_str);
-    if (coinbase_tx == NULL) {
-        ESP_LOGE(TAG, "Failed to construct coinbase_tx");
+    const coinbase_template *coinbase = get_pool_coinbase(notification, session);
+    if (coinbase == NULL) {
+        // Not hex or out of memory, either way the notify yields no jobs until the pool sends another
+        ESP_LOGE(TAG, "Failed to construct coinbase template, dropping job %s", notification->job_id);
+        set_pool_work(notification->pool_id, NULL);
         return;
     }
 
-    char merkle_root[65];
-    calculate_merkle_root_hash(coinbase_tx, (uint8_t(*)[32])notification->merkle_branches, notification->n_merkle_branches, merkle_root);
+    // Binary from the parsed notify to the bm_job, only the submit template is hex
+    uint8_t extranonce_2_bin[SHA256_LANES][MAX_EXTRANONCE_2_LEN];
+    const uint8_t *extranonce_2_lanes[count];
+    for (int i = 0; i < count; i++) {
+        extranonce_2_generate_bin(extranonce_2 + i, session->extranonce_2_len, extranonce_2_bin[i]);
+        extranonce_2_lanes[i] = extranonce_2_bin[i];
+    }
+
+    // The coinbases and merkle paths of a batch are hashed side by side
+    uint8_t merkle_roots[count][32];
+    coinbase_template_hash_lanes(coinbase, extranonce_2_lanes, count, merkle_roots);
+    calculate_merkle_root_lanes(merkle_roots, (uint8_t(*)[32])notification->merkle_branches, notification->n_merkle_branches, count);
+
+    // Shares of the job only patch nonce, ntime and version bits into this
+    const char *user = notification->pool_id == POOL_ID_FALLBACK ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user
+                                                                   : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
+    for (int i = 0; i < count; i++) {
+        stratum_submit_template *submit_template = STRATUM_V1_create_submit_template(user, notification->job_id, extranonce_2_bin[i],
+                                                                                     session->extranonce_2_len);
+
+        if (GLOBAL_STATE->SYSTEM_MODULE.ntime_roll_s > 0 && submit_template != NULL) {
+            int pool_id = notification->pool_id;
+            clear_pool_roll(pool_id);
+            pool_roll[pool_id].submit_template = STRATUM_V1_retain_submit_template(submit_template);
+            memcpy(pool_roll[pool_id].merkle_root, merkle_roots[i], 32);
+            pool_roll[pool_id].ntime_offset = 0;
+        }
+
+        queue_job(GLOBAL_STATE, notification, session, merkle_roots[i], notification->ntime, submit_template, version_mask, new_block);
+    }
+}
+
+// The header of the last extranonce_2 job one second later, no coinbase or merkle hashing
+static bool roll_work(GlobalState *GLOBAL_STATE, mining_notify *notification, const PoolSession *session, uint32_t version_mask)
+{
+    ntime_roll_base *base = &pool_roll[notification->pool_id];
+    // get_pool_coinbase drops the roll base when the session's extranonce changed
+    if (session->extranonce_str == NULL || get_pool_coinbase(notification, session) == NULL || base->submit_template == NULL) {
+        return false;
+    }
+
+    int64_t notify_age_us = notification->received_us > 0 ? esp_timer_get_time() - notification->received_us : 0;
+    if (!ntime_roll_allowed(base->ntime_offset + 1, notify_age_us, GLOBAL_STATE->SYSTEM_MODULE.ntime_roll_s)) {
+        return false;
+    }
+    base->ntime_offset++;
 
-    bm_job next_job = construct_bm_job(notification, merkle_root, GLOBAL_STATE->version_mask, difficulty);
+    queue_job(GLOBAL_STATE, notification, session, base->merkle_root, notification->ntime + base->ntime_offset,
+              STRATUM_V1_retain_submit_template(base->submit_template), version_mask, false);
+    return true;
+}
 
-    bm_job *queued_next_job = malloc(sizeof(bm_job));
+static void queue_job(GlobalState *GLOBAL_STATE, mining_notify *notification, const PoolSession *session, const uint8_t merkle_root[32],
+                      uint32_t ntime, stratum_submit_template *submit_template, uint32_t version_mask, bool new_block)
+{
+    bm_job next_job = construct_bm_job_for_format(ASIC_get_job_format(GLOBAL_STATE), notification->version,
+                                                  notification->prev_block_hash_bin, merkle_root, ntime, notification->target,
+                                                  version_mask, session->difficulty);
+
+    bm_job *queued_next_job = bm_job_alloc();
     if (queued_next_job == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for queued_next_job");
-        free(coinbase_tx);
+        STRATUM_V1_release_submit_template(submit_template);
         return;
     }
 
     memcpy(queued_next_job, &next_job, sizeof(bm_job));
-    queued_next_job->extranonce2 = strdup(extranonce_2_str);
-    queued_next_job->jobid = strdup(notification->job_id);
-    queued_next_job->version_mask = GLOBAL_STATE->version_mask;
-
-    queue_enqueue(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
+    bm_job_set_jobid(queued_next_job, notification->job_id);
+    queued_next_job->version_mask = version_mask;
+    queued_next_job->pool_id = notification->pool_id;
+    queued_next_job->submit_template = submit_template;
 
-    free(coinbase_tx);
-}
\ No newline at end of file
+    if (new_block) {
+        queued_next_job->notify_received_us = notification->received_us;
+        ASIC_jobs_queue_push_front(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
+        // Wakes ASIC_task from the job interval wait
+        xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
+    } else {
+        queue_enqueue(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
+    }
+}
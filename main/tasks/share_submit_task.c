@@ -0,0 +1,221 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <lwip/sockets.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "share_submit_task.h"
+#include "stratum_task.h"
+#include "stratum_v2_task.h"
+#include "pool_tls.h"
+
+// Shares written with a single send
+#define SHARE_BATCH_MAX 8
+#define SHARE_LINE_SIZE 512
+
+typedef struct {
+    // Holds a reference until the share is written or dropped, the job may be gone by then
+    stratum_submit_template *submit_template;
+    uint32_t sv2_job_id;
+    uint32_t ntime;
+    uint32_t nonce;
+    uint32_t version_bits;
+    uint32_t version;
+    uint8_t pool_id;
+    uint32_t session;
+    int64_t enqueued_us;
+} share_submission;
+
+static const char *TAG = "share_submit";
+
+static QueueHandle_t outbox;
+static ShareSubmitStats stats;
+// The result task drops shares on a full outbox, the share task those of ended sessions
+static atomic_uint dropped;
+// Bumped when a pool session ends, queued shares of older sessions are dropped
+static volatile uint32_t pool_sessions[MAX_POOLS];
+
+static share_submission batch_shares[SHARE_BATCH_MAX];
+static char batch_buffer[SHARE_BATCH_MAX * SHARE_LINE_SIZE];
+
+void share_submit_init(void)
+{
+    if (outbox == NULL) {
+        outbox = xQueueCreate(SHARE_OUTBOX_SIZE, sizeof(share_submission));
+    }
+}
+
+bool share_submit_enqueue(const bm_job *job, uint32_t nonce, uint32_t rolled_version)
+{
+    share_submission share;
+
+    share.submit_template = job->submit_template;
+    share.sv2_job_id = job->submit_template == NULL ? strtoul(job->jobid, NULL, 10) : 0;
+    share.ntime = job->ntime;
+    share.nonce = nonce;
+    share.version_bits = rolled_version ^ job->version;
+    share.version = rolled_version;
+    share.pool_id = job->pool_id;
+    share.session = pool_sessions[job->pool_id];
+    share.enqueued_us = esp_timer_get_time();
+
+    STRATUM_V1_retain_submit_template(share.submit_template);
+    if (xQueueSend(outbox, &share, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Share outbox full, dropping share for job %s", job->jobid);
+        STRATUM_V1_release_submit_template(share.submit_template);
+        atomic_fetch_add(&dropped, 1);
+        return false;
+    }
+    return true;
+}
+
+void share_submit_clear(int pool_id)
+{
+    pool_sessions[pool_id]++;
+}
+
+void share_submit_get_stats(ShareSubmitStats *out)
+{
+    *out = stats;
+    out->dropped = atomic_load(&dropped);
+}
+
+static bool write_all(int sock, const char *data, size_t len)
+{
+    while (len > 0) {
+        int ret = pool_send(sock, data, len);
+        if (ret < 0) {
+            return false;
+        }
+        data += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+// Writes the shares of one pool with a single send, returns how many were sent
+static int send_batch(GlobalState *GLOBAL_STATE, int pool_id, int count)
+{
+    bool split = pool_id != stratum_active_pool_id(GLOBAL_STATE);
+    int sock = split ? GLOBAL_STATE->split_session.sock : GLOBAL_STATE->sock;
+
+    size_t len = 0;
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        share_submission *share = &batch_shares[i];
+        if (share->pool_id != pool_id) {
+            continue;
+        }
+        stratum_submit_template *submit_template = share->submit_template;
+        share->submit_template = NULL;
+        if (share->session != pool_sessions[pool_id] || sock < 0) {
+            STRATUM_V1_release_submit_template(submit_template);
+            atomic_fetch_add(&dropped, 1);
+            share->enqueued_us = 0;
+            continue;
+        }
+        if (!split && stratum_v2_is_active()) {
+            STRATUM_V1_release_submit_template(submit_template);
+            size_t frame_len = stratum_v2_encode_share((uint8_t *)batch_buffer + len, SHARE_LINE_SIZE, share->sv2_job_id,
+                                                       share->nonce, share->ntime, share->version);
+            if (frame_len == 0) {
+                atomic_fetch_add(&dropped, 1);
+                share->enqueued_us = 0;
+                continue;
+            }
+            ESP_LOGI(TAG, "tx: SubmitSharesStandard job %lu nonce %08lx ntime %08lx version %08lx", share->sv2_job_id,
+                     share->nonce, share->ntime, share->version);
+            len += frame_len;
+            sent++;
+            continue;
+        }
+        if (submit_template == NULL) {
+            ESP_LOGE(TAG, "Share with nonce %08lx has no submit template, dropping", share->nonce);
+            atomic_fetch_add(&dropped, 1);
+            share->enqueued_us = 0;
+            continue;
+        }
+        int send_uid = atomic_fetch_add(split ? &GLOBAL_STATE->split_session.send_uid : &GLOBAL_STATE->send_uid, 1);
+        int line_len = STRATUM_V1_format_submit_template(batch_buffer + len, SHARE_LINE_SIZE, submit_template, send_uid,
+                                                         share->ntime, share->nonce, share->version_bits);
+        STRATUM_V1_release_submit_template(submit_template);
+        if (line_len >= SHARE_LINE_SIZE) {
+            ESP_LOGE(TAG, "Share with nonce %08lx exceeds %d bytes, dropping", share->nonce, SHARE_LINE_SIZE);
+            atomic_fetch_add(&dropped, 1);
+            share->enqueued_us = 0;
+            continue;
+        }
+        ESP_LOGI(TAG, "tx: %.*s", line_len - 1, batch_buffer + len);
+        // Request timings only track the session of stratum_task, the split session's ids are its own
+        STRATUM_V1_stamp_tx(sock, send_uid, STRATUM_REQUEST_SUBMIT);
+        len += line_len;
+        sent++;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (!write_all(sock, batch_buffer, len)) {
+        ESP_LOGI(TAG, "Unable to write shares to socket. Closing connection. (errno %d: %s)", errno, strerror(errno));
+        // The task reading the socket owns it, it sees the shutdown, closes the socket and reconnects
+        shutdown(sock, SHUT_RDWR);
+        for (int i = 0; i < count; i++) {
+            if (batch_shares[i].pool_id == pool_id) {
+                batch_shares[i].enqueued_us = 0;
+            }
+        }
+        return 0;
+    }
+    if (!split) {
+        stratum_health_submitted(sent);
+    }
+    return sent;
+}
+
+void share_submit_task(void *pvParameters)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+
+    share_submit_init();
+
+    while (1)
+    {
+        if (xQueueReceive(outbox, &batch_shares[0], portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // Pick up whatever else piled up while we were waiting on the socket
+        int count = 1;
+        while (count < SHARE_BATCH_MAX && xQueueReceive(outbox, &batch_shares[count], 0) == pdTRUE) {
+            count++;
+        }
+
+        int sent = 0;
+        for (int pool_id = 0; pool_id < MAX_POOLS; pool_id++) {
+            sent += send_batch(GLOBAL_STATE, pool_id, count);
+        }
+        if (sent == 0) {
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < count; i++) {
+            if (batch_shares[i].enqueued_us == 0) {
+                continue;
+            }
+            uint32_t latency_us = now - batch_shares[i].enqueued_us;
+            stats.last_latency_us = latency_us;
+            if (latency_us > stats.max_latency_us) {
+                stats.max_latency_us = latency_us;
+            }
+        }
+        stats.submitted += sent;
+        stats.batches++;
+        ESP_LOGD(TAG, "Sent %d shares, enqueue to wire %lu us", sent, stats.last_latency_us);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SHARE_SUBMIT_TASK_H_
+#define SHARE_SUBMIT_TASK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "global_state.h"
+
+#define SHARE_OUTBOX_SIZE 32
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t dropped;
+    uint32_t batches;
+    uint32_t last_latency_us; // enqueue to write() returning
+    uint32_t max_latency_us;
+} ShareSubmitStats;
+
+void share_submit_init(void);
+void share_submit_task(void *pvParameters);
+
+// Never blocks, the share is dropped and counted if the outbox is full
+bool share_submit_enqueue(const bm_job *job, uint32_t nonce, uint32_t rolled_version);
+// Drops the queued shares of a pool whose session ended
+void share_submit_clear(int pool_id);
+
+void share_submit_get_stats(ShareSubmitStats *stats);
+
+#endif /* SHARE_SUBMIT_TASK_H_ */
@@ -0,0 +1,389 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#include "global_state.h"
+#include "line_buffer.h"
+#include "share_submit_task.h"
+#include "system.h"
+#include "work_queue.h"
+#include "stratum_api.h"
+#include "pool_tls.h"
+#include "stratum_task.h"
+#include "stratum_standby_task.h"
+
+#define STANDBY_POLL_MS 100
+#define STANDBY_TAKE_TIMEOUT_MS 1000
+#define STANDBY_RETRY_MIN_MS 5000
+#define STANDBY_RETRY_MAX_MS 60000
+
+static const char * TAG = "stratum_standby";
+
+static stratum_standby_session session = {.sock = -1};
+static line_buffer_t session_buffer;
+static int authorize_message_id;
+static bool authorized;
+static bool split_mining;
+static bool published;
+
+static volatile bool ready;
+static volatile bool takeover_requested;
+static bool takeover_result;
+static SemaphoreHandle_t takeover_done;
+static stratum_standby_session takeover_session;
+
+bool stratum_split_enabled(GlobalState * GLOBAL_STATE)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    return module->pool_weight > 0 && module->fallback_pool_weight > 0 && module->fallback_pool_url != NULL &&
+           module->fallback_pool_url[0] != '\0' && module->pool_protocol == 1 && module->fallback_pool_protocol == 1;
+}
+
+bool stratum_standby_enabled(GlobalState * GLOBAL_STATE, bool use_fallback)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    if (!module->hot_standby || stratum_split_enabled(GLOBAL_STATE)) {
+        return false;
+    }
+    if (use_fallback) {
+        return module->fallback_pool_url != NULL && module->fallback_pool_url[0] != '\0' && module->fallback_pool_protocol == 1;
+    }
+    return module->pool_protocol == 1;
+}
+
+bool stratum_standby_ready(void)
+{
+    return ready;
+}
+
+bool stratum_standby_take(stratum_standby_session * taken)
+{
+    if (!ready || takeover_done == NULL) {
+        return false;
+    }
+
+    // The standby task owns the socket and buffer, it hands them over between two reads
+    xSemaphoreTake(takeover_done, 0);
+    takeover_requested = true;
+    if (xSemaphoreTake(takeover_done, STANDBY_TAKE_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+        takeover_requested = false;
+        ESP_LOGW(TAG, "Standby session did not respond to takeover");
+        return false;
+    }
+    if (!takeover_result) {
+        return false;
+    }
+
+    *taken = takeover_session;
+    return true;
+}
+
+static void answer_takeover(bool result)
+{
+    if (!takeover_requested) {
+        return;
+    }
+    takeover_result = result;
+    takeover_requested = false;
+    xSemaphoreGive(takeover_done);
+}
+
+static void hand_over(void)
+{
+    ready = false;
+    takeover_session = session;
+
+    session.sock = -1;
+    session.extranonce_str = NULL;
+    session.notify = NULL;
+
+    STRATUM_V1_swap_buffer(&session_buffer);
+    line_buffer_reset(&session_buffer);
+
+    ESP_LOGI(TAG, "Handing over %s pool session", takeover_session.is_fallback ? "fallback" : "primary");
+    answer_takeover(true);
+}
+
+static void forward_notify(GlobalState * GLOBAL_STATE, mining_notify * notify, bool clean_jobs)
+{
+    notify->pool_id = POOL_ID_FALLBACK;
+    notify->clean_jobs = clean_jobs;
+    notify_mailbox_post(&GLOBAL_STATE->stratum_mailbox, notify);
+}
+
+// Makes the session visible to create_jobs_task and share_submit_task, they own send_uid from here on
+static void publish_session(GlobalState * GLOBAL_STATE)
+{
+    PoolSession * split = &GLOBAL_STATE->split_session;
+    pthread_mutex_lock(&GLOBAL_STATE->split_session_lock);
+    atomic_store(&split->send_uid, session.send_uid);
+    split->extranonce_str = session.extranonce_str;
+    split->extranonce_2_len = session.extranonce_2_len;
+    split->difficulty = session.difficulty != 0 ? session.difficulty : GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty;
+    split->version_mask = session.version_mask;
+    pthread_mutex_unlock(&GLOBAL_STATE->split_session_lock);
+    published = true;
+
+    ESP_LOGI(TAG, "Mining the fallback pool next to the primary");
+    // Queue the fresh notify first so create_jobs_task never builds on the previous session's work
+    forward_notify(GLOBAL_STATE, session.notify, true);
+    session.notify = NULL;
+    split->sock = session.sock;
+}
+
+static void unpublish_session(GlobalState * GLOBAL_STATE)
+{
+    if (!published) {
+        return;
+    }
+    published = false;
+    // close_session frees the extranonce once create_jobs_task can no longer copy it
+    pthread_mutex_lock(&GLOBAL_STATE->split_session_lock);
+    GLOBAL_STATE->split_session.sock = -1;
+    GLOBAL_STATE->split_session.extranonce_str = NULL;
+    pthread_mutex_unlock(&GLOBAL_STATE->split_session_lock);
+    share_submit_clear(POOL_ID_FALLBACK);
+}
+
+static void close_session(GlobalState * GLOBAL_STATE)
+{
+    unpublish_session(GLOBAL_STATE);
+    ready = false;
+    authorized = false;
+    answer_takeover(false);
+
+    if (session.sock >= 0) {
+        shutdown(session.sock, SHUT_RDWR);
+        pool_close(session.sock);
+        session.sock = -1;
+    }
+    free(session.extranonce_str);
+    session.extranonce_str = NULL;
+    if (session.notify != NULL) {
+        STRATUM_V1_free_mining_notify(session.notify);
+        session.notify = NULL;
+    }
+}
+
+static bool wait_readable(int sock, int timeout_ms)
+{
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(sock, &read_fds);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    return select(sock + 1, &read_fds, NULL, NULL, &timeout) > 0;
+}
+
+// Returns false if the session should be dropped
+static bool handle_line(GlobalState * GLOBAL_STATE, const char * line)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    StratumApiV1Message message = {};
+    STRATUM_V1_parse(&message, line);
+
+    switch (message.method) {
+        case MINING_NOTIFY:
+            if (published) {
+                message.mining_notification->received_us = esp_timer_get_time();
+                forward_notify(GLOBAL_STATE, message.mining_notification, message.should_abandon_work);
+                break;
+            }
+            if (session.notify != NULL) {
+                STRATUM_V1_free_mining_notify(session.notify);
+            }
+            session.notify = message.mining_notification;
+            break;
+        case MINING_SET_DIFFICULTY:
+            session.difficulty = message.new_difficulty;
+            if (published) {
+                GLOBAL_STATE->split_session.difficulty = message.new_difficulty;
+            }
+            break;
+        case MINING_SET_VERSION_MASK:
+        case STRATUM_RESULT_VERSION_MASK:
+            session.version_mask = message.version_mask;
+            if (published) {
+                GLOBAL_STATE->split_session.version_mask = message.version_mask;
+            }
+            break;
+        case MINING_SET_EXTRANONCE:
+        case STRATUM_RESULT_SUBSCRIBE: {
+            char * old_extranonce_str = session.extranonce_str;
+            session.extranonce_str = message.extranonce_str;
+            session.extranonce_2_len = message.extranonce_2_len > MAX_EXTRANONCE_2_LEN ? MAX_EXTRANONCE_2_LEN : message.extranonce_2_len;
+            if (published) {
+                pthread_mutex_lock(&GLOBAL_STATE->split_session_lock);
+                GLOBAL_STATE->split_session.extranonce_str = session.extranonce_str;
+                GLOBAL_STATE->split_session.extranonce_2_len = session.extranonce_2_len;
+                pthread_mutex_unlock(&GLOBAL_STATE->split_session_lock);
+            }
+            // create_jobs_task only reads the shared string under the lock, no one holds the old one now
+            free(old_extranonce_str);
+            break;
+        }
+        case STRATUM_RESULT:
+            if (!split_mining) {
+                break;
+            }
+            if (message.response_success) {
+                ESP_LOGI(TAG, "Fallback pool accepted share");
+                SYSTEM_notify_accepted_share(GLOBAL_STATE, POOL_ID_FALLBACK);
+            } else {
+                ESP_LOGW(TAG, "Fallback pool rejected share: %s", message.error_str);
+                SYSTEM_notify_rejected_share(GLOBAL_STATE, POOL_ID_FALLBACK, message.error_str);
+            }
+            break;
+        case STRATUM_RESULT_SETUP:
+            if (message.message_id != authorize_message_id) {
+                break;
+            }
+            if (!message.response_success) {
+                ESP_LOGE(TAG, "Standby authorize rejected: %s", message.error_str);
+                return false;
+            }
+            authorized = true;
+            uint32_t difficulty = session.is_fallback ? module->fallback_pool_difficulty : module->pool_difficulty;
+            if (difficulty > 0) {
+                STRATUM_V1_suggest_difficulty(session.sock, session.send_uid++, difficulty);
+            }
+            if (session.is_fallback ? module->fallback_pool_extranonce_subscribe : module->pool_extranonce_subscribe) {
+                STRATUM_V1_extranonce_subscribe(session.sock, session.send_uid++);
+            }
+            break;
+        case CLIENT_RECONNECT:
+            ESP_LOGI(TAG, "Standby pool requested reconnect");
+            return false;
+        default:
+            break;
+    }
+
+    if (published) {
+        return true;
+    }
+    bool was_ready = ready;
+    ready = authorized && session.extranonce_str != NULL && session.notify != NULL;
+    if (ready && split_mining) {
+        ready = false;
+        publish_session(GLOBAL_STATE);
+    } else if (ready && !was_ready) {
+        ESP_LOGI(TAG, "%s pool on standby", session.is_fallback ? "Fallback" : "Primary");
+    }
+    return true;
+}
+
+// Returns true if the session was handed over to stratum_task
+static bool run_session(GlobalState * GLOBAL_STATE, bool use_fallback, bool * reached_ready)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    const char * url = use_fallback ? module->fallback_pool_url : module->pool_url;
+    uint16_t port = use_fallback ? module->fallback_pool_port : module->pool_port;
+    const char * user = use_fallback ? module->fallback_pool_user : module->pool_user;
+    const char * pass = use_fallback ? module->fallback_pool_pass : module->pool_pass;
+
+    session.sock = stratum_connect(url, port, NULL);
+    if (session.sock < 0) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Opening standby session to %s:%d", url, port);
+
+    session.is_fallback = use_fallback;
+    session.send_uid = 1;
+    session.version_mask = 0;
+    session.difficulty = 0;
+    line_buffer_reset(&session_buffer);
+
+    STRATUM_V1_configure_version_rolling(session.sock, session.send_uid++, &session.version_mask);
+    STRATUM_V1_subscribe(session.sock, session.send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
+    authorize_message_id = session.send_uid++;
+    STRATUM_V1_authorize(session.sock, authorize_message_id, user, pass);
+
+    bool switch_back_sent = false;
+    while (1) {
+        if (takeover_requested) {
+            if (ready) {
+                hand_over();
+                return true;
+            }
+            answer_takeover(false);
+        }
+
+        // stratum_task switched to this pool on its own
+        if (module->is_using_fallback == use_fallback) {
+            return false;
+        }
+
+        if (ready || published) {
+            *reached_ready = true;
+            // Replaces the primary heartbeat: drop the fallback session, stratum_task then takes this one
+            if (!use_fallback && !module->use_fallback_stratum && !switch_back_sent && GLOBAL_STATE->sock >= 0) {
+                ESP_LOGI(TAG, "Primary pool is back, switching over");
+                shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
+                switch_back_sent = true;
+            }
+        }
+
+        if (!line_buffer_has_line(&session_buffer) && !pool_tls_pending(session.sock) && !wait_readable(session.sock, STANDBY_POLL_MS)) {
+            continue;
+        }
+
+        const char * line = STRATUM_V1_receive_line(session.sock, &session_buffer);
+        if (line == NULL || !handle_line(GLOBAL_STATE, line)) {
+            return false;
+        }
+    }
+}
+
+void stratum_standby_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+
+    takeover_done = xSemaphoreCreateBinary();
+    if (takeover_done == NULL || line_buffer_init(&session_buffer, LINE_BUFFER_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate standby session");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int retry_delay_ms = STANDBY_RETRY_MIN_MS;
+    while (1) {
+        answer_takeover(false);
+
+        split_mining = stratum_split_enabled(GLOBAL_STATE);
+        bool use_fallback = split_mining || !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
+        if ((!split_mining && !stratum_standby_enabled(GLOBAL_STATE, use_fallback)) || !is_network_connected(GLOBAL_STATE)) {
+            vTaskDelay(STANDBY_RETRY_MIN_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        bool reached_ready = false;
+        if (run_session(GLOBAL_STATE, use_fallback, &reached_ready)) {
+            retry_delay_ms = STANDBY_RETRY_MIN_MS;
+            continue;
+        }
+        close_session(GLOBAL_STATE);
+
+        // The pool in use may have just changed, pick the other one right away
+        if (GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback == use_fallback) {
+            continue;
+        }
+
+        if (reached_ready) {
+            retry_delay_ms = STANDBY_RETRY_MIN_MS;
+        } else {
+            retry_delay_ms = retry_delay_ms * 2 > STANDBY_RETRY_MAX_MS ? STANDBY_RETRY_MAX_MS : retry_delay_ms * 2;
+        }
+        ESP_LOGI(TAG, "Standby session closed, retrying in %d s", retry_delay_ms / 1000);
+        vTaskDelay(retry_delay_ms / portTICK_PERIOD_MS);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef STRATUM_STANDBY_TASK_H_
+#define STRATUM_STANDBY_TASK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "global_state.h"
+#include "stratum_api.h"
+
+// A subscribed and authorized session to the pool that is not in use, ready to be mined
+typedef struct
+{
+    int sock;
+    int send_uid;
+    bool is_fallback;
+    char * extranonce_str;
+    int extranonce_2_len;
+    uint32_t version_mask;
+    uint32_t difficulty; // 0 if the pool has not sent one yet
+    mining_notify * notify;
+} stratum_standby_session;
+
+// Keeps a session to the pool that is not in use while stratum_task mines the other one.
+// While split mining it mines the fallback pool next to the primary instead.
+void stratum_standby_task(void * pvParameters);
+
+// True if hot standby is enabled and the pool can be kept on standby (Stratum V1 only)
+bool stratum_standby_enabled(GlobalState * GLOBAL_STATE, bool use_fallback);
+
+// True if both pools have a weight and speak Stratum V1, jobs are then split between them
+bool stratum_split_enabled(GlobalState * GLOBAL_STATE);
+
+bool stratum_standby_ready(void);
+
+// Hands the standby session over to the caller. Its unread bytes are moved into the
+// stratum_api session buffer, extranonce_str and notify are owned by the caller afterwards.
+bool stratum_standby_take(stratum_standby_session * session);
+
+#endif /* STRATUM_STANDBY_TASK_H_ */
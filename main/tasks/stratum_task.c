@@ -8,6 +8,14 @@
 #include "nvs_config.h"
 #include "stratum_task.h"
 #include "work_queue.h"
+#include "share_submit_task.h"
+#include "stratum_v2_task.h"
+#include "stratum_standby_task.h"
+#include "pool_connect.h"
+#include "vardiff.h"
+#include "pool_health.h"
+#include "pool_tls.h"
+#include "esp_random.h"
 #include "esp_wifi.h"
 #include <esp_sntp.h>
 #include <time.h>
@@ -22,6 +30,11 @@
 
 #define BUFFER_SIZE 1024
 
+#define HEALTH_CHECK_INTERVAL_MS 5000
+#define TCP_KEEPALIVE_IDLE_S 30
+#define TCP_KEEPALIVE_INTERVAL_S 5
+#define TCP_KEEPALIVE_COUNT 3
+
 static const char * TAG = "stratum_task";
 
 static StratumApiV1Message stratum_api_v1_message = {};
@@ -29,6 +42,14 @@ static StratumApiV1Message stratum_api_v1_message = {};
 static const char * primary_stratum_url;
 static uint16_t primary_stratum_port;
 
+static vardiff_controller vardiff;
+static int vardiff_message_id = -1;
+
+// Liveness of the V1 session in stratum_session, checked by stratum_health_task
+static pool_health health;
+static bool health_tracking = false;
+static pthread_mutex_t health_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct timeval tcp_snd_timeout = {
     .tv_sec = 5,
     .tv_usec = 0
@@ -39,106 +60,32 @@ struct timeval tcp_rcv_timeout = {
     .tv_usec = 0
 };
 
-typedef struct {
-    struct sockaddr_storage dest_addr;  // Stores IPv4 or IPv6 address with scope_id for IPv6
-    socklen_t addrlen;
-    int addr_family;
-    int ip_protocol;
-    char host_ip[INET6_ADDRSTRLEN + 16];  // IPv6 address + zone identifier (e.g., "fe80::1%wlan0")
-} stratum_connection_info_t;
-
-static esp_err_t resolve_stratum_address(const char *hostname, uint16_t port, stratum_connection_info_t *conn_info)
+// getaddrinfo can return link-local IPv6 addresses without a scope, bind them to the WiFi interface
+static void set_link_local_scope(pool_addr_list * list)
 {
-    struct addrinfo hints = {
-        .ai_family = AF_UNSPEC,
-        .ai_socktype = SOCK_STREAM,
-        .ai_protocol = IPPROTO_TCP,
-        .ai_flags = AI_NUMERICSERV  // Port is numeric
-    };
-    struct addrinfo *res;
-    char port_str[6];
-    
-    snprintf(port_str, sizeof(port_str), "%d", port);
-    
-    ESP_LOGD(TAG, "Resolving address for hostname: %s (port %d)", hostname, port);
-    
-    int gai_err = getaddrinfo(hostname, port_str, &hints, &res);
-    if (gai_err != 0) {
-        ESP_LOGE(TAG, "getaddrinfo failed for %s: error code %d", hostname, gai_err);
-        return ESP_FAIL;
-    }
-
-    memset(conn_info, 0, sizeof(stratum_connection_info_t));
-    conn_info->addr_family = AF_UNSPEC;
-
-    // Prefer IPv6
-    struct addrinfo *p;
-    for (p = res; p != NULL; p = p->ai_next) {
-        if (p->ai_family == AF_INET6) {
-            memcpy(&conn_info->dest_addr, p->ai_addr, p->ai_addrlen);
-            conn_info->addrlen = p->ai_addrlen;
-            conn_info->addr_family = AF_INET6;
-            conn_info->ip_protocol = IPPROTO_IPV6;
-            
-            // Log scope ID for IPv6 link-local addresses
-            struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&conn_info->dest_addr;
-            if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr)) {
-                ESP_LOGI(TAG, "Link-local IPv6 address detected, scope_id: %lu", (unsigned long)addr6->sin6_scope_id);
-                if (addr6->sin6_scope_id == 0) {
-                    ESP_LOGW(TAG, "Warning: Link-local IPv6 without scope ID - attempting to set from WIFI_STA_DEF");
-                    // Try to get the WiFi STA interface index
-                    esp_netif_t *esp_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
-                    if (esp_netif) {
-                        int netif_index = esp_netif_get_netif_impl_index(esp_netif);
-                        if (netif_index >= 0) {
-                            addr6->sin6_scope_id = (u32_t)netif_index;
-                            ESP_LOGI(TAG, "Set scope_id to interface index: %lu", (unsigned long)addr6->sin6_scope_id);
-                        }
-                    }
-                }
-            }
-            break;
+    for (int i = 0; i < list->count; i++) {
+        if (list->addrs[i].ss_family != AF_INET6) {
+            continue;
         }
-    }
-
-    // If no IPv6, use IPv4
-    if (conn_info->addr_family == AF_UNSPEC) {
-        for (p = res; p != NULL; p = p->ai_next) {
-            if (p->ai_family == AF_INET) {
-                memcpy(&conn_info->dest_addr, p->ai_addr, p->ai_addrlen);
-                conn_info->addrlen = p->ai_addrlen;
-                conn_info->addr_family = AF_INET;
-                conn_info->ip_protocol = IPPROTO_IP;
-                break;
-            }
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&list->addrs[i];
+        if (!IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr) || addr6->sin6_scope_id != 0) {
+            continue;
         }
-    }
-
-    freeaddrinfo(res);
-
-    if (conn_info->addr_family == AF_UNSPEC) {
-        ESP_LOGE(TAG, "No suitable address found for %s", hostname);
-        return ESP_FAIL;
-    }
-
-    // Convert address to string for logging
-    if (conn_info->addr_family == AF_INET6) {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&conn_info->dest_addr;
-        inet_ntop(AF_INET6, &addr6->sin6_addr,
-                  conn_info->host_ip, sizeof(conn_info->host_ip));
-        
-        // Append zone identifier for link-local addresses
-        if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr) && addr6->sin6_scope_id != 0) {
-            char zone_buf[16];
-            snprintf(zone_buf, sizeof(zone_buf), "%%%lu", addr6->sin6_scope_id);
-            strncat(conn_info->host_ip, zone_buf, sizeof(conn_info->host_ip) - strlen(conn_info->host_ip) - 1);
+        ESP_LOGW(TAG, "Warning: Link-local IPv6 without scope ID - attempting to set from WIFI_STA_DEF");
+        esp_netif_t *esp_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+        if (esp_netif) {
+            int netif_index = esp_netif_get_netif_impl_index(esp_netif);
+            if (netif_index >= 0) {
+                addr6->sin6_scope_id = (u32_t)netif_index;
+                ESP_LOGI(TAG, "Set scope_id to interface index: %lu", (unsigned long)addr6->sin6_scope_id);
+            }
         }
-    } else {
-        inet_ntop(AF_INET, &((struct sockaddr_in *)&conn_info->dest_addr)->sin_addr,
-                  conn_info->host_ip, sizeof(conn_info->host_ip));
     }
+}
 
-    return ESP_OK;
+int stratum_active_pool_id(GlobalState * GLOBAL_STATE)
+{
+    return GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? POOL_ID_FALLBACK : POOL_ID_PRIMARY;
 }
 
 bool is_network_connected(GlobalState *state) {
@@ -156,10 +103,66 @@ bool is_network_connected(GlobalState *state) {
     return false;
 }
 
+int stratum_connect(const char * url, uint16_t port, int * addr_family)
+{
+    bool tls;
+    const char * host = pool_url_host(url, &tls);
+
+    pool_addr_list candidates;
+    if (pool_resolve(host, port, &candidates) != ESP_OK) {
+        ESP_LOGE(TAG, "Address resolution failed for %s", host);
+        return -1;
+    }
+    set_link_local_scope(&candidates);
+
+    int connected;
+    int sock = pool_connect(&candidates, POOL_CONNECT_TIMEOUT_MS, &connected);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Socket unable to connect to %s:%d (%d candidates)", host, port, candidates.count);
+        // The pool may have moved, ask the resolver again next time
+        pool_dns_cache_invalidate(host);
+        return sock;
+    }
+
+    char host_ip[INET6_ADDRSTRLEN + 16];
+    pool_format_addr(&candidates.addrs[connected], host_ip, sizeof(host_ip));
+    ESP_LOGI(TAG, "Connected to %s:%d (%s)", host, port, host_ip);
+
+    if (tls && pool_tls_handshake(sock, host, port) != ESP_OK) {
+        close(sock);
+        return -1;
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO , &tcp_rcv_timeout, sizeof(tcp_rcv_timeout)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
+    }
+
+    // Half-open connections fail the pending recv once the keepalive probes go unanswered
+    int keepalive = 1;
+    int keepalive_idle = TCP_KEEPALIVE_IDLE_S;
+    int keepalive_interval = TCP_KEEPALIVE_INTERVAL_S;
+    int keepalive_count = TCP_KEEPALIVE_COUNT;
+    if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepalive_interval, sizeof(keepalive_interval)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepalive_count, sizeof(keepalive_count)) != 0) {
+        ESP_LOGE(TAG, "Fail to setsockopt TCP keepalive");
+    }
+
+    if (addr_family != NULL) {
+        *addr_family = candidates.addrs[connected].ss_family;
+    }
+    return sock;
+}
+
 void cleanQueue(GlobalState * GLOBAL_STATE) {
     ESP_LOGI(TAG, "Clean Jobs: clearing queue");
     GLOBAL_STATE->abandon_work = 1;
-    queue_clear(&GLOBAL_STATE->stratum_queue);
+    notify_mailbox_clear(&GLOBAL_STATE->stratum_mailbox);
 
     pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
     ASIC_jobs_queue_clear(&GLOBAL_STATE->ASIC_jobs_queue);
@@ -172,7 +175,8 @@ void cleanQueue(GlobalState * GLOBAL_STATE) {
 void stratum_reset_uid(GlobalState * GLOBAL_STATE)
 {
     ESP_LOGI(TAG, "Resetting stratum uid");
-    GLOBAL_STATE->send_uid = 1;
+    atomic_store(&GLOBAL_STATE->send_uid, 1);
+    STRATUM_V1_reset_request_timings(GLOBAL_STATE->sock);
 }
 
 
@@ -184,10 +188,71 @@ void stratum_close_connection(GlobalState * GLOBAL_STATE)
     }
 
     ESP_LOGE(TAG, "Shutting down socket and restarting...");
-    shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
-    close(GLOBAL_STATE->sock);
+    // The number may be handed to the standby session next
+    STRATUM_V1_reset_request_timings(-1);
+    // stratum_health_task shuts the socket down under health_lock, so it is invalidated there
+    // before the number can be reused
+    pthread_mutex_lock(&health_lock);
+    int sock = GLOBAL_STATE->sock;
+    GLOBAL_STATE->sock = -1;
+    health_tracking = false;
+    pthread_mutex_unlock(&health_lock);
+    shutdown(sock, SHUT_RDWR);
+    pool_close(sock);
     cleanQueue(GLOBAL_STATE);
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    // Shares for the old session would only be rejected by the next one
+    share_submit_clear(stratum_active_pool_id(GLOBAL_STATE));
+}
+
+void stratum_health_submitted(int count)
+{
+    pthread_mutex_lock(&health_lock);
+    if (health_tracking) {
+        pool_health_on_submit(&health, count, esp_timer_get_time());
+    }
+    pthread_mutex_unlock(&health_lock);
+}
+
+static void health_update(void (*update)(pool_health *, int64_t))
+{
+    pthread_mutex_lock(&health_lock);
+    update(&health, esp_timer_get_time());
+    pthread_mutex_unlock(&health_lock);
+}
+
+// Stops the health checks of a session and counts the time mined since the pool was last heard from
+static void health_session_lost(GlobalState * GLOBAL_STATE)
+{
+    pthread_mutex_lock(&health_lock);
+    if (health_tracking) {
+        double stale_s = (esp_timer_get_time() - health.last_rx_us) / 1e6;
+        GLOBAL_STATE->SYSTEM_MODULE.stale_work_s += stale_s;
+        ESP_LOGI(TAG, "Session lost %.1f s after the last message from the pool", stale_s);
+    }
+    health_tracking = false;
+    pthread_mutex_unlock(&health_lock);
+}
+
+// Reconnects once the pool has been silent for longer than its notify cadence allows or stopped answering submits,
+// instead of waiting for the receive timeout
+static void stratum_health_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+
+    while (1) {
+        vTaskDelay(HEALTH_CHECK_INTERVAL_MS / portTICK_PERIOD_MS);
+
+        pthread_mutex_lock(&health_lock);
+        pool_health_status status = health_tracking ? pool_health_check(&health, esp_timer_get_time()) : POOL_HEALTH_OK;
+        if (status != POOL_HEALTH_OK && GLOBAL_STATE->sock >= 0) {
+            ESP_LOGW(TAG, "Pool session dead (%s, silence limit %.0f s, %d submits unanswered), reconnecting...",
+                     pool_health_status_str(status), pool_health_silence_timeout_s(&health), health.outstanding_submits);
+            GLOBAL_STATE->SYSTEM_MODULE.dead_session_count++;
+            // stratum_session sees the connection close and reconnects
+            shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
+        }
+        pthread_mutex_unlock(&health_lock);
+    }
 }
 
 void stratum_primary_heartbeat(void * pvParameters)
@@ -205,7 +270,8 @@ void stratum_primary_heartbeat(void * pvParameters)
 
     while (1)
     {
-        if (GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback == false) {
+        // A standby session to the primary pool switches back on its own
+        if (GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback == false || stratum_standby_enabled(GLOBAL_STATE, false)) {
             vTaskDelay(10000 / portTICK_PERIOD_MS);
             continue;
         }
@@ -218,25 +284,9 @@ void stratum_primary_heartbeat(void * pvParameters)
             continue;
         }
 
-        stratum_connection_info_t conn_info;
-        if (resolve_stratum_address(primary_stratum_url, primary_stratum_port, &conn_info) != ESP_OK) {
-            ESP_LOGD(TAG, "Heartbeat. Address resolution failed for: %s", primary_stratum_url);
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
-            continue;
-        }
-
-        int sock = socket(conn_info.addr_family, SOCK_STREAM, conn_info.ip_protocol);
+        int sock = stratum_connect(primary_stratum_url, primary_stratum_port, NULL);
         if (sock < 0) {
-            ESP_LOGD(TAG, "Heartbeat. Failed socket create check!");
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
-            continue;
-        }
-
-        int err = connect(sock, (struct sockaddr *)&conn_info.dest_addr, conn_info.addrlen);
-        if (err != 0)
-        {
-            ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d (errno %d: %s)", conn_info.host_ip, primary_stratum_port, errno, strerror(errno));
-            close(sock);
+            ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d", primary_stratum_url, primary_stratum_port);
             vTaskDelay(60000 / portTICK_PERIOD_MS);
             continue;
         }
@@ -245,23 +295,26 @@ void stratum_primary_heartbeat(void * pvParameters)
             ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
         }
 
-        int send_uid = 1;
-        STRATUM_V1_subscribe(sock, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
-        STRATUM_V1_authorize(sock, send_uid++, GLOBAL_STATE->SYSTEM_MODULE.pool_user, GLOBAL_STATE->SYSTEM_MODULE.pool_pass);
-
-        char recv_buffer[BUFFER_SIZE];
-        memset(recv_buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(sock, recv_buffer, BUFFER_SIZE - 1, 0);
+        bool primary_alive;
+        if (GLOBAL_STATE->SYSTEM_MODULE.pool_protocol == 2) {
+            bool tls;
+            primary_alive = stratum_v2_probe(sock, pool_url_host(primary_stratum_url, &tls), primary_stratum_port,
+                                             GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
+        } else {
+            int send_uid = 1;
+            STRATUM_V1_subscribe(sock, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
+            STRATUM_V1_authorize(sock, send_uid++, GLOBAL_STATE->SYSTEM_MODULE.pool_user, GLOBAL_STATE->SYSTEM_MODULE.pool_pass);
+
+            char recv_buffer[BUFFER_SIZE];
+            memset(recv_buffer, 0, BUFFER_SIZE);
+            int bytes_received = pool_recv(sock, recv_buffer, BUFFER_SIZE - 1);
+            primary_alive = bytes_received != -1 && strstr(recv_buffer, "mining.notify") != NULL;
+        }
 
         shutdown(sock, SHUT_RDWR);
-        close(sock);
-
-        if (bytes_received == -1)  {
-            vTaskDelay(60000 / portTICK_PERIOD_MS);
-            continue;
-        }
+        pool_close(sock);
 
-        if (strstr(recv_buffer, "mining.notify") != NULL && !GLOBAL_STATE->SYSTEM_MODULE.use_fallback_stratum) {
+        if (primary_alive && !GLOBAL_STATE->SYSTEM_MODULE.use_fallback_stratum) {
             ESP_LOGI(TAG, "Heartbeat successful and in fallback mode. Switching back to primary.");
             GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
             stratum_close_connection(GLOBAL_STATE);
@@ -348,6 +401,211 @@ static void decode_mining_notification(GlobalState * GLOBAL_STATE, const mining_
     }
 }
 
+static void record_time_to_first_notify(GlobalState * GLOBAL_STATE, int64_t session_lost_us)
+{
+    double elapsed_ms = (esp_timer_get_time() - session_lost_us) / 1000.0;
+    GLOBAL_STATE->SYSTEM_MODULE.time_to_first_notify_ms = elapsed_ms;
+    ESP_LOGI(TAG, "First mining.notify %.0f ms after disconnect", elapsed_ms);
+}
+
+static void vardiff_start(GlobalState * GLOBAL_STATE)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    // The configured suggestion stays the lower bound
+    uint32_t min_difficulty = module->is_using_fallback ? module->fallback_pool_difficulty : module->pool_difficulty;
+    vardiff_init(&vardiff, module->pool_shares_per_minute, min_difficulty, UINT32_MAX, esp_timer_get_time());
+    vardiff_message_id = -1;
+}
+
+static void vardiff_retarget(GlobalState * GLOBAL_STATE)
+{
+    SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
+    double hashrate = module->current_hashrate;
+    if (stratum_split_enabled(GLOBAL_STATE)) {
+        // Only the primary's share of the jobs is mined on this session
+        hashrate = hashrate * module->pool_weight / (module->pool_weight + module->fallback_pool_weight);
+    }
+
+    uint32_t difficulty = vardiff_update(&vardiff, hashrate, GLOBAL_STATE->pool_difficulty, esp_timer_get_time());
+    if (difficulty != 0) {
+        ESP_LOGI(TAG, "Suggesting difficulty %lu for %d shares per minute", difficulty, module->pool_shares_per_minute);
+        vardiff_message_id = atomic_fetch_add(&GLOBAL_STATE->send_uid, 1);
+        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, vardiff_message_id, difficulty);
+    }
+}
+
+// Dispatches pool messages until the connection drops or the pool asks for a reconnect.
+// Returns true if the pool answered the setup or sent work before that.
+static bool stratum_session(GlobalState * GLOBAL_STATE, int authorize_message_id, uint32_t difficulty, bool extranonce_subscribe,
+                            int * retry_attempts, int64_t * session_lost_us)
+{
+    bool established = false;
+    vardiff_start(GLOBAL_STATE);
+
+    pthread_mutex_lock(&health_lock);
+    pool_health_reset(&health, esp_timer_get_time());
+    health_tracking = true;
+    pthread_mutex_unlock(&health_lock);
+
+    while (1) {
+        const char * line = STRATUM_V1_receive_jsonrpc_line(GLOBAL_STATE->sock);
+        if (!line) {
+            ESP_LOGE(TAG, "Failed to receive JSON-RPC line, reconnecting...");
+            health_session_lost(GLOBAL_STATE);
+            (*retry_attempts)++;
+            *session_lost_us = esp_timer_get_time();
+            stratum_close_connection(GLOBAL_STATE);
+            return established;
+        }
+        int64_t received_us = esp_timer_get_time();
+        health_update(pool_health_on_rx);
+
+        STRATUM_V1_parse(&stratum_api_v1_message, line);
+
+        double response_time_ms = STRATUM_V1_record_response(&stratum_api_v1_message);
+        if (response_time_ms >= 0) {
+            ESP_LOGI(TAG, "Stratum response time: %.2f ms", response_time_ms);
+            GLOBAL_STATE->SYSTEM_MODULE.response_time = response_time_ms;
+        }
+
+        if (stratum_api_v1_message.method == MINING_NOTIFY) {
+            established = true;
+            health_update(pool_health_on_notify);
+            if (*session_lost_us != 0) {
+                record_time_to_first_notify(GLOBAL_STATE, *session_lost_us);
+                *session_lost_us = 0;
+            }
+            GLOBAL_STATE->SYSTEM_MODULE.work_received++;
+            stratum_api_v1_message.mining_notification->pool_id = stratum_active_pool_id(GLOBAL_STATE);
+            stratum_api_v1_message.mining_notification->clean_jobs = stratum_api_v1_message.should_abandon_work;
+            stratum_api_v1_message.mining_notification->received_us = received_us;
+            SYSTEM_notify_new_ntime(GLOBAL_STATE, stratum_api_v1_message.mining_notification->ntime);
+            if (stratum_api_v1_message.should_abandon_work &&
+                (notify_mailbox_pending(&GLOBAL_STATE->stratum_mailbox) || queue_count(&GLOBAL_STATE->ASIC_jobs_queue) > 0)) {
+                cleanQueue(GLOBAL_STATE);
+            }
+            notify_mailbox_post(&GLOBAL_STATE->stratum_mailbox, stratum_api_v1_message.mining_notification);
+            decode_mining_notification(GLOBAL_STATE, stratum_api_v1_message.mining_notification);
+            vardiff_retarget(GLOBAL_STATE);
+        } else if (stratum_api_v1_message.method == MINING_SET_DIFFICULTY) {
+            ESP_LOGI(TAG, "Set pool difficulty: %ld", stratum_api_v1_message.new_difficulty);
+            if (stratum_api_v1_message.new_difficulty != GLOBAL_STATE->pool_difficulty) {
+                vardiff_pool_difficulty_changed(&vardiff);
+            }
+            GLOBAL_STATE->pool_difficulty = stratum_api_v1_message.new_difficulty;
+            GLOBAL_STATE->new_set_mining_difficulty_msg = true;
+        } else if (stratum_api_v1_message.method == MINING_SET_VERSION_MASK ||
+                stratum_api_v1_message.method == STRATUM_RESULT_VERSION_MASK) {
+            ESP_LOGI(TAG, "Set version mask: %08lx", stratum_api_v1_message.version_mask);
+            GLOBAL_STATE->version_mask = stratum_api_v1_message.version_mask;
+            GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+        } else if (stratum_api_v1_message.method == MINING_SET_EXTRANONCE ||
+                stratum_api_v1_message.method == STRATUM_RESULT_SUBSCRIBE) {
+            // Validate extranonce_2_len to prevent buffer overflow
+            if (stratum_api_v1_message.extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
+                ESP_LOGW(TAG, "Extranonce_2_len %d exceeds maximum %d, clamping to maximum", 
+                         stratum_api_v1_message.extranonce_2_len, MAX_EXTRANONCE_2_LEN);
+                stratum_api_v1_message.extranonce_2_len = MAX_EXTRANONCE_2_LEN;
+            }
+            ESP_LOGI(TAG, "Set extranonce: %s, extranonce_2_len: %d", stratum_api_v1_message.extranonce_str, stratum_api_v1_message.extranonce_2_len);
+            char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
+            GLOBAL_STATE->extranonce_str = stratum_api_v1_message.extranonce_str;
+            GLOBAL_STATE->extranonce_2_len = stratum_api_v1_message.extranonce_2_len;
+            free(old_extranonce_str);
+        } else if (stratum_api_v1_message.method == CLIENT_RECONNECT) {
+            ESP_LOGE(TAG, "Pool requested client reconnect...");
+            pthread_mutex_lock(&health_lock);
+            health_tracking = false;
+            pthread_mutex_unlock(&health_lock);
+            *session_lost_us = esp_timer_get_time();
+            stratum_close_connection(GLOBAL_STATE);
+            return established;
+        } else if (stratum_api_v1_message.method == STRATUM_RESULT && stratum_api_v1_message.message_id == vardiff_message_id) {
+            ESP_LOGI(TAG, "suggest_difficulty %s", stratum_api_v1_message.response_success ? "accepted" : "rejected");
+        } else if (stratum_api_v1_message.method == STRATUM_RESULT) {
+            health_update(pool_health_on_submit_response);
+            if (stratum_api_v1_message.response_success) {
+                ESP_LOGI(TAG, "message result accepted");
+                SYSTEM_notify_accepted_share(GLOBAL_STATE, stratum_active_pool_id(GLOBAL_STATE));
+                vardiff_record_share(&vardiff, GLOBAL_STATE->pool_difficulty);
+                vardiff_retarget(GLOBAL_STATE);
+            } else {
+                ESP_LOGW(TAG, "message result rejected: %s", stratum_api_v1_message.error_str);
+                SYSTEM_notify_rejected_share(GLOBAL_STATE, stratum_active_pool_id(GLOBAL_STATE), stratum_api_v1_message.error_str);
+            }
+        } else if (stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
+            // Reset retry attempts after successfully receiving data.
+            *retry_attempts = 0;
+            if (stratum_api_v1_message.response_success) {
+                established = true;
+                ESP_LOGI(TAG, "setup message accepted");
+                if (stratum_api_v1_message.message_id == authorize_message_id && difficulty > 0) {
+                    STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, atomic_fetch_add(&GLOBAL_STATE->send_uid, 1), difficulty);
+                }
+                if (extranonce_subscribe) {
+                    STRATUM_V1_extranonce_subscribe(GLOBAL_STATE->sock, atomic_fetch_add(&GLOBAL_STATE->send_uid, 1));
+                }
+            } else {
+                ESP_LOGE(TAG, "setup message rejected: %s", stratum_api_v1_message.error_str);
+            }
+        }
+    }
+}
+
+static void reset_share_stats(GlobalState * GLOBAL_STATE)
+{
+    for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
+    }
+    GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.work_received = 0;
+}
+
+// Mines the other pool's standby session right away instead of connecting to it from scratch
+static bool adopt_standby_session(GlobalState * GLOBAL_STATE, int64_t session_lost_us)
+{
+    stratum_standby_session standby;
+    if (!stratum_standby_take(&standby)) {
+        return false;
+    }
+
+    GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = standby.is_fallback;
+    reset_share_stats(GLOBAL_STATE);
+
+    cleanQueue(GLOBAL_STATE);
+    GLOBAL_STATE->sock = standby.sock;
+    atomic_store(&GLOBAL_STATE->send_uid, standby.send_uid);
+    STRATUM_V1_reset_request_timings(standby.sock);
+
+    char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
+    GLOBAL_STATE->extranonce_str = standby.extranonce_str;
+    GLOBAL_STATE->extranonce_2_len = standby.extranonce_2_len;
+    free(old_extranonce_str);
+
+    if (standby.version_mask != 0) {
+        GLOBAL_STATE->version_mask = standby.version_mask;
+        GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+    }
+    if (standby.difficulty != 0) {
+        GLOBAL_STATE->pool_difficulty = standby.difficulty;
+        GLOBAL_STATE->new_set_mining_difficulty_msg = true;
+    }
+
+    GLOBAL_STATE->abandon_work = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.work_received++;
+    if (session_lost_us != 0) {
+        record_time_to_first_notify(GLOBAL_STATE, session_lost_us);
+    }
+    standby.notify->pool_id = stratum_active_pool_id(GLOBAL_STATE);
+    SYSTEM_notify_new_ntime(GLOBAL_STATE, standby.notify->ntime);
+    notify_mailbox_post(&GLOBAL_STATE->stratum_mailbox, standby.notify);
+    decode_mining_notification(GLOBAL_STATE, standby.notify);
+    return true;
+}
+
 void stratum_task(void * pvParameters)
 {
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
@@ -357,13 +615,32 @@ void stratum_task(void * pvParameters)
     char * stratum_url = GLOBAL_STATE->SYSTEM_MODULE.pool_url;
     uint16_t port = GLOBAL_STATE->SYSTEM_MODULE.pool_port;
     bool extranonce_subscribe = GLOBAL_STATE->SYSTEM_MODULE.pool_extranonce_subscribe;
-    uint16_t difficulty = GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty;
+    uint32_t difficulty = GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty;
+
+    // Pools behind a private CA, the certificate bundle covers the public ones
+    char * ca_cert = nvs_config_get_string(NVS_CONFIG_STRATUM_CA_CERT);
+    pool_tls_set_ca_cert(ca_cert);
+    free(ca_cert);
 
     STRATUM_V1_initialize_buffer();
     int retry_attempts = 0;
     int retry_critical_attempts = 0;
+    int backoff_attempt = 0;
+    int64_t session_lost_us = 0;
+
+    bool split_mining = stratum_split_enabled(GLOBAL_STATE);
+    if (split_mining) {
+        ESP_LOGI(TAG, "Split mining, primary weight %d, fallback weight %d", GLOBAL_STATE->SYSTEM_MODULE.pool_weight,
+                 GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_weight);
+        // stratum_task keeps the primary, the fallback session runs next to it
+        GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
+    }
 
     xTaskCreateWithCaps(stratum_primary_heartbeat, "stratum primary heartbeat", 8192, pvParameters, 1, NULL, MALLOC_CAP_SPIRAM);
+    xTaskCreateWithCaps(stratum_health_task, "stratum health", 4096, pvParameters, 3, NULL, MALLOC_CAP_SPIRAM);
+    if (GLOBAL_STATE->SYSTEM_MODULE.hot_standby || split_mining) {
+        xTaskCreateWithCaps(stratum_standby_task, "stratum standby", 8192, pvParameters, 3, NULL, MALLOC_CAP_SPIRAM);
+    }
 
     ESP_LOGI(TAG, "Opening connection to pool: %s:%d", stratum_url, port);
     while (1) {
@@ -373,7 +650,24 @@ void stratum_task(void * pvParameters)
             continue;
         }
 
-        if (retry_attempts >= MAX_RETRY_ATTEMPTS)
+        // With hot standby the other pool is already subscribed, switch without waiting for more retries
+        if (retry_attempts > 0 && stratum_standby_enabled(GLOBAL_STATE, !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback) &&
+            adopt_standby_session(GLOBAL_STATE, session_lost_us)) {
+            ESP_LOGI(TAG, "Switched to the %s pool on standby", GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? "fallback" : "primary");
+            GLOBAL_STATE->failover_started_us = session_lost_us != 0 ? session_lost_us : esp_timer_get_time();
+            session_lost_us = 0;
+            retry_attempts = 0;
+            // configure, subscribe and authorize were answered on the standby session
+            stratum_session(GLOBAL_STATE, -1, 0, false, &retry_attempts, &session_lost_us);
+            backoff_attempt = 1;
+            continue;
+        }
+
+        if (retry_attempts >= MAX_RETRY_ATTEMPTS && split_mining) {
+            // The fallback pool is already being mined, keep retrying the primary
+            ESP_LOGI(TAG, "Primary pool unreachable, mining the fallback pool only (retries: %d)...", retry_attempts);
+            retry_attempts = 0;
+        } else if (retry_attempts >= MAX_RETRY_ATTEMPTS)
         {
             if (GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url == NULL || GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url[0] == '\0') {
                 ESP_LOGI(TAG, "Unable to switch to fallback. No url configured. (retries: %d)...", retry_attempts);
@@ -385,173 +679,90 @@ void stratum_task(void * pvParameters)
             GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
             
             // Reset share stats at failover
-            for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
-            }
-            GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.work_received = 0;
+            reset_share_stats(GLOBAL_STATE);
+            GLOBAL_STATE->failover_started_us = session_lost_us != 0 ? session_lost_us : esp_timer_get_time();
 
             ESP_LOGI(TAG, "Switching target due to too many failures (retries: %d)...", retry_attempts);
             retry_attempts = 0;
+            // Nothing to back off from on the other pool
+            backoff_attempt = 0;
         }
 
         stratum_url = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url : GLOBAL_STATE->SYSTEM_MODULE.pool_url;
         port = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_port : GLOBAL_STATE->SYSTEM_MODULE.pool_port;
         extranonce_subscribe = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_extranonce_subscribe : GLOBAL_STATE->SYSTEM_MODULE.pool_extranonce_subscribe;
         difficulty = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty : GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty;
+        uint16_t protocol = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_protocol : GLOBAL_STATE->SYSTEM_MODULE.pool_protocol;
 
-        stratum_connection_info_t conn_info;
-        if (resolve_stratum_address(stratum_url, port, &conn_info) != ESP_OK) {
-            ESP_LOGE(TAG, "Address resolution failed for %s", stratum_url);
-            retry_attempts++;
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
+        if (backoff_attempt > 0) {
+            uint32_t delay_ms = pool_backoff_ms(backoff_attempt - 1, esp_random());
+            ESP_LOGI(TAG, "Reconnecting in %lu ms", (unsigned long) delay_ms);
+            vTaskDelay(delay_ms / portTICK_PERIOD_MS);
         }
 
-        ESP_LOGI(TAG, "Connecting to: stratum+tcp://%s:%d (%s)", stratum_url, port, conn_info.host_ip);
+        bool tls;
+        const char * host = pool_url_host(stratum_url, &tls);
+        ESP_LOGI(TAG, "Connecting to: %s://%s:%d", tls ? "stratum+ssl" : "stratum+tcp", host, port);
 
-        GLOBAL_STATE->sock = socket(conn_info.addr_family, SOCK_STREAM, conn_info.ip_protocol);
-        vTaskDelay(300 / portTICK_PERIOD_MS);
-        if (GLOBAL_STATE->sock < 0) {
-            ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        int addr_family = 0;
+        GLOBAL_STATE->sock = stratum_connect(stratum_url, port, &addr_family);
+        if (GLOBAL_STATE->sock == POOL_CONNECT_NO_SOCKET) {
+            GLOBAL_STATE->sock = -1;
             if (++retry_critical_attempts > MAX_CRITICAL_RETRY_ATTEMPTS) {
                 ESP_LOGE(TAG, "Max retry attempts reached, restarting...");
                 esp_restart();
             }
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            backoff_attempt++;
             continue;
         }
-        retry_critical_attempts = 0;
-
-        ESP_LOGI(TAG, "Socket created, connecting to %s:%d", conn_info.host_ip, port);
-        int err = connect(GLOBAL_STATE->sock, (struct sockaddr *)&conn_info.dest_addr, conn_info.addrlen);
-        if (err != 0)
-        {
+        if (GLOBAL_STATE->sock < 0) {
             retry_attempts++;
-            ESP_LOGE(TAG, "Socket unable to connect to %s:%d (errno %d: %s)", stratum_url, port, errno, strerror(errno));
-            // close the socket
-            shutdown(GLOBAL_STATE->sock, SHUT_RDWR);
-            close(GLOBAL_STATE->sock);
-            // instead of restarting, retry this every 5 seconds
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            backoff_attempt++;
             continue;
         }
+        retry_critical_attempts = 0;
 
-        if (setsockopt(GLOBAL_STATE->sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) != 0) {
-            ESP_LOGE(TAG, "Fail to setsockopt SO_SNDTIMEO");
-        }
+        // Store the resolved address family
+        GLOBAL_STATE->SYSTEM_MODULE.pool_addr_family = addr_family;
 
-        if (setsockopt(GLOBAL_STATE->sock, SOL_SOCKET, SO_RCVTIMEO , &tcp_rcv_timeout, sizeof(tcp_rcv_timeout)) != 0) {
-            ESP_LOGE(TAG, "Fail to setsockopt SO_RCVTIMEO ");
-        }
+        char * username = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
+        char * password = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_pass : GLOBAL_STATE->SYSTEM_MODULE.pool_pass;
 
-        // Store the resolved address family
-        GLOBAL_STATE->SYSTEM_MODULE.pool_addr_family = conn_info.addr_family;
+        if (protocol == 2) {
+            cleanQueue(GLOBAL_STATE);
+            if (stratum_v2_session(GLOBAL_STATE, host, port, username)) {
+                retry_attempts = 0;
+                backoff_attempt = 1;
+            } else {
+                retry_attempts++;
+                backoff_attempt++;
+            }
+            session_lost_us = esp_timer_get_time();
+            continue;
+        }
 
         stratum_reset_uid(GLOBAL_STATE);
         cleanQueue(GLOBAL_STATE);
+        STRATUM_V1_initialize_buffer();
 
         ///// Start Stratum Action
         // mining.configure - ID: 1
-        STRATUM_V1_configure_version_rolling(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, &GLOBAL_STATE->version_mask);
+        STRATUM_V1_configure_version_rolling(GLOBAL_STATE->sock, atomic_fetch_add(&GLOBAL_STATE->send_uid, 1), &GLOBAL_STATE->version_mask);
 
         // mining.subscribe - ID: 2
-        STRATUM_V1_subscribe(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
+        STRATUM_V1_subscribe(GLOBAL_STATE->sock, atomic_fetch_add(&GLOBAL_STATE->send_uid, 1), GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
 
-        char * username = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-        char * password = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_pass : GLOBAL_STATE->SYSTEM_MODULE.pool_pass;
-
-        int authorize_message_id = GLOBAL_STATE->send_uid++;
+        int authorize_message_id = atomic_fetch_add(&GLOBAL_STATE->send_uid, 1);
         //mining.authorize - ID: 3
         STRATUM_V1_authorize(GLOBAL_STATE->sock, authorize_message_id, username, password);
-        STRATUM_V1_stamp_tx(authorize_message_id);
 
         // Everything is set up, lets make sure we don't abandon work unnecessarily.
         GLOBAL_STATE->abandon_work = 0;
 
-        while (1) {
-            char * line = STRATUM_V1_receive_jsonrpc_line(GLOBAL_STATE->sock);
-            if (!line) {
-                ESP_LOGE(TAG, "Failed to receive JSON-RPC line, reconnecting...");
-                retry_attempts++;
-                stratum_close_connection(GLOBAL_STATE);
-                break;
-            }
-
-            double response_time_ms = STRATUM_V1_get_response_time_ms(stratum_api_v1_message.message_id);
-            if (response_time_ms >= 0) {
-                ESP_LOGI(TAG, "Stratum response time: %.2f ms", response_time_ms);
-                GLOBAL_STATE->SYSTEM_MODULE.response_time = response_time_ms;
-            }
-
-            STRATUM_V1_parse(&stratum_api_v1_message, line);
-            free(line);
-
-            if (stratum_api_v1_message.method == MINING_NOTIFY) {
-                GLOBAL_STATE->SYSTEM_MODULE.work_received++;
-                SYSTEM_notify_new_ntime(GLOBAL_STATE, stratum_api_v1_message.mining_notification->ntime);
-                if (stratum_api_v1_message.should_abandon_work &&
-                    (GLOBAL_STATE->stratum_queue.count > 0 || GLOBAL_STATE->ASIC_jobs_queue.count > 0)) {
-                    cleanQueue(GLOBAL_STATE);
-                }
-                if (GLOBAL_STATE->stratum_queue.count == QUEUE_SIZE) {
-                    mining_notify * next_notify_json_str = (mining_notify *) queue_dequeue(&GLOBAL_STATE->stratum_queue);
-                    STRATUM_V1_free_mining_notify(next_notify_json_str);
-                }
-                queue_enqueue(&GLOBAL_STATE->stratum_queue, stratum_api_v1_message.mining_notification);
-                decode_mining_notification(GLOBAL_STATE, stratum_api_v1_message.mining_notification);
-            } else if (stratum_api_v1_message.method == MINING_SET_DIFFICULTY) {
-                ESP_LOGI(TAG, "Set pool difficulty: %ld", stratum_api_v1_message.new_difficulty);
-                GLOBAL_STATE->pool_difficulty = stratum_api_v1_message.new_difficulty;
-                GLOBAL_STATE->new_set_mining_difficulty_msg = true;
-            } else if (stratum_api_v1_message.method == MINING_SET_VERSION_MASK ||
-                    stratum_api_v1_message.method == STRATUM_RESULT_VERSION_MASK) {
-                ESP_LOGI(TAG, "Set version mask: %08lx", stratum_api_v1_message.version_mask);
-                GLOBAL_STATE->version_mask = stratum_api_v1_message.version_mask;
-                GLOBAL_STATE->new_stratum_version_rolling_msg = true;
-            } else if (stratum_api_v1_message.method == MINING_SET_EXTRANONCE ||
-                    stratum_api_v1_message.method == STRATUM_RESULT_SUBSCRIBE) {
-                // Validate extranonce_2_len to prevent buffer overflow
-                if (stratum_api_v1_message.extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
-                    ESP_LOGW(TAG, "Extranonce_2_len %d exceeds maximum %d, clamping to maximum", 
-                             stratum_api_v1_message.extranonce_2_len, MAX_EXTRANONCE_2_LEN);
-                    stratum_api_v1_message.extranonce_2_len = MAX_EXTRANONCE_2_LEN;
-                }
-                ESP_LOGI(TAG, "Set extranonce: %s, extranonce_2_len: %d", stratum_api_v1_message.extranonce_str, stratum_api_v1_message.extranonce_2_len);
-                char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
-                GLOBAL_STATE->extranonce_str = stratum_api_v1_message.extranonce_str;
-                GLOBAL_STATE->extranonce_2_len = stratum_api_v1_message.extranonce_2_len;
-                free(old_extranonce_str);
-            } else if (stratum_api_v1_message.method == CLIENT_RECONNECT) {
-                ESP_LOGE(TAG, "Pool requested client reconnect...");
-                stratum_close_connection(GLOBAL_STATE);
-                break;
-            } else if (stratum_api_v1_message.method == STRATUM_RESULT) {
-                if (stratum_api_v1_message.response_success) {
-                    ESP_LOGI(TAG, "message result accepted");
-                    SYSTEM_notify_accepted_share(GLOBAL_STATE);
-                } else {
-                    ESP_LOGW(TAG, "message result rejected: %s", stratum_api_v1_message.error_str);
-                    SYSTEM_notify_rejected_share(GLOBAL_STATE, stratum_api_v1_message.error_str);
-                }
-            } else if (stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
-                // Reset retry attempts after successfully receiving data.
-                retry_attempts = 0;
-                if (stratum_api_v1_message.response_success) {
-                    ESP_LOGI(TAG, "setup message accepted");
-                    if (stratum_api_v1_message.message_id == authorize_message_id && difficulty > 0) {
-                        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++, difficulty);
-                    }
-                    if (extranonce_subscribe) {
-                        STRATUM_V1_extranonce_subscribe(GLOBAL_STATE->sock, GLOBAL_STATE->send_uid++);
-                    }
-                } else {
-                    ESP_LOGE(TAG, "setup message rejected: %s", stratum_api_v1_message.error_str);
-                }
-            }
+        if (stratum_session(GLOBAL_STATE, authorize_message_id, difficulty, extranonce_subscribe, &retry_attempts, &session_lost_us)) {
+            backoff_attempt = 1;
+        } else {
+            backoff_attempt++;
         }
     }
     vTaskDelete(NULL);
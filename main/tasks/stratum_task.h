@@ -1,7 +1,22 @@
 #ifndef STRATUM_TASK_H_
 #define STRATUM_TASK_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void stratum_task(void *pvParameters);
 void stratum_close_connection(GlobalState * GLOBAL_STATE);
+void cleanQueue(GlobalState * GLOBAL_STATE);
+bool is_network_connected(GlobalState * state);
+
+// Pool id of the session stratum_task is mining, POOL_ID_PRIMARY or POOL_ID_FALLBACK
+int stratum_active_pool_id(GlobalState * GLOBAL_STATE);
+
+// Resolves and connects to a pool with the stratum socket timeouts, a stratum+ssl:// url also runs the TLS handshake.
+// Returns the socket, -1 or POOL_CONNECT_NO_SOCKET if no socket could be created.
+int stratum_connect(const char * url, uint16_t port, int * addr_family);
+
+// Submits sent on the session of stratum_task, for the dead session detection
+void stratum_health_submitted(int count);
 
 #endif
\ No newline at end of file
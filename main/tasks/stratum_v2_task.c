@@ -0,0 +1,365 @@
+#include <stdatomic.h>
+#include <string.h>
+#include <stdio.h>
+#include <lwip/sockets.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_app_desc.h"
+
+#include "stratum_v2_task.h"
+#include "stratum_task.h"
+#include "stratum_v2.h"
+#include "pool_tls.h"
+#include "system.h"
+#include "mining.h"
+#include "utils.h"
+#include "asic.h"
+
+// Future jobs kept around until a SetNewPrevHash activates one of them
+#define SV2_JOB_SLOTS 8
+#define SV2_QUEUE_LOW_WATER_MARK 10
+#define SV2_POLL_MS 100
+#define SV2_IDLE_TIMEOUT_US (180 * 1000000LL)
+
+static const char * TAG = "stratum_v2_task";
+
+typedef struct
+{
+    bool valid;
+    uint32_t job_id;
+    uint32_t version;
+    uint8_t merkle_root[32];
+} sv2_job;
+
+static StratumApiV2Message message;
+static uint8_t tx_buffer[512];
+
+static sv2_job jobs[SV2_JOB_SLOTS];
+static int next_job_slot;
+
+static bool has_prev_hash;
+static uint8_t prev_hash[32];
+static uint32_t nbits;
+
+// The job being fed to the ASICs. Standard channels only let us roll ntime
+// (up to the seconds elapsed since the job was activated) and the version bits.
+static int active_job = -1;
+static uint32_t active_min_ntime;
+static int64_t active_since_us;
+static int64_t fed_second;
+static uint32_t next_version;
+// Receipt of the SetNewPrevHash whose first job is not sent yet
+static int64_t new_block_us;
+
+static volatile bool channel_open;
+static uint32_t channel_id;
+// share_submit_task numbers the shares, stratum_task resets the count per session
+static atomic_uint sequence_number;
+
+static bool write_frame(int sock, const uint8_t * frame, size_t len)
+{
+    if (len == 0) {
+        ESP_LOGE(TAG, "Frame does not fit the tx buffer");
+        return false;
+    }
+    while (len > 0) {
+        int ret = pool_send(sock, frame, len);
+        if (ret < 0) {
+            ESP_LOGI(TAG, "Unable to write frame (errno %d: %s)", errno, strerror(errno));
+            return false;
+        }
+        frame += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static size_t encode_setup_connection(uint8_t * buffer, size_t size, const char * host, uint16_t port, const char * model)
+{
+    const esp_app_desc_t * app_desc = esp_app_get_description();
+    return STRATUM_V2_encode_setup_connection(buffer, size, SV2_REQUIRES_STANDARD_JOBS | SV2_REQUIRES_VERSION_ROLLING, host, port,
+                                              "bitaxe", model, app_desc->version, "");
+}
+
+bool stratum_v2_is_active(void)
+{
+    return channel_open;
+}
+
+size_t stratum_v2_encode_share(uint8_t * buffer, size_t size, uint32_t job_id, uint32_t nonce, uint32_t ntime, uint32_t version)
+{
+    if (!channel_open) {
+        return 0;
+    }
+    return STRATUM_V2_encode_submit_shares_standard(buffer, size, channel_id, atomic_fetch_add(&sequence_number, 1), job_id, nonce, ntime, version);
+}
+
+static void reset_jobs(void)
+{
+    memset(jobs, 0, sizeof(jobs));
+    next_job_slot = 0;
+    has_prev_hash = false;
+    active_job = -1;
+}
+
+static int find_job(uint32_t job_id)
+{
+    for (int i = 0; i < SV2_JOB_SLOTS; i++) {
+        if (jobs[i].valid && jobs[i].job_id == job_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int store_job(const StratumApiV2Message * msg)
+{
+    int slot = next_job_slot;
+    if (slot == active_job) {
+        slot = (slot + 1) % SV2_JOB_SLOTS;
+    }
+    next_job_slot = (slot + 1) % SV2_JOB_SLOTS;
+
+    jobs[slot].valid = true;
+    jobs[slot].job_id = msg->job_id;
+    jobs[slot].version = msg->version;
+    memcpy(jobs[slot].merkle_root, msg->merkle_root, 32);
+    return slot;
+}
+
+static void enqueue_job(GlobalState * GLOBAL_STATE, uint32_t ntime, uint32_t version)
+{
+    const sv2_job * job = &jobs[active_job];
+
+    bm_job next_job = construct_bm_job_for_format(ASIC_get_job_format(GLOBAL_STATE), version, prev_hash, job->merkle_root, ntime,
+                                                  nbits, GLOBAL_STATE->version_mask, GLOBAL_STATE->pool_difficulty);
+
+    bm_job * queued_next_job = bm_job_alloc();
+    if (queued_next_job == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for queued_next_job");
+        return;
+    }
+
+    memcpy(queued_next_job, &next_job, sizeof(bm_job));
+    snprintf(queued_next_job->jobid, sizeof(queued_next_job->jobid), "%lu", job->job_id);
+    queued_next_job->version_mask = GLOBAL_STATE->version_mask;
+    queued_next_job->pool_id = stratum_active_pool_id(GLOBAL_STATE);
+    queued_next_job->notify_received_us = new_block_us;
+    new_block_us = 0;
+
+    queue_enqueue(&GLOBAL_STATE->ASIC_jobs_queue, queued_next_job);
+}
+
+// A header-only job is a single midstate, so we hand out a fresh job every second
+// with the next ntime. The BM1397 can't roll the version itself and runs through
+// a job quickly, so it also gets the version bits rolled in software.
+static void feed_jobs(GlobalState * GLOBAL_STATE)
+{
+    if (active_job < 0 || !has_prev_hash || !GLOBAL_STATE->ASIC_initalized ||
+        queue_count(&GLOBAL_STATE->ASIC_jobs_queue) >= SV2_QUEUE_LOW_WATER_MARK) {
+        return;
+    }
+
+    int64_t second = (esp_timer_get_time() - active_since_us) / 1000000;
+    if (second != fed_second) {
+        fed_second = second;
+        next_version = jobs[active_job].version;
+        enqueue_job(GLOBAL_STATE, active_min_ntime + second, next_version);
+        return;
+    }
+
+    if (GLOBAL_STATE->DEVICE_CONFIG.family.asic.id != BM1397 || GLOBAL_STATE->version_mask == 0) {
+        return;
+    }
+
+    while (queue_count(&GLOBAL_STATE->ASIC_jobs_queue) < SV2_QUEUE_LOW_WATER_MARK) {
+        for (int i = 0; i < 4; i++) {
+            next_version = increment_bitmask(next_version, GLOBAL_STATE->version_mask);
+        }
+        if (next_version == jobs[active_job].version) {
+            // Version space for this second is exhausted, wait for the next ntime
+            return;
+        }
+        enqueue_job(GLOBAL_STATE, active_min_ntime + second, next_version);
+    }
+}
+
+static void activate_job(GlobalState * GLOBAL_STATE, int slot, uint32_t min_ntime, bool clean_jobs)
+{
+    active_job = slot;
+    active_min_ntime = min_ntime;
+    active_since_us = esp_timer_get_time();
+    fed_second = -1;
+
+    if (clean_jobs) {
+        new_block_us = active_since_us;
+        cleanQueue(GLOBAL_STATE);
+    }
+
+    feed_jobs(GLOBAL_STATE);
+
+    if (clean_jobs) {
+        xSemaphoreGive(GLOBAL_STATE->ASIC_TASK_MODULE.semaphore);
+    }
+}
+
+static void set_target(GlobalState * GLOBAL_STATE, const uint8_t target[32])
+{
+    double difficulty = STRATUM_V2_target_to_difficulty(target);
+    GLOBAL_STATE->pool_difficulty = difficulty < 1 ? 1 : (difficulty > UINT32_MAX ? UINT32_MAX : (uint32_t) difficulty);
+    ESP_LOGI(TAG, "Set pool difficulty: %ld", GLOBAL_STATE->pool_difficulty);
+}
+
+static void set_new_prev_hash(GlobalState * GLOBAL_STATE, const StratumApiV2Message * msg)
+{
+    int slot = find_job(msg->job_id);
+    if (slot < 0) {
+        ESP_LOGW(TAG, "SetNewPrevHash for unknown job %lu", msg->job_id);
+        return;
+    }
+
+    // Every other future job was built on the previous block
+    for (int i = 0; i < SV2_JOB_SLOTS; i++) {
+        if (i != slot) {
+            jobs[i].valid = false;
+        }
+    }
+
+    memcpy(prev_hash, msg->prev_hash, 32);
+    nbits = msg->nbits;
+    has_prev_hash = true;
+
+    double network_difficulty = networkDifficulty(nbits);
+    GLOBAL_STATE->network_nonce_diff = (uint64_t) network_difficulty;
+    suffixString(network_difficulty, GLOBAL_STATE->network_diff_string, DIFF_STRING_SIZE, 0);
+    SYSTEM_notify_new_ntime(GLOBAL_STATE, msg->min_ntime);
+
+    activate_job(GLOBAL_STATE, slot, msg->min_ntime, true);
+}
+
+bool stratum_v2_session(GlobalState * GLOBAL_STATE, const char * host, uint16_t port, const char * user)
+{
+    int sock = GLOBAL_STATE->sock;
+    bool opened = false;
+
+    reset_jobs();
+    channel_open = false;
+    atomic_store(&sequence_number, 0);
+
+    // Without the Noise handshake this only works against a local SV2 proxy or translator
+    ESP_LOGW(TAG, "Stratum V2 runs unencrypted, %s:%d has to be a plaintext SV2 proxy", host, port);
+
+    if (!write_frame(sock, tx_buffer, encode_setup_connection(tx_buffer, sizeof(tx_buffer), host, port,
+                                                              GLOBAL_STATE->DEVICE_CONFIG.family.asic.name))) {
+        stratum_close_connection(GLOBAL_STATE);
+        return false;
+    }
+
+    // Standard channels carry no extranonce, all of the search space is the nonce and the version bits
+    GLOBAL_STATE->version_mask = STRATUM_DEFAULT_VERSION_MASK;
+    if (GLOBAL_STATE->ASIC_initalized) {
+        ASIC_set_version_mask(GLOBAL_STATE, GLOBAL_STATE->version_mask);
+    }
+
+    int64_t last_rx_us = esp_timer_get_time();
+
+    while (1) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock, &read_fds);
+        struct timeval poll_timeout = {.tv_sec = 0, .tv_usec = SV2_POLL_MS * 1000};
+
+        int ready = select(sock + 1, &read_fds, NULL, NULL, &poll_timeout);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed (errno %d: %s)", errno, strerror(errno));
+            break;
+        }
+
+        if (ready == 0) {
+            if (esp_timer_get_time() - last_rx_us > SV2_IDLE_TIMEOUT_US) {
+                ESP_LOGE(TAG, "No data from pool, reconnecting...");
+                break;
+            }
+            feed_jobs(GLOBAL_STATE);
+            continue;
+        }
+
+        size_t len;
+        const uint8_t * frame = STRATUM_V2_receive_frame(sock, &len);
+        if (frame == NULL) {
+            ESP_LOGE(TAG, "Failed to receive frame, reconnecting...");
+            break;
+        }
+        last_rx_us = esp_timer_get_time();
+
+        if (!STRATUM_V2_parse(&message, frame, len)) {
+            ESP_LOGE(TAG, "Malformed frame, message type 0x%02x", frame[2]);
+            break;
+        }
+
+        if (message.msg_type == SV2_SETUP_CONNECTION_SUCCESS) {
+            ESP_LOGI(TAG, "Connection setup, protocol version %u, flags %08lx", message.used_version, message.flags);
+            // Let the pool pick the target, expected_hashrate is in GH/s
+            uint8_t max_target[32];
+            memset(max_target, 0xff, sizeof(max_target));
+            size_t frame_len = STRATUM_V2_encode_open_standard_channel(tx_buffer, sizeof(tx_buffer), 1, user,
+                                                                      GLOBAL_STATE->POWER_MANAGEMENT_MODULE.expected_hashrate * 1e9f,
+                                                                      max_target);
+            if (!write_frame(sock, tx_buffer, frame_len)) {
+                break;
+            }
+        } else if (message.msg_type == SV2_SETUP_CONNECTION_ERROR || message.msg_type == SV2_OPEN_MINING_CHANNEL_ERROR) {
+            ESP_LOGE(TAG, "Pool refused %s: %s", message.msg_type == SV2_SETUP_CONNECTION_ERROR ? "connection" : "channel",
+                     message.error_code);
+            break;
+        } else if (message.msg_type == SV2_OPEN_STANDARD_MINING_CHANNEL_SUCCESS) {
+            channel_id = message.channel_id;
+            channel_open = true;
+            opened = true;
+            ESP_LOGI(TAG, "Opened standard channel %lu", channel_id);
+            set_target(GLOBAL_STATE, message.target);
+            GLOBAL_STATE->abandon_work = 0;
+        } else if (message.msg_type == SV2_NEW_MINING_JOB) {
+            GLOBAL_STATE->SYSTEM_MODULE.work_received++;
+            int slot = store_job(&message);
+            if (message.has_min_ntime) {
+                // Not a future job, it replaces the current one on the same prevhash
+                activate_job(GLOBAL_STATE, slot, message.min_ntime, false);
+            }
+        } else if (message.msg_type == SV2_SET_NEW_PREV_HASH) {
+            set_new_prev_hash(GLOBAL_STATE, &message);
+        } else if (message.msg_type == SV2_SET_TARGET) {
+            set_target(GLOBAL_STATE, message.target);
+        } else if (message.msg_type == SV2_SUBMIT_SHARES_SUCCESS) {
+            ESP_LOGI(TAG, "%lu shares accepted, last sequence number %lu", message.accepted_count, message.sequence_number);
+            for (uint32_t i = 0; i < message.accepted_count; i++) {
+                SYSTEM_notify_accepted_share(GLOBAL_STATE, stratum_active_pool_id(GLOBAL_STATE));
+            }
+        } else if (message.msg_type == SV2_SUBMIT_SHARES_ERROR) {
+            ESP_LOGW(TAG, "share %lu rejected: %s", message.sequence_number, message.error_code);
+            SYSTEM_notify_rejected_share(GLOBAL_STATE, stratum_active_pool_id(GLOBAL_STATE), message.error_code);
+        } else if (message.msg_type == SV2_RECONNECT) {
+            ESP_LOGE(TAG, "Pool requested client reconnect...");
+            break;
+        }
+
+        feed_jobs(GLOBAL_STATE);
+    }
+
+    channel_open = false;
+    stratum_close_connection(GLOBAL_STATE);
+    return opened;
+}
+
+bool stratum_v2_probe(int sock, const char * host, uint16_t port, const char * model)
+{
+    uint8_t buffer[256];
+    if (!write_frame(sock, buffer, encode_setup_connection(buffer, sizeof(buffer), host, port, model))) {
+        return false;
+    }
+
+    // Only the message type matters, and the receive frame buffer belongs to the running session
+    int bytes_received = pool_recv(sock, buffer, SV2_FRAME_HEADER_SIZE);
+    return bytes_received >= 3 && buffer[2] == SV2_SETUP_CONNECTION_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#ifndef STRATUM_V2_TASK_H_
+#define STRATUM_V2_TASK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "global_state.h"
+
+// Runs a Stratum V2 session on the already connected GLOBAL_STATE->sock until the
+// connection drops. Returns true if a mining channel was opened. Plaintext framing
+// only, there is no Noise handshake, so the pool has to be a local SV2 proxy.
+bool stratum_v2_session(GlobalState * GLOBAL_STATE, const char * host, uint16_t port, const char * user);
+
+// Heartbeat probe, true if the pool answers SetupConnection with Success
+bool stratum_v2_probe(int sock, const char * host, uint16_t port, const char * model);
+
+bool stratum_v2_is_active(void);
+
+// Frames a SubmitSharesStandard for the open channel, 0 if no channel is open
+size_t stratum_v2_encode_share(uint8_t * buffer, size_t size, uint32_t job_id, uint32_t nonce, uint32_t ntime, uint32_t version);
+
+#endif /* STRATUM_V2_TASK_H_ */
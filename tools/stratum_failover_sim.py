@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+stratum_failover_sim.py
+=======================
+Runs a primary and a fallback Stratum V1 pool on a Linux host and takes the
+primary down on a schedule, to measure how long the ASICs sit idle when the
+device switches pools. Both pools accept every share; the notify content is a
+fixed mainnet template with a fresh job id, prevhash and ntime.
+
+The device reports the gap between losing a pool and sending the first job of
+the next one as ``lastFailoverIdleMs`` in ``/api/system/info``. With
+``--device`` the simulator reads it after every switch and prints a summary.
+
+Usage examples
+--------------
+1. Point stratumURL at port 3333 and fallbackStratumURL at port 3334 of this
+   host, then fail the primary every 120 s for 60 s, five times:
+
+    $ python3 stratum_failover_sim.py --device 192.168.1.50 --cycles 5
+
+2. Compare with and without hot standby by toggling ``stratumHotStandby``
+   between runs (the setting is applied on restart).
+"""
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import selectors
+import socket
+import statistics
+import struct
+import time
+import urllib.request
+
+COINBASE_1 = ("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020c"
+              "fabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000")
+COINBASE_2 = ("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c"
+              "4188ac00000000")
+MERKLE_BRANCHES = [
+    "ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81",
+    "980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21",
+]
+VERSION = "20000004"
+NBITS = "1705c739"
+
+
+class Miner:
+    def __init__(self, pool: "Pool", conn: socket.socket):
+        self.pool = pool
+        self.conn = conn
+        self.rx = b""
+        self.authorized = False
+        self.extranonce1 = os.urandom(4).hex()
+
+    def send(self, message: dict) -> None:
+        self.conn.sendall((json.dumps(message) + "\n").encode())
+
+    def notify(self, clean: bool) -> None:
+        params = [f"{self.pool.job_id:x}", self.pool.prev_hash, COINBASE_1, COINBASE_2, MERKLE_BRANCHES,
+                  VERSION, NBITS, f"{int(time.time()):08x}", clean]
+        self.send({"id": None, "method": "mining.notify", "params": params})
+
+    def handle(self, request: dict) -> None:
+        method, msg_id = request.get("method"), request.get("id")
+        if method == "mining.configure":
+            self.send({"id": msg_id, "result": {"version-rolling": True, "version-rolling.mask": "1fffe000"}, "error": None})
+        elif method == "mining.subscribe":
+            self.send({"id": msg_id, "result": [[["mining.notify", "1"]], self.extranonce1, 4], "error": None})
+        elif method == "mining.authorize":
+            self.send({"id": msg_id, "result": True, "error": None})
+            self.send({"id": None, "method": "mining.set_difficulty", "params": [self.pool.args.difficulty]})
+            self.authorized = True
+            self.notify(clean=True)
+        elif method == "mining.submit":
+            self.pool.shares += 1
+            self.send({"id": msg_id, "result": True, "error": None})
+        elif msg_id is not None:
+            self.send({"id": msg_id, "result": True, "error": None})
+
+    def receive(self) -> bool:
+        data = self.conn.recv(4096)
+        if not data:
+            return False
+        self.rx += data
+        while b"\n" in self.rx:
+            line, self.rx = self.rx.split(b"\n", 1)
+            if line.strip():
+                self.handle(json.loads(line))
+        return True
+
+
+class Pool:
+    def __init__(self, name: str, port: int, args: argparse.Namespace, selector: selectors.BaseSelector):
+        self.name = name
+        self.port = port
+        self.args = args
+        self.selector = selector
+        self.listener: socket.socket | None = None
+        self.miners: list[Miner] = []
+        self.job_id = 1
+        self.prev_hash = os.urandom(32).hex()
+        self.shares = 0
+
+    def start(self) -> None:
+        self.listener = socket.create_server(("", self.port), family=socket.AF_INET6, dualstack_ipv6=True, reuse_port=True)
+        self.selector.register(self.listener, selectors.EVENT_READ, self)
+
+    def stop(self) -> None:
+        # Reset the connections like a crashed pool would
+        for miner in list(self.miners):
+            miner.conn.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+            self.drop(miner)
+        if self.listener is not None:
+            self.selector.unregister(self.listener)
+            self.listener.close()
+            self.listener = None
+
+    def drop(self, miner: Miner) -> None:
+        self.selector.unregister(miner.conn)
+        miner.conn.close()
+        self.miners.remove(miner)
+
+    def accept(self) -> None:
+        conn, addr = self.listener.accept()
+        miner = Miner(self, conn)
+        self.miners.append(miner)
+        self.selector.register(conn, selectors.EVENT_READ, miner)
+        print(f"{self.name}: miner connected from {addr[0]} ({len(self.miners)} sessions)")
+
+    def new_job(self) -> None:
+        self.job_id += 1
+        for miner in self.miners:
+            if miner.authorized:
+                miner.notify(clean=False)
+
+
+def device_failovers(device: str) -> tuple[int, float] | None:
+    try:
+        with urllib.request.urlopen(f"http://{device}/api/system/info", timeout=2) as response:
+            info = json.load(response)
+        return info.get("failoverCount", 0), info.get("lastFailoverIdleMs", 0.0)
+    except (OSError, ValueError):
+        return None
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Primary and fallback Stratum V1 pools with scheduled primary outages")
+    parser.add_argument("--primary-port", type=int, default=3333)
+    parser.add_argument("--fallback-port", type=int, default=3334)
+    parser.add_argument("--difficulty", type=int, default=1000)
+    parser.add_argument("--job-interval", type=float, default=30, help="seconds between mining.notify")
+    parser.add_argument("--fail-every", type=float, default=120, help="seconds of primary uptime before each outage")
+    parser.add_argument("--down-for", type=float, default=60, help="seconds the primary stays down")
+    parser.add_argument("--cycles", type=int, default=3)
+    parser.add_argument("--device", help="device address, reads lastFailoverIdleMs after every switch")
+    args = parser.parse_args()
+
+    selector = selectors.DefaultSelector()
+    primary = Pool("primary", args.primary_port, args, selector)
+    fallback = Pool("fallback", args.fallback_port, args, selector)
+    primary.start()
+    fallback.start()
+
+    idle_ms: list[float] = []
+    seen = (device_failovers(args.device) or (0, 0.0)) if args.device else None
+    last_job = last_poll = time.time()
+    next_event = time.time() + args.fail_every
+    cycle = 0
+    while cycle < args.cycles:
+        for key, _ in selector.select(timeout=0.2):
+            target = key.data
+            if isinstance(target, Pool):
+                target.accept()
+            elif not target.receive():
+                print(f"{target.pool.name}: miner disconnected")
+                target.pool.drop(target)
+
+        now = time.time()
+        if now - last_job >= args.job_interval:
+            primary.new_job()
+            fallback.new_job()
+            last_job = now
+
+        if now >= next_event:
+            if primary.listener is not None:
+                print(f"primary: going down for {args.down_for:.0f} s")
+                primary.stop()
+                next_event = now + args.down_for
+            else:
+                print("primary: back up")
+                primary.start()
+                next_event = now + args.fail_every
+                cycle += 1
+
+        if args.device and seen is not None and now - last_poll >= 1:
+            last_poll = now
+            current = device_failovers(args.device)
+            if current is not None and current[0] > seen[0]:
+                print(f"device: pool switch #{current[0]}, ASIC idle {current[1]:.1f} ms")
+                idle_ms.append(current[1])
+                seen = current
+
+    primary.stop()
+    fallback.stop()
+    print(f"shares: primary {primary.shares}, fallback {fallback.shares}")
+    if idle_ms:
+        print(f"idle per pool switch over {len(idle_ms)} switches: min {min(idle_ms):.1f} ms, "
+              f"median {statistics.median(idle_ms):.1f} ms, max {max(idle_ms):.1f} ms")
+
+
+if __name__ == "__main__":
+    main()
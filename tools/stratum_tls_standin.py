@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+stratum_tls_standin.py
+======================
+A Stratum V1 pool behind TLS for testing ``stratum+ssl://`` pools on a Linux
+host. On first start it creates a self-signed CA and a server certificate for
+the given host names with the openssl CLI, and prints the CA to paste into the
+device's ``stratumCaCert`` setting. Every share is accepted.
+
+Each connection prints whether the device resumed its previous TLS session and
+how long the handshake took on this side. The device reports its own view as
+``stratumTls`` in ``/api/system/info``.
+
+Usage examples
+--------------
+1. Serve on port 3335 for the host's address, then set stratumURL to
+   ``stratum+ssl://192.168.1.10`` and stratumPort to 3335:
+
+    $ python3 stratum_tls_standin.py --name 192.168.1.10
+
+2. Drop every session after 60 s to watch reconnects resume:
+
+    $ python3 stratum_tls_standin.py --name 192.168.1.10 --drop-after 60
+"""
+from __future__ import annotations
+
+import argparse
+import ipaddress
+import json
+import os
+import socket
+import ssl
+import subprocess
+import threading
+import time
+
+COINBASE_1 = ("01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020c"
+              "fabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000")
+COINBASE_2 = ("41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c"
+              "4188ac00000000")
+MERKLE_BRANCHES = [
+    "ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81",
+    "980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21",
+]
+VERSION = "20000004"
+NBITS = "1705c739"
+
+
+def openssl(*args: str) -> None:
+    subprocess.run(["openssl", *args], check=True, capture_output=True)
+
+
+def make_certificates(directory: str, names: list[str]) -> tuple[str, str, str]:
+    ca_key, ca_crt = os.path.join(directory, "ca.key"), os.path.join(directory, "ca.crt")
+    key, crt = os.path.join(directory, "server.key"), os.path.join(directory, "server.crt")
+    if os.path.exists(crt):
+        return ca_crt, crt, key
+
+    os.makedirs(directory, exist_ok=True)
+    openssl("req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1", "-nodes",
+            "-keyout", ca_key, "-out", ca_crt, "-days", "3650", "-subj", "/CN=Stratum test CA")
+
+    alt_names = []
+    for name in names:
+        try:
+            ipaddress.ip_address(name)
+            alt_names.append(f"IP:{name}")
+        except ValueError:
+            alt_names.append(f"DNS:{name}")
+    ext = os.path.join(directory, "server.ext")
+    with open(ext, "w") as f:
+        f.write(f"subjectAltName={','.join(alt_names)}\nbasicConstraints=CA:FALSE\n")
+    csr = os.path.join(directory, "server.csr")
+    openssl("req", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1", "-nodes",
+            "-keyout", key, "-out", csr, "-subj", f"/CN={names[0]}")
+    openssl("x509", "-req", "-in", csr, "-CA", ca_crt, "-CAkey", ca_key, "-CAcreateserial",
+            "-out", crt, "-days", "825", "-extfile", ext)
+    return ca_crt, crt, key
+
+
+class Miner:
+    def __init__(self, conn: ssl.SSLSocket, args: argparse.Namespace):
+        self.conn = conn
+        self.args = args
+        self.rx = b""
+        self.job_id = 1
+        self.prev_hash = os.urandom(32).hex()
+        self.extranonce1 = os.urandom(4).hex()
+        self.shares = 0
+
+    def send(self, message: dict) -> None:
+        self.conn.sendall((json.dumps(message) + "\n").encode())
+
+    def notify(self, clean: bool) -> None:
+        params = [f"{self.job_id:x}", self.prev_hash, COINBASE_1, COINBASE_2, MERKLE_BRANCHES,
+                  VERSION, NBITS, f"{int(time.time()):08x}", clean]
+        self.send({"id": None, "method": "mining.notify", "params": params})
+        self.job_id += 1
+
+    def handle(self, request: dict) -> None:
+        method, msg_id = request.get("method"), request.get("id")
+        if method == "mining.configure":
+            self.send({"id": msg_id, "result": {"version-rolling": True, "version-rolling.mask": "1fffe000"}, "error": None})
+        elif method == "mining.subscribe":
+            self.send({"id": msg_id, "result": [[["mining.notify", "1"]], self.extranonce1, 4], "error": None})
+        elif method == "mining.authorize":
+            self.send({"id": msg_id, "result": True, "error": None})
+            self.send({"id": None, "method": "mining.set_difficulty", "params": [self.args.difficulty]})
+            self.notify(clean=True)
+        elif method == "mining.submit":
+            self.shares += 1
+            self.send({"id": msg_id, "result": True, "error": None})
+        elif msg_id is not None:
+            self.send({"id": msg_id, "result": True, "error": None})
+
+    def serve(self) -> None:
+        started = last_job = time.time()
+        self.conn.settimeout(0.5)
+        while self.args.drop_after == 0 or time.time() - started < self.args.drop_after:
+            try:
+                data = self.conn.recv(4096)
+                if not data:
+                    return
+                self.rx += data
+                while b"\n" in self.rx:
+                    line, self.rx = self.rx.split(b"\n", 1)
+                    if line.strip():
+                        self.handle(json.loads(line))
+            except socket.timeout:
+                pass
+            if time.time() - last_job >= self.args.job_interval:
+                self.notify(clean=False)
+                last_job = time.time()
+
+
+def handle_connection(context: ssl.SSLContext, conn: socket.socket, addr: tuple, args: argparse.Namespace) -> None:
+    start = time.perf_counter()
+    try:
+        tls = context.wrap_socket(conn, server_side=True)
+    except (ssl.SSLError, OSError) as exc:
+        print(f"{addr[0]}: handshake failed: {exc}")
+        conn.close()
+        return
+    handshake_ms = (time.perf_counter() - start) * 1000
+    print(f"{addr[0]}: {tls.version()} {tls.cipher()[0]}, handshake {handshake_ms:.1f} ms, "
+          f"session_reused={tls.session_reused}")
+    miner = Miner(tls, args)
+    try:
+        miner.serve()
+    except (ssl.SSLError, OSError, ValueError) as exc:
+        print(f"{addr[0]}: connection error: {exc}")
+    finally:
+        tls.close()
+        print(f"{addr[0]}: disconnected after {miner.shares} shares")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Stratum V1 pool over TLS with a self-signed CA")
+    parser.add_argument("--port", type=int, default=3335)
+    parser.add_argument("--name", action="append", default=[],
+                        help="host name or address the device connects to, repeatable (default localhost)")
+    parser.add_argument("--cert-dir", default="stratum_tls_certs")
+    parser.add_argument("--difficulty", type=int, default=1000)
+    parser.add_argument("--job-interval", type=float, default=30, help="seconds between mining.notify")
+    parser.add_argument("--drop-after", type=float, default=0, help="close every session after this many seconds")
+    parser.add_argument("--max-tls", choices=["1.2", "1.3"], default="1.3")
+    args = parser.parse_args()
+
+    ca_crt, crt, key = make_certificates(args.cert_dir, args.name or ["localhost"])
+    with open(ca_crt) as f:
+        print("stratumCaCert:\n" + f.read())
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(crt, key)
+    context.maximum_version = ssl.TLSVersion.TLSv1_3 if args.max_tls == "1.3" else ssl.TLSVersion.TLSv1_2
+
+    listener = socket.create_server(("", args.port), family=socket.AF_INET6, dualstack_ipv6=True)
+    print(f"listening on port {args.port}")
+    while True:
+        conn, addr = listener.accept()
+        threading.Thread(target=handle_connection, args=(context, conn, addr, args), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
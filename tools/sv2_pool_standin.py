@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""
+sv2_pool_standin.py
+===================
+A minimal Stratum V2 pool stand-in for testing the firmware's standard channel
+client on a Linux host. It speaks the plaintext SV2 framing (no Noise handshake),
+hands out header-only jobs, validates every SubmitSharesStandard against the
+channel target and reports the bytes spent per job.
+
+Usage examples
+--------------
+1. Serve on the default port with difficulty 1 shares:
+
+    $ python3 sv2_pool_standin.py
+
+2. New block every 60 s, merkle root update every 10 s, difficulty 256:
+
+    $ python3 sv2_pool_standin.py --port 34255 --block-interval 60 --job-interval 10 --difficulty 256
+
+Point the device at the host with ``stratumProtocol`` set to 2.
+"""
+from __future__ import annotations
+
+import argparse
+import hashlib
+import os
+import selectors
+import socket
+import struct
+import time
+
+SETUP_CONNECTION = 0x00
+SETUP_CONNECTION_SUCCESS = 0x01
+OPEN_STANDARD_MINING_CHANNEL = 0x10
+OPEN_STANDARD_MINING_CHANNEL_SUCCESS = 0x11
+NEW_MINING_JOB = 0x15
+SUBMIT_SHARES_STANDARD = 0x1A
+SUBMIT_SHARES_SUCCESS = 0x1C
+SUBMIT_SHARES_ERROR = 0x1D
+SET_NEW_PREV_HASH = 0x20
+
+CHANNEL_MSG_BIT = 0x8000
+CHANNEL_MESSAGES = {NEW_MINING_JOB, SUBMIT_SHARES_STANDARD, SUBMIT_SHARES_SUCCESS, SUBMIT_SHARES_ERROR, SET_NEW_PREV_HASH}
+
+DIFF1_TARGET = 0xFFFF << 208
+NBITS = 0x1705DD01
+VERSION = 0x20000000
+
+
+def frame(msg_type: int, payload: bytes) -> bytes:
+    ext = CHANNEL_MSG_BIT if msg_type in CHANNEL_MESSAGES else 0
+    return struct.pack("<HB", ext, msg_type) + len(payload).to_bytes(3, "little") + payload
+
+
+def str0_255(value: str) -> bytes:
+    data = value.encode()[:255]
+    return bytes([len(data)]) + data
+
+
+def read_str0_255(payload: bytes, pos: int) -> tuple[str, int]:
+    length = payload[pos]
+    return payload[pos + 1:pos + 1 + length].decode(errors="replace"), pos + 1 + length
+
+
+class Miner:
+    def __init__(self, conn: socket.socket, args: argparse.Namespace):
+        self.conn = conn
+        self.args = args
+        self.rx = b""
+        self.channel_id = 1
+        self.target = DIFF1_TARGET // args.difficulty
+        self.jobs: dict[int, bytes] = {}
+        self.next_job_id = 1
+        self.prev_hash = os.urandom(32)
+        self.prevhash_sent_at = time.time()
+        self.min_ntime = int(self.prevhash_sent_at)
+        self.job_bytes = 0
+        self.job_count = 0
+        self.accepted = 0
+        self.rejected = 0
+
+    def send(self, msg_type: int, payload: bytes, is_job: bool = False) -> None:
+        data = frame(msg_type, payload)
+        if is_job:
+            self.job_bytes += len(data)
+        self.conn.sendall(data)
+
+    def new_job(self, future: bool) -> int:
+        job_id = self.next_job_id
+        self.next_job_id += 1
+        self.jobs[job_id] = os.urandom(32)
+        ntime = b"\x00" if future else b"\x01" + struct.pack("<I", self.min_ntime)
+        payload = struct.pack("<II", self.channel_id, job_id) + ntime + struct.pack("<I", VERSION) + self.jobs[job_id]
+        self.send(NEW_MINING_JOB, payload, is_job=True)
+        self.job_count += 1
+        return job_id
+
+    def new_block(self) -> None:
+        job_id = self.new_job(future=True)
+        self.jobs = {job_id: self.jobs[job_id]}
+        self.prev_hash = os.urandom(32)
+        self.prevhash_sent_at = time.time()
+        self.min_ntime = int(self.prevhash_sent_at)
+        payload = struct.pack("<II", self.channel_id, job_id) + self.prev_hash + struct.pack("<II", self.min_ntime, NBITS)
+        self.send(SET_NEW_PREV_HASH, payload, is_job=True)
+        print(f"new block, job {job_id}")
+
+    def handle(self, msg_type: int, payload: bytes) -> None:
+        if msg_type == SETUP_CONNECTION:
+            _protocol, _min_version, _max_version, flags = struct.unpack_from("<BHHI", payload)
+            host, pos = read_str0_255(payload, 9)
+            print(f"SetupConnection host {host} flags {flags:#x}")
+            self.send(SETUP_CONNECTION_SUCCESS, struct.pack("<HI", 2, 0))
+        elif msg_type == OPEN_STANDARD_MINING_CHANNEL:
+            request_id = struct.unpack_from("<I", payload)[0]
+            user, pos = read_str0_255(payload, 4)
+            hashrate = struct.unpack_from("<f", payload, pos)[0]
+            print(f"OpenStandardMiningChannel user {user} nominal {hashrate / 1e9:.1f} GH/s")
+            payload = struct.pack("<II", request_id, self.channel_id) + self.target.to_bytes(32, "little")
+            payload += b"\x00" + struct.pack("<I", 0)
+            self.send(OPEN_STANDARD_MINING_CHANNEL_SUCCESS, payload)
+            self.new_block()
+        elif msg_type == SUBMIT_SHARES_STANDARD:
+            self.check_share(payload)
+        else:
+            print(f"ignoring message type {msg_type:#04x}")
+
+    def check_share(self, payload: bytes) -> None:
+        channel_id, seq, job_id, nonce, ntime, version = struct.unpack("<IIIIII", payload)
+        error = None
+        if job_id not in self.jobs:
+            error = "invalid-job-id"
+        elif not self.min_ntime <= ntime <= self.min_ntime + int(time.time() - self.prevhash_sent_at) + 1:
+            error = "invalid-timestamp"
+        else:
+            header = struct.pack("<I", version) + self.prev_hash + self.jobs[job_id] + struct.pack("<III", ntime, NBITS, nonce)
+            digest = hashlib.sha256(hashlib.sha256(header).digest()).digest()
+            if int.from_bytes(digest, "little") > self.target:
+                error = "difficulty-too-low"
+
+        if error is None:
+            self.accepted += 1
+            self.send(SUBMIT_SHARES_SUCCESS, struct.pack("<IIIQ", channel_id, seq, 1, self.args.difficulty))
+        else:
+            self.rejected += 1
+            self.send(SUBMIT_SHARES_ERROR, struct.pack("<II", channel_id, seq) + str0_255(error))
+        print(f"share seq {seq} job {job_id} nonce {nonce:08x} version {version:08x}: {error or 'accepted'}"
+              f" ({self.accepted} accepted, {self.rejected} rejected)")
+
+    def receive(self) -> bool:
+        data = self.conn.recv(4096)
+        if not data:
+            return False
+        self.rx += data
+        while len(self.rx) >= 6:
+            length = int.from_bytes(self.rx[3:6], "little")
+            if len(self.rx) < 6 + length:
+                break
+            msg_type, payload = self.rx[2], self.rx[6:6 + length]
+            self.rx = self.rx[6 + length:]
+            self.handle(msg_type, payload)
+        return True
+
+
+def serve(args: argparse.Namespace) -> None:
+    listener = socket.create_server(("", args.port), family=socket.AF_INET6, dualstack_ipv6=True)
+    print(f"listening on port {args.port}")
+    while True:
+        conn, addr = listener.accept()
+        print(f"miner connected from {addr[0]}")
+        miner = Miner(conn, args)
+        selector = selectors.DefaultSelector()
+        selector.register(conn, selectors.EVENT_READ)
+        last_block = last_job = time.time()
+        try:
+            while True:
+                if selector.select(timeout=0.5) and not miner.receive():
+                    break
+                now = time.time()
+                if miner.jobs and now - last_block >= args.block_interval:
+                    miner.new_block()
+                    last_block = last_job = now
+                elif miner.jobs and now - last_job >= args.job_interval:
+                    miner.new_job(future=False)
+                    last_job = now
+        except (ConnectionError, struct.error) as exc:
+            print(f"connection error: {exc}")
+        finally:
+            conn.close()
+            if miner.job_count:
+                print(f"miner disconnected: {miner.job_count} jobs, {miner.job_bytes / miner.job_count:.1f} bytes per job, "
+                      f"{miner.accepted} accepted, {miner.rejected} rejected")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Stratum V2 pool stand-in for standard channels (plaintext framing)")
+    parser.add_argument("--port", type=int, default=34255)
+    parser.add_argument("--difficulty", type=int, default=1, help="share difficulty of the channel target")
+    parser.add_argument("--job-interval", type=float, default=30, help="seconds between merkle root updates")
+    parser.add_argument("--block-interval", type=float, default=600, help="seconds between new prevhashes")
+    serve(parser.parse_args())
+
+
+if __name__ == "__main__":
+    main()